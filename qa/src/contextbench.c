@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2020 Red Hat.
+ *
+ * Multi-threaded scaling of PMAPI calls, each thread with its own
+ * context ... reports calls/sec for 1, 2, 4, ... up to -t threads.
+ * Every call maps the context handle to a context, so this is
+ * mostly a measure of contention between the threads in libpcp.
+ *
+ * With -d another thread keeps creating and destroying contexts
+ * while the others run, and their handles are used after being
+ * destroyed, which must fail with PM_ERR_NOCONTEXT.
+ *
+ * Usage: contextbench [-dq] [-c call] [-i iterations] [-t threads] archive
+ */
+
+#include <pcp/pmapi.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+static const char	*archive;
+static int		iterations = 100000;
+static int		maxthreads = 8;
+static int		quiet;
+static int		churn;
+static volatile int	stop;
+static pmID		pmid;
+static pthread_mutex_t	err_lock = PTHREAD_MUTEX_INITIALIZER;
+static int		errors;		/* protected by err_lock */
+
+enum { C_DESC, C_FETCH, C_USE };
+static int		call = C_DESC;
+
+static void
+fail(const char *msg, int sts)
+{
+    pthread_mutex_lock(&err_lock);
+    if (errors++ < 10)
+	printf("Error: %s: %s\n", msg, pmErrStr(sts));
+    pthread_mutex_unlock(&err_lock);
+}
+
+static void *
+worker(void *arg)
+{
+    int		ctx = *(int *)arg;
+    pmDesc	desc;
+    pmResult	*rp;
+    int		i, sts;
+
+    if ((sts = pmUseContext(ctx)) < 0) {
+	fail("pmUseContext", sts);
+	return NULL;
+    }
+    for (i = 0; i < iterations; i++) {
+	switch (call) {
+	case C_DESC:
+	    if ((sts = pmLookupDesc(pmid, &desc)) < 0)
+		fail("pmLookupDesc", sts);
+	    break;
+	case C_FETCH:
+	    if ((sts = pmFetch(1, &pmid, &rp)) < 0) {
+		if (sts != PM_ERR_EOL)
+		    fail("pmFetch", sts);
+		/* back to the start of the archive */
+		pmSetMode(PM_MODE_INTERP, NULL, 0);
+	    }
+	    else
+		pmFreeResult(rp);
+	    break;
+	case C_USE:
+	    if ((sts = pmUseContext(ctx)) < 0)
+		fail("pmUseContext", sts);
+	    break;
+	}
+    }
+    return NULL;
+}
+
+/*
+ * Create and destroy contexts, using each one after it is gone.
+ */
+static void *
+churner(void *arg)
+{
+    int		*count = (int *)arg;
+    pmDesc	desc;
+    int		ctx, sts;
+
+    while (!stop) {
+	if ((ctx = pmNewContext(PM_CONTEXT_ARCHIVE, archive)) < 0) {
+	    fail("pmNewContext", ctx);
+	    break;
+	}
+	if ((sts = pmLookupDesc(pmid, &desc)) < 0)
+	    fail("churn pmLookupDesc", sts);
+	/* handle lookup, not via the current context */
+	if ((sts = pmFetchAsyncComplete(ctx, 0)) != PM_ERR_NOTHOST)
+	    fail("pmFetchAsyncComplete", sts);
+	pmDestroyContext(ctx);
+	if ((sts = pmUseContext(ctx)) != PM_ERR_NOCONTEXT)
+	    fail("pmUseContext after destroy", sts);
+	if ((sts = pmFetchAsyncComplete(ctx, 0)) != PM_ERR_NOCONTEXT)
+	    fail("pmFetchAsyncComplete after destroy", sts);
+	(*count)++;
+    }
+    return NULL;
+}
+
+static double
+run(int nthreads, int *ctxs)
+{
+    pthread_t		*tid;
+    pthread_t		churn_tid;
+    struct timeval	start, end;
+    int			nchurn = 0;
+    int			i;
+
+    if ((tid = (pthread_t *)malloc(nthreads * sizeof(pthread_t))) == NULL) {
+	fprintf(stderr, "malloc failed\n");
+	exit(1);
+    }
+    stop = 0;
+    if (churn && pthread_create(&churn_tid, NULL, churner, &nchurn) != 0) {
+	fprintf(stderr, "pthread_create failed\n");
+	exit(1);
+    }
+    gettimeofday(&start, NULL);
+    for (i = 0; i < nthreads; i++) {
+	if (pthread_create(&tid[i], NULL, worker, &ctxs[i]) != 0) {
+	    fprintf(stderr, "pthread_create failed\n");
+	    exit(1);
+	}
+    }
+    for (i = 0; i < nthreads; i++)
+	pthread_join(tid[i], NULL);
+    gettimeofday(&end, NULL);
+    if (churn) {
+	stop = 1;
+	pthread_join(churn_tid, NULL);
+	if (nchurn == 0)
+	    fail("no contexts churned", 0);
+    }
+    free(tid);
+    return pmtimevalSub(&end, &start);
+}
+
+int
+main(int argc, char **argv)
+{
+    char	*name = "sample.long.one";
+    int		*ctxs;
+    double	secs;
+    int		c, i, n, sts;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "c:di:qt:")) != EOF) {
+	switch (c) {
+	case 'c':
+	    if (strcmp(optarg, "desc") == 0)
+		call = C_DESC;
+	    else if (strcmp(optarg, "fetch") == 0)
+		call = C_FETCH;
+	    else if (strcmp(optarg, "use") == 0)
+		call = C_USE;
+	    else {
+		fprintf(stderr, "%s: call must be desc, fetch or use\n", pmGetProgname());
+		exit(1);
+	    }
+	    break;
+	case 'd':
+	    churn = 1;
+	    break;
+	case 'i':
+	    iterations = atoi(optarg);
+	    break;
+	case 'q':
+	    quiet = 1;
+	    break;
+	case 't':
+	    maxthreads = atoi(optarg);
+	    break;
+	default:
+	    optind = argc;
+	    break;
+	}
+    }
+    if (optind != argc - 1 || iterations < 1 || maxthreads < 1) {
+	fprintf(stderr, "Usage: %s [-dq] [-c desc|fetch|use] [-i iterations] [-t threads] archive\n",
+		pmGetProgname());
+	exit(1);
+    }
+    archive = argv[optind];
+
+    if ((ctxs = (int *)malloc(maxthreads * sizeof(int))) == NULL) {
+	fprintf(stderr, "malloc failed\n");
+	exit(1);
+    }
+    for (i = 0; i < maxthreads; i++) {
+	if ((ctxs[i] = pmNewContext(PM_CONTEXT_ARCHIVE, archive)) < 0) {
+	    fprintf(stderr, "%s: pmNewContext(%s): %s\n", pmGetProgname(),
+		    archive, pmErrStr(ctxs[i]));
+	    exit(1);
+	}
+    }
+    if ((sts = pmLookupName(1, &name, &pmid)) < 0) {
+	fprintf(stderr, "%s: %s: %s\n", pmGetProgname(), name, pmErrStr(sts));
+	exit(1);
+    }
+
+    for (n = 1; ; n *= 2) {
+	if (n > maxthreads)
+	    n = maxthreads;
+	secs = run(n, ctxs);
+	if (quiet)
+	    printf("%d threads: done\n", n);
+	else
+	    printf("%d threads: %.0f calls/sec (%.0f per thread)\n", n,
+		    (double)iterations * n / secs, iterations / secs);
+	if (n == maxthreads)
+	    break;
+    }
+
+    for (i = 0; i < maxthreads; i++)
+	pmDestroyContext(ctxs[i]);
+    printf("errors: %d\n", errors);
+
+    return errors != 0;
+}
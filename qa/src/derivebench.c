@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2020 Red Hat.
+ *
+ * Check that compiled derived metric expressions produce the same
+ * values as walking the expression tree, and compare their speed,
+ * over the sample.many.int instance domain from the sample PMDA.
+ *
+ * The instance count is set with pmStore(sample.many.count) and put
+ * back on exit.
+ */
+
+#include <pcp/pmapi.h>
+#include <sys/time.h>
+
+static struct {
+    char	*name;
+    char	*expr;
+} exprs[] = {
+    { "bench.ratio", "sample.many.int / (sample.many.int + sample.many.int)" },
+    { "bench.scaled", "sample.double.ten * sample.many.int * 3 - sample.many.int" },
+    { "bench.relop", "sample.many.int >= 2 && sample.many.int != 4" },
+    { "bench.neg", "-sample.many.int" },
+    { "bench.not", "!sample.many.int" },
+    { "bench.delta", "delta(sample.many.int)" },
+    { "bench.rate", "rate(sample.many.int) * 2" },
+    { "bench.sum", "sum(sample.many.int)" },
+    { "bench.avg", "avg(sample.many.int)" },
+    { "bench.minmax", "max(sample.many.int) - min(sample.many.int)" },
+    { "bench.count", "count(sample.many.int) + count(sample.bad.fetch.again)" },
+    { "bench.walk", "sample.many.int - matchinst(/^i-[0-3]/, sample.many.int)" },
+};
+#define NEXPR (sizeof(exprs) / sizeof(exprs[0]))
+
+/* operands of the expressions above */
+static char *operands[] = {
+    "sample.many.int", "sample.double.ten", "sample.bad.fetch.again",
+};
+#define NOPERAND (sizeof(operands) / sizeof(operands[0]))
+
+static int	ninst = 1000;
+static int	nfetch = 3;
+static int	rounds = 200;
+static int	errors;
+
+static void
+fail(const char *name, const char *msg, int k)
+{
+    if (errors++ < 10)
+	printf("%s: Error: %s [%d]\n", name, msg, k);
+}
+
+static int
+store_count(int count)
+{
+    pmID	pmid;
+    pmResult	*rp;
+    int		old;
+    int		sts;
+    char	*name = "sample.many.count";
+
+    if ((sts = pmLookupName(1, &name, &pmid)) < 0 ||
+	(sts = pmFetch(1, &pmid, &rp)) < 0) {
+	fprintf(stderr, "%s: %s: %s\n", pmGetProgname(), name, pmErrStr(sts));
+	exit(1);
+    }
+    if (rp->vset[0]->numval != 1) {
+	fprintf(stderr, "%s: %s: no value\n", pmGetProgname(), name);
+	exit(1);
+    }
+    old = rp->vset[0]->vlist[0].value.lval;
+    rp->vset[0]->vlist[0].value.lval = count;
+    if ((sts = pmStore(rp)) < 0) {
+	fprintf(stderr, "%s: pmStore(%s): %s\n", pmGetProgname(), name, pmErrStr(sts));
+	exit(1);
+    }
+    pmFreeResult(rp);
+    return old;
+}
+
+/*
+ * New context for host, with derived metrics compiled or not
+ * (decided when each metric is first bound in the context).
+ */
+static int
+context(const char *host, const char *compile, char **names, int n, pmID *pmids)
+{
+    pmResult	*rp;
+    int		ctx;
+    int		sts;
+
+    setenv("PCP_DERIVED_COMPILE", compile, 1);
+    if ((ctx = pmNewContext(PM_CONTEXT_HOST, host)) < 0) {
+	fprintf(stderr, "%s: pmNewContext(%s): %s\n", pmGetProgname(), host, pmErrStr(ctx));
+	exit(1);
+    }
+    if ((sts = pmLookupName(n, names, pmids)) < 0) {
+	fprintf(stderr, "%s: pmLookupName: %s\n", pmGetProgname(), pmErrStr(sts));
+	exit(1);
+    }
+    /* first fetch binds the derived metrics */
+    if ((sts = pmFetch(n, pmids, &rp)) < 0) {
+	fprintf(stderr, "%s: pmFetch: %s\n", pmGetProgname(), pmErrStr(sts));
+	exit(1);
+    }
+    pmFreeResult(rp);
+    unsetenv("PCP_DERIVED_COMPILE");
+    return ctx;
+}
+
+static pmResult *
+fetch(int ctx, int n, pmID *pmids)
+{
+    pmResult	*rp;
+    int		sts;
+
+    pmUseContext(ctx);
+    if ((sts = pmFetch(n, pmids, &rp)) < 0) {
+	fprintf(stderr, "%s: pmFetch: %s\n", pmGetProgname(), pmErrStr(sts));
+	exit(1);
+    }
+    return rp;
+}
+
+static void
+compare(pmResult *crp, pmResult *wrp)
+{
+    pmValueSet	*cvp, *wvp;
+    int		i, k;
+
+    for (i = 0; i < NEXPR; i++) {
+	cvp = crp->vset[i];
+	wvp = wrp->vset[i];
+	if (cvp->numval != wvp->numval) {
+	    fail(exprs[i].name, "numval", cvp->numval);
+	    continue;
+	}
+	for (k = 0; k < cvp->numval; k++) {
+	    if (cvp->vlist[k].inst != wvp->vlist[k].inst)
+		fail(exprs[i].name, "inst", k);
+	    else if (cvp->valfmt == PM_VAL_INSITU) {
+		if (cvp->vlist[k].value.lval != wvp->vlist[k].value.lval)
+		    fail(exprs[i].name, "value", k);
+	    }
+	    else if (cvp->vlist[k].value.pval->vlen != wvp->vlist[k].value.pval->vlen ||
+		     memcmp(cvp->vlist[k].value.pval->vbuf,
+			    wvp->vlist[k].value.pval->vbuf,
+			    cvp->vlist[k].value.pval->vlen - PM_VAL_HDR_SIZE) != 0)
+		fail(exprs[i].name, "value", k);
+	}
+    }
+}
+
+static double
+bench(int ctx, int n, pmID *pmids)
+{
+    struct timeval	start, now;
+    int			r;
+
+    gettimeofday(&start, NULL);
+    for (r = 0; r < rounds; r++)
+	pmFreeResult(fetch(ctx, n, pmids));
+    gettimeofday(&now, NULL);
+    return pmtimevalSub(&now, &start) * 1e6 / rounds;
+}
+
+int
+main(int argc, char **argv)
+{
+    const char	*host = "local:";
+    char	*names[NEXPR];
+    pmID	pmids[NEXPR];
+    pmID	opmids[NOPERAND];
+    pmResult	*crp, *wrp;
+    char	*errmsg;
+    double	ops, walk, comp;
+    int		ctx, cctx, wctx, octx;
+    int		timing = 0;
+    int		old;
+    int		c, i, f;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "D:f:h:n:r:t")) != EOF) {
+	switch (c) {
+	case 'D':
+	    if (pmSetDebug(optarg) < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+			pmGetProgname(), optarg);
+		exit(1);
+	    }
+	    break;
+	case 'f':
+	    nfetch = atoi(optarg);
+	    break;
+	case 'h':
+	    host = optarg;
+	    break;
+	case 'n':
+	    ninst = atoi(optarg);
+	    break;
+	case 'r':
+	    rounds = atoi(optarg);
+	    break;
+	case 't':
+	    timing = 1;
+	    break;
+	default:
+	    fprintf(stderr, "Usage: %s [-t] [-D debug] [-f fetches] [-h host] [-n instances] [-r rounds]\n",
+		    pmGetProgname());
+	    exit(1);
+	}
+    }
+    if (ninst < 0 || nfetch < 1 || rounds < 1) {
+	fprintf(stderr, "%s: bad -f, -n or -r value\n", pmGetProgname());
+	exit(1);
+    }
+
+    for (i = 0; i < NEXPR; i++) {
+	names[i] = exprs[i].name;
+	if (pmRegisterDerivedMetric(exprs[i].name, exprs[i].expr, &errmsg) < 0) {
+	    fprintf(stderr, "%s: %s", pmGetProgname(), errmsg);
+	    free(errmsg);
+	    exit(1);
+	}
+    }
+
+    if ((ctx = pmNewContext(PM_CONTEXT_HOST, host)) < 0) {
+	fprintf(stderr, "%s: pmNewContext(%s): %s\n", pmGetProgname(), host, pmErrStr(ctx));
+	exit(1);
+    }
+    old = store_count(ninst);
+
+    cctx = context(host, "1", names, NEXPR, pmids);
+    wctx = context(host, "0", names, NEXPR, pmids);
+
+    for (f = 0; f < nfetch; f++) {
+	crp = fetch(cctx, NEXPR, pmids);
+	wrp = fetch(wctx, NEXPR, pmids);
+	compare(crp, wrp);
+	pmFreeResult(crp);
+	pmFreeResult(wrp);
+    }
+    printf("%d instances, %d fetches: %s\n", ninst, nfetch,
+	    errors ? "differences" : "identical");
+
+    if (timing) {
+	octx = context(host, "1", operands, NOPERAND, opmids);
+	ops = bench(octx, NOPERAND, opmids);
+	walk = bench(wctx, NEXPR, pmids);
+	comp = bench(cctx, NEXPR, pmids);
+	printf("operands only: %.1f usec/fetch\n", ops);
+	printf("tree walk: %.1f usec/fetch (derived %.1f)\n", walk, walk - ops);
+	printf("compiled: %.1f usec/fetch (derived %.1f)\n", comp, comp - ops);
+	pmDestroyContext(octx);
+    }
+
+    pmUseContext(ctx);
+    store_count(old);
+    pmDestroyContext(cctx);
+    pmDestroyContext(wctx);
+    pmDestroyContext(ctx);
+
+    return errors != 0;
+}
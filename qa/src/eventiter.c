@@ -0,0 +1,290 @@
+/*
+ * Copyright (c) 2020 Red Hat.
+ *
+ * pmEventIter*() must return the same event records and parameters
+ * as pmUnpackEventRecords() and pmUnpackHighResEventRecords(), for
+ * all the event record values of metric in an archive.
+ *
+ * With -b, report records/sec for unpacking and for iterating over
+ * the same values, repeated iterations times.
+ *
+ * Usage: eventiter [-b iterations] archive metric
+ */
+
+#include <pcp/pmapi.h>
+#include <sys/time.h>
+
+static pmID	pmid_flags;
+static pmID	pmid_missed;
+static int	nrecords;
+static int	nparams;
+static int	errors;
+
+static void
+fail(const char *msg, int rec)
+{
+    if (errors++ < 10)
+	printf("Error: record %d: %s\n", rec, msg);
+}
+
+static int
+same_value(pmValueSet *a, pmValueSet *b)
+{
+    pmValueBlock	*ap, *bp;
+
+    if (a->pmid != b->pmid || a->numval != 1 || b->numval != 1 ||
+	a->vlist[0].inst != b->vlist[0].inst)
+	return 0;
+    if (a->valfmt == PM_VAL_INSITU || b->valfmt == PM_VAL_INSITU)
+	return a->valfmt == b->valfmt &&
+	       a->vlist[0].value.lval == b->vlist[0].value.lval;
+    ap = a->vlist[0].value.pval;
+    bp = b->vlist[0].value.pval;
+    return ap->vtype == bp->vtype && ap->vlen == bp->vlen &&
+	   memcmp(ap->vbuf, bp->vbuf, ap->vlen - PM_VAL_HDR_SIZE) == 0;
+}
+
+/*
+ * Check one unpacked record against the iterator's current record,
+ * the event.flags and event.missed metrics come first.
+ */
+static void
+check_record(pmEventIter *iter, struct timespec *stamp,
+		int numpmid, pmValueSet **vset)
+{
+    pmValueSet	*vsp;
+    int		i = 0;
+
+    if (stamp->tv_sec != iter->ei_timestamp.tv_sec ||
+	stamp->tv_nsec != iter->ei_timestamp.tv_nsec)
+	fail("timestamp", iter->ei_record);
+    if (i < numpmid && vset[i]->pmid == pmid_flags) {
+	if (vset[i]->vlist[0].value.lval != (int)iter->ei_flags)
+	    fail("flags", iter->ei_record);
+	i++;
+    }
+    else if (iter->ei_flags != 0)
+	fail("no event.flags", iter->ei_record);
+    if (i < numpmid && vset[i]->pmid == pmid_missed) {
+	if (vset[i]->vlist[0].value.lval != iter->ei_missed)
+	    fail("missed", iter->ei_record);
+	i++;
+    }
+    else if (iter->ei_missed != 0)
+	fail("no event.missed", iter->ei_record);
+    if (numpmid - i != iter->ei_nparams)
+	fail("nparams", iter->ei_record);
+
+    for (; pmEventIterNextParam(iter, &vsp) > 0; i++) {
+	if (i >= numpmid || !same_value(vset[i], vsp))
+	    fail("parameter", iter->ei_record);
+	nparams++;
+    }
+    nrecords++;
+}
+
+static void
+check(pmValueSet *vsp, int idx, int highres)
+{
+    pmEventIter		iter;
+    pmResult		**res = NULL;
+    pmHighResResult	**hres = NULL;
+    struct timespec	stamp;
+    int			n, r, sts;
+
+    if (highres)
+	n = pmUnpackHighResEventRecords(vsp, idx, &hres);
+    else
+	n = pmUnpackEventRecords(vsp, idx, &res);
+    if ((sts = pmEventIterInit(&iter, vsp, idx)) != n) {
+	printf("Error: pmEventIterInit: %d, unpack: %d\n", sts, n);
+	errors++;
+    }
+    if (n < 0)
+	return;
+
+    if (pmid_flags == PM_ID_NULL) {
+	/* anonymous metrics, registered by unpacking */
+	char	*name_flags = "event.flags";
+	char	*name_missed = "event.missed";
+
+	pmLookupName(1, &name_flags, &pmid_flags);
+	pmLookupName(1, &name_missed, &pmid_missed);
+    }
+
+    for (r = 0; r < n; r++) {
+	if (pmEventIterNextRecord(&iter) != 1) {
+	    fail("too few records", r);
+	    break;
+	}
+	if (iter.ei_record != r)
+	    fail("ei_record", r);
+	if (highres)
+	    check_record(&iter, &hres[r]->timestamp,
+			hres[r]->numpmid, hres[r]->vset);
+	else {
+	    stamp.tv_sec = res[r]->timestamp.tv_sec;
+	    stamp.tv_nsec = res[r]->timestamp.tv_usec * 1000;
+	    check_record(&iter, &stamp, res[r]->numpmid, res[r]->vset);
+	}
+    }
+    if (pmEventIterNextRecord(&iter) != 0)
+	fail("too many records", r);
+    if (pmEventIterNextRecord(&iter) != 0)
+	fail("records after the end", r);
+
+    if (highres)
+	pmFreeHighResEventResult(hres);
+    else
+	pmFreeEventResult(res);
+}
+
+static double
+elapsed(struct timeval *start)
+{
+    struct timeval	end;
+
+    gettimeofday(&end, NULL);
+    return pmtimevalSub(&end, start);
+}
+
+static void
+bench(pmResult **results, int nresults, int highres, int iterations)
+{
+    pmEventIter		iter;
+    pmValueSet		*vsp, *pvsp;
+    pmResult		**res;
+    pmHighResResult	**hres;
+    struct timeval	start;
+    double		unpack, walk;
+    long		count = 0;
+    int			i, j, k, n;
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < iterations; i++) {
+	for (j = 0; j < nresults; j++) {
+	    vsp = results[j]->vset[0];
+	    for (k = 0; k < vsp->numval; k++) {
+		if (highres) {
+		    if ((n = pmUnpackHighResEventRecords(vsp, k, &hres)) > 0)
+			pmFreeHighResEventResult(hres);
+		}
+		else {
+		    if ((n = pmUnpackEventRecords(vsp, k, &res)) > 0)
+			pmFreeEventResult(res);
+		}
+		if (n > 0)
+		    count += n;
+	    }
+	}
+    }
+    unpack = elapsed(&start);
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < iterations; i++) {
+	for (j = 0; j < nresults; j++) {
+	    vsp = results[j]->vset[0];
+	    for (k = 0; k < vsp->numval; k++) {
+		if (pmEventIterInit(&iter, vsp, k) <= 0)
+		    continue;
+		while (pmEventIterNextRecord(&iter) > 0)
+		    while (pmEventIterNextParam(&iter, &pvsp) > 0)
+			;
+	    }
+	}
+    }
+    walk = elapsed(&start);
+
+    printf("%ld records: unpack %.0f/sec, iterate %.0f/sec\n",
+	    count, count / unpack, count / walk);
+}
+
+int
+main(int argc, char **argv)
+{
+    pmEventIter		iter;
+    pmValueSet		vset;
+    pmResult		*rp;
+    pmResult		**results = NULL;
+    pmDesc		desc;
+    pmID		pmid;
+    char		*name;
+    int			iterations = 0;
+    int			nresults = 0;
+    int			highres;
+    int			c, i, sts;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "b:")) != EOF) {
+	switch (c) {
+	case 'b':
+	    iterations = atoi(optarg);
+	    break;
+	default:
+	    optind = argc;
+	    break;
+	}
+    }
+    if (optind != argc - 2) {
+	fprintf(stderr, "Usage: %s [-b iterations] archive metric\n", pmGetProgname());
+	exit(1);
+    }
+    name = argv[optind + 1];
+
+    if ((sts = pmNewContext(PM_CONTEXT_ARCHIVE, argv[optind])) < 0) {
+	fprintf(stderr, "%s: pmNewContext(%s): %s\n", pmGetProgname(),
+		argv[optind], pmErrStr(sts));
+	exit(1);
+    }
+    if ((sts = pmLookupName(1, &name, &pmid)) < 0 ||
+	(sts = pmLookupDesc(pmid, &desc)) < 0) {
+	fprintf(stderr, "%s: %s: %s\n", pmGetProgname(), name, pmErrStr(sts));
+	exit(1);
+    }
+    if (desc.type != PM_TYPE_EVENT && desc.type != PM_TYPE_HIGHRES_EVENT) {
+	fprintf(stderr, "%s: %s: not an event record metric\n", pmGetProgname(), name);
+	exit(1);
+    }
+    highres = (desc.type == PM_TYPE_HIGHRES_EVENT);
+    pmid_flags = pmid_missed = PM_ID_NULL;
+
+    /* no values, and values that are not event records */
+    memset(&vset, 0, sizeof(vset));
+    vset.pmid = pmid;
+    printf("numval 0: %d\n", pmEventIterInit(&iter, &vset, 0));
+    printf("after numval 0: %d\n", pmEventIterNextRecord(&iter));
+    vset.numval = PM_ERR_PMID;
+    printf("numval error: %s\n", pmErrStr(pmEventIterInit(&iter, &vset, 0)));
+    vset.numval = 1;
+    vset.valfmt = PM_VAL_INSITU;
+    printf("insitu: %s\n", pmErrStr(pmEventIterInit(&iter, &vset, 0)));
+
+    while ((sts = pmFetch(1, &pmid, &rp)) >= 0) {
+	for (i = 0; i < rp->vset[0]->numval; i++)
+	    check(rp->vset[0], i, highres);
+	if (iterations > 0) {
+	    results = (pmResult **)realloc(results, (nresults + 1) * sizeof(pmResult *));
+	    if (results == NULL) {
+		fprintf(stderr, "%s: realloc failed\n", pmGetProgname());
+		exit(1);
+	    }
+	    results[nresults++] = rp;
+	}
+	else
+	    pmFreeResult(rp);
+    }
+    if (sts != PM_ERR_EOL)
+	printf("pmFetch: %s\n", pmErrStr(sts));
+
+    printf("%s: %d records, %d parameters\n", name, nrecords, nparams);
+    if (iterations > 0) {
+	bench(results, nresults, highres, iterations);
+	for (i = 0; i < nresults; i++)
+	    pmFreeResult(results[i]);
+	free(results);
+    }
+    printf("%s\n", errors ? "differences" : "all match");
+
+    return errors != 0;
+}
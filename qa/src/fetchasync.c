@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) 2020 Red Hat.
+ *
+ * Exercise pmFetchAsync() and friends against pmcd and the sample
+ * PMDA ... replies must come back in request order and match the
+ * values from pmFetch().
+ */
+
+#include <pcp/pmapi.h>
+#include <poll.h>
+
+static char *names[] = {
+    "sample.long.one", "sample.double.ten", "sample.string.hullo",
+    "sample.bin", "my.twenty",
+};
+#define NMETRIC (sizeof(names) / sizeof(names[0]))
+
+static pmID	pmids[NMETRIC];
+static pmResult	*expect;
+static int	ctx;
+static int	nextseq = 1;	/* expected in the next callback */
+static int	ncallback;
+static int	nchain;		/* further requests from the callback */
+static int	errors;
+
+static void
+fail(const char *msg, int seq)
+{
+    if (errors++ < 10)
+	printf("Error: request %d: %s\n", seq, msg);
+}
+
+static void
+compare(pmResult *rp, int seq)
+{
+    pmValueSet	*vp, *evp;
+    int		i, k;
+
+    if (rp->numpmid != expect->numpmid) {
+	fail("numpmid", seq);
+	return;
+    }
+    for (i = 0; i < rp->numpmid; i++) {
+	vp = rp->vset[i];
+	evp = expect->vset[i];
+	if (vp->pmid != evp->pmid || vp->numval != evp->numval) {
+	    fail(names[i], seq);
+	    continue;
+	}
+	for (k = 0; k < vp->numval; k++) {
+	    if (vp->vlist[k].inst != evp->vlist[k].inst)
+		fail(names[i], seq);
+	    else if (vp->valfmt == PM_VAL_INSITU) {
+		if (vp->vlist[k].value.lval != evp->vlist[k].value.lval)
+		    fail(names[i], seq);
+	    }
+	    else if (vp->vlist[k].value.pval->vlen != evp->vlist[k].value.pval->vlen ||
+		     memcmp(vp->vlist[k].value.pval->vbuf,
+			    evp->vlist[k].value.pval->vbuf,
+			    vp->vlist[k].value.pval->vlen - PM_VAL_HDR_SIZE) != 0)
+		fail(names[i], seq);
+	}
+    }
+}
+
+static void
+callback(int handle, int seq, int sts, pmResult *rp, void *data)
+{
+    int		*tag = (int *)data;
+
+    ncallback++;
+    if (handle != ctx)
+	fail("context", seq);
+    if (seq != nextseq)
+	fail("out of order", seq);
+    if (*tag != seq)
+	fail("callback data", seq);
+    nextseq = seq + 1;
+    free(tag);
+    if (sts < 0) {
+	printf("request %d: %s\n", seq, pmErrStr(sts));
+	return;
+    }
+    compare(rp, seq);
+    pmFreeResult(rp);
+
+    if (nchain > 0) {
+	nchain--;
+	tag = (int *)malloc(sizeof(int));
+	if ((*tag = pmFetchAsync(NMETRIC, pmids, callback, tag)) < 0) {
+	    printf("chained pmFetchAsync: %s\n", pmErrStr(*tag));
+	    free(tag);
+	}
+    }
+}
+
+static void
+request(int n)
+{
+    int		*tag;
+
+    while (n-- > 0) {
+	tag = (int *)malloc(sizeof(int));
+	if ((*tag = pmFetchAsync(NMETRIC, pmids, callback, tag)) < 0) {
+	    printf("pmFetchAsync: %s\n", pmErrStr(*tag));
+	    free(tag);
+	    exit(1);
+	}
+    }
+}
+
+/* make callbacks until none are outstanding */
+static void
+complete(void)
+{
+    int		sts;
+
+    while ((sts = pmFetchAsyncComplete(ctx, 1)) > 0)
+	;
+    if (sts < 0)
+	printf("pmFetchAsyncComplete: %s\n", pmErrStr(sts));
+}
+
+int
+main(int argc, char **argv)
+{
+    const char		*host = "local:";
+    const char		*archive = NULL;
+    struct pollfd	pfd;
+    pmResult		*rp;
+    pmDesc		desc;
+    int			*instlist;
+    char		**namelist;
+    char		*name;
+    char		*errmsg;
+    int			nreq = 100;
+    int			c, n, sts;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "a:D:h:n:")) != EOF) {
+	switch (c) {
+	case 'a':
+	    archive = optarg;
+	    break;
+	case 'D':
+	    if (pmSetDebug(optarg) < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+			pmGetProgname(), optarg);
+		exit(1);
+	    }
+	    break;
+	case 'h':
+	    host = optarg;
+	    break;
+	case 'n':
+	    nreq = atoi(optarg);
+	    break;
+	default:
+	    fprintf(stderr, "Usage: %s [-a archive] [-D debug] [-h host] [-n requests]\n",
+		    pmGetProgname());
+	    exit(1);
+	}
+    }
+
+    if (pmRegisterDerivedMetric("my.twenty", "sample.double.ten * 2", &errmsg) < 0) {
+	fprintf(stderr, "%s: %s", pmGetProgname(), errmsg);
+	free(errmsg);
+	exit(1);
+    }
+
+    if (archive != NULL) {
+	if ((ctx = pmNewContext(PM_CONTEXT_ARCHIVE, archive)) < 0) {
+	    fprintf(stderr, "%s: pmNewContext(%s): %s\n", pmGetProgname(), archive, pmErrStr(ctx));
+	    exit(1);
+	}
+	printf("archive pmFetchAsync: %s\n", pmErrStr(pmFetchAsync(1, pmids, callback, NULL)));
+	printf("archive pmFetchAsyncComplete: %s\n", pmErrStr(pmFetchAsyncComplete(ctx, 0)));
+	printf("archive pmFetchAsyncFd: %s\n", pmErrStr(pmFetchAsyncFd(ctx)));
+	pmDestroyContext(ctx);
+    }
+
+    if ((ctx = pmNewContext(PM_CONTEXT_HOST, host)) < 0) {
+	fprintf(stderr, "%s: pmNewContext(%s): %s\n", pmGetProgname(), host, pmErrStr(ctx));
+	exit(1);
+    }
+    if ((sts = pmLookupName(NMETRIC, names, pmids)) < 0) {
+	fprintf(stderr, "%s: pmLookupName: %s\n", pmGetProgname(), pmErrStr(sts));
+	exit(1);
+    }
+    if ((sts = pmFetch(NMETRIC, pmids, &expect)) < 0) {
+	fprintf(stderr, "%s: pmFetch: %s\n", pmGetProgname(), pmErrStr(sts));
+	exit(1);
+    }
+
+    printf("numpmid 0: %s\n", pmErrStr(pmFetchAsync(0, pmids, callback, NULL)));
+    printf("no callback: %s\n", pmErrStr(pmFetchAsync(1, pmids, NULL, NULL)));
+    printf("nothing outstanding: %d\n", pmFetchAsyncComplete(ctx, 1));
+
+    /* pipelined, more than can be outstanding at once */
+    request(nreq);
+    complete();
+    printf("pipelined: %d callbacks\n", ncallback);
+
+    /* reply readiness from poll(2), no waiting in the PMAPI */
+    ncallback = 0;
+    request(10);
+    pfd.fd = pmFetchAsyncFd(ctx);
+    pfd.events = POLLIN;
+    while (ncallback < 10) {
+	if (poll(&pfd, 1, 5000) != 1) {
+	    printf("poll: no reply\n");
+	    break;
+	}
+	if ((n = pmFetchAsyncComplete(ctx, 0)) < 0) {
+	    printf("pmFetchAsyncComplete: %s\n", pmErrStr(n));
+	    break;
+	}
+    }
+    printf("poll: %d callbacks\n", ncallback);
+
+    /* requests issued from the callbacks */
+    ncallback = 0;
+    nchain = 20;
+    request(2);
+    complete();
+    printf("chained: %d callbacks\n", ncallback);
+
+    /* pmFetch() with requests outstanding */
+    ncallback = 0;
+    request(5);
+    if ((sts = pmFetch(NMETRIC, pmids, &rp)) < 0)
+	printf("pmFetch: %s\n", pmErrStr(sts));
+    else {
+	compare(rp, 0);
+	pmFreeResult(rp);
+    }
+    printf("after pmFetch: %d callbacks\n", ncallback);
+    n = pmFetchAsyncComplete(ctx, 0);
+    printf("after pmFetchAsyncComplete: %d (%d callbacks)\n", n, ncallback);
+
+    /* other PMAPI requests with fetches outstanding */
+    ncallback = 0;
+    request(5);
+    if ((sts = pmLookupDesc(pmids[3], &desc)) < 0)
+	printf("pmLookupDesc: %s\n", pmErrStr(sts));
+    else if ((sts = pmGetInDom(desc.indom, &instlist, &namelist)) < 0)
+	printf("pmGetInDom: %s\n", pmErrStr(sts));
+    else {
+	printf("pmGetInDom: %d instances\n", sts);
+	free(instlist);
+	free(namelist);
+    }
+    request(2);
+    if ((sts = pmNameID(pmids[0], &name)) < 0)
+	printf("pmNameID: %s\n", pmErrStr(sts));
+    else {
+	printf("pmNameID: %s\n", name);
+	free(name);
+    }
+    printf("after other requests: %d callbacks\n", ncallback);
+    complete();
+    printf("after pmFetchAsyncComplete: %d callbacks\n", ncallback);
+
+    /* outstanding requests are discarded with the context */
+    ncallback = 0;
+    request(3);
+    pmDestroyContext(ctx);
+    printf("destroyed: %d callbacks\n", ncallback);
+
+    pmFreeResult(expect);
+    printf("%s\n", errors ? "differences" : "all values match");
+
+    return errors != 0;
+}
@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2020 Red Hat.
+ *
+ * pmFetchGroups() testing ... several fetchgroups for pmcd on the
+ * local host (one request to each outstanding at once), plus one for
+ * an archive, fetched together.
+ *
+ * Usage: fetchgroups [-D debug] [-h host] [-n groups] [-r rounds] archive
+ */
+
+#include <pcp/pmapi.h>
+
+typedef struct {
+    pmFG	fg;
+    pmAtomValue	one;
+    pmAtomValue	ten;
+    pmAtomValue	bins[9];
+    pmAtomValue	hundred;
+    int		one_sts;
+    int		ten_sts;
+    int		bins_sts;
+    int		hundred_sts;
+    unsigned int nbins;
+    struct timeval stamp;
+} group_t;
+
+static void
+create(group_t *gp, int type, const char *source)
+{
+    int		sts;
+
+    if ((sts = pmCreateFetchGroup(&gp->fg, type, source)) < 0 ||
+	(sts = pmExtendFetchGroup_item(gp->fg, "sample.long.one", NULL, NULL,
+			&gp->one, PM_TYPE_32, &gp->one_sts)) < 0 ||
+	(sts = pmExtendFetchGroup_item(gp->fg, "sample.double.ten", NULL, NULL,
+			&gp->ten, PM_TYPE_DOUBLE, &gp->ten_sts)) < 0 ||
+	(sts = pmExtendFetchGroup_indom(gp->fg, "sample.bin", NULL, NULL, NULL,
+			gp->bins, PM_TYPE_32, NULL, 9, &gp->nbins,
+			&gp->bins_sts)) < 0 ||
+	(sts = pmExtendFetchGroup_timestamp(gp->fg, &gp->stamp)) < 0) {
+	fprintf(stderr, "%s: %s: %s\n", pmGetProgname(), source, pmErrStr(sts));
+	exit(1);
+    }
+}
+
+/* archive group back to the start, for the same values each time */
+static void
+rewind_archive(group_t *gp)
+{
+    pmLogLabel	label;
+    int		sts;
+
+    if ((sts = pmUseContext(pmGetFetchGroupContext(gp->fg))) < 0 ||
+	(sts = pmGetArchiveLabel(&label)) < 0 ||
+	(sts = pmSetMode(PM_MODE_FORW, &label.ll_start, 0)) < 0) {
+	fprintf(stderr, "%s: rewind: %s\n", pmGetProgname(), pmErrStr(sts));
+	exit(1);
+    }
+}
+
+static void
+report(const char *tag, int n, group_t *groups, int *status, double *latency)
+{
+    group_t	*gp;
+    int		i;
+
+    for (i = 0; i < n; i++) {
+	gp = &groups[i];
+	if (latency[i] < 0.0)
+	    printf("%s group %d: Error: latency %.6f\n", tag, i, latency[i]);
+	if (status[i] < 0) {
+	    printf("%s group %d: %s (one %s)\n", tag, i, pmErrStr(status[i]),
+		    pmErrStr(gp->one_sts));
+	    continue;
+	}
+	printf("%s group %d: one=%d ten=%.1f bins=%u", tag, i,
+		gp->one_sts < 0 ? -1 : gp->one.l,
+		gp->ten_sts < 0 ? -1 : gp->ten.d,
+		gp->bins_sts < 0 ? 0 : gp->nbins);
+	if (gp->bins_sts >= 0 && gp->nbins > 0)
+	    printf(" [%d..%d]", gp->bins[0].l, gp->bins[gp->nbins-1].l);
+	printf(" stamp %s\n", gp->stamp.tv_sec > 0 ? "set" : "unset");
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    const char		*host = "local:";
+    struct timeval	zero = { 0, 0 };
+    struct timeval	timeout = { 10, 0 };
+    group_t		*groups;
+    pmFG		*fgs;
+    int			*status;
+    double		*latency;
+    int			ngroup = 4;
+    int			rounds = 3;
+    int			c, i, r, sts;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "D:h:n:r:")) != EOF) {
+	switch (c) {
+	case 'D':
+	    if (pmSetDebug(optarg) < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+			pmGetProgname(), optarg);
+		exit(1);
+	    }
+	    break;
+	case 'h':
+	    host = optarg;
+	    break;
+	case 'n':
+	    ngroup = atoi(optarg);
+	    break;
+	case 'r':
+	    rounds = atoi(optarg);
+	    break;
+	default:
+	    optind = argc;
+	    break;
+	}
+    }
+    if (optind != argc - 1 || ngroup < 1 || rounds < 1) {
+	fprintf(stderr, "Usage: %s [-D debug] [-h host] [-n groups] [-r rounds] archive\n",
+		pmGetProgname());
+	exit(1);
+    }
+
+    /* host groups, then the archive group last */
+    groups = (group_t *)calloc(ngroup + 1, sizeof(group_t));
+    fgs = (pmFG *)calloc(ngroup + 1, sizeof(pmFG));
+    status = (int *)calloc(ngroup + 1, sizeof(int));
+    latency = (double *)calloc(ngroup + 1, sizeof(double));
+    for (i = 0; i < ngroup; i++) {
+	create(&groups[i], PM_CONTEXT_HOST, host);
+	fgs[i] = groups[i].fg;
+    }
+    create(&groups[ngroup], PM_CONTEXT_ARCHIVE, argv[optind]);
+    fgs[ngroup] = groups[ngroup].fg;
+
+    printf("no groups: %s\n", pmErrStr(pmFetchGroups(0, fgs, NULL, NULL, NULL)));
+
+    for (r = 0; r < rounds; r++) {
+	rewind_archive(&groups[ngroup]);
+	sts = pmFetchGroups(ngroup + 1, fgs, &timeout, status, latency);
+	printf("round %d: %d fetched\n", r, sts);
+	report("round", ngroup + 1, groups, status, latency);
+    }
+
+    /*
+     * Deadline already passed, so the host fetches time out and their
+     * late replies must be discarded by the next round.
+     */
+    rewind_archive(&groups[ngroup]);
+    sts = pmFetchGroups(ngroup + 1, fgs, &zero, status, latency);
+    printf("no time: %d fetched\n", sts);
+    report("no time", ngroup + 1, groups, status, latency);
+
+    rewind_archive(&groups[ngroup]);
+    sts = pmFetchGroups(ngroup + 1, fgs, NULL, status, NULL);
+    printf("default timeout: %d fetched\n", sts);
+    report("default", ngroup + 1, groups, status, latency);
+
+    /* pmFetchGroup() after requests were abandoned */
+    sts = pmFetchGroups(ngroup, fgs, &zero, NULL, NULL);
+    printf("no time, no reporting: %d fetched\n", sts);
+    for (i = 0; i < ngroup; i++) {
+	if ((sts = pmFetchGroup(fgs[i])) < 0 || groups[i].one.l != 1)
+	    printf("pmFetchGroup group %d: sts %d one %d\n", i, sts, groups[i].one.l);
+    }
+    /* metadata requests after requests were abandoned */
+    sts = pmFetchGroups(ngroup, fgs, &zero, NULL, NULL);
+    printf("no time, then extend: %d fetched\n", sts);
+    for (i = 0; i < ngroup; i++) {
+	if ((sts = pmExtendFetchGroup_item(fgs[i], "sample.long.hundred",
+			NULL, NULL, &groups[i].hundred, PM_TYPE_32,
+			&groups[i].hundred_sts)) < 0)
+	    printf("pmExtendFetchGroup_item group %d: %s\n", i, pmErrStr(sts));
+	else if ((sts = pmFetchGroup(fgs[i])) < 0 ||
+		 groups[i].one.l != 1 || groups[i].hundred.l != 100)
+	    printf("extended group %d: sts %d one %d hundred %d\n",
+		    i, sts, groups[i].one.l, groups[i].hundred.l);
+    }
+
+    rewind_archive(&groups[ngroup]);
+    sts = pmFetchGroups(ngroup + 1, fgs, &timeout, status, latency);
+    printf("final: %d fetched\n", sts);
+
+    for (i = 0; i <= ngroup; i++)
+	pmDestroyFetchGroup(fgs[i]);
+    return 0;
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2020 Red Hat.
+ *
+ * Exercise the __pmFILE interfaces for an uncompressed file opened
+ * read-only (the memory mapped handler), including a file that grows
+ * while it is open, as for an archive being written by pmlogger.
+ */
+
+#include <pcp/pmapi.h>
+#include "libpcp.h"
+
+static int	wfd;
+
+static void
+append(const char *str)
+{
+    if (write(wfd, str, strlen(str)) != strlen(str)) {
+	fprintf(stderr, "%s: write failed: %s\n", pmGetProgname(), strerror(errno));
+	exit(1);
+    }
+    printf("append \"%s\"\n", str);
+}
+
+static void
+doread(__pmFILE *f, size_t size, size_t nmemb)
+{
+    char	buf[64];
+    size_t	n;
+
+    memset(buf, 0, sizeof(buf));
+    n = __pmFread(buf, size, nmemb, f);
+    printf("read %zd x %zd -> %zd \"%s\" tell=%ld eof=%d\n",
+	    nmemb, size, n, buf, __pmFtell(f), __pmFeof(f) != 0);
+}
+
+static void
+doseek(__pmFILE *f, long offset, int whence)
+{
+    int		sts;
+
+    sts = __pmFseek(f, offset, whence);
+    printf("seek %ld %s -> %d tell=%ld\n", offset,
+	    whence == SEEK_SET ? "SEEK_SET" :
+	    (whence == SEEK_CUR ? "SEEK_CUR" : "SEEK_END"),
+	    sts, __pmFtell(f));
+}
+
+int
+main(int argc, char **argv)
+{
+    __pmFILE	*f;
+    struct stat	sbuf;
+    char	c = 'x';
+    size_t	n;
+    int		sts;
+
+    pmSetProgname(argv[0]);
+
+    if (argc != 2) {
+	fprintf(stderr, "Usage: %s file\n", pmGetProgname());
+	exit(1);
+    }
+    if ((wfd = open(argv[1], O_WRONLY|O_CREAT|O_TRUNC, 0644)) < 0) {
+	fprintf(stderr, "%s: open(%s): %s\n", pmGetProgname(), argv[1], strerror(errno));
+	exit(1);
+    }
+
+    append("0123456789");
+    if ((f = __pmFopen(argv[1], "r")) == NULL) {
+	fprintf(stderr, "%s: __pmFopen(%s): %s\n", pmGetProgname(), argv[1], strerror(errno));
+	exit(1);
+    }
+    doread(f, 1, 4);
+    append("abcdefghij");
+    doread(f, 1, 10);
+    doseek(f, -6, SEEK_CUR);
+    printf("getc -> '%c'\n", __pmFgetc(f));
+    doseek(f, 0, SEEK_END);
+    doread(f, 1, 1);
+    printf("getc -> %d eof=%d\n", __pmFgetc(f), __pmFeof(f) != 0);
+    __pmClearerr(f);
+    printf("clearerr: eof=%d\n", __pmFeof(f) != 0);
+    append("XYZ");
+    doread(f, 1, 3);
+    doseek(f, 18, SEEK_SET);
+    doread(f, 1, 10);
+    doseek(f, 4, SEEK_SET);
+    doread(f, 4, 3);
+    doread(f, 4, 3);
+    doseek(f, -1, SEEK_SET);
+    __pmRewind(f);
+    doread(f, 5, 1);
+    if (__pmFstat(f, &sbuf) == 0)
+	printf("fstat: size=%ld\n", (long)sbuf.st_size);
+    printf("fileno valid: %d\n", __pmFileno(f) >= 0);
+    n = __pmFwrite(&c, 1, 1, f);
+    printf("write -> %zd error=%d\n", n, __pmFerror(f) != 0);
+    __pmClearerr(f);
+    printf("clearerr: error=%d\n", __pmFerror(f) != 0);
+    printf("close -> %d\n", __pmFclose(f));
+
+    /* truncated while open, reads past the new end are short */
+    if (ftruncate(wfd, 0) < 0 || lseek(wfd, 0, SEEK_SET) < 0) {
+	fprintf(stderr, "%s: truncate failed: %s\n", pmGetProgname(), strerror(errno));
+	exit(1);
+    }
+    append("0123456789");
+    if (ftruncate(wfd, 3 * 4096) < 0) {
+	fprintf(stderr, "%s: extend failed: %s\n", pmGetProgname(), strerror(errno));
+	exit(1);
+    }
+    if ((f = __pmFopen(argv[1], "r")) == NULL) {
+	fprintf(stderr, "%s: __pmFopen(%s): %s\n", pmGetProgname(), argv[1], strerror(errno));
+	exit(1);
+    }
+    doseek(f, 0, SEEK_END);
+    if (ftruncate(wfd, 10) < 0) {
+	fprintf(stderr, "%s: truncate failed: %s\n", pmGetProgname(), strerror(errno));
+	exit(1);
+    }
+    printf("truncate to 10 bytes\n");
+    doseek(f, 2 * 4096, SEEK_SET);
+    doread(f, 1, 4);
+    doseek(f, 6, SEEK_SET);
+    doread(f, 1, 10);
+    printf("close -> %d\n", __pmFclose(f));
+    close(wfd);
+
+    /* not a regular file, falls back to stdio */
+    if ((f = __pmFopen("/dev/null", "r")) == NULL)
+	printf("__pmFopen(/dev/null): %s\n", strerror(errno));
+    else {
+	doread(f, 1, 1);
+	__pmFclose(f);
+    }
+
+    if ((f = __pmFopen("/no/such/file", "r")) == NULL) {
+	sts = errno;
+	printf("__pmFopen(/no/such/file): %s\n", strerror(sts));
+    }
+    else
+	printf("__pmFopen(/no/such/file): botch, succeeded\n");
+
+    return 0;
+}
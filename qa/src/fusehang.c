@@ -0,0 +1,46 @@
+/*
+ * Mount a FUSE filesystem that never answers the kernel, so any
+ * statfs(2) or other access below the mount point blocks until
+ * this process exits.  Stand-in for a hung network filesystem.
+ *
+ * Usage: fusehang dir
+ *
+ * Copyright (c) 2020 Red Hat.
+ */
+#include <pcp/pmapi.h>
+#ifdef __linux__
+#include <sys/mount.h>
+#endif
+
+int
+main(int argc, char **argv)
+{
+#ifdef __linux__
+    char	opts[64];
+    int		fd;
+
+    if (argc != 2) {
+	fprintf(stderr, "Usage: %s dir\n", argv[0]);
+	exit(1);
+    }
+    if ((fd = open("/dev/fuse", O_RDWR)) < 0) {
+	fprintf(stderr, "%s: /dev/fuse: %s\n", argv[0], strerror(errno));
+	exit(1);
+    }
+    pmsprintf(opts, sizeof(opts),
+		"fd=%d,rootmode=40000,user_id=0,group_id=0", fd);
+    if (mount("fusehang", argv[1], "fuse", MS_NOSUID|MS_NODEV, opts) < 0) {
+	fprintf(stderr, "%s: mount %s: %s\n", argv[0], argv[1], strerror(errno));
+	exit(1);
+    }
+    printf("mounted\n");
+    fflush(stdout);
+
+    /* never read the INIT request, so every request waits for it */
+    for ( ; ; )
+	pause();
+#else
+    fprintf(stderr, "%s: not supported on this platform\n", argv[0]);
+    exit(1);
+#endif
+}
@@ -0,0 +1,274 @@
+/*
+ * Copyright (c) 2020 Red Hat.
+ *
+ * Check the open addressing __pmOHash* tables against the chained
+ * __pmHash* tables, and compare their speed for the key distributions
+ * seen in archives: pmIDs (a few domains, clustered items), dense
+ * instance identifiers and sparse instance identifiers (PIDs).
+ */
+
+#include <pcp/pmapi.h>
+#include "libpcp.h"
+#include <sys/time.h>
+
+static int	nkeys = 20000;
+static int	rounds = 20;
+static int	quiet;
+static int	errors;
+
+static void
+fail(const char *dist, const char *msg)
+{
+    if (errors++ < 10)
+	printf("%s: Error: %s\n", dist, msg);
+}
+
+static void
+keys_pmid(unsigned int *keys, int n)
+{
+    static const int	domains[] = { 2, 3, 60, 70, 78, 79, 80 };
+    int			ndomains = sizeof(domains) / sizeof(domains[0]);
+    int			i;
+
+    /* 40 items per cluster, 50 clusters per domain, then more clusters */
+    for (i = 0; i < n; i++)
+	keys[i] = pmID_build(domains[(i / 2000) % ndomains],
+			(i / 40) % 50 + 50 * (i / (2000 * ndomains)), i % 40);
+}
+
+static void
+keys_inst(unsigned int *keys, int n)
+{
+    int		i;
+
+    for (i = 0; i < n; i++)
+	keys[i] = i;
+}
+
+static void
+keys_pid(unsigned int *keys, int n)
+{
+    unsigned int	pid = 1;
+    int			i;
+
+    /* ascending, sparse, as for a process instance domain */
+    for (i = 0; i < n; i++) {
+	pid += 1 + (lrand48() % 200);
+	keys[i] = pid;
+    }
+}
+
+typedef struct {
+    const char	*name;
+    void	(*gen)(unsigned int *, int);
+} distribution_t;
+
+static distribution_t	dists[] = {
+    { "pmid", keys_pmid },
+    { "inst", keys_inst },
+    { "pid", keys_pid },
+};
+
+static double
+elapsed(struct timeval *start)
+{
+    struct timeval	now;
+
+    gettimeofday(&now, NULL);
+    return pmtimevalSub(&now, start);
+}
+
+static unsigned int	walk_count;
+static unsigned long	walk_sum;
+
+static __pmHashWalkState
+walker(const __pmHashNode *hp, void *arg)
+{
+    walk_count++;
+    walk_sum += (unsigned long)hp->data;
+    /* delete odd keys */
+    if (arg != NULL && (hp->key & 1))
+	return PM_HASH_WALK_DELETE_NEXT;
+    return PM_HASH_WALK_NEXT;
+}
+
+static __pmHashWalkState
+deleter(const __pmHashNode *hp, void *arg)
+{
+    return PM_HASH_WALK_DELETE_NEXT;
+}
+
+/*
+ * Exercise both table types with the same operations and check that
+ * they agree.
+ */
+static void
+check(distribution_t *dp, unsigned int *keys, int n)
+{
+    __pmHashCtl		hc;
+    __pmOHashCtl	oc;
+    __pmHashNode	*hp, *op;
+    unsigned long	sum = 0;
+    int			i;
+
+    __pmHashInit(&hc);
+    __pmOHashInit(&oc);
+    for (i = 0; i < n; i++) {
+	__pmHashAdd(keys[i], (void *)(long)(i + 1), &hc);
+	__pmOHashAdd(keys[i], (void *)(long)(i + 1), &oc);
+	sum += i + 1;
+	/* delete every third key soon after adding it */
+	if (i % 3 == 2) {
+	    if (__pmHashDel(keys[i-1], (void *)(long)i, &hc) != 1 ||
+		__pmOHashDel(keys[i-1], (void *)(long)i, &oc) != 1)
+		fail(dp->name, "delete");
+	    sum -= i;
+	}
+    }
+    if (hc.nodes != oc.nodes)
+	fail(dp->name, "node count");
+    for (i = 0; i < n; i++) {
+	hp = __pmHashSearch(keys[i], &hc);
+	op = __pmOHashSearch(keys[i], &oc);
+	if ((hp == NULL) != (op == NULL) || (hp && hp->data != op->data))
+	    fail(dp->name, "search");
+	if (__pmOHashSearch(keys[i] ^ 0x80000000, &oc) != NULL)
+	    fail(dp->name, "search miss");
+    }
+
+    /* iterator walk, deleting the node returned every so often */
+    walk_count = 0;
+    walk_sum = 0;
+    for (op = __pmOHashWalk(&oc, PM_HASH_WALK_START), i = 0;
+	 op != NULL;
+	 op = __pmOHashWalk(&oc, PM_HASH_WALK_NEXT), i++) {
+	walk_count++;
+	walk_sum += (unsigned long)op->data;
+	if (i % 7 == 0) {
+	    __pmHashDel(op->key, op->data, &hc);
+	    __pmOHashDel(op->key, op->data, &oc);
+	}
+    }
+    if (walk_count != n - n / 3 || walk_sum != sum)
+	fail(dp->name, "iterator walk");
+
+    /* callback walk deleting odd keys, then one more to count */
+    __pmOHashWalkCB(walker, (void *)1, &oc);
+    __pmHashWalkCB(walker, (void *)1, &hc);
+    walk_count = 0;
+    __pmOHashWalkCB(walker, NULL, &oc);
+    if (walk_count != oc.nodes)
+	fail(dp->name, "callback walk");
+    for (i = 0; i < n; i++) {
+	hp = __pmHashSearch(keys[i], &hc);
+	op = __pmOHashSearch(keys[i], &oc);
+	if ((hp == NULL) != (op == NULL) || ((keys[i] & 1) && op != NULL))
+	    fail(dp->name, "walk delete");
+    }
+
+    __pmHashWalkCB(deleter, NULL, &hc);
+    __pmHashClear(&hc);
+    __pmOHashClear(&oc);
+    if (quiet)
+	printf("%s: checked\n", dp->name);
+}
+
+static void
+bench(distribution_t *dp, unsigned int *keys, int n)
+{
+    struct timeval	start;
+    __pmHashCtl		hc;
+    __pmOHashCtl	oc;
+    double		add, hit, miss;
+    unsigned long	found;
+    int			i, r;
+
+    __pmHashInit(&hc);
+    gettimeofday(&start, NULL);
+    for (i = 0; i < n; i++)
+	__pmHashAdd(keys[i], (void *)(long)i, &hc);
+    add = elapsed(&start);
+    gettimeofday(&start, NULL);
+    for (r = found = 0; r < rounds; r++)
+	for (i = 0; i < n; i++)
+	    found += (__pmHashSearch(keys[i], &hc) != NULL);
+    hit = elapsed(&start);
+    gettimeofday(&start, NULL);
+    for (r = 0; r < rounds; r++)
+	for (i = 0; i < n; i++)
+	    found += (__pmHashSearch(keys[i] + 0x40000000, &hc) != NULL);
+    miss = elapsed(&start);
+    __pmHashWalkCB(deleter, NULL, &hc);
+    __pmHashClear(&hc);
+    printf("%s %6s: add %.1f, hit %.1f, miss %.1f nsec/key\n", dp->name,
+	    "chain", add * 1e9 / n, hit * 1e9 / n / rounds,
+	    miss * 1e9 / n / rounds);
+
+    __pmOHashInit(&oc);
+    gettimeofday(&start, NULL);
+    for (i = 0; i < n; i++)
+	__pmOHashAdd(keys[i], (void *)(long)i, &oc);
+    add = elapsed(&start);
+    gettimeofday(&start, NULL);
+    for (r = found = 0; r < rounds; r++)
+	for (i = 0; i < n; i++)
+	    found += (__pmOHashSearch(keys[i], &oc) != NULL);
+    hit = elapsed(&start);
+    gettimeofday(&start, NULL);
+    for (r = 0; r < rounds; r++)
+	for (i = 0; i < n; i++)
+	    found += (__pmOHashSearch(keys[i] + 0x40000000, &oc) != NULL);
+    miss = elapsed(&start);
+    __pmOHashClear(&oc);
+    printf("%s %6s: add %.1f, hit %.1f, miss %.1f nsec/key\n", dp->name,
+	    "open", add * 1e9 / n, hit * 1e9 / n / rounds,
+	    miss * 1e9 / n / rounds);
+}
+
+int
+main(int argc, char **argv)
+{
+    unsigned int	*keys;
+    int			c, i;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "n:qr:")) != EOF) {
+	switch (c) {
+	case 'n':
+	    nkeys = atoi(optarg);
+	    break;
+	case 'q':
+	    quiet = 1;
+	    break;
+	case 'r':
+	    rounds = atoi(optarg);
+	    break;
+	default:
+	    fprintf(stderr, "Usage: %s [-q] [-n keys] [-r rounds]\n",
+		    pmGetProgname());
+	    exit(1);
+	}
+    }
+    if (nkeys < 3 || rounds < 1) {
+	fprintf(stderr, "%s: need at least 3 keys and 1 round\n",
+		pmGetProgname());
+	exit(1);
+    }
+    if ((keys = (unsigned int *)malloc(nkeys * sizeof(unsigned int))) == NULL) {
+	fprintf(stderr, "%s: malloc failed\n", pmGetProgname());
+	exit(1);
+    }
+
+    srand48(1);
+    for (i = 0; i < sizeof(dists) / sizeof(dists[0]); i++) {
+	dists[i].gen(keys, nkeys);
+	check(&dists[i], keys, nkeys);
+	if (!quiet)
+	    bench(&dists[i], keys, nkeys);
+    }
+    printf("errors: %d\n", errors);
+
+    free(keys);
+    return errors != 0;
+}
@@ -0,0 +1,309 @@
+/*
+ * Copyright (c) 2020 Red Hat.
+ *
+ * Write an archive with many versions of one instance domain, then
+ * check pmGetInDom(), pmNameInDom() and pmLookupInDom() return the
+ * version in force at the current archive time, visiting the times
+ * forwards, backwards and in a scattered order.
+ *
+ * Version v is at base+v seconds, with the instances v/2 ... v/2+3,
+ * so every second version is the same as the one before it.
+ *
+ * With -b, report lookups/sec for iterations lookups at scattered
+ * times.
+ *
+ * Usage: indomtime [-b iterations] [-D debug] [-n versions] archive
+ */
+
+#include <pcp/pmapi.h>
+#include "libpcp.h"
+#include <sys/time.h>
+
+#define NINST	4
+#define BASE	1000000
+
+static pmID	pmid;
+static pmInDom	indom;
+static int	nversions = 100;
+static int	errors;
+
+static int
+first_inst(int v)
+{
+    return v / 2;
+}
+
+static void
+make_indom(int v, int **instlist, char ***namelist)
+{
+    char	*names;
+    int		i;
+
+    /* one allocation for the names, as for pmGetInDom() */
+    *instlist = (int *)malloc(NINST * sizeof(int));
+    *namelist = (char **)malloc(NINST * (sizeof(char *) + 16));
+    if (*instlist == NULL || *namelist == NULL) {
+	fprintf(stderr, "%s: malloc failed\n", pmGetProgname());
+	exit(1);
+    }
+    names = (char *)&(*namelist)[NINST];
+    for (i = 0; i < NINST; i++) {
+	(*instlist)[i] = first_inst(v) + i;
+	(*namelist)[i] = &names[i * 16];
+	pmsprintf((*namelist)[i], 16, "inst-%d", first_inst(v) + i);
+    }
+}
+
+static void
+write_archive(const char *archive)
+{
+    __pmLogCtl	logctl;
+    __pmArchCtl	archctl;
+    __pmPDU	*pdp;
+    pmResult	*rp;
+    pmDesc	desc;
+    pmTimeval	stamp = { BASE, 0 };
+    char	*name = "qa.indomtime";
+    int		*instlist;
+    char	**namelist;
+    int		nshared = 0;
+    int		i, v, sts;
+
+    memset(&logctl, 0, sizeof(logctl));
+    memset(&archctl, 0, sizeof(archctl));
+    archctl.ac_log = &logctl;
+    if ((sts = __pmLogCreate("qatest", archive, LOG_PDU_VERSION, &archctl)) != 0) {
+	fprintf(stderr, "%s: __pmLogCreate failed: %s\n", pmGetProgname(), pmErrStr(sts));
+	exit(1);
+    }
+    logctl.l_state = PM_LOG_STATE_INIT;
+    logctl.l_label.ill_pid = 1234;
+    logctl.l_label.ill_start = stamp;
+    strcpy(logctl.l_label.ill_hostname, "happycamper");
+    strcpy(logctl.l_label.ill_tz, "UTC");
+    logctl.l_label.ill_vol = PM_LOG_VOL_TI;
+    __pmLogWriteLabel(logctl.l_tifp, &logctl.l_label);
+    logctl.l_label.ill_vol = PM_LOG_VOL_META;
+    __pmLogWriteLabel(logctl.l_mdfp, &logctl.l_label);
+    logctl.l_label.ill_vol = 0;
+    __pmLogWriteLabel(archctl.ac_mfp, &logctl.l_label);
+    __pmFflush(archctl.ac_mfp);
+    __pmFflush(logctl.l_mdfp);
+    __pmLogPutIndex(&archctl, &stamp);
+
+    desc.pmid = pmid;
+    desc.type = PM_TYPE_32;
+    desc.indom = indom;
+    desc.sem = PM_SEM_INSTANT;
+    memset(&desc.units, 0, sizeof(desc.units));
+    if ((sts = __pmLogPutDesc(&archctl, &desc, 1, &name)) < 0) {
+	fprintf(stderr, "%s: __pmLogPutDesc failed: %s\n", pmGetProgname(), pmErrStr(sts));
+	exit(1);
+    }
+
+    if ((rp = (pmResult *)malloc(sizeof(pmResult))) == NULL ||
+	(rp->vset[0] = (pmValueSet *)malloc(sizeof(pmValueSet) +
+				(NINST - 1) * sizeof(pmValue))) == NULL) {
+	fprintf(stderr, "%s: malloc failed\n", pmGetProgname());
+	exit(1);
+    }
+    rp->numpmid = 1;
+    rp->vset[0]->pmid = pmid;
+    rp->vset[0]->numval = NINST;
+    rp->vset[0]->valfmt = PM_VAL_INSITU;
+
+    for (v = 0; v < nversions; v++) {
+	stamp.tv_sec = BASE + v;
+	make_indom(v, &instlist, &namelist);
+	if ((sts = __pmLogPutInDom(&archctl, indom, &stamp, NINST, instlist, namelist)) < 0) {
+	    fprintf(stderr, "%s: __pmLogPutInDom failed: %s\n", pmGetProgname(), pmErrStr(sts));
+	    exit(1);
+	}
+	if (sts == PMLOGPUTINDOM_DUP) {
+	    /* same as the previous version, libpcp shares that one */
+	    nshared++;
+	    free(instlist);
+	    free(namelist);
+	}
+
+	rp->timestamp.tv_sec = stamp.tv_sec;
+	rp->timestamp.tv_usec = 0;
+	for (i = 0; i < NINST; i++) {
+	    rp->vset[0]->vlist[i].inst = first_inst(v) + i;
+	    rp->vset[0]->vlist[i].value.lval = v;
+	}
+	if ((sts = __pmEncodeResult(__pmFileno(archctl.ac_mfp), rp, &pdp)) < 0) {
+	    fprintf(stderr, "%s: __pmEncodeResult failed: %s\n", pmGetProgname(), pmErrStr(sts));
+	    exit(1);
+	}
+	__pmOverrideLastFd(__pmFileno(archctl.ac_mfp));
+	if ((sts = __pmLogPutResult2(&archctl, pdp)) < 0) {
+	    fprintf(stderr, "%s: __pmLogPutResult2 failed: %s\n", pmGetProgname(), pmErrStr(sts));
+	    exit(1);
+	}
+	__pmUnpinPDUBuf(pdp);
+    }
+    pmFreeResult(rp);
+
+    __pmFflush(archctl.ac_mfp);
+    __pmFflush(logctl.l_mdfp);
+    __pmLogPutIndex(&archctl, &stamp);
+    __pmLogClose(&archctl);
+
+    printf("wrote %d versions, %d shared with the previous version\n",
+	    nversions, nshared);
+}
+
+/*
+ * Check the instance domain at time base+half/2 seconds
+ */
+static void
+check(int half)
+{
+    struct timeval	when;
+    int			*instlist;
+    char		**namelist;
+    char		*name;
+    char		expect[16];
+    int			v = half / 2;
+    int			i, sts;
+
+    when.tv_sec = BASE + v;
+    when.tv_usec = (half % 2) ? 500000 : 0;
+    if ((sts = pmSetMode(PM_MODE_FORW, &when, 0)) < 0) {
+	printf("pmSetMode: %s\n", pmErrStr(sts));
+	exit(1);
+    }
+
+    if ((sts = pmGetInDom(indom, &instlist, &namelist)) != NINST) {
+	if (errors++ < 10)
+	    printf("Error: version %d: pmGetInDom: %d\n", v, sts);
+	return;
+    }
+    for (i = 0; i < NINST; i++) {
+	pmsprintf(expect, sizeof(expect), "inst-%d", first_inst(v) + i);
+	if (instlist[i] != first_inst(v) + i || strcmp(namelist[i], expect) != 0) {
+	    if (errors++ < 10)
+		printf("Error: version %d: [%d] %d \"%s\"\n", v, i, instlist[i], namelist[i]);
+	}
+    }
+    free(instlist);
+    free(namelist);
+
+    pmsprintf(expect, sizeof(expect), "inst-%d", first_inst(v));
+    if ((sts = pmNameInDom(indom, first_inst(v), &name)) < 0) {
+	if (errors++ < 10)
+	    printf("Error: version %d: pmNameInDom: %s\n", v, pmErrStr(sts));
+    }
+    else {
+	if (strcmp(name, expect) != 0 && errors++ < 10)
+	    printf("Error: version %d: pmNameInDom: \"%s\"\n", v, name);
+	free(name);
+    }
+    pmsprintf(expect, sizeof(expect), "inst-%d", first_inst(v) + NINST - 1);
+    if ((sts = pmLookupInDom(indom, expect)) != first_inst(v) + NINST - 1) {
+	if (errors++ < 10)
+	    printf("Error: version %d: pmLookupInDom: %d\n", v, sts);
+    }
+    /* instance that has come and gone, or is yet to come */
+    if (v > 1 && (sts = pmLookupInDom(indom, "inst-0")) != PM_ERR_INST_LOG) {
+	if (errors++ < 10)
+	    printf("Error: version %d: pmLookupInDom(inst-0): %d\n", v, sts);
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    struct timeval	before = { BASE - 1, 0 };
+    struct timeval	start, end;
+    int			*instlist;
+    char		**namelist;
+    int			iterations = 0;
+    int			errflag = 0;
+    int			c, h, i, sts;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "b:D:n:")) != EOF) {
+	switch (c) {
+	case 'b':
+	    iterations = atoi(optarg);
+	    break;
+	case 'D':
+	    if ((sts = pmSetDebug(optarg)) < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+			pmGetProgname(), optarg);
+		errflag++;
+	    }
+	    break;
+	case 'n':
+	    nversions = atoi(optarg);
+	    break;
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+    if (errflag || optind != argc - 1 || nversions < 1) {
+	fprintf(stderr, "Usage: %s [-b iterations] [-D debug] [-n versions] archive\n",
+		pmGetProgname());
+	exit(1);
+    }
+
+    pmid = pmID_build(245, 0, 1);
+    indom = pmInDom_build(245, 1);
+    write_archive(argv[optind]);
+
+    if ((sts = pmNewContext(PM_CONTEXT_ARCHIVE, argv[optind])) < 0) {
+	fprintf(stderr, "%s: pmNewContext(%s): %s\n", pmGetProgname(),
+		argv[optind], pmErrStr(sts));
+	exit(1);
+    }
+
+    /* before the first version */
+    pmSetMode(PM_MODE_FORW, &before, 0);
+    printf("before: %s\n", pmErrStr(pmGetInDom(indom, &instlist, &namelist)));
+
+    for (h = 0; h < 2 * nversions; h++)
+	check(h);
+    printf("forwards: %d errors\n", errors);
+    for (h = 2 * nversions - 1; h >= 0; h--)
+	check(h);
+    printf("backwards: %d errors\n", errors);
+    /* a stride that is co-prime with the number of times */
+    for (h = i = 0; i < 2 * nversions; i++) {
+	check(h);
+	h = (h + 2 * 7919 + 1) % (2 * nversions);
+    }
+    printf("scattered: %d errors\n", errors);
+
+    /* union over all versions */
+    if ((sts = pmGetInDomArchive(indom, &instlist, &namelist)) < 0)
+	printf("pmGetInDomArchive: %s\n", pmErrStr(sts));
+    else {
+	printf("pmGetInDomArchive: %s\n",
+		sts == first_inst(nversions - 1) + NINST ? "all instances" : "wrong");
+	free(instlist);
+	free(namelist);
+    }
+
+    if (iterations > 0) {
+	gettimeofday(&start, NULL);
+	for (h = i = 0; i < iterations; i++) {
+	    struct timeval	when = { BASE + h, 0 };
+
+	    pmSetMode(PM_MODE_FORW, &when, 0);
+	    if (pmGetInDom(indom, &instlist, &namelist) > 0) {
+		free(instlist);
+		free(namelist);
+	    }
+	    h = (h + 7919) % nversions;
+	}
+	gettimeofday(&end, NULL);
+	printf("%d versions: %.0f lookups/sec\n", nversions,
+		iterations / pmtimevalSub(&end, &start));
+    }
+
+    return errors != 0;
+}
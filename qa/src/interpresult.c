@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2020 Red Hat.
+ *
+ * Interpolated fetches from an archive, optionally including derived
+ * metrics, checking that the pmResults built by __pmLogFetchInterp()
+ * and __dmpostfetch() are released by pmFreeResult() without leaving
+ * PDU buffers pinned.
+ *
+ * With -r the archive is replayed backwards from the end.
+ *
+ * Usage: interpresult [-rv] [-d name=expr] [-D debug] [-s samples]
+ *		       [-t delta] archive [metric ...]
+ */
+
+#include <pcp/pmapi.h>
+#include "libpcp.h"
+
+static pmID	*pmidlist;
+static int	numpmid;
+
+static void
+dometric(const char *name)
+{
+    pmID	pmid;
+
+    if (pmLookupName(1, (char **)&name, &pmid) < 0)
+	return;
+    if ((pmidlist = (pmID *)realloc(pmidlist, (numpmid + 1) * sizeof(pmID))) == NULL) {
+	fprintf(stderr, "%s: realloc failed\n", pmGetProgname());
+	exit(1);
+    }
+    pmidlist[numpmid++] = pmid;
+}
+
+static void
+dumpresult(pmResult *rp)
+{
+    pmDesc	desc;
+    char	*name;
+    int		i, j;
+
+    for (i = 0; i < rp->numpmid; i++) {
+	pmValueSet	*vsp = rp->vset[i];
+
+	if (pmNameID(vsp->pmid, &name) < 0)
+	    name = strdup(pmIDStr(vsp->pmid));
+	if (vsp->numval < 0) {
+	    printf("%s: %s\n", name, pmErrStr(vsp->numval));
+	    free(name);
+	    continue;
+	}
+	if (pmLookupDesc(vsp->pmid, &desc) < 0) {
+	    free(name);
+	    continue;
+	}
+	for (j = 0; j < vsp->numval; j++) {
+	    printf("%s[%d]:", name, vsp->vlist[j].inst);
+	    pmPrintValue(stdout, vsp->valfmt, desc.type, &vsp->vlist[j], 1);
+	    putchar('\n');
+	}
+	free(name);
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    pmLogLabel		label;
+    struct timeval	start;
+    pmResult		*rp;
+    struct timeval	delta = { 10, 0 };
+    char		*errmsg;
+    char		*expr;
+    int			verbose = 0;
+    int			reverse = 0;
+    int			reads;
+    int			samples = 10;
+    int			nvalues = 0;
+    int			pinned;
+    int			nfree;
+    int			c, i, j, sts;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "d:D:rs:t:v")) != EOF) {
+	switch (c) {
+	case 'd':
+	    if ((expr = strchr(optarg, '=')) == NULL) {
+		fprintf(stderr, "%s: bad derived metric: %s\n", pmGetProgname(), optarg);
+		exit(1);
+	    }
+	    *expr++ = '\0';
+	    if (pmRegisterDerivedMetric(optarg, expr, &errmsg) < 0) {
+		fprintf(stderr, "%s: %s", pmGetProgname(), errmsg);
+		free(errmsg);
+		exit(1);
+	    }
+	    break;
+	case 'D':
+	    if ((sts = pmSetDebug(optarg)) < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+		    pmGetProgname(), optarg);
+		exit(1);
+	    }
+	    break;
+	case 'r':
+	    reverse = 1;
+	    break;
+	case 's':
+	    samples = atoi(optarg);
+	    break;
+	case 't':
+	    delta.tv_sec = atoi(optarg);
+	    break;
+	case 'v':
+	    verbose = 1;
+	    break;
+	default:
+	    optind = argc;
+	    break;
+	}
+    }
+    if (optind >= argc) {
+	fprintf(stderr, "Usage: %s [-rv] [-d name=expr] [-D debug] [-s samples] [-t delta] archive [metric ...]\n", pmGetProgname());
+	exit(1);
+    }
+
+    if ((sts = pmNewContext(PM_CONTEXT_ARCHIVE, argv[optind])) < 0) {
+	fprintf(stderr, "%s: pmNewContext(%s): %s\n", pmGetProgname(),
+		argv[optind], pmErrStr(sts));
+	exit(1);
+    }
+    if ((sts = pmGetArchiveLabel(&label)) < 0) {
+	fprintf(stderr, "%s: pmGetArchiveLabel: %s\n", pmGetProgname(), pmErrStr(sts));
+	exit(1);
+    }
+    if (++optind == argc) {
+	if ((sts = pmTraversePMNS("", dometric)) < 0) {
+	    fprintf(stderr, "%s: pmTraversePMNS: %s\n", pmGetProgname(), pmErrStr(sts));
+	    exit(1);
+	}
+    }
+    for (; optind < argc; optind++)
+	dometric(argv[optind]);
+    if (numpmid == 0) {
+	fprintf(stderr, "%s: no metrics\n", pmGetProgname());
+	exit(1);
+    }
+
+    if (reverse) {
+	if ((sts = pmGetArchiveEnd(&start)) < 0) {
+	    fprintf(stderr, "%s: pmGetArchiveEnd: %s\n", pmGetProgname(), pmErrStr(sts));
+	    exit(1);
+	}
+	delta.tv_sec = -delta.tv_sec;
+    }
+    else
+	start = label.ll_start;
+    if ((sts = pmSetMode(PM_MODE_INTERP, &start, delta.tv_sec * 1000)) < 0) {
+	fprintf(stderr, "%s: pmSetMode: %s\n", pmGetProgname(), pmErrStr(sts));
+	exit(1);
+    }
+
+    reads = __pmLogReads;
+    for (i = 0; i < samples; i++) {
+	if ((sts = pmFetch(numpmid, pmidlist, &rp)) < 0) {
+	    if (sts != PM_ERR_EOL)
+		printf("pmFetch: %s\n", pmErrStr(sts));
+	    break;
+	}
+	if (verbose)
+	    dumpresult(rp);
+	for (j = 0; j < rp->numpmid; j++) {
+	    if (rp->vset[j]->numval > 0)
+		nvalues += rp->vset[j]->numval;
+	}
+	pmFreeResult(rp);
+    }
+    printf("%d samples, %d values\n", i, nvalues);
+    if (pmDebugOptions.interp)
+	fprintf(stderr, "%d log reads\n", __pmLogReads - reads);
+
+    /* the archive read cache is the only other holder of PDU buffers */
+    pmDestroyContext(pmWhichContext());
+    __pmCountPDUBuf(0, &pinned, &nfree);
+    printf("%d PDU buffers still pinned\n", pinned);
+
+    return 0;
+}
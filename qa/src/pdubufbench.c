@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2020 Red Hat.
+ *
+ * Microbenchmark for PDU buffer allocation ... compares the libpcp
+ * __pmFindPDUBuf() pool with the malloc(3) + tsearch(3) scheme libpcp
+ * used previously (reproduced here), using the same mix of buffer sizes
+ * and pin/unpin calls (including interior pointers and pointers that are
+ * not PDU buffers at all, as __pmFreeResultValues() does).
+ */
+
+#include <pcp/pmapi.h>
+#include "libpcp.h"
+#include <pthread.h>
+#include <search.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+static int	sizes[] = { 24, 100, 380, 1200, 2100, 6000, 20000 };
+#define NSIZES	(sizeof(sizes) / sizeof(sizes[0]))
+#define BATCH	16		/* buffers held at once by each thread */
+
+static int	iterations = 100000;
+static int	nthreads = 1;
+static int	quiet;
+static int	errors;		/* protected by tree_lock */
+
+/*
+ * The old allocator: every buffer is malloc'd and found again via a
+ * tree of address ranges.
+ */
+typedef struct {
+    int		bc_pincnt;
+    int		bc_size;
+    char	*bc_buf;
+} bufctl_t;
+
+static void		*tree;
+static pthread_mutex_t	tree_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int
+tree_compare(const void *a, const void *b)
+{
+    const bufctl_t *aa = (const bufctl_t *)a;
+    const bufctl_t *bb = (const bufctl_t *)b;
+
+    if ((uintptr_t)&aa->bc_buf[aa->bc_size-1] < (uintptr_t)&bb->bc_buf[0])
+	return -1;
+    if ((uintptr_t)&bb->bc_buf[bb->bc_size-1] < (uintptr_t)&aa->bc_buf[0])
+	return 1;
+    return 0;
+}
+
+static void *
+tree_find(int need)
+{
+    bufctl_t	*pcp;
+
+    if ((pcp = (bufctl_t *)malloc(sizeof(*pcp) + need)) == NULL)
+	return NULL;
+    pcp->bc_pincnt = 1;
+    pcp->bc_size = need;
+    pcp->bc_buf = (char *)pcp + sizeof(*pcp);
+    pthread_mutex_lock(&tree_lock);
+    tsearch(pcp, &tree, tree_compare);
+    pthread_mutex_unlock(&tree_lock);
+    return pcp->bc_buf;
+}
+
+static void
+tree_pin(void *handle)
+{
+    bufctl_t	search, **bcp;
+
+    search.bc_buf = handle;
+    search.bc_size = 1;
+    pthread_mutex_lock(&tree_lock);
+    if ((bcp = (bufctl_t **)tfind(&search, &tree, tree_compare)) != NULL)
+	(*bcp)->bc_pincnt++;
+    pthread_mutex_unlock(&tree_lock);
+}
+
+static int
+tree_unpin(void *handle)
+{
+    bufctl_t	search, **bcp, *pcp;
+
+    search.bc_buf = handle;
+    search.bc_size = 1;
+    pthread_mutex_lock(&tree_lock);
+    if ((bcp = (bufctl_t **)tfind(&search, &tree, tree_compare)) == NULL) {
+	pthread_mutex_unlock(&tree_lock);
+	return 0;
+    }
+    pcp = *bcp;
+    if (--pcp->bc_pincnt == 0) {
+	tdelete(pcp, &tree, tree_compare);
+	pthread_mutex_unlock(&tree_lock);
+	free(pcp);
+    }
+    else
+	pthread_mutex_unlock(&tree_lock);
+    return 1;
+}
+
+static void *
+pool_find(int need)
+{
+    return __pmFindPDUBuf(need);
+}
+
+typedef struct {
+    const char	*name;
+    void	*(*find)(int);
+    void	(*pin)(void *);
+    int		(*unpin)(void *);
+} allocator_t;
+
+static allocator_t	allocators[] = {
+    { "malloc+tsearch", tree_find, tree_pin, tree_unpin },
+    { "pool", pool_find, __pmPinPDUBuf, __pmUnpinPDUBuf },
+};
+
+static void
+fail(const char *msg)
+{
+    pthread_mutex_lock(&tree_lock);
+    errors++;
+    pthread_mutex_unlock(&tree_lock);
+    if (!quiet)
+	fprintf(stderr, "Error: %s\n", msg);
+}
+
+static void *
+worker(void *arg)
+{
+    allocator_t	*ap = (allocator_t *)arg;
+    char	*bufs[BATCH];
+    int		need[BATCH];
+    int		notbuf[4];	/* never a PDU buffer */
+    int		i, j, k = 0;
+
+    for (i = 0; i < iterations; i += BATCH) {
+	for (j = 0; j < BATCH; j++) {
+	    need[j] = sizes[k++ % NSIZES];
+	    if ((bufs[j] = ap->find(need[j])) == NULL) {
+		fail("find");
+		return NULL;
+	    }
+	    bufs[j][0] = bufs[j][need[j]-1] = j;
+	}
+	for (j = 0; j < BATCH; j++) {
+	    /* pin via an interior pointer, as for a vset in a result */
+	    ap->pin(&bufs[j][(need[j] / 2) & ~(sizeof(int)-1)]);
+	    if (ap->unpin(notbuf) != 0)
+		fail("unpin of non-buffer succeeded");
+	}
+	for (j = 0; j < BATCH; j++) {
+	    if (bufs[j][0] != j || bufs[j][need[j]-1] != j)
+		fail("buffer trampled");
+	    if (ap->unpin(&bufs[j][need[j] & ~(sizeof(int)-1)]) != 0)
+		fail("unpin beyond buffer succeeded");
+	    if (ap->unpin(bufs[j]) != 1 || ap->unpin(bufs[j]) != 1)
+		fail("unpin failed");
+	}
+    }
+    return NULL;
+}
+
+static double
+run(allocator_t *ap)
+{
+    pthread_t		*tid;
+    struct timeval	start, end;
+    int			i;
+
+    if ((tid = (pthread_t *)malloc(nthreads * sizeof(pthread_t))) == NULL) {
+	fprintf(stderr, "malloc failed\n");
+	exit(1);
+    }
+    gettimeofday(&start, NULL);
+    for (i = 0; i < nthreads; i++) {
+	if (pthread_create(&tid[i], NULL, worker, ap) != 0) {
+	    fprintf(stderr, "pthread_create failed\n");
+	    exit(1);
+	}
+    }
+    for (i = 0; i < nthreads; i++)
+	pthread_join(tid[i], NULL);
+    gettimeofday(&end, NULL);
+    free(tid);
+    return pmtimevalSub(&end, &start);
+}
+
+int
+main(int argc, char **argv)
+{
+    allocator_t	*ap;
+    double	secs;
+    long	ops;
+    int		alloced, nfree;
+    int		c, i;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "i:qt:")) != EOF) {
+	switch (c) {
+	case 'i':
+	    iterations = atoi(optarg);
+	    break;
+	case 'q':
+	    quiet = 1;
+	    break;
+	case 't':
+	    nthreads = atoi(optarg);
+	    break;
+	default:
+	    fprintf(stderr, "Usage: %s [-q] [-i iterations] [-t threads]\n",
+		    pmGetProgname());
+	    exit(1);
+	}
+    }
+    if (iterations < BATCH || nthreads < 1) {
+	fprintf(stderr, "%s: need at least %d iterations and 1 thread\n",
+		pmGetProgname(), BATCH);
+	exit(1);
+    }
+
+    /* each buffer is found, pinned and unpinned twice */
+    ops = (long)((iterations + BATCH - 1) / BATCH) * BATCH * nthreads;
+    for (i = 0; i < sizeof(allocators) / sizeof(allocators[0]); i++) {
+	ap = &allocators[i];
+	secs = run(ap);
+	if (quiet)
+	    printf("%s: done\n", ap->name);
+	else
+	    printf("%s: %ld buffers in %.3f sec, %.1f nsec/buffer\n",
+		    ap->name, ops, secs, secs * 1e9 / ops);
+    }
+
+    __pmCountPDUBuf(0, &alloced, &nfree);
+    printf("pool: %d buffers still pinned\n", alloced);
+    printf("errors: %d\n", errors);
+
+    return errors != 0;
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2020 Red Hat.
+ *
+ * pmcd with a slow PMDA ... the caller has stopped the sample PMDA,
+ * one client has fetches outstanding for it, and another client's
+ * fetch from a different agent must not wait for them.  Once the
+ * command from -c has resumed the sample PMDA, the first client's
+ * replies must arrive in the order the requests were made.
+ */
+
+#include <pcp/pmapi.h>
+#include <sys/time.h>
+
+static char *names[] = { "sample.long.one", "pmcd.numagents" };
+#define SLOW	0
+#define FAST	1
+
+static pmID	pmids[2];
+static int	nextseq = 1;	/* expected in the next callback */
+
+static void
+callback(int handle, int seq, int sts, pmResult *rp, void *data)
+{
+    int		which = *(int *)data;
+
+    free(data);
+    printf("reply %d: %s", seq, names[which]);
+    if (seq != nextseq)
+	printf(" out of order, expected %d", nextseq);
+    nextseq = seq + 1;
+    if (sts < 0)
+	printf(": %s\n", pmErrStr(sts));
+    else {
+	if (rp->vset[0]->pmid != pmids[which])
+	    printf(" wrong metric");
+	printf(" numval %d\n", rp->vset[0]->numval);
+	pmFreeResult(rp);
+    }
+}
+
+static int
+request(int which)
+{
+    int		*data;
+    int		seq;
+
+    data = (int *)malloc(sizeof(int));
+    *data = which;
+    if ((seq = pmFetchAsync(1, &pmids[which], callback, data)) < 0) {
+	printf("pmFetchAsync(%s): %s\n", names[which], pmErrStr(seq));
+	free(data);
+	exit(1);
+    }
+    return seq;
+}
+
+int
+main(int argc, char **argv)
+{
+    const char		*host = "local:";
+    const char		*command = NULL;
+    struct timeval	start, end;
+    pmResult		*rp;
+    double		elapsed;
+    int			slow, fast;
+    int			c, n, sts;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "c:D:h:")) != EOF) {
+	switch (c) {
+	case 'c':
+	    command = optarg;
+	    break;
+	case 'D':
+	    if (pmSetDebug(optarg) < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+			pmGetProgname(), optarg);
+		exit(1);
+	    }
+	    break;
+	case 'h':
+	    host = optarg;
+	    break;
+	default:
+	    c = '?';
+	    break;
+	}
+	if (c == '?')
+	    break;
+    }
+    if (c == '?' || command == NULL || optind != argc) {
+	fprintf(stderr, "Usage: %s [-D debug] [-h host] -c command\n",
+		pmGetProgname());
+	exit(1);
+    }
+
+    /* two clients of pmcd, each with its own connection */
+    if ((slow = pmNewContext(PM_CONTEXT_HOST, host)) < 0 ||
+	(fast = pmNewContext(PM_CONTEXT_HOST, host)) < 0) {
+	fprintf(stderr, "%s: pmNewContext(%s): %s\n", pmGetProgname(), host,
+		pmErrStr(slow < 0 ? slow : fast));
+	exit(1);
+    }
+    if ((sts = pmLookupName(2, names, pmids)) < 0) {
+	fprintf(stderr, "%s: pmLookupName: %s\n", pmGetProgname(), pmErrStr(sts));
+	exit(1);
+    }
+
+    /* sample PMDA first, then pmcd, from the same client */
+    pmUseContext(slow);
+    request(SLOW);
+    request(FAST);
+
+    /* the other client is not held up by the stopped sample PMDA */
+    pmUseContext(fast);
+    gettimeofday(&start, NULL);
+    if ((sts = pmFetch(1, &pmids[FAST], &rp)) < 0)
+	printf("other client: %s\n", pmErrStr(sts));
+    else {
+	gettimeofday(&end, NULL);
+	elapsed = pmtimevalSub(&end, &start);
+	if (elapsed < 2.0)
+	    printf("other client: fetch completed promptly\n");
+	else
+	    printf("other client: fetch took %.1f sec\n", elapsed);
+	pmFreeResult(rp);
+    }
+
+    /* and the first client's pmcd reply is behind the sample one */
+    printf("replies before resuming: %d\n", pmFetchAsyncComplete(slow, 0));
+
+    fflush(stdout);
+    if ((sts = system(command)) != 0)
+	printf("%s: exit status %d\n", command, sts);
+
+    for (n = 0; n < 2; n += sts) {
+	if ((sts = pmFetchAsyncComplete(slow, 1)) <= 0) {
+	    printf("pmFetchAsyncComplete: %s\n", sts < 0 ? pmErrStr(sts) : "no callbacks");
+	    break;
+	}
+    }
+
+    return 0;
+}
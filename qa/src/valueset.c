@@ -0,0 +1,339 @@
+/*
+ * Copyright (c) 2020 Red Hat.
+ *
+ * pmExtractValueSet(), pmExtractValueSet64(), pmConvScaleFactor() and
+ * pmRateValues() ... results must match pmExtractValue() and
+ * pmConvScale() one value at a time.
+ *
+ * With -b, time both ways of converting a synthetic pmValueSet with
+ * that many instances, instead.
+ *
+ * Usage: valueset [-b instances] [-h host]
+ */
+
+#include <pcp/pmapi.h>
+#include <sys/time.h>
+
+static char *names[] = {
+    "sample.long.bin", "sample.ulong.bin", "sample.longlong.bin",
+    "sample.ulonglong.bin_ctr", "sample.float.bin", "sample.double.bin_ctr",
+    "sample.scramble.bin", "sample.string.bin",
+};
+#define NMETRIC (sizeof(names) / sizeof(names[0]))
+
+static int	errors;
+
+static void
+fail(const char *name, const char *msg, int i)
+{
+    if (errors++ < 20)
+	printf("Error: %s [%d]: %s\n", name, i, msg);
+}
+
+static void
+check_factor(const char *iunits, const char *ounits)
+{
+    pmUnits	iu, ou;
+    pmAtomValue	one, scaled;
+    double	factor, mult;
+    char	*errmsg;
+    int		sts;
+
+    if (pmParseUnitsStr(iunits, &iu, &mult, &errmsg) < 0 ||
+	pmParseUnitsStr(ounits, &ou, &mult, &errmsg) < 0) {
+	printf("%s -> %s: %s\n", iunits, ounits, errmsg);
+	free(errmsg);
+	return;
+    }
+    if ((sts = pmConvScaleFactor(&iu, &ou, &factor)) < 0) {
+	printf("%s -> %s: %s\n", iunits, ounits, pmErrStr(sts));
+	return;
+    }
+    one.d = 1.0;
+    pmConvScale(PM_TYPE_DOUBLE, &one, &iu, &scaled, &ou);
+    printf("%s -> %s: %g%s\n", iunits, ounits, factor,
+		factor == scaled.d ? "" : " (differs from pmConvScale)");
+}
+
+static void
+check_valueset(const char *name, const pmDesc *desc, const pmValueSet *vsp)
+{
+    double	values[16];
+    __int64_t	values64[16];
+    int		insts[16];
+    pmAtomValue	a;
+    int		i, n, sts;
+
+    n = pmExtractValueSet(vsp, desc->type, 0.5, insts, values, 16);
+    if (n < 0) {
+	printf("%s: pmExtractValueSet: %s\n", name, pmErrStr(n));
+	return;
+    }
+    if (n != vsp->numval)
+	fail(name, "numval", n);
+    for (i = 0; i < n; i++) {
+	if (insts[i] != vsp->vlist[i].inst)
+	    fail(name, "inst", i);
+	pmExtractValue(vsp->valfmt, &vsp->vlist[i], desc->type, &a, PM_TYPE_DOUBLE);
+	if (values[i] != a.d * 0.5)
+	    fail(name, "double value", i);
+    }
+    if (n > 0 && pmExtractValueSet(vsp, desc->type, 1.0, NULL, values, n - 1) != PM_ERR_TOOBIG)
+	fail(name, "not too big", n - 1);
+
+    sts = pmExtractValueSet64(vsp, desc->type, NULL, values64, 16);
+    if (desc->type == PM_TYPE_FLOAT || desc->type == PM_TYPE_DOUBLE) {
+	if (sts != PM_ERR_CONV)
+	    fail(name, "pmExtractValueSet64 of floating point", sts);
+    }
+    else {
+	for (i = 0; i < sts; i++) {
+	    pmExtractValue(vsp->valfmt, &vsp->vlist[i], desc->type, &a,
+			desc->type == PM_TYPE_U64 ? PM_TYPE_U64 : PM_TYPE_64);
+	    if (values64[i] != a.ll)
+		fail(name, "64-bit value", i);
+	}
+    }
+    printf("%s: checked\n", name);	/* NB: numval varies for scramble */
+}
+
+static void
+check_rates(void)
+{
+    /* previous values, in a different order */
+    int		pinsts[] = { 3, 1, 2, 5 };
+    double	pvalues[] = { 30, 4294967290.0, 20, 50 };
+    int		insts[] = { 1, 2, 3, 4, 5 };
+    double	values[5];
+    double	current[] = { 5, 26, 36, 40, 10 };
+    int		stss[5];
+    int		i, n, wrap;
+
+    for (wrap = 0; wrap < 2; wrap++) {
+	memcpy(values, current, sizeof(values));
+	n = pmRateValues(PM_TYPE_U32, 2.0, wrap, 10.0, 5, insts, values,
+			4, pinsts, pvalues, stss);
+	printf("rates, wrap %d: %d computed\n", wrap, n);
+	for (i = 0; i < 5; i++) {
+	    if (stss[i] < 0)
+		printf("    inst %d: %s\n", insts[i], pmErrStr(stss[i]));
+	    else
+		printf("    inst %d: %g\n", insts[i], values[i]);
+	}
+    }
+}
+
+/*
+ * Compare an indom fetchgroup (with rate and unit conversion for all
+ * instances at once) against pmfg items, one per instance.
+ */
+static void
+check_fetchgroup(const char *host)
+{
+    static char	*iname[] = {
+	"bin-100", "bin-200", "bin-300", "bin-400", "bin-500",
+	"bin-600", "bin-700", "bin-800", "bin-900",
+    };
+    pmFG	fg;
+    pmAtomValue	values[9], item_values[9];
+    int		stss[9], item_stss[9], insts[9];
+    unsigned	i, n;
+    int		round, sts;
+
+    if ((sts = pmCreateFetchGroup(&fg, PM_CONTEXT_HOST, host)) < 0) {
+	printf("pmCreateFetchGroup: %s\n", pmErrStr(sts));
+	return;
+    }
+    if ((sts = pmExtendFetchGroup_indom(fg, "sample.ulonglong.bin_ctr",
+			"Mbyte/min", insts, NULL, values, PM_TYPE_DOUBLE,
+			stss, 9, &n, NULL)) < 0) {
+	printf("pmExtendFetchGroup_indom: %s\n", pmErrStr(sts));
+	return;
+    }
+    for (i = 0; i < 9; i++) {
+	if ((sts = pmExtendFetchGroup_item(fg, "sample.ulonglong.bin_ctr",
+			iname[i], "Mbyte/min", &item_values[i], PM_TYPE_DOUBLE,
+			&item_stss[i])) < 0) {
+	    printf("pmExtendFetchGroup_item: %s\n", pmErrStr(sts));
+	    return;
+	}
+    }
+    for (round = 0; round < 3; round++) {
+	if ((sts = pmFetchGroup(fg)) < 0)
+	    printf("pmFetchGroup: %s\n", pmErrStr(sts));
+	for (i = 0; i < n; i++) {
+	    if (stss[i] != item_stss[(insts[i] / 100) - 1])
+		fail("fetchgroup", "status", i);
+	    else if (stss[i] == 0 &&
+		     values[i].d != item_values[(insts[i] / 100) - 1].d)
+		fail("fetchgroup", "value", i);
+	}
+	printf("fetchgroup round %d: %u instances, %s\n", round, n,
+		pmErrStr(stss[0]));
+    }
+    pmDestroyFetchGroup(fg);
+}
+
+static double
+since(struct timeval *start)
+{
+    struct timeval	now;
+
+    gettimeofday(&now, NULL);
+    return pmtimevalSub(&now, start);
+}
+
+/*
+ * Timings for numinst PM_TYPE_U64 counter values, converted one at a
+ * time (searching for each previous value, as pmfetchgroup(3) used to)
+ * and in a batch.
+ */
+static void
+benchmark(int numinst)
+{
+    pmValueSet		*vsp, *pvsp;
+    pmValueBlock	*vbp;
+    pmUnits		iu, ou;
+    pmAtomValue		a, b;
+    struct timeval	start;
+    double		*values, *pvalues, factor, sum;
+    int			*insts, *pinsts, *stss;
+    int			i, j, k, loops;
+    __uint64_t		v;
+
+    memset(&iu, 0, sizeof(iu));
+    iu.dimSpace = 1;
+    iu.scaleSpace = PM_SPACE_KBYTE;
+    ou = iu;
+    ou.scaleSpace = PM_SPACE_MBYTE;
+
+    vsp = (pmValueSet *)malloc(sizeof(pmValueSet) + numinst * sizeof(pmValue));
+    pvsp = (pmValueSet *)malloc(sizeof(pmValueSet) + numinst * sizeof(pmValue));
+    values = (double *)malloc(2 * numinst * sizeof(double));
+    pvalues = values + numinst;
+    insts = (int *)malloc(3 * numinst * sizeof(int));
+    pinsts = insts + numinst;
+    stss = pinsts + numinst;
+    vsp->numval = pvsp->numval = numinst;
+    vsp->valfmt = pvsp->valfmt = PM_VAL_DPTR;
+    for (i = 0; i < numinst; i++) {
+	vbp = (pmValueBlock *)malloc(PM_VAL_HDR_SIZE + sizeof(v));
+	vbp->vtype = PM_TYPE_U64;
+	vbp->vlen = PM_VAL_HDR_SIZE + sizeof(v);
+	v = 1000 * (i + 1);
+	memcpy(vbp->vbuf, &v, sizeof(v));
+	vsp->vlist[i].inst = i;
+	vsp->vlist[i].value.pval = vbp;
+	vbp = (pmValueBlock *)malloc(PM_VAL_HDR_SIZE + sizeof(v));
+	vbp->vtype = PM_TYPE_U64;
+	vbp->vlen = PM_VAL_HDR_SIZE + sizeof(v);
+	v = 500 * (i + 1);
+	memcpy(vbp->vbuf, &v, sizeof(v));
+	pvsp->vlist[i].inst = i;
+	pvsp->vlist[i].value.pval = vbp;
+    }
+    loops = 10000000 / numinst;
+    if (loops < 1)
+	loops = 1;
+
+    gettimeofday(&start, NULL);
+    for (k = 0, sum = 0; k < loops; k++) {
+	for (i = 0; i < numinst; i++) {
+	    pmExtractValue(vsp->valfmt, &vsp->vlist[i], PM_TYPE_U64, &a, PM_TYPE_DOUBLE);
+	    for (j = 0; j < numinst; j++) {
+		if (pvsp->vlist[j].inst == vsp->vlist[i].inst)
+		    break;
+	    }
+	    pmExtractValue(pvsp->valfmt, &pvsp->vlist[j], PM_TYPE_U64, &b, PM_TYPE_DOUBLE);
+	    a.d = (a.d - b.d) / 10.0;
+	    pmConvScale(PM_TYPE_DOUBLE, &a, &iu, &b, &ou);
+	    sum += b.d;
+	}
+    }
+    printf("%d instances: one at a time %.0f values/sec\n", numinst,
+		(double)loops * numinst / since(&start));
+
+    gettimeofday(&start, NULL);
+    for (k = 0; k < loops; k++) {
+	pmConvScaleFactor(&iu, &ou, &factor);
+	pmExtractValueSet(vsp, PM_TYPE_U64, 1.0, insts, values, numinst);
+	pmExtractValueSet(pvsp, PM_TYPE_U64, 1.0, pinsts, pvalues, numinst);
+	pmRateValues(PM_TYPE_U64, 10.0, 0, factor, numinst, insts, values,
+			numinst, pinsts, pvalues, stss);
+    }
+    printf("%d instances: batch %.0f values/sec\n", numinst,
+		(double)loops * numinst / since(&start));
+
+    for (i = 0; i < numinst; i++) {
+	a.d = (1000.0 - 500.0) * (i + 1) / 10.0 / 1024;
+	if (stss[i] != 0 || values[i] != a.d)
+	    fail("benchmark", "rate", i);
+    }
+    printf("errors: %d\n", errors);
+}
+
+int
+main(int argc, char **argv)
+{
+    const char	*host = "local:";
+    pmDesc	descs[NMETRIC];
+    pmID	pmids[NMETRIC];
+    pmResult	*rp;
+    int		numinst = 0;
+    int		c, i, sts;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "b:h:")) != EOF) {
+	switch (c) {
+	case 'b':
+	    numinst = atoi(optarg);
+	    break;
+	case 'h':
+	    host = optarg;
+	    break;
+	default:
+	    fprintf(stderr, "Usage: %s [-b instances] [-h host]\n", pmGetProgname());
+	    exit(1);
+	}
+    }
+
+    if (numinst > 0) {
+	benchmark(numinst);
+	return errors != 0;
+    }
+
+    check_factor("Kbyte", "Mbyte");
+    check_factor("Kbyte / sec", "Mbyte / hour");
+    check_factor("nanosec", "millisec");
+    check_factor("count x 10^3", "count");
+    check_factor("byte", "sec");
+
+    if ((sts = pmNewContext(PM_CONTEXT_HOST, host)) < 0) {
+	fprintf(stderr, "%s: pmNewContext(%s): %s\n", pmGetProgname(), host, pmErrStr(sts));
+	exit(1);
+    }
+    if ((sts = pmLookupName(NMETRIC, names, pmids)) < 0) {
+	fprintf(stderr, "%s: pmLookupName: %s\n", pmGetProgname(), pmErrStr(sts));
+	exit(1);
+    }
+    for (i = 0; i < NMETRIC; i++) {
+	if ((sts = pmLookupDesc(pmids[i], &descs[i])) < 0) {
+	    fprintf(stderr, "%s: pmLookupDesc(%s): %s\n", pmGetProgname(), names[i], pmErrStr(sts));
+	    exit(1);
+	}
+    }
+    if ((sts = pmFetch(NMETRIC, pmids, &rp)) < 0) {
+	fprintf(stderr, "%s: pmFetch: %s\n", pmGetProgname(), pmErrStr(sts));
+	exit(1);
+    }
+    for (i = 0; i < NMETRIC; i++)
+	check_valueset(names[i], &descs[i], rp->vset[i]);
+    pmFreeResult(rp);
+
+    check_rates();
+    check_fetchgroup(host);
+
+    printf("errors: %d\n", errors);
+    return errors != 0;
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2020 Red Hat.
+ *
+ * Read a zstd compressed file with __pmFopen() while it grows, as for
+ * an archive volume being compressed as it is written.
+ *
+ * Usage: zstdgrow file.zst frame1.zst frame2.zst ...
+ *
+ * Each frame file holds one zstd frame of printable text.  The first
+ * frame is written before the open, and each subsequent frame is
+ * appended in two halves, reading after each, so the reader sees an
+ * incomplete trailing frame and then the complete one.
+ */
+
+#include <pcp/pmapi.h>
+#include "libpcp.h"
+
+static int	wfd;
+
+static void
+append(const char *buf, size_t len)
+{
+    if (write(wfd, buf, len) != len) {
+	fprintf(stderr, "%s: write failed: %s\n", pmGetProgname(), strerror(errno));
+	exit(1);
+    }
+    printf("append %zd compressed bytes\n", len);
+}
+
+static void
+doread(__pmFILE *f)
+{
+    char	buf[256];
+    size_t	n;
+
+    memset(buf, 0, sizeof(buf));
+    n = __pmFread(buf, 1, sizeof(buf) - 1, f);
+    printf("read -> %zd \"%s\" tell=%ld eof=%d\n",
+	    n, buf, __pmFtell(f), __pmFeof(f) != 0);
+    __pmClearerr(f);
+}
+
+static size_t
+slurp(const char *name, char *buf, size_t size)
+{
+    FILE	*fp;
+    size_t	n;
+
+    if ((fp = fopen(name, "r")) == NULL) {
+	fprintf(stderr, "%s: fopen(%s): %s\n", pmGetProgname(), name, strerror(errno));
+	exit(1);
+    }
+    n = fread(buf, 1, size, fp);
+    fclose(fp);
+    return n;
+}
+
+int
+main(int argc, char **argv)
+{
+    __pmFILE	*f;
+    struct stat	sbuf;
+    char	buf[4096];
+    size_t	n;
+    int		i;
+
+    pmSetProgname(argv[0]);
+
+    if (argc < 3) {
+	fprintf(stderr, "Usage: %s file.zst frame.zst ...\n", pmGetProgname());
+	exit(1);
+    }
+    if ((wfd = open(argv[1], O_WRONLY|O_CREAT|O_TRUNC, 0644)) < 0) {
+	fprintf(stderr, "%s: open(%s): %s\n", pmGetProgname(), argv[1], strerror(errno));
+	exit(1);
+    }
+
+    n = slurp(argv[2], buf, sizeof(buf));
+    append(buf, n);
+    if ((f = __pmFopen(argv[1], "r")) == NULL) {
+	fprintf(stderr, "%s: __pmFopen(%s): %s\n", pmGetProgname(), argv[1], strerror(errno));
+	exit(1);
+    }
+    doread(f);
+    for (i = 3; i < argc; i++) {
+	n = slurp(argv[i], buf, sizeof(buf));
+	append(buf, n / 2);
+	doread(f);
+	append(&buf[n / 2], n - n / 2);
+	doread(f);
+    }
+
+    __pmRewind(f);
+    doread(f);
+    if (__pmFseek(f, -5, SEEK_END) == 0)
+	doread(f);
+    if (__pmFstat(f, &sbuf) == 0)
+	printf("fstat: size=%ld\n", (long)sbuf.st_size);
+    printf("close -> %d\n", __pmFclose(f));
+    close(wfd);
+
+    return 0;
+}
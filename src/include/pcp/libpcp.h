@@ -173,6 +173,11 @@ typedef struct __pmnsTree {
     __pmnsNode		**htab; /* hash table of nodes keyed on pmid */
     int			htabsize;     /* number of nodes in the table */
     int			mark_state;   /* the total mark value for trimming */
+    __pmnsNode		**ctab; /* open hash of nodes keyed on parent and name */
+    int			ctabsize;     /* number of slots, power of 2 */
+    int			ctabused;     /* number of nodes in the table */
+    void		*image; /* mapped binary PMNS image, if loaded from one */
+    size_t		imagesize;
 } __pmnsTree;
 
 /* used by pmnsmerge/pmnsdel */
@@ -184,6 +189,9 @@ PCP_CALL extern void __pmUsePMNS(__pmnsTree *); /* for debugging */
 PCP_CALL extern int __pmFixPMNSHashTab(__pmnsTree *, int, int);
 PCP_CALL extern int __pmAddPMNSNode(__pmnsTree *, int, const char *);
 
+/* binary PMNS image of an ASCII PMNS file, for pmnsmerge/pmnsdel */
+PCP_CALL extern int __pmWritePMNSImage(const char *, __pmnsNode *);
+
 /* return true if the named pmns file has changed */
 PCP_CALL extern int __pmHasPMNSFileChanged(const char *);
 
@@ -284,6 +292,7 @@ typedef struct {
 #define PDU_FLAG_CERT_REQD	(1U<<7)
 #define PDU_FLAG_BAD_LABEL	(1U<<8)	/* bad, encoding issues */
 #define PDU_FLAG_LABELS		(1U<<9)
+#define PDU_FLAG_PROFILES	(1U<<10) /* PMDA keeps per-context profiles */
 /* Credential CVERSION PDU elements look like this */
 typedef struct {
 #ifdef HAVE_BITFIELDS_LTOR
@@ -407,6 +416,23 @@ PCP_DATA extern unsigned int *__pmPDUCntIn;
 PCP_DATA extern unsigned int *__pmPDUCntOut;
 PCP_CALL extern void __pmSetPDUCntBuf(unsigned *, unsigned *);
 
+/*
+ * Result arena ... the pmValueSets and pmValueBlocks of a pmResult
+ * built in one pinned PDU buffer, sized up front, so that building the
+ * result does no per-value allocation and pmFreeResult() releases the
+ * lot with a single unpin.  Every vset[] of the result must come from
+ * the arena.
+ */
+typedef struct {
+    char	*base;
+    size_t	size;
+    size_t	used;
+} __pmResultArena;
+#define __PM_ARENA_ALIGN(n)	(((n) + 7) & ~((size_t)7))
+PCP_CALL extern int __pmResultArenaInit(__pmResultArena *, size_t);
+PCP_CALL extern void *__pmResultArenaAlloc(__pmResultArena *, size_t);
+PCP_CALL extern void __pmResultArenaDone(__pmResultArena *);
+
 /* internal IPC protocol stuff */
 typedef int (*__pmConnectHostType)(int, int);
 PCP_CALL extern int __pmSetSocketIPC(int);
@@ -503,6 +529,42 @@ PCP_CALL extern int __pmHashAdd(unsigned int, void *, __pmHashCtl *);
 PCP_CALL extern int __pmHashDel(unsigned int, void *, __pmHashCtl *);
 PCP_CALL extern void __pmHashClear(__pmHashCtl *);
 
+/*
+ * Open addressing (Robin Hood) variant of the above, with the nodes held
+ * inline in a power-of-two sized table that grows incrementally.  The
+ * interfaces mirror the __pmHash* ones, except that a node returned by
+ * __pmOHashSearch or __pmOHashWalk is only valid until the next add or
+ * delete (other than deleting that node during a walk), node->next is
+ * not used and __pmOHashClear releases all the nodes.
+ */
+typedef struct __pmOHashSlot {
+    __pmHashNode	node;
+    unsigned int	dist;		/* probe distance + 1, 0 if empty */
+} __pmOHashSlot;
+typedef struct __pmOHashTab {
+    __pmOHashSlot	*slot;
+    unsigned int	size;		/* power of two, or zero */
+    unsigned int	used;
+} __pmOHashTab;
+typedef struct __pmOHashCtl {
+    int			nodes;
+    __pmOHashTab	cur;
+    __pmOHashTab	old;		/* being moved into cur after growth */
+    unsigned int	mindex;		/* next old slot to move */
+    unsigned int	mcount;		/* old slots still to visit */
+    unsigned int	wtab;		/* __pmOHashWalk position */
+    unsigned int	wstart;
+    unsigned int	wcount;
+} __pmOHashCtl;
+PCP_CALL extern void __pmOHashInit(__pmOHashCtl *);
+PCP_CALL extern int __pmOHashPreAlloc(int, __pmOHashCtl *);
+PCP_CALL extern void __pmOHashWalkCB(__pmHashWalkCallback, void *, __pmOHashCtl *);
+PCP_CALL extern __pmHashNode *__pmOHashWalk(__pmOHashCtl *, __pmHashWalkState);
+PCP_CALL extern __pmHashNode *__pmOHashSearch(unsigned int, __pmOHashCtl *);
+PCP_CALL extern int __pmOHashAdd(unsigned int, void *, __pmOHashCtl *);
+PCP_CALL extern int __pmOHashDel(unsigned int, void *, __pmOHashCtl *);
+PCP_CALL extern void __pmOHashClear(__pmOHashCtl *);
+
 
 /*
  * Host specification allowing one or more pmproxy host, and port numbers
@@ -597,6 +659,7 @@ typedef struct {
     int			pc_timeout;	/* set if connect times out */
     int			pc_tout_sec;	/* timeout for __pmGetPDU */
     time_t		pc_again;	/* time to try again */
+    void		*pc_async;	/* pmFetchAsync() requests, if any */
 } __pmPMCDCtl;
 PCP_CALL extern int __pmAuxConnectPMCDPort(const char *, int);
 
@@ -658,6 +721,11 @@ typedef struct __pmLogHdr {
  * as well as buffer allocation, 
  * the namelist has been allocated separately and so
  * both the buf and namelist should be freed.
+ * (4)
+ * buf is NULL, allinbuf == 1,
+ * instlist and namelist are shared with the previous
+ * version of the same instance domain, so nothing
+ * should be freed.
  */
 typedef struct __pmLogInDom {
     struct __pmLogInDom	*next;
@@ -747,6 +815,7 @@ typedef struct {
     int		l_state;	/* (when writing) log state */
     __pmHashCtl	l_hashpmid;	/* PMID hashed access */
     __pmHashCtl	l_hashindom;	/* instance domain hashed access */
+    __pmOHashCtl l_hashindomtime; /* ... and in time order, for searching */
     __pmHashCtl	l_hashrange;	/* ptr to first and last value in log for */
 				/* each metric */
     __pmHashCtl	l_hashlabels;	/* maps the various metadata label types */
@@ -790,12 +859,12 @@ typedef struct {
     long		ac_offset;	/* fseek ptr for archives */
     int			ac_vol;		/* volume for ac_offset */
     int			ac_serial;	/* serial access pattern for archives */
-    __pmHashCtl		ac_pmid_hc;	/* per PMID controls for INTERP */
+    __pmOHashCtl	ac_pmid_hc;	/* per PMID controls for INTERP */
     double		ac_end;		/* time at end of archive */
     void		*ac_want;	/* used in interp.c */
     void		*ac_unbound;	/* used in interp.c */
     void		*ac_cache;	/* used in interp.c */
-    int			ac_cache_idx;	/* used in interp.c */
+    int			ac_cache_idx;	/* no longer used */
     /*
      * These were added to the ABI in order to support multiple archives
      * in a single context.
@@ -837,6 +906,7 @@ typedef struct {
 PCP_CALL extern int __pmLogChkLabel(__pmArchCtl *, __pmFILE *, __pmLogLabel *, int);
 PCP_CALL extern int __pmLogCreate(const char *, const char *, int, __pmArchCtl *);
 PCP_CALL extern __pmFILE *__pmLogNewFile(const char *, int);
+PCP_CALL extern int __pmLogSetCompress(const char *);
 PCP_CALL extern void __pmLogClose(__pmArchCtl *);
 PCP_CALL extern int __pmLogPutDesc(__pmArchCtl *, const pmDesc *, int, char **);
 PCP_CALL extern int __pmLogPutInDom(__pmArchCtl *, pmInDom, const pmTimeval *, int, int *, char **);
@@ -540,6 +540,19 @@ PCP_CALL extern int pmFetch(int, pmID *, pmResult **);
 #define PMCD_LABEL_CHANGE	(1<<3)
 #define PMCD_NAMES_CHANGE	(1<<4)
 
+/*
+ * Asynchronous fetch for PM_CONTEXT_HOST contexts ... several requests
+ * may be outstanding on the one connection to PMCD, and the callback
+ * (context, request, status, result, data) is made for each in the
+ * order the requests were issued, from pmFetchAsyncComplete().
+ * The descriptor from pmFetchAsyncFd() is readable when replies
+ * have arrived, for use with poll(2), select(2) and the like.
+ */
+typedef void (*pmFetchCallBack)(int, int, int, pmResult *, void *);
+PCP_CALL extern int pmFetchAsync(int, pmID *, pmFetchCallBack, void *);
+PCP_CALL extern int pmFetchAsyncComplete(int, int);
+PCP_CALL extern int pmFetchAsyncFd(int);
+
 /*
  * Variant that is used to return a pmResult from an archive
  */
@@ -666,6 +679,15 @@ PCP_CALL extern void pmPrintValue(FILE *, int, int, const pmValue *, int);
 /* Scale conversion, based on value format, value type and scale */
 PCP_CALL extern int pmConvScale(int, const pmAtomValue *, const pmUnits *, pmAtomValue *, 
 		       const pmUnits *);
+PCP_CALL extern int pmConvScaleFactor(const pmUnits *, const pmUnits *, double *);
+
+/* Value extract and conversion for all the values in a pmValueSet */
+PCP_CALL extern int pmExtractValueSet(const pmValueSet *, int, double, int *,
+			double *, int);
+PCP_CALL extern int pmExtractValueSet64(const pmValueSet *, int, int *,
+			__int64_t *, int);
+PCP_CALL extern int pmRateValues(int, double, int, double, int, const int *,
+			double *, int, const int *, const double *, int *);
 
 /* Sort instances for each metric within a pmResult */
 PCP_CALL extern void pmSortInstances(pmResult *);
@@ -1067,6 +1089,28 @@ PCP_CALL extern int pmUnpackHighResEventRecords(pmValueSet *, int, pmHighResResu
 /* Free set of pmHighResResults from pmUnpackEventRecords */
 PCP_CALL extern void pmFreeHighResEventResult(pmHighResResult **);
 
+/*
+ * Walk the records of a PM_TYPE_EVENT or PM_TYPE_HIGHRES_EVENT value
+ * in place, without unpacking them into pmResults
+ */
+typedef struct pmEventIter {
+    int			ei_type;	/* PM_TYPE_EVENT or PM_TYPE_HIGHRES_EVENT */
+    int			ei_nrecords;	/* number of event records */
+    int			ei_record;	/* current record, from 0 */
+    struct timespec	ei_timestamp;	/* ... its timestamp */
+    unsigned int	ei_flags;	/* ... its er_flags */
+    int			ei_nparams;	/* ... its number of parameters */
+    int			ei_missed;	/* ... missed records if PM_EVENT_FLAG_MISSED */
+    /* private, for the iterator only */
+    int			ei_param;	/* next parameter */
+    char		*ei_next;	/* next record or parameter */
+    pmValueSet		ei_vset;	/* returned for each parameter */
+} pmEventIter;
+
+PCP_CALL extern int pmEventIterInit(pmEventIter *, pmValueSet *, int);
+PCP_CALL extern int pmEventIterNextRecord(pmEventIter *);
+PCP_CALL extern int pmEventIterNextParam(pmEventIter *, pmValueSet **);
+
 /* Service discovery, for clients. */
 #define PM_SERVER_SERVICE_SPEC	"pmcd"
 #define PM_SERVER_PROXY_SPEC	"pmproxy"
@@ -1090,6 +1134,8 @@ PCP_CALL extern int pmExtendFetchGroup_event(pmFG, const char *, const char *,
 			unsigned int, unsigned int *, int *);
 PCP_CALL extern int pmExtendFetchGroup_timestamp(pmFG, struct timeval *);
 PCP_CALL extern int pmFetchGroup(pmFG);
+PCP_CALL extern int pmFetchGroups(int, pmFG *, const struct timeval *,
+			int *, double *);
 PCP_CALL extern int pmDestroyFetchGroup(pmFG);
 
 /* libpcp debug/tracing */
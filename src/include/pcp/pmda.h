@@ -83,6 +83,14 @@ typedef int (*pmdaFetchCallBack)(pmdaMetric *, unsigned int, pmAtomValue *);
 #define PMDA_FETCH_STATIC	1
 #define PMDA_FETCH_DYNAMIC	2	/* free avp->vp after __pmStuffValue */
 
+/*
+ * Type of function call back used by pmdaFetch to assign the values of
+ * all requested instances of a metric in one call - instance list and
+ * count in, one value and one PMDA_FETCH_* (or error) status out for
+ * each instance.
+ */
+typedef int (*pmdaFetchBulkCallBack)(pmdaMetric *, int, const unsigned int *, pmAtomValue *, int *);
+
 /*
  * Type of function call back used by pmdaMain to clean up a pmResult structure
  * after a fetch.
@@ -291,6 +299,7 @@ typedef struct pmdaInterface {
 /* comm(unication) flags */
 #define PMDA_FLAG_AUTHORIZE	(1<<2)	/* authentication support */
 #define PMDA_FLAG_CONTAINER	(1<<6)	/* container name support */
+#define PMDA_FLAG_PROFILES	(1<<10)	/* per-context profiles kept */
 
 /* communication attributes (mirrored from libpcp.h) */
 #define PMDA_ATTR_USERNAME   5  /* username (sasl) */
@@ -456,6 +465,12 @@ typedef struct pmdaOptions {
  *      pmAtom structure with a metrics value. This must be set if pmdaFetch is
  *      used as the fetch callback.
  *
+ * pmdaSetFetchBulkCallBack
+ *	Allows an application specific routine to be specified for completing
+ *	the values of all instances of a metric in the profile at once, rather
+ *	than one instance at a time.  A callback result of PM_ERR_NYI means
+ *	the fetch callback is used for that metric instead.
+ *
  * pmdaSetCheckCallBack
  *      Allows an application specific routine to be called upon receipt of any
  *      PDU. For all PDUs except PDU_PROFILE, a result less than zero
@@ -477,6 +492,11 @@ typedef struct pmdaOptions {
  *	Lookup any metadata labels associated with metric instances.
  *	Passed in a metric table entry and instance identifier and expects
  *      the callback to fill the given labelset structure.
+ *
+ * pmdaSetSnapshot
+ *	Daemon PMDAs only.  Refresh the values of metrics in the given
+ *	clusters (all if NULL) in a background thread every interval,
+ *	and answer fetches for them from the latest values.
  */
 
 PMDA_CALL extern int pmdaGetOpt(int, char *const *, const char *, pmdaInterface *, int *);
@@ -499,10 +519,12 @@ PMDA_CALL extern void pmdaSendError(pmdaInterface *, int);
 
 PMDA_CALL extern void pmdaSetResultCallBack(pmdaInterface *, pmdaResultCallBack);
 PMDA_CALL extern void pmdaSetFetchCallBack(pmdaInterface *, pmdaFetchCallBack);
+PMDA_CALL extern void pmdaSetFetchBulkCallBack(pmdaInterface *, pmdaFetchBulkCallBack);
 PMDA_CALL extern void pmdaSetCheckCallBack(pmdaInterface *, pmdaCheckCallBack);
 PMDA_CALL extern void pmdaSetDoneCallBack(pmdaInterface *, pmdaDoneCallBack);
 PMDA_CALL extern void pmdaSetEndContextCallBack(pmdaInterface *, pmdaEndContextCallBack);
 PMDA_CALL extern void pmdaSetLabelCallBack(pmdaInterface *, pmdaLabelCallBack);
+PMDA_CALL extern int pmdaSetSnapshot(pmdaInterface *, const struct timeval *, int, const unsigned int *);
 
 /*
  * Callbacks to PMCD which should be adequate for most PMDAs.
@@ -24,6 +24,9 @@
 #ifdef HAVE_NETIOAPI_H
 #include <netioapi.h>
 #endif
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
 #define SOCKET_INTERNAL
 #include "internal.h"
 
@@ -1595,11 +1598,24 @@ __pmRecv(int socket, void *buffer, size_t length, int flags)
 int
 __pmSocketReady(int fd, struct timeval *timeout)
 {
+#ifdef HAVE_POLL_H
+    /* poll(2) has no FD_SETSIZE limit on the descriptor value */
+    struct pollfd	onefd;
+    int			msec = -1;
+
+    if (timeout != NULL)
+	msec = timeout->tv_sec * 1000 + (timeout->tv_usec + 999) / 1000;
+    onefd.fd = fd;
+    onefd.events = POLLIN;
+    onefd.revents = 0;
+    return poll(&onefd, 1, msec);
+#else
     __pmFdSet	onefd;
 
     FD_ZERO(&onefd);
     FD_SET(fd, &onefd);
     return select(fd+1, &onefd, NULL, NULL, timeout);
+#endif
 }
 
 #endif /* !HAVE_SECURE_SOCKETS */
@@ -19,7 +19,12 @@
  * curr_ctx needs to be thread-private
  *
  * contexts[], contexts_map[], contexts_len and last_handle are protected
- * from changes * using the local contexts_lock mutex.
+ * from changes * using the local contexts_lock mutex.  But mapping a
+ * handle to a context (__pmHandleToPtr() and pmUseContext(), called on
+ * every PMAPI operation) is done without contexts_lock ... contexts[]
+ * and contexts_map[] are replaced rather than realloc'd as they grow,
+ * the __pmContext structs are never freed, and the mapping is checked
+ * again once the context's c_lock is held.
  *
  * Ditto for back n_backoff, def_backoff[] and backoff[].
  *
@@ -38,6 +43,7 @@
 
 static __pmContext	**contexts;		/* array of context ptrs */
 static int		contexts_len;		/* number of contexts */
+static int		contexts_max;		/* allocated size of contexts[] */
 static int		last_handle = -1;	/* last returned context handle */
 /*
  * For handle x above the PMAPI, if the context is valid, then for some
@@ -52,6 +58,35 @@ static int		*contexts_map;
 #define MAP_FREE	-1		/* contexts[i] can be reused */
 #define MAP_TEARDOWN	-2		/* contexts[i] is being destroyed */
 
+/*
+ * contexts[] entry while a real __pmContext is being built
+ */
+static __pmContext	being_initialized = { .c_type = PM_CONTEXT_INIT };
+
+/*
+ * Earlier contexts[] and contexts_map[] arrays, which lock-free lookups
+ * may still be scanning.
+ */
+typedef struct retired {
+    struct retired	*next;
+    __pmContext		**contexts;
+    int			*map;
+} retired_t;
+static retired_t	*retired;
+
+/*
+ * Stores to contexts_len, contexts[], contexts_map[] and their entries
+ * are made with contexts_lock held, and must be seen in order by the
+ * lookups that do not take contexts_lock.
+ */
+#ifdef PM_MULTI_THREAD
+#define CTX_LOAD(x)		__atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define CTX_STORE(x, v)		__atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+#else
+#define CTX_LOAD(x)		(x)
+#define CTX_STORE(x, v)		((x) = (v))
+#endif
+
 #ifdef PM_MULTI_THREAD
 #ifdef HAVE___THREAD
 /* using a gcc construct here to make curr_handle thread-private */
@@ -91,18 +126,70 @@ __pmIsContextsLock(void *lock)
 static int
 map_handle_nolock(int handle)
 {
-    int		ctxnum = -1;
+    __pmContext	**list;
+    int		*list_map;
+    int		len;
     int		i;
 
-    for (i = 0; i < contexts_len; i++) {
-	if (contexts_map[i] == handle && contexts_map[i] >= 0) {
-	    if (contexts[i]->c_type != PM_CONTEXT_INIT) {
-		ctxnum = i;
-		break;
-	    }
+    if (handle < 0)
+	return -1;
+
+    /* len before the arrays, which hold at least len entries */
+    len = CTX_LOAD(contexts_len);
+    list = CTX_LOAD(contexts);
+    list_map = CTX_LOAD(contexts_map);
+    for (i = 0; i < len; i++) {
+	if (CTX_LOAD(list_map[i]) == handle) {
+	    if (CTX_LOAD(list[i]) != &being_initialized)
+		return i;
+	    break;
 	}
     }
-    return ctxnum;
+    return -1;
+}
+
+/*
+ * Make room in contexts[] and contexts_map[] for more contexts.
+ * Lookups may be scanning the arrays without contexts_lock, so they
+ * are replaced (not realloc'd) and the old ones retired (not freed).
+ */
+static int
+grow_contexts(void)
+{
+    __pmContext	**list;
+    int		*list_map;
+    retired_t	*rp = NULL;
+    int		max = contexts_max == 0 ? 4 : 2 * contexts_max;
+
+    PM_ASSERT_IS_LOCKED(contexts_lock);
+
+    list = (__pmContext **)malloc(max * sizeof(__pmContext *));
+    list_map = (int *)malloc(max * sizeof(int));
+    if (contexts != NULL)
+	rp = (retired_t *)malloc(sizeof(retired_t));
+    if (list == NULL || list_map == NULL || (contexts != NULL && rp == NULL)) {
+	if (list != NULL)
+	    free(list);
+	if (list_map != NULL)
+	    free(list_map);
+	if (rp != NULL)
+	    free(rp);
+	return -ENOMEM;
+    }
+    if (contexts_len > 0) {
+	memcpy(list, contexts, contexts_len * sizeof(__pmContext *));
+	memcpy(list_map, contexts_map, contexts_len * sizeof(int));
+    }
+    if (rp != NULL) {
+	rp->contexts = contexts;
+	rp->map = contexts_map;
+	rp->next = retired;
+	retired = rp;
+    }
+    CTX_STORE(contexts, list);
+    CTX_STORE(contexts_map, list_map);
+    contexts_max = max;
+    return 0;
 }
 
 static int
@@ -185,39 +272,45 @@ waitawhile(__pmPMCDCtl *ctl)
 __pmContext *
 __pmHandleToPtr(int handle)
 {
-    int		i;
+    __pmContext	*ctxp;
+    int		ctxnum;
 
-    PM_LOCK(contexts_lock);
-    for (i = 0; i < contexts_len; i++) {
-	if (contexts_map[i] == handle && contexts_map[i] >= 0) {
-	    if (contexts[i]->c_type > PM_CONTEXT_UNDEF) {
-		__pmContext	*sts = contexts[i];
-		/*
-		 * Important Note:
-		 *   Once c_lock is locked for _any_ context, the caller
-		 *   cannot call into the routines here where contexts_lock
-		 *   is acquired without first releasing the c_lock for all
-		 *   contexts that are locked.
-		 */
-		PM_LOCK(sts->c_lock);
-		/*
-		 * Note:
-		 *   Since we're holding the contexts_lock no
-		 *   pmDestroyContext() for this context can happen between
-		 *   the test above and the lock being granted ... and
-		 *   without a pmContextDestroy() there can be no reuse
-		 *   of the __pmContext struct, so the asserts below are
-		 *   to-be-sure-to-be-sure.
-		 */
-		PM_UNLOCK(contexts_lock);
-		assert(sts->c_handle == handle);
-		assert(sts->c_type > PM_CONTEXT_UNDEF);
-		return sts;
-	    }
-	}
+    /* most often the current context, else search without contexts_lock */
+    ctxp = PM_TPD(curr_ctxp);
+    if (ctxp == NULL || handle != PM_TPD(curr_handle)) {
+	if ((ctxnum = map_handle_nolock(handle)) < 0)
+	    return NULL;
+	ctxp = CTX_LOAD(CTX_LOAD(contexts)[ctxnum]);
+	if (ctxp == &being_initialized)
+	    return NULL;
     }
-    PM_UNLOCK(contexts_lock);
-    return NULL;
+
+    /*
+     * Important Note:
+     *   Once c_lock is locked for _any_ context, the caller
+     *   cannot call into the routines here where contexts_lock
+     *   is acquired without first releasing the c_lock for all
+     *   contexts that are locked.
+     */
+    PM_LOCK(ctxp->c_lock);
+    /*
+     * Note:
+     *   The __pmContext struct is never freed and c_lock is never
+     *   destroyed, but between the search above and the lock being
+     *   granted the context may have been destroyed (and the struct
+     *   reused).  pmDestroyContext() changes contexts_map[] with c_lock
+     *   held and handles are never reused, so with c_lock held the
+     *   context is the one for handle iff contexts_map[] says so.
+     */
+    ctxnum = ctxp->c_slot;
+    if (CTX_LOAD(CTX_LOAD(contexts_map)[ctxnum]) != handle ||
+	CTX_LOAD(CTX_LOAD(contexts)[ctxnum]) != ctxp ||
+	ctxp->c_type <= PM_CONTEXT_UNDEF) {
+	PM_UNLOCK(ctxp->c_lock);
+	return NULL;
+    }
+    assert(ctxp->c_handle == handle);
+    return ctxp;
 }
 
 int
@@ -953,8 +1046,7 @@ initarchive(__pmContext	*ctxp, const char *name)
     acp->ac_offset = sizeof(__pmLogLabel) + 2*sizeof(int);
     acp->ac_vol = acp->ac_curvol;
     acp->ac_serial = 0;		/* not serial access, yet */
-    acp->ac_pmid_hc.nodes = 0;	/* empty hash list */
-    acp->ac_pmid_hc.hsize = 0;
+    __pmOHashInit(&acp->ac_pmid_hc);	/* empty hash list */
     acp->ac_end = 0.0;
     acp->ac_want = NULL;
     acp->ac_unbound = NULL;
@@ -999,15 +1091,11 @@ int
 pmNewContext(int type, const char *name)
 {
     __pmContext	*new = NULL;
-    __pmContext	**list;
-    int		*list_map;
     int		i;
     int		sts;
     int		old_curr_handle;
     __pmContext	*old_curr_ctxp;
     int		ctxnum = -1;	/* index into contexts[] for new context */
-    /* A pointer to this stub object is put in contexts[] while a real __pmContext is being built. */
-    static /*const*/ __pmContext being_initialized = { .c_type = PM_CONTEXT_INIT };
 
     if (pmDebugOptions.pmapi) {
 	if (name == NULL)
@@ -1044,28 +1132,8 @@ pmNewContext(int type, const char *name)
     }
 
     /* Create a new one */
-    if (contexts == NULL) {
-	list = (__pmContext **)malloc(sizeof(__pmContext *));
-	list_map = (int *)malloc(sizeof(int));
-    }
-    else {
-	list = (__pmContext **)realloc((void *)contexts, (1+contexts_len) * sizeof(__pmContext *));
-	list_map = (int *)realloc((void *)contexts_map, (1+contexts_len) * sizeof(int));
-    }
-    if (list == NULL || list_map == NULL) {
-	sts = -oserror();
+    if (contexts_len == contexts_max && (sts = grow_contexts()) < 0)
 	goto FAILED_LOCKED;
-    }
-    contexts = list;
-    contexts_map = list_map;
-    /*
-     * NB: it is harmless (not a leak) if contexts[] and/or contexts_map[]
-     * is realloc'd a little larger, and then the last slot is not
-     * initialized (since context_len is not incremented, and/or
-     * initialization fails.
-     * A subsequent pmNewContext allocation attempt will just do the
-     * realloc again, and that time it'll be a trivial success.
-     */
 
     new = (__pmContext *)malloc(sizeof(__pmContext));
     if (new == NULL) {
@@ -1076,7 +1144,6 @@ pmNewContext(int type, const char *name)
     initcontextlock(&new->c_lock);
 
     ctxnum = contexts_len;
-    contexts_len++;
 
     /*
      * We do not need to hold contexts_lock just for filling of the
@@ -1094,8 +1161,10 @@ INIT_CONTEXT:
     PM_TPD(curr_ctxp) = new;
     PM_TPD(curr_handle) = new->c_handle = ++last_handle;
     new->c_slot = ctxnum;
-    contexts[ctxnum] = &being_initialized;
-    contexts_map[ctxnum] = last_handle;
+    CTX_STORE(contexts[ctxnum], &being_initialized);
+    CTX_STORE(contexts_map[ctxnum], last_handle);
+    if (ctxnum == contexts_len)
+	CTX_STORE(contexts_len, contexts_len + 1);
     PM_UNLOCK(contexts_lock);
     /* c_lock not re-initialized, created once from initcontextlock() above */
     new->c_type = (type & PM_CONTEXT_TYPEMASK);
@@ -1197,7 +1266,7 @@ INIT_CONTEXT:
     /* Take contexts_lock mutex to update contexts[] with this fully operational
        battle station ^W context. */
     PM_LOCK(contexts_lock);
-    contexts[ctxnum] = new;
+    CTX_STORE(contexts[ctxnum], new);
     PM_UNLOCK(contexts_lock);
 
     /* return the handle to the new (current) context */
@@ -1239,8 +1308,8 @@ FAILED_LOCKED:
         }
         /* We could memset-0 the struct, but this is not really
            necessary.  That's the first thing we'll do in INIT_CONTEXT. */
-        contexts[ctxnum] = new;
-	contexts_map[ctxnum] = MAP_FREE;
+        CTX_STORE(contexts[ctxnum], new);
+	CTX_STORE(contexts_map[ctxnum], MAP_FREE);
     }
     PM_TPD(curr_handle) = old_curr_handle;
     PM_TPD(curr_ctxp) = old_curr_ctxp;
@@ -1303,6 +1372,8 @@ pmReconnectContext(int handle)
 	    /* don't care if this fails */
 	    __pmCloseSocket(ctl->pc_fd);
 	    ctl->pc_fd = -1;
+	    /* no replies now for any pmFetchAsync() requests */
+	    __pmFetchAsyncAbort(ctxp, PM_ERR_IPC);
 	}
 
 	if ((sts = __pmConnectPMCD(ctl->pc_hosts, ctl->pc_nhosts,
@@ -1468,8 +1539,7 @@ pmDupContext(void)
 	 * __pmFreeInterpData() to trash our hash list and read cache.
 	 * Start with an empty hash list and read cache for the dup'd context.
 	 */
-	newcon->c_archctl->ac_pmid_hc.nodes = 0;
-	newcon->c_archctl->ac_pmid_hc.hsize = 0;
+	__pmOHashInit(&newcon->c_archctl->ac_pmid_hc);
 	newcon->c_archctl->ac_cache = NULL;
 
 	/*
@@ -1542,7 +1612,7 @@ done:
     /* return an error code, or the handle for the new context */
     if (sts < 0 && new >= 0) {
 	PM_LOCK(contexts_lock);
-	contexts_map[ctxnum] = MAP_FREE;
+	CTX_STORE(contexts_map[ctxnum], MAP_FREE);
 	PM_UNLOCK(contexts_lock);
     }
 
@@ -1579,11 +1649,14 @@ pmUseContext(int handle)
 
     PM_INIT_LOCKS();
 
-    PM_LOCK(contexts_lock);
-    if ((ctxnum = map_handle(handle)) < 0) {
+    /*
+     * No contexts_lock here ... the context could be destroyed as
+     * soon as we return in any case, and __pmHandleToPtr() checks
+     * that it has not been.
+     */
+    if ((ctxnum = map_handle_nolock(handle)) < 0) {
 	if (pmDebugOptions.context)
 	    fprintf(stderr, "pmUseContext(%d) -> %d\n", handle, PM_ERR_NOCONTEXT);
-	PM_UNLOCK(contexts_lock);
 	sts = PM_ERR_NOCONTEXT;
 	goto pmapi_return;
     }
@@ -1591,9 +1664,7 @@ pmUseContext(int handle)
     if (pmDebugOptions.context)
 	fprintf(stderr, "pmUseContext(%d) -> contexts[%d]\n", handle, ctxnum);
     PM_TPD(curr_handle) = handle;
-    PM_TPD(curr_ctxp) = contexts[ctxnum];
-
-    PM_UNLOCK(contexts_lock);
+    PM_TPD(curr_ctxp) = CTX_LOAD(CTX_LOAD(contexts)[ctxnum]);
 
     sts = 0;
 
@@ -1623,6 +1694,7 @@ __pmPMCDCtlFree(__pmPMCDCtl *cp)
 			(char *)&dolinger, (__pmSockLen)sizeof(dolinger));
 	__pmCloseSocket(cp->pc_fd);
     }
+    __pmFetchAsyncFree(cp);
     __pmFreeHostSpec(cp->pc_hosts, cp->pc_nhosts);
     free(cp);
 }
@@ -1651,7 +1723,7 @@ pmDestroyContext(int handle)
 
     ctxp = contexts[ctxnum];
     PM_LOCK(ctxp->c_lock);
-    contexts_map[ctxnum] = MAP_TEARDOWN;
+    CTX_STORE(contexts_map[ctxnum], MAP_TEARDOWN);
     PM_UNLOCK(contexts_lock);
     if (ctxp->c_pmcd != NULL) {
 	__pmPMCDCtlFree(ctxp->c_pmcd);
@@ -1690,7 +1762,7 @@ pmDestroyContext(int handle)
     PM_UNLOCK(ctxp->c_lock);
 
     PM_LOCK(contexts_lock);
-    contexts_map[ctxnum] = MAP_FREE;
+    CTX_STORE(contexts_map[ctxnum], MAP_FREE);
     PM_UNLOCK(contexts_lock);
 
     sts = 0;
@@ -70,12 +70,40 @@ typedef struct node {		/* expression tree node */
     } data;
 } node_t;
 
+typedef struct {		/* one instruction of a compiled expression */
+    node_t	*np;		/* expression node */
+    int		op;		/* np->type, or I_WALK */
+    int		left;		/* insn[] index of left operand, or -1 */
+    int		right;		/* insn[] index of right operand, or -1 */
+    int		ctype;		/* type operands are promoted to */
+    int		parent;		/* insn[] index of parent, or -1 for root */
+    int		numval;		/* values in the register, or error */
+    int		maxval;		/* allocated length of inst[] and val[] */
+    int		*inst;		/* instance ids */
+    pmAtomValue	*val;		/* values, of type np->desc.type */
+    int		last_numval;	/* previous fetch for delta() or rate() */
+    int		last_maxval;
+    int		*last_inst;
+    pmAtomValue	*last_val;
+} insn_t;
+
+typedef struct {		/* compiled expression, see __dmcompile() */
+    int		ninsn;
+    insn_t	*insn;		/* postfix order, result in insn[ninsn-1] */
+    int		maxval;		/* allocated length of scratch arrays */
+    pmAtomValue	*lval;		/* promoted left operand values */
+    pmAtomValue	*rval;		/* promoted right operand values */
+    int		*lidx;		/* left operand index for each result */
+    int		*ridx;		/* right operand index for each result */
+} prog_t;
+
 typedef struct {		/* one derived metric */
     char	*name;
     int		anon;		/* 1 for anonymous derived metrics */
     pmID	pmid;
     int		bind;		/* 0/1 if bind_expr() has been called */
     node_t	*expr;		/* NULL => invalid, e.g. dup or missing operands */
+    prog_t	*prog;		/* NULL => evaluate by walking expr */
     const char	*oneline;	/* help text for PM_TEXT_ONELINE */
     const char	*helptext;	/* help text for PM_TEXT_HELP */
 } dm_t;
@@ -129,6 +157,9 @@ typedef struct {
 #define N_PATTERN	33
 #define N_SCALAR	34
 
+/* insn_t op for a subtree evaluated by walking the expression tree */
+#define I_WALK		0
+
 /* instance filtering types */
 #define F_REGEX		0		/* matchinst([!]pattern, expr) */
 #define F_EXACT		1		/* metric[instance] */
@@ -146,7 +177,10 @@ extern void __dmclosecontext(__pmContext *) _PCP_HIDDEN;
 extern int __dmdesc(__pmContext *, int, pmID, pmDesc *) _PCP_HIDDEN;
 extern int __dmprefetch(__pmContext *, int, const pmID *, pmID **) _PCP_HIDDEN;
 extern void __dmpostfetch(__pmContext *, pmResult **) _PCP_HIDDEN;
+extern void __dmresumefetch(__pmContext *, int) _PCP_HIDDEN;
 extern void __dmdumpexpr(node_t *, int) _PCP_HIDDEN;
+extern prog_t *__dmcompile(node_t *) _PCP_HIDDEN;
+extern void __dmfreeprog(prog_t *) _PCP_HIDDEN;
 extern char *__dmnode_type_str(int) _PCP_HIDDEN;
 extern int __dmhelptext(pmID, int, char **) _PCP_HIDDEN;
 
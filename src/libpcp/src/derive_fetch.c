@@ -15,7 +15,8 @@
  *	DERIVE - high-level diagnostics
  *	DERIVE & APPL0 - configuration and static syntax analysis
  *	DERIVE & APPL1 - expression binding and semantic analysis
- *	DERIVE & APPL2 - fetch handling
+ *	DERIVE & APPL2 - fetch handling (forces evaluation by tree walking)
+ *	DERIVE & APPL3 - compiled expressions
  */
 
 #include <inttypes.h>
@@ -650,6 +651,30 @@ regex_inst_gc(pattern_t *pp)
     pp->used = 0;
 }
 
+/*
+ * Scaling factor for rate() of a time counter, to scale the metric
+ * from counter units into seconds for time utilization.
+ */
+static double
+time_scale(node_t *np)
+{
+    int		i;
+
+    if (np->data.info->time_scale < 0) {
+	/* one trip initialization */
+	np->data.info->time_scale = 1;
+	if (np->left->desc.units.scaleTime > PM_TIME_SEC) {
+	    for (i = PM_TIME_SEC; i < np->left->desc.units.scaleTime; i++)
+		np->data.info->time_scale *= 60;
+	}
+	else {
+	    for (i = np->left->desc.units.scaleTime; i < PM_TIME_SEC; i++)
+		np->data.info->time_scale /= 1000;
+	}
+    }
+    return np->data.info->time_scale;
+}
+
 /*
  * Walk an expression tree, filling in operand values from the
  * pmResult at the leaf nodes and propagating the computed values
@@ -855,24 +880,7 @@ eval_expr(__pmContext *ctxp, node_t *np, pmResult *rp, int level)
 		     */
 		    if (np->left->desc.units.dimTime == 1) {
 			/* scale rate(time counter) -> time utilization */
-			if (np->data.info->time_scale < 0) {
-			    /*
-			     * one trip initialization for time utilization
-			     * scaling factor (to scale metric from counter
-			     * units into seconds)
-			     */
-			    int		i;
-			    np->data.info->time_scale = 1;
-			    if (np->left->desc.units.scaleTime > PM_TIME_SEC) {
-				for (i = PM_TIME_SEC; i < np->left->desc.units.scaleTime; i++)
-				    np->data.info->time_scale *= 60;
-			    }
-			    else {
-				for (i = np->left->desc.units.scaleTime; i < PM_TIME_SEC; i++)
-				    np->data.info->time_scale /= 1000;
-			    }
-			}
-			np->data.info->ivlist[k].value.d *= np->data.info->time_scale;
+			np->data.info->ivlist[k].value.d *= time_scale(np);
 		    }
 		}
 		k++;
@@ -1753,6 +1761,963 @@ eval_expr(__pmContext *ctxp, node_t *np, pmResult *rp, int level)
     /*NOTREACHED*/
 }
 
+/*
+ * Compiled expressions.
+ *
+ * When a derived metric is bound, __dmcompile() flattens its expression
+ * tree into a program with one instruction per node in postfix order,
+ * i.e. the order in which eval_expr() finishes with each node.  Each
+ * instruction has a register holding the instance ids and the values
+ * for its node in contiguous arrays that are reused from one fetch to
+ * the next.  The type of every operand is known at bind time, so the
+ * type dispatch is done once per instruction rather than once per value
+ * and the per-instance loops are simple enough for the compiler to
+ * vectorize.
+ *
+ * Metrics, constants, the arithmetic, relational and boolean operators,
+ * delta(), rate(), avg(), count(), max(), min() and sum() are compiled.
+ * Any other subtree with a numeric value, e.g. ?:, matchinst() or
+ * rescale(), becomes one I_WALK instruction that evaluates the subtree
+ * with eval_expr() and copies the result into its register.  Errors and
+ * instance matching are handled exactly as in eval_expr(), so the
+ * results are the same.
+ */
+
+#define NUMERIC(type)	((type) >= PM_TYPE_32 && (type) <= PM_TYPE_DOUBLE)
+
+/* how an operand register maps onto the instances of the result */
+#define M_IDENT		0	/* k-th result uses k-th value */
+#define M_BCAST		1	/* all results use the first value */
+#define M_GATHER	2	/* k-th result uses the value at idx[k] */
+
+/*
+ * Can np be evaluated by an instruction of its own?  If so, each
+ * operand is either compiled or has a numeric value for I_WALK.
+ */
+static int
+compilable(node_t *np)
+{
+    if (!NUMERIC(np->desc.type))
+	return 0;
+    switch (np->type) {
+	case N_NAME:
+	    return np->data.info->pmid != PM_ID_NULL;
+	case N_INTEGER:
+	case N_DOUBLE:
+	    return 1;
+	case N_PLUS:
+	case N_MINUS:
+	case N_STAR:
+	case N_SLASH:
+	case N_LT:
+	case N_LEQ:
+	case N_EQ:
+	case N_GEQ:
+	case N_GT:
+	case N_NEQ:
+	case N_AND:
+	case N_OR:
+	    return NUMERIC(np->left->desc.type) && NUMERIC(np->right->desc.type);
+	case N_NOT:
+	case N_NEG:
+	case N_COUNT:
+	    return NUMERIC(np->left->desc.type);
+	case N_DELTA:
+	case N_RATE:
+	case N_AVG:
+	case N_MAX:
+	case N_MIN:
+	case N_SUM:
+	    /* operand is always a metric, history is kept in its register */
+	    return np->left->type == N_NAME && compilable(np->left);
+    }
+    return 0;
+}
+
+static void
+grow(insn_t *ip, int n)
+{
+    size_t	need;
+
+    if (n <= ip->maxval)
+	return;
+    need = n * sizeof(int);
+    if ((ip->inst = (int *)realloc(ip->inst, need)) == NULL) {
+	pmNoMem("__dmpostfetch: register inst", need, PM_FATAL_ERR);
+	/*NOTREACHED*/
+    }
+    need = n * sizeof(pmAtomValue);
+    if ((ip->val = (pmAtomValue *)realloc(ip->val, need)) == NULL) {
+	pmNoMem("__dmpostfetch: register val", need, PM_FATAL_ERR);
+	/*NOTREACHED*/
+    }
+    ip->maxval = n;
+}
+
+static void
+grow_scratch(prog_t *pp, int n)
+{
+    size_t	need;
+
+    if (n <= pp->maxval)
+	return;
+    need = n * sizeof(pmAtomValue);
+    if ((pp->lval = (pmAtomValue *)realloc(pp->lval, need)) == NULL ||
+	(pp->rval = (pmAtomValue *)realloc(pp->rval, need)) == NULL) {
+	pmNoMem("__dmpostfetch: scratch values", need, PM_FATAL_ERR);
+	/*NOTREACHED*/
+    }
+    need = n * sizeof(int);
+    if ((pp->lidx = (int *)realloc(pp->lidx, need)) == NULL ||
+	(pp->ridx = (int *)realloc(pp->ridx, need)) == NULL) {
+	pmNoMem("__dmpostfetch: scratch index", need, PM_FATAL_ERR);
+	/*NOTREACHED*/
+    }
+    pp->maxval = n;
+}
+
+/*
+ * Append instructions for np and its operands, return the index of the
+ * instruction for np.
+ */
+static int
+emit(prog_t *pp, node_t *np)
+{
+    insn_t	*ip;
+    int		left = -1;
+    int		right = -1;
+    int		op = I_WALK;
+
+    if (compilable(np)) {
+	op = np->type;
+	if (np->left != NULL && op != N_INTEGER && op != N_DOUBLE)
+	    left = emit(pp, np->left);
+	if (np->right != NULL)
+	    right = emit(pp, np->right);
+    }
+
+    ip = &pp->insn[pp->ninsn];
+    memset(ip, 0, sizeof(*ip));
+    ip->np = np;
+    ip->op = op;
+    ip->left = left;
+    ip->right = right;
+    ip->parent = -1;
+    if (left >= 0)
+	pp->insn[left].parent = pp->ninsn;
+    if (right >= 0)
+	pp->insn[right].parent = pp->ninsn;
+    if (op == N_LT || op == N_LEQ || op == N_EQ || op == N_GEQ ||
+	op == N_GT || op == N_NEQ || op == N_AND || op == N_OR)
+	ip->ctype = promote[np->left->desc.type][np->right->desc.type];
+    else
+	ip->ctype = np->desc.type;
+    if (op == N_INTEGER || op == N_DOUBLE) {
+	/* as for eval_expr(), error checking done in the lexical scanner */
+	grow(ip, 1);
+	ip->numval = 1;
+	ip->inst[0] = PM_INDOM_NULL;
+	switch (np->desc.type) {
+	    case PM_TYPE_32:
+		ip->val[0].l = atoi(np->value);
+		break;
+	    case PM_TYPE_U32:
+		ip->val[0].ul = atoi(np->value);
+		break;
+	    case PM_TYPE_64:
+		ip->val[0].ll = strtoll(np->value, NULL, 10);
+		break;
+	    case PM_TYPE_U64:
+		ip->val[0].ll = strtoull(np->value, NULL, 10);
+		break;
+	    case PM_TYPE_FLOAT:
+		ip->val[0].f = atof(np->value);
+		break;
+	    case PM_TYPE_DOUBLE:
+		ip->val[0].d = atof(np->value);
+		break;
+	}
+    }
+    return pp->ninsn++;
+}
+
+static int
+count_nodes(node_t *np)
+{
+    if (np == NULL)
+	return 0;
+    return 1 + count_nodes(np->left) + count_nodes(np->right);
+}
+
+/*
+ * Compile the bound expression expr, returns NULL if expr should be
+ * evaluated by eval_expr() instead.
+ */
+prog_t *
+__dmcompile(node_t *expr)
+{
+    prog_t	*pp;
+    char	*env;
+    int		i;
+
+    if (!compilable(expr))
+	return NULL;
+    /* keep the node by node diagnostics from eval_expr() */
+    if (pmDebugOptions.derive && pmDebugOptions.appl2)
+	return NULL;
+    if ((env = getenv("PCP_DERIVED_COMPILE")) != NULL && strcmp(env, "0") == 0)
+	return NULL;
+
+    if ((pp = (prog_t *)calloc(1, sizeof(prog_t))) == NULL ||
+	(pp->insn = (insn_t *)malloc(count_nodes(expr) * sizeof(insn_t))) == NULL) {
+	pmNoMem("__dmcompile: prog", count_nodes(expr) * sizeof(insn_t), PM_FATAL_ERR);
+	/*NOTREACHED*/
+    }
+    emit(pp, expr);
+
+    if (pmDebugOptions.derive && pmDebugOptions.appl3) {
+	char	strbuf[20];
+	fprintf(stderr, "__dmcompile: %d instructions\n", pp->ninsn);
+	for (i = 0; i < pp->ninsn; i++) {
+	    insn_t	*ip = &pp->insn[i];
+	    fprintf(stderr, "  [%d] %s", i,
+		ip->op == I_WALK ? "WALK" : __dmnode_type_str(ip->op));
+	    if (ip->op == I_WALK)
+		fprintf(stderr, " %s", __dmnode_type_str(ip->np->type));
+	    else if (ip->op == N_NAME || ip->op == N_INTEGER || ip->op == N_DOUBLE)
+		fprintf(stderr, " %s", ip->np->value);
+	    if (ip->left >= 0)
+		fprintf(stderr, " [%d]", ip->left);
+	    if (ip->right >= 0)
+		fprintf(stderr, " [%d]", ip->right);
+	    fprintf(stderr, " type=%s",
+		pmTypeStr_r(ip->ctype, strbuf, sizeof(strbuf)));
+	    if (ip->np->desc.indom != PM_INDOM_NULL)
+		fprintf(stderr, " indom=%s",
+		    pmInDomStr_r(ip->np->desc.indom, strbuf, sizeof(strbuf)));
+	    fputc('\n', stderr);
+	}
+    }
+    return pp;
+}
+
+void
+__dmfreeprog(prog_t *pp)
+{
+    int		i;
+
+    for (i = 0; i < pp->ninsn; i++) {
+	free(pp->insn[i].inst);
+	free(pp->insn[i].val);
+	free(pp->insn[i].last_inst);
+	free(pp->insn[i].last_val);
+    }
+    free(pp->insn);
+    free(pp->lval);
+    free(pp->rval);
+    free(pp->lidx);
+    free(pp->ridx);
+    free(pp);
+}
+
+/*
+ * dst[i] = src[i] promoted from stype to type, as done by bin_op(),
+ * dst may be the same as src.
+ */
+static void
+convert(pmAtomValue *dst, const pmAtomValue *src, int n, int stype, int type)
+{
+    int		i;
+
+    switch (type) {
+	case PM_TYPE_64:
+	    if (stype == PM_TYPE_32) {
+		for (i = 0; i < n; i++)
+		    dst[i].ll = src[i].l;
+		return;
+	    }
+	    if (stype == PM_TYPE_U32) {
+		for (i = 0; i < n; i++)
+		    dst[i].ll = src[i].ul;
+		return;
+	    }
+	    break;
+	case PM_TYPE_U64:
+	    if (stype == PM_TYPE_32) {
+		for (i = 0; i < n; i++)
+		    dst[i].ull = src[i].l;
+		return;
+	    }
+	    if (stype == PM_TYPE_U32) {
+		for (i = 0; i < n; i++)
+		    dst[i].ull = src[i].ul;
+		return;
+	    }
+	    break;
+	case PM_TYPE_FLOAT:
+	    switch (stype) {
+		case PM_TYPE_32:
+		    for (i = 0; i < n; i++)
+			dst[i].f = src[i].l;
+		    return;
+		case PM_TYPE_U32:
+		    for (i = 0; i < n; i++)
+			dst[i].f = src[i].ul;
+		    return;
+		case PM_TYPE_64:
+		    for (i = 0; i < n; i++)
+			dst[i].f = src[i].ll;
+		    return;
+		case PM_TYPE_U64:
+		    for (i = 0; i < n; i++)
+			dst[i].f = src[i].ull;
+		    return;
+	    }
+	    break;
+	case PM_TYPE_DOUBLE:
+	    switch (stype) {
+		case PM_TYPE_32:
+		    for (i = 0; i < n; i++)
+			dst[i].d = src[i].l;
+		    return;
+		case PM_TYPE_U32:
+		    for (i = 0; i < n; i++)
+			dst[i].d = src[i].ul;
+		    return;
+		case PM_TYPE_64:
+		    for (i = 0; i < n; i++)
+			dst[i].d = src[i].ll;
+		    return;
+		case PM_TYPE_U64:
+		    for (i = 0; i < n; i++)
+			dst[i].d = src[i].ull;
+		    return;
+		case PM_TYPE_FLOAT:
+		    for (i = 0; i < n; i++)
+			dst[i].d = src[i].f;
+		    return;
+	    }
+	    break;
+    }
+    /* same representation, nothing to convert */
+    if (dst != src)
+	memcpy(dst, src, n * sizeof(pmAtomValue));
+}
+
+/*
+ * Return n contiguous values of the operand in register ip, in the
+ * result instance order given by mode and idx[], promoted to type and
+ * scaled if type is PM_TYPE_DOUBLE.  buf[] is used if the register
+ * values cannot be used directly.
+ */
+static const pmAtomValue *
+operand(pmAtomValue *buf, insn_t *ip, int mode, const int *idx, int n, int type)
+{
+    const pmAtomValue	*src = ip->val;
+    int			stype = ip->np->desc.type;
+    int			mul = ip->np->data.info->mul_scale;
+    int			div = ip->np->data.info->div_scale;
+    int			i;
+
+    if (type != PM_TYPE_DOUBLE)
+	mul = div = 1;
+    if (mode == M_IDENT && stype == type && mul == 1 && div == 1)
+	return src;
+    if (mode == M_BCAST) {
+	for (i = 0; i < n; i++)
+	    buf[i] = src[0];
+	src = buf;
+    }
+    else if (mode == M_GATHER) {
+	for (i = 0; i < n; i++)
+	    buf[i] = src[idx[i]];
+	src = buf;
+    }
+    convert(buf, src, n, stype, type);
+    if (mul != 1 || div != 1) {
+	for (i = 0; i < n; i++)
+	    buf[i].d = (buf[i].d / div) * mul;
+    }
+    return buf;
+}
+
+/*
+ * res[i] = a[i] <op> b[i] for the operands promoted to type, for the
+ * relational and boolean operators the result is always a U32 value.
+ */
+#define BINOP_LOOPS(f) \
+	switch (op) { \
+	    case N_PLUS: \
+		for (i = 0; i < n; i++) res[i].f = a[i].f + b[i].f; \
+		break; \
+	    case N_MINUS: \
+		for (i = 0; i < n; i++) res[i].f = a[i].f - b[i].f; \
+		break; \
+	    case N_STAR: \
+		for (i = 0; i < n; i++) res[i].f = a[i].f * b[i].f; \
+		break; \
+	    case N_LT: \
+		for (i = 0; i < n; i++) res[i].ul = a[i].f < b[i].f; \
+		break; \
+	    case N_LEQ: \
+		for (i = 0; i < n; i++) res[i].ul = a[i].f <= b[i].f; \
+		break; \
+	    case N_EQ: \
+		for (i = 0; i < n; i++) res[i].ul = a[i].f == b[i].f; \
+		break; \
+	    case N_GEQ: \
+		for (i = 0; i < n; i++) res[i].ul = a[i].f >= b[i].f; \
+		break; \
+	    case N_GT: \
+		for (i = 0; i < n; i++) res[i].ul = a[i].f > b[i].f; \
+		break; \
+	    case N_NEQ: \
+		for (i = 0; i < n; i++) res[i].ul = a[i].f != b[i].f; \
+		break; \
+	    case N_AND: \
+		for (i = 0; i < n; i++) res[i].ul = (a[i].f != 0) & (b[i].f != 0); \
+		break; \
+	    case N_OR: \
+		for (i = 0; i < n; i++) res[i].ul = (a[i].f != 0) | (b[i].f != 0); \
+		break; \
+	}
+
+static void
+binop(int op, int type, pmAtomValue *res, const pmAtomValue *a, const pmAtomValue *b, int n)
+{
+    int		i;
+
+    switch (type) {
+	case PM_TYPE_32:
+	    BINOP_LOOPS(l)
+	    break;
+	case PM_TYPE_U32:
+	    BINOP_LOOPS(ul)
+	    break;
+	case PM_TYPE_64:
+	    BINOP_LOOPS(ll)
+	    break;
+	case PM_TYPE_U64:
+	    BINOP_LOOPS(ull)
+	    break;
+	case PM_TYPE_FLOAT:
+	    /* semantics enforce no N_SLASH for float results */
+	    BINOP_LOOPS(f)
+	    break;
+	case PM_TYPE_DOUBLE:
+	    if (op == N_SLASH) {
+		/* divide unconditionally so the loop has no branches */
+		for (i = 0; i < n; i++) {
+		    double	q = a[i].d / b[i].d;
+		    res[i].d = a[i].d == 0 ? 0 : q;
+		}
+	    }
+	    else
+		BINOP_LOOPS(d)
+	    break;
+    }
+}
+
+/* extract the values for a metric from the pmResult */
+static int
+exec_name(insn_t *ip, __pmContext *ctxp, pmResult *rp)
+{
+    pmValueSet	*vsp;
+    int		*itmp;
+    pmAtomValue	*vtmp;
+    int		i;
+    int		j;
+    char	strbuf[20];
+
+    for (j = 0; j < rp->numpmid; j++) {
+	if (ip->np->data.info->pmid == rp->vset[j]->pmid)
+	    break;
+    }
+    if (j == rp->numpmid) {
+	if (pmDebugOptions.derive) {
+	    fprintf(stderr, "eval_prog: botch: operand %s not in the extended pmResult\n", pmIDStr_r(ip->np->data.info->pmid, strbuf, sizeof(strbuf)));
+	    __pmDumpResult_ctx(ctxp, stderr, rp);
+	}
+	return PM_ERR_PMID;
+    }
+    vsp = rp->vset[j];
+    if (ip->np->save_last) {
+	/* this sample becomes the last one for delta() or rate() */
+	itmp = ip->last_inst;
+	ip->last_inst = ip->inst;
+	ip->inst = itmp;
+	vtmp = ip->last_val;
+	ip->last_val = ip->val;
+	ip->val = vtmp;
+	i = ip->last_maxval;
+	ip->last_maxval = ip->maxval;
+	ip->maxval = i;
+	ip->last_numval = ip->numval;
+    }
+    ip->numval = vsp->numval;
+    if (ip->numval <= 0)
+	return ip->numval;
+    grow(ip, ip->numval);
+    for (i = 0; i < ip->numval; i++)
+	ip->inst[i] = vsp->vlist[i].inst;
+    switch (ip->np->desc.type) {
+	case PM_TYPE_32:
+	case PM_TYPE_U32:
+	    for (i = 0; i < ip->numval; i++)
+		ip->val[i].l = vsp->vlist[i].value.lval;
+	    break;
+	case PM_TYPE_64:
+	case PM_TYPE_U64:
+	case PM_TYPE_DOUBLE:
+	    if (vsp->valfmt != PM_VAL_DPTR && vsp->valfmt != PM_VAL_SPTR)
+		return PM_ERR_LOGREC;
+	    for (i = 0; i < ip->numval; i++)
+		memcpy(&ip->val[i].ll, vsp->vlist[i].value.pval->vbuf, sizeof(__int64_t));
+	    break;
+	case PM_TYPE_FLOAT:
+	    if (vsp->valfmt == PM_VAL_INSITU) {
+		/* old style insitu float */
+		for (i = 0; i < ip->numval; i++)
+		    ip->val[i].l = vsp->vlist[i].value.lval;
+	    }
+	    else if (vsp->valfmt == PM_VAL_DPTR || vsp->valfmt == PM_VAL_SPTR) {
+		for (i = 0; i < ip->numval; i++)
+		    memcpy(&ip->val[i].f, vsp->vlist[i].value.pval->vbuf, sizeof(float));
+	    }
+	    else
+		return PM_ERR_LOGREC;
+	    break;
+    }
+    return ip->numval;
+}
+
+static int
+exec_binop(prog_t *pp, insn_t *ip)
+{
+    insn_t		*lp = &pp->insn[ip->left];
+    insn_t		*rp = &pp->insn[ip->right];
+    const pmAtomValue	*a;
+    const pmAtomValue	*b;
+    int			lmode;
+    int			rmode;
+    int			i;
+    int			j;
+    int			k;
+    int			n;
+
+    if (lp->numval <= 0 || rp->numval <= 0)
+	return ip->numval = 0;
+
+    if (lp->np->desc.indom == PM_INDOM_NULL) {
+	n = rp->numval;
+	lmode = M_BCAST;
+	rmode = rp->np->desc.indom == PM_INDOM_NULL ? M_BCAST : M_IDENT;
+    }
+    else if (rp->np->desc.indom == PM_INDOM_NULL) {
+	n = lp->numval;
+	lmode = M_IDENT;
+	rmode = M_BCAST;
+    }
+    else if (lp->numval == rp->numval &&
+	     memcmp(lp->inst, rp->inst, lp->numval * sizeof(int)) == 0) {
+	/* the common case, same instances in the same order */
+	n = lp->numval;
+	lmode = rmode = M_IDENT;
+    }
+    else {
+	/* match up instances as eval_expr() does */
+	n = lp->numval <= rp->numval ? lp->numval : rp->numval;
+	grow_scratch(pp, n);
+	for (i = j = k = 0; k < n; ) {
+	    if (i >= lp->numval || j >= rp->numval)
+		break;
+	    if (lp->inst[i] != rp->inst[j]) {
+		for (j = 0; j < rp->numval; j++) {
+		    if (lp->inst[i] == rp->inst[j])
+			break;
+		}
+		if (j == rp->numval) {
+		    i++;
+		    j = 0;
+		    continue;
+		}
+	    }
+	    pp->lidx[k] = i;
+	    pp->ridx[k] = j;
+	    k++;
+	    i++;
+	    j++;
+	    if (j >= rp->numval)
+		j = 0;
+	}
+	n = k;
+	lmode = rmode = M_GATHER;
+    }
+
+    grow(ip, n);
+    grow_scratch(pp, n);
+    a = operand(pp->lval, lp, lmode, pp->lidx, n, ip->ctype);
+    b = operand(pp->rval, rp, rmode, pp->ridx, n, ip->ctype);
+    binop(ip->op, ip->ctype, ip->val, a, b, n);
+
+    if (lmode == M_IDENT)
+	memcpy(ip->inst, lp->inst, n * sizeof(int));
+    else if (lmode == M_GATHER) {
+	for (k = 0; k < n; k++)
+	    ip->inst[k] = lp->inst[pp->lidx[k]];
+    }
+    else if (rmode == M_IDENT)
+	memcpy(ip->inst, rp->inst, n * sizeof(int));
+    else {
+	for (k = 0; k < n; k++)
+	    ip->inst[k] = rp->inst[0];
+    }
+    return ip->numval = n;
+}
+
+static int
+exec_unary(prog_t *pp, insn_t *ip)
+{
+    insn_t		*lp = &pp->insn[ip->left];
+    const pmAtomValue	*a = lp->val;
+    pmAtomValue		*res;
+    int			n = lp->numval;
+    int			i;
+
+    if (n <= 0)
+	return ip->numval = n;
+    grow(ip, n);
+    res = ip->val;
+    if (ip->op == N_NOT) {
+	switch (lp->np->desc.type) {
+	    case PM_TYPE_32:
+		for (i = 0; i < n; i++) res[i].ul = a[i].l == 0;
+		break;
+	    case PM_TYPE_U32:
+		for (i = 0; i < n; i++) res[i].ul = a[i].ul == 0;
+		break;
+	    case PM_TYPE_64:
+		for (i = 0; i < n; i++) res[i].ul = a[i].ll == 0;
+		break;
+	    case PM_TYPE_U64:
+		for (i = 0; i < n; i++) res[i].ul = a[i].ull == 0;
+		break;
+	    case PM_TYPE_FLOAT:
+		for (i = 0; i < n; i++) res[i].ul = a[i].f == 0;
+		break;
+	    case PM_TYPE_DOUBLE:
+		for (i = 0; i < n; i++) res[i].ul = a[i].d == 0;
+		break;
+	}
+    }
+    else {
+	switch (lp->np->desc.type) {
+	    case PM_TYPE_32:
+		for (i = 0; i < n; i++) res[i].l = -a[i].l;
+		break;
+	    case PM_TYPE_U32:
+		for (i = 0; i < n; i++) res[i].l = -a[i].ul;
+		break;
+	    case PM_TYPE_64:
+		for (i = 0; i < n; i++) res[i].ll = -a[i].ll;
+		break;
+	    case PM_TYPE_U64:
+		for (i = 0; i < n; i++) res[i].ll = -a[i].ull;
+		break;
+	    case PM_TYPE_FLOAT:
+		for (i = 0; i < n; i++) res[i].f = -a[i].f;
+		break;
+	    case PM_TYPE_DOUBLE:
+		for (i = 0; i < n; i++) res[i].d = -a[i].d;
+		break;
+	}
+    }
+    memcpy(ip->inst, lp->inst, n * sizeof(int));
+    return ip->numval = n;
+}
+
+/* delta() and rate() ... this and the last values are in the left operand */
+static int
+exec_delta(prog_t *pp, insn_t *ip, pmResult *rp)
+{
+    insn_t		*lp = &pp->insn[ip->left];
+    info_t		*info = ip->np->data.info;
+    const pmAtomValue	*a;
+    const pmAtomValue	*b;
+    struct timeval	stampdiff;
+    double		dt;
+    double		scale;
+    int			i;
+    int			j;
+    int			k;
+    int			n;
+
+    info->last_stamp = info->stamp;
+    info->stamp = rp->timestamp;
+    n = lp->numval <= lp->last_numval ? lp->numval : lp->last_numval;
+    if (n <= 0)
+	return ip->numval = n;
+    grow(ip, n);
+
+    if (lp->numval == lp->last_numval &&
+	memcmp(lp->inst, lp->last_inst, n * sizeof(int)) == 0) {
+	a = lp->val;
+	b = lp->last_val;
+	memcpy(ip->inst, lp->inst, n * sizeof(int));
+	k = n;
+    }
+    else {
+	/* match up instances as eval_expr() does */
+	grow_scratch(pp, lp->numval);
+	for (i = k = 0; i < lp->numval; i++) {
+	    j = i;
+	    if (j >= lp->last_numval)
+		j = 0;
+	    if (lp->inst[i] != lp->last_inst[j]) {
+		for (j = 0; j < lp->last_numval; j++) {
+		    if (lp->inst[i] == lp->last_inst[j])
+			break;
+		}
+		if (j == lp->last_numval)
+		    continue;
+	    }
+	    ip->inst[k] = lp->inst[i];
+	    pp->lval[k] = lp->val[i];
+	    pp->rval[k] = lp->last_val[j];
+	    k++;
+	}
+	a = pp->lval;
+	b = pp->rval;
+    }
+
+    /* difference in the operand type, for delta() the result type */
+    binop(N_MINUS, lp->np->desc.type, ip->val, a, b, k);
+    if (ip->op == N_RATE) {
+	stampdiff = info->stamp;
+	pmtimevalDec(&stampdiff, &info->last_stamp);
+	dt = pmtimevalToReal(&stampdiff);
+	convert(ip->val, ip->val, k, lp->np->desc.type, PM_TYPE_DOUBLE);
+	for (i = 0; i < k; i++)
+	    ip->val[i].d /= dt;
+	/* check_expr() ensures dimTime is 0 or 1 at bind time */
+	if (lp->np->desc.units.dimTime == 1) {
+	    scale = time_scale(ip->np);
+	    for (i = 0; i < k; i++)
+		ip->val[i].d *= scale;
+	}
+    }
+    return ip->numval = k;
+}
+
+/* avg(), count(), max(), min() and sum() over the left operand */
+static int
+exec_aggr(prog_t *pp, insn_t *ip)
+{
+    insn_t		*lp = &pp->insn[ip->left];
+    const pmAtomValue	*a = lp->val;
+    pmAtomValue		*res;
+    int			n = lp->numval;
+    int			i;
+
+    if (ip->maxval == 0) {
+	grow(ip, 1);
+	ip->inst[0] = PM_IN_NULL;
+	memset(&ip->val[0], 0, sizeof(pmAtomValue));
+    }
+    res = &ip->val[0];
+    ip->numval = 1;
+
+    if (ip->op == N_COUNT) {
+	/* errors are mapped to a count of 0 */
+	res->l = n < 0 ? 0 : n;
+	return ip->numval;
+    }
+
+    if (ip->op == N_AVG) {
+	res->f = 0;
+	switch (lp->np->desc.type) {
+	    case PM_TYPE_32:
+		for (i = 0; i < n; i++) res->f += (float)a[i].l / n;
+		break;
+	    case PM_TYPE_U32:
+		for (i = 0; i < n; i++) res->f += (float)a[i].ul / n;
+		break;
+	    case PM_TYPE_64:
+		for (i = 0; i < n; i++) res->f += (float)a[i].ll / n;
+		break;
+	    case PM_TYPE_U64:
+		for (i = 0; i < n; i++) res->f += (float)a[i].ull / n;
+		break;
+	    case PM_TYPE_FLOAT:
+		for (i = 0; i < n; i++) res->f += (float)a[i].f / n;
+		break;
+	    case PM_TYPE_DOUBLE:
+		for (i = 0; i < n; i++) res->f += (float)a[i].d / n;
+		break;
+	}
+	return ip->numval;
+    }
+
+#define AGGR_LOOPS(f) \
+	switch (ip->op) { \
+	    case N_SUM: \
+		res->f = 0; \
+		for (i = 0; i < n; i++) res->f += a[i].f; \
+		break; \
+	    case N_MAX: \
+		for (i = 0; i < n; i++) { \
+		    if (i == 0 || res->f < a[i].f) res->f = a[i].f; \
+		} \
+		break; \
+	    case N_MIN: \
+		for (i = 0; i < n; i++) { \
+		    if (i == 0 || res->f > a[i].f) res->f = a[i].f; \
+		} \
+		break; \
+	}
+
+    switch (ip->np->desc.type) {
+	case PM_TYPE_32:
+	    AGGR_LOOPS(l)
+	    break;
+	case PM_TYPE_U32:
+	    AGGR_LOOPS(ul)
+	    break;
+	case PM_TYPE_64:
+	    AGGR_LOOPS(ll)
+	    break;
+	case PM_TYPE_U64:
+	    AGGR_LOOPS(ull)
+	    break;
+	case PM_TYPE_FLOAT:
+	    AGGR_LOOPS(f)
+	    break;
+	case PM_TYPE_DOUBLE:
+	    AGGR_LOOPS(d)
+	    break;
+    }
+    return ip->numval;
+}
+
+/* subtree that is not compiled, evaluate with eval_expr() */
+static int
+exec_walk(insn_t *ip, __pmContext *ctxp, pmResult *rp)
+{
+    val_t	*ivlist;
+    int		n;
+    int		i;
+
+    if ((n = eval_expr(ctxp, ip->np, rp, 1)) <= 0)
+	return ip->numval = n;
+    grow(ip, n);
+    ivlist = ip->np->data.info->ivlist;
+    for (i = 0; i < n; i++) {
+	ip->inst[i] = ivlist[i].inst;
+	ip->val[i] = ivlist[i].value;
+    }
+    return ip->numval = n;
+}
+
+/*
+ * Run the program for the expression expr, leaving the result in the
+ * ivlist[] of the root node as eval_expr() would.
+ */
+static int
+eval_prog(__pmContext *ctxp, node_t *expr, prog_t *pp, pmResult *rp)
+{
+    insn_t	*ip;
+    info_t	*info = expr->data.info;
+    int		sts = 0;
+    int		i;
+
+    for (ip = pp->insn; ip < &pp->insn[pp->ninsn]; ip++) {
+	switch (ip->op) {
+	    case N_NAME:
+		sts = exec_name(ip, ctxp, rp);
+		break;
+	    case N_INTEGER:
+	    case N_DOUBLE:
+		sts = ip->numval;
+		break;
+	    case N_NOT:
+	    case N_NEG:
+		sts = exec_unary(pp, ip);
+		break;
+	    case N_DELTA:
+	    case N_RATE:
+		sts = exec_delta(pp, ip, rp);
+		break;
+	    case N_AVG:
+	    case N_COUNT:
+	    case N_MAX:
+	    case N_MIN:
+	    case N_SUM:
+		sts = exec_aggr(pp, ip);
+		break;
+	    case I_WALK:
+		sts = exec_walk(ip, ctxp, rp);
+		break;
+	    default:
+		sts = exec_binop(pp, ip);
+		break;
+	}
+	if (sts < 0) {
+	    /*
+	     * as for eval_expr(), the error is returned up the tree
+	     * until it reaches count() which maps it to 0, and any
+	     * operands not yet evaluated are skipped
+	     */
+	    ip->numval = sts;
+	    while (ip->parent >= 0 && pp->insn[ip->parent].op != N_COUNT) {
+		ip = &pp->insn[ip->parent];
+		ip->numval = sts;
+	    }
+	    if (ip->parent < 0)
+		return sts;
+	    /* resume with count() */
+	    ip = &pp->insn[ip->parent] - 1;
+	}
+    }
+
+    ip = &pp->insn[pp->ninsn-1];
+    info->numval = ip->numval;
+    if (ip->numval > 0) {
+	if ((info->ivlist = (val_t *)realloc(info->ivlist, ip->numval * sizeof(val_t))) == NULL) {
+	    pmNoMem("eval_prog: root ivlist", ip->numval * sizeof(val_t), PM_FATAL_ERR);
+	    /*NOTREACHED*/
+	}
+	for (i = 0; i < ip->numval; i++) {
+	    info->ivlist[i].inst = ip->inst[i];
+	    info->ivlist[i].value = ip->val[i];
+	}
+    }
+    return info->numval;
+}
+
+/*
+ * Restore the state saved by __dmprefetch() for a fetch of numpmid
+ * metrics that included derived metrics, when other fetches have been
+ * prepared since, as for pmFetchAsync().
+ */
+void
+__dmresumefetch(__pmContext *ctxp, int numpmid)
+{
+    ctl_t	*cp = (ctl_t *)ctxp->c_dm;
+
+    if (cp == NULL)
+	return;
+    cp->numpmid = numpmid;
+    cp->fetch_has_dm = 1;
+}
+
+/* per-vset state carried from pass 1 to pass 2 of __dmpostfetch() */
+typedef struct {
+    int		numval;
+    int		valfmt;
+    int		rewrite;
+    int		m;
+} postfetch_t;
+
 /*
  * Algorithm here is complicated by trying to re-write the pmResult.
  *
@@ -1773,12 +2738,11 @@ eval_expr(__pmContext *ctxp, node_t *np, pmResult *rp, int level)
  * This means ...
  * - malloc() the pmResult (padded out to the right number of vset[]
  *   entries)
- * - if valfmt is not PM_VAL_INSITU use PM_VAL_DPTR (not PM_VAL_SPTR),
- *   so anything we point to is going to be released when our caller
- *   calls pmFreeResult()
- * - use one malloc() for each pmValueSet with vlist[] sized to be 0
- *   if numval < 0 else numval
- * - pmValueBlocks are from malloc()
+ * - if valfmt is not PM_VAL_INSITU use PM_VAL_DPTR (not PM_VAL_SPTR)
+ * - every pmValueSet (with vlist[] sized to be 0 if numval < 0 else
+ *   numval) and every pmValueBlock comes from one result arena, so
+ *   the first pass evaluates the derived metrics and sizes the new
+ *   pmResult, and the second pass builds it
  *
  * For reference, the same logic appears in __pmLogFetchInterp() to
  * sythesize a pmResult there.
@@ -1793,9 +2757,13 @@ __dmpostfetch(__pmContext *ctxp, pmResult **result)
     int		valfmt;
     size_t	need;
     int		rewrite;
+    int		sts;
     ctl_t	*cp = (ctl_t *)ctxp->c_dm;
     pmResult	*rp = *result;
     pmResult	*newrp;
+    postfetch_t	*pfp;
+    __pmResultArena	arena;
+    size_t	rsize;
 
     /* if needed, __dminit() called in __dmopencontext beforehand */
 
@@ -1808,7 +2776,15 @@ __dmpostfetch(__pmContext *ctxp, pmResult **result)
     }
     newrp->timestamp = rp->timestamp;
     newrp->numpmid = cp->numpmid;
+    if ((pfp = (postfetch_t *)malloc(newrp->numpmid * sizeof(postfetch_t))) == NULL) {
+	pmNoMem("__dmpostfetch: pfp", newrp->numpmid * sizeof(postfetch_t), PM_FATAL_ERR);
+	/*NOTREACHED*/
+    }
 
+    /*
+     * pass 1 ... evaluate the derived metrics and size the new pmResult
+     */
+    rsize = 0;
     for (j = 0; j < newrp->numpmid; j++) {
 	numval = rp->vset[j]->numval;
 	valfmt = rp->vset[j]->valfmt;
@@ -1831,7 +2807,22 @@ __dmpostfetch(__pmContext *ctxp, pmResult **result)
 			    valfmt = PM_VAL_INSITU;
 			else
 			    valfmt = PM_VAL_DPTR;
-			numval = eval_expr(ctxp, cp->mlist[m].expr, rp, 1);
+			/*
+			 * evaluate once, even if the same derived metric
+			 * is in the pmResult more than once
+			 */
+			for (i = 0; i < j; i++) {
+			    if (pfp[i].rewrite && pfp[i].m == m)
+				break;
+			}
+			if (i < j) {
+			    numval = pfp[i].numval;
+			    break;
+			}
+			if (cp->mlist[m].prog != NULL)
+			    numval = eval_prog(ctxp, cp->mlist[m].expr, cp->mlist[m].prog, rp);
+			else
+			    numval = eval_expr(ctxp, cp->mlist[m].expr, rp, 1);
     if (pmDebugOptions.derive && pmDebugOptions.appl2) {
 	int	k;
 	char	strbuf[20];
@@ -1868,6 +2859,61 @@ __dmpostfetch(__pmContext *ctxp, pmResult **result)
 	    }
 	}
 
+	pfp[j].numval = numval;
+	pfp[j].valfmt = valfmt;
+	pfp[j].rewrite = rewrite;
+	pfp[j].m = m;
+
+	if (numval <= 0) {
+	    /* only need pmid and numval */
+	    rsize += __PM_ARENA_ALIGN(sizeof(pmValueSet) - sizeof(pmValue));
+	    continue;
+	}
+	/* already one pmValue in a pmValueSet */
+	rsize += __PM_ARENA_ALIGN(sizeof(pmValueSet) + (numval - 1)*sizeof(pmValue));
+	for (i = 0; i < numval; i++) {
+	    if (!rewrite) {
+		if (valfmt == PM_VAL_DPTR || valfmt == PM_VAL_SPTR)
+		    rsize += __PM_ARENA_ALIGN(rp->vset[j]->vlist[i].value.pval->vlen);
+		continue;
+	    }
+	    switch (cp->mlist[m].expr->desc.type) {
+		case PM_TYPE_64:
+		case PM_TYPE_U64:
+		    rsize += __PM_ARENA_ALIGN(PM_VAL_HDR_SIZE + sizeof(__int64_t));
+		    break;
+		case PM_TYPE_FLOAT:
+		    rsize += __PM_ARENA_ALIGN(PM_VAL_HDR_SIZE + sizeof(float));
+		    break;
+		case PM_TYPE_DOUBLE:
+		    rsize += __PM_ARENA_ALIGN(PM_VAL_HDR_SIZE + sizeof(double));
+		    break;
+		case PM_TYPE_STRING:
+		    rsize += __PM_ARENA_ALIGN(PM_VAL_HDR_SIZE + cp->mlist[m].expr->data.info->ivlist[i].vlen);
+		    break;
+		case PM_TYPE_AGGREGATE:
+		case PM_TYPE_AGGREGATE_STATIC:
+		case PM_TYPE_EVENT:
+		case PM_TYPE_HIGHRES_EVENT:
+		    rsize += __PM_ARENA_ALIGN(cp->mlist[m].expr->data.info->ivlist[i].vlen);
+		    break;
+	    }
+	}
+    }
+    if ((sts = __pmResultArenaInit(&arena, rsize)) < 0) {
+	pmNoMem("__dmpostfetch: arena", rsize, PM_FATAL_ERR);
+	/*NOTREACHED*/
+    }
+
+    /*
+     * pass 2 ... build the new pmResult in the arena
+     */
+    for (j = 0; j < newrp->numpmid; j++) {
+	numval = pfp[j].numval;
+	valfmt = pfp[j].valfmt;
+	rewrite = pfp[j].rewrite;
+	m = pfp[j].m;
+
 	if (numval <= 0) {
 	    /* only need pmid and numval */
 	    need = sizeof(pmValueSet) - sizeof(pmValue);
@@ -1876,11 +2922,9 @@ __dmpostfetch(__pmContext *ctxp, pmResult **result)
 	    /* already one pmValue in a pmValueSet */
 	    need = sizeof(pmValueSet) + (numval - 1)*sizeof(pmValue);
 	}
-	if (need > 0) {
-	    if ((newrp->vset[j] = (pmValueSet *)malloc(need)) == NULL) {
-		pmNoMem("__dmpostfetch: vset", need, PM_FATAL_ERR);
-		/*NOTREACHED*/
-	    }
+	if ((newrp->vset[j] = (pmValueSet *)__pmResultArenaAlloc(&arena, need)) == NULL) {
+	    pmNoMem("__dmpostfetch: vset", need, PM_FATAL_ERR);
+	    /*NOTREACHED*/
 	}
 	newrp->vset[j]->pmid = rp->vset[j]->pmid;
 	newrp->vset[j]->numval = numval;
@@ -1895,7 +2939,7 @@ __dmpostfetch(__pmContext *ctxp, pmResult **result)
 		newrp->vset[j]->vlist[i].inst = rp->vset[j]->vlist[i].inst;
 		if (rp->vset[j]->valfmt == PM_VAL_DPTR || rp->vset[j]->valfmt == PM_VAL_SPTR) {
 		    need = rp->vset[j]->vlist[i].value.pval->vlen;
-		    vp = (pmValueBlock *)malloc(need);
+		    vp = (pmValueBlock *)__pmResultArenaAlloc(&arena, need);
 		    if (vp == NULL) {
 			pmNoMem("__dmpostfetch: copy value", need, PM_FATAL_ERR);
 			/*NOTREACHED*/
@@ -1910,8 +2954,7 @@ __dmpostfetch(__pmContext *ctxp, pmResult **result)
 		    if (rp->vset[j]->valfmt == PM_VAL_SPTR) {
 			/*
 			 * memcpy() means this is no longer static buffer,
-			 * change valfmt so pmFreeResult() is a happy
-			 * camper and there's no memory leak
+			 * change valfmt to match the other copies
 			 */
 			newrp->vset[j]->valfmt = PM_VAL_DPTR;
 		    }
@@ -1936,7 +2979,7 @@ __dmpostfetch(__pmContext *ctxp, pmResult **result)
 		case PM_TYPE_64:
 		case PM_TYPE_U64:
 		    need = PM_VAL_HDR_SIZE + sizeof(__int64_t);
-		    if ((vp = (pmValueBlock *)malloc(need)) == NULL) {
+		    if ((vp = (pmValueBlock *)__pmResultArenaAlloc(&arena, need)) == NULL) {
 			pmNoMem("__dmpostfetch: 64-bit int value", need, PM_FATAL_ERR);
 			/*NOTREACHED*/
 		    }
@@ -1948,7 +2991,7 @@ __dmpostfetch(__pmContext *ctxp, pmResult **result)
 
 		case PM_TYPE_FLOAT:
 		    need = PM_VAL_HDR_SIZE + sizeof(float);
-		    if ((vp = (pmValueBlock *)malloc(need)) == NULL) {
+		    if ((vp = (pmValueBlock *)__pmResultArenaAlloc(&arena, need)) == NULL) {
 			pmNoMem("__dmpostfetch: float value", need, PM_FATAL_ERR);
 			/*NOTREACHED*/
 		    }
@@ -1960,7 +3003,7 @@ __dmpostfetch(__pmContext *ctxp, pmResult **result)
 
 		case PM_TYPE_DOUBLE:
 		    need = PM_VAL_HDR_SIZE + sizeof(double);
-		    if ((vp = (pmValueBlock *)malloc(need)) == NULL) {
+		    if ((vp = (pmValueBlock *)__pmResultArenaAlloc(&arena, need)) == NULL) {
 			pmNoMem("__dmpostfetch: double value", need, PM_FATAL_ERR);
 			/*NOTREACHED*/
 		    }
@@ -1972,7 +3015,7 @@ __dmpostfetch(__pmContext *ctxp, pmResult **result)
 
 		case PM_TYPE_STRING:
 		    need = PM_VAL_HDR_SIZE + cp->mlist[m].expr->data.info->ivlist[i].vlen;
-		    vp = (pmValueBlock *)malloc(need);
+		    vp = (pmValueBlock *)__pmResultArenaAlloc(&arena, need);
 		    if (vp == NULL) {
 			pmNoMem("__dmpostfetch: string value", need, PM_FATAL_ERR);
 			/*NOTREACHED*/
@@ -1988,7 +3031,7 @@ __dmpostfetch(__pmContext *ctxp, pmResult **result)
 		case PM_TYPE_EVENT:
 		case PM_TYPE_HIGHRES_EVENT:
 		    need = cp->mlist[m].expr->data.info->ivlist[i].vlen;
-		    vp = (pmValueBlock *)malloc(need);
+		    vp = (pmValueBlock *)__pmResultArenaAlloc(&arena, need);
 		    if (vp == NULL) {
 			pmNoMem("__dmpostfetch: aggregate or event value", need, PM_FATAL_ERR);
 			/*NOTREACHED*/
@@ -2011,6 +3054,9 @@ __dmpostfetch(__pmContext *ctxp, pmResult **result)
 	}
     }
 
+    __pmResultArenaDone(&arena);
+    free(pfp);
+
     /*
      * cull the original pmResult and return the rewritten one
      */
@@ -1,8 +1,9 @@
 /*
  * Unpack an array of event records
  * Free space from unpack
+ * Iterate over an array of event records in place
  *
- * Copyright (c) 2014 Red Hat.
+ * Copyright (c) 2014,2020 Red Hat.
  * Copyright (c) 2010 Ken McDonell.  All Rights Reserved.
  * 
  * This library is free software; you can redistribute it and/or modify it
@@ -712,3 +713,150 @@ pmFreeHighResEventResult(pmHighResResult **rset)
 	__pmFreeHighResResult(rset[r]);
     free(rset);
 }
+
+/*
+ * Iterate over the event records of the idx'th instance of an event
+ * record metric value (either type) in place ... unlike unpacking,
+ * there is nothing allocated and nothing to free, and parameters are
+ * returned in a pmValueSet in the iterator that refers directly to
+ * the value in the packed array.
+ *
+ * Returns the number of event records, else an error code.
+ */
+int
+pmEventIterInit(pmEventIter *iter, pmValueSet *vsp, int idx)
+{
+    pmEventArray	*eap;
+    int			sts;
+
+    memset(iter, 0, sizeof(*iter));
+    iter->ei_record = -1;
+    if (vsp->numval < 1)
+	return vsp->numval;
+    if (vsp->valfmt != PM_VAL_DPTR && vsp->valfmt != PM_VAL_SPTR)
+	return PM_ERR_CONV;
+
+    /* same header for both types, but check_event_records() needs to know */
+    eap = (pmEventArray *)vsp->vlist[idx].value.pval;
+    iter->ei_type = eap->ea_type;
+    if ((sts = check_event_records(vsp, idx,
+			iter->ei_type == PM_TYPE_HIGHRES_EVENT)) < 0) {
+	dump_event_records(stderr, vsp, idx,
+			iter->ei_type == PM_TYPE_HIGHRES_EVENT);
+	return sts;
+    }
+    iter->ei_nrecords = eap->ea_nrecords;
+    if (iter->ei_type == PM_TYPE_HIGHRES_EVENT)
+	iter->ei_next = (char *)&((pmHighResEventArray *)eap)->ea_record[0];
+    else
+	iter->ei_next = (char *)&eap->ea_record[0];
+    iter->ei_vset.numval = 1;
+    iter->ei_vset.vlist[0].inst = PM_IN_NULL;
+    return iter->ei_nrecords;
+}
+
+/*
+ * Move to the next event record, skipping any parameters not yet
+ * seen in the current one.  Returns 1, or 0 if there are no more
+ * event records.
+ */
+int
+pmEventIterNextRecord(pmEventIter *iter)
+{
+    pmEventParameter	*epp;
+
+    if (iter->ei_record >= iter->ei_nrecords - 1) {
+	iter->ei_record = iter->ei_nrecords;
+	return 0;
+    }
+    for (; iter->ei_param < iter->ei_nparams; iter->ei_param++) {
+	epp = (pmEventParameter *)iter->ei_next;
+	iter->ei_next += sizeof(epp->ep_pmid) + PM_PDU_SIZE_BYTES(epp->ep_len);
+    }
+    iter->ei_record++;
+
+    if (iter->ei_type == PM_TYPE_HIGHRES_EVENT) {
+	pmHighResEventRecord	*hrerp = (pmHighResEventRecord *)iter->ei_next;
+
+	iter->ei_timestamp.tv_sec = hrerp->er_timestamp.tv_sec;
+	iter->ei_timestamp.tv_nsec = hrerp->er_timestamp.tv_nsec;
+	iter->ei_flags = hrerp->er_flags;
+	iter->ei_nparams = hrerp->er_nparams;
+	iter->ei_next += sizeof(hrerp->er_timestamp) + sizeof(hrerp->er_flags) +
+			 sizeof(hrerp->er_nparams);
+    }
+    else {
+	pmEventRecord	*erp = (pmEventRecord *)iter->ei_next;
+
+	iter->ei_timestamp.tv_sec = erp->er_timestamp.tv_sec;
+	iter->ei_timestamp.tv_nsec = erp->er_timestamp.tv_usec * 1000;
+	iter->ei_flags = erp->er_flags;
+	iter->ei_nparams = erp->er_nparams;
+	iter->ei_next += sizeof(erp->er_timestamp) + sizeof(erp->er_flags) +
+			 sizeof(erp->er_nparams);
+    }
+    iter->ei_param = 0;
+
+    /* for missed records er_nparams is the count, not parameters */
+    if (iter->ei_flags & PM_EVENT_FLAG_MISSED) {
+	iter->ei_missed = iter->ei_nparams;
+	iter->ei_nparams = 0;
+    }
+    else
+	iter->ei_missed = 0;
+    return 1;
+}
+
+/*
+ * Next parameter of the current event record, in *vspp with numval
+ * of 1.  The pmValueSet belongs to the iterator, and is only valid
+ * until the next call.  Values that are not insitu refer to the packed
+ * array (PM_VAL_SPTR), so the pmValueSet must not be freed.
+ *
+ * Returns 1, 0 if there are no more parameters in this record, else
+ * an error code, e.g. PM_ERR_TYPE for a nested event record parameter,
+ * which is skipped.
+ */
+int
+pmEventIterNextParam(pmEventIter *iter, pmValueSet **vspp)
+{
+    pmEventParameter	*epp;
+    pmValueSet		*vsp = &iter->ei_vset;
+    char		*vbuf;
+
+    if (iter->ei_record < 0 || iter->ei_record >= iter->ei_nrecords ||
+	iter->ei_param >= iter->ei_nparams)
+	return 0;
+
+    /* step past this parameter now, even if it cannot be returned */
+    epp = (pmEventParameter *)iter->ei_next;
+    iter->ei_next += sizeof(epp->ep_pmid) + PM_PDU_SIZE_BYTES(epp->ep_len);
+    iter->ei_param++;
+    switch (epp->ep_type) {
+	case PM_TYPE_32:
+	case PM_TYPE_U32:
+	    vbuf = (char *)epp + sizeof(epp->ep_pmid) + sizeof(int);
+	    vsp->valfmt = PM_VAL_INSITU;
+	    memcpy((void *)&vsp->vlist[0].value.lval, (void *)vbuf, sizeof(__int32_t));
+	    break;
+	case PM_TYPE_64:
+	case PM_TYPE_U64:
+	case PM_TYPE_FLOAT:
+	case PM_TYPE_DOUBLE:
+	case PM_TYPE_AGGREGATE:
+	case PM_TYPE_STRING:
+	case PM_TYPE_AGGREGATE_STATIC:
+	    /* type and length are laid out as in a pmValueBlock */
+	    vsp->valfmt = PM_VAL_SPTR;
+	    vsp->vlist[0].value.pval =
+		    (pmValueBlock *)((char *)epp + sizeof(epp->ep_pmid));
+	    break;
+	case PM_TYPE_EVENT:	/* no nesting! */
+	case PM_TYPE_HIGHRES_EVENT:
+	default:
+	    return PM_ERR_TYPE;
+    }
+    vsp->pmid = epp->ep_pmid;
+    *vspp = vsp;
+    return 1;
+}
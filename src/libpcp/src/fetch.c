@@ -85,6 +85,8 @@ __pmFinishResult(__pmContext *ctxp, int count, pmResult **resultp)
     return count;
 }
 
+static int async_drain(__pmContext *);
+
 /*
  * Internal variant of pmFetch() ... ctxp is not NULL for
  * internal callers where the current context is already locked, but
@@ -133,6 +135,14 @@ pmFetch_ctx(__pmContext *ctxp, int numpmid, pmID *pmidlist, pmResult **result)
 	    goto pmapi_return;
 	}
 
+	/*
+	 * replies for any pmFetchAsync() requests come first, and before
+	 * __pmPrepareFetch() as derived metrics for these may need
+	 * evaluating
+	 */
+	if (ctxp->c_type == PM_CONTEXT_HOST && (sts = async_drain(ctxp)) < 0)
+	    goto pmapi_return;
+
 	/* for derived metrics, may need to rewrite the pmidlist */
 	have_dm = newcnt = __pmPrepareFetch(ctxp, numpmid, pmidlist, &newlist);
 	if (newcnt > numpmid) {
@@ -235,6 +245,374 @@ pmFetch(int numpmid, pmID *pmidlist, pmResult **result)
     return sts;
 }
 
+/*
+ * Asynchronous fetch.
+ *
+ * PMCD replies to the requests from a client in the order they were
+ * sent, so several fetches may be outstanding on the one connection
+ * with each reply belonging to the oldest request still waiting.
+ * Replies are decoded (and any derived metrics evaluated) as they are
+ * received, and the callbacks are made later from
+ * pmFetchAsyncComplete() without the context lock held, so a callback
+ * may issue the next pmFetchAsync() for the context.
+ */
+
+/* limit on requests awaiting replies, beyond this pmFetchAsync() waits */
+#define ASYNC_MAXSENT	32
+
+typedef struct asyncreq {
+    struct asyncreq	*next;
+    int			seq;		/* request sequence number */
+    int			numpmid;	/* before derived metric rewrite */
+    int			have_dm;	/* derived metrics in the request */
+    int			sts;		/* status of the reply */
+    pmResult		*result;	/* the reply */
+    pmFetchCallBack	callback;
+    void		*data;
+} asyncreq_t;
+
+typedef struct asyncctl {
+    struct asyncctl	*next;		/* all contexts using pmFetchAsync() */
+    __pmContext		*ctxp;
+    int			seq;		/* last sequence number issued */
+    int			nsent;		/* requests awaiting replies */
+    asyncreq_t		*sent;		/* ... oldest first */
+    asyncreq_t		**sent_tail;
+    asyncreq_t		*done;		/* replies, callbacks not yet made */
+    asyncreq_t		**done_tail;
+} asyncctl_t;
+
+static asyncctl_t	*async_list;
+
+#ifdef PM_MULTI_THREAD
+static pthread_mutex_t	async_lock = PTHREAD_MUTEX_INITIALIZER;
+#else
+void			*async_lock;
+#endif
+
+static asyncctl_t *
+async_ctl(__pmContext *ctxp)
+{
+    __pmPMCDCtl	*pc = ctxp->c_pmcd;
+    asyncctl_t	*ap = (asyncctl_t *)pc->pc_async;
+
+    if (ap == NULL) {
+	if ((ap = (asyncctl_t *)calloc(1, sizeof(asyncctl_t))) == NULL)
+	    return NULL;
+	ap->ctxp = ctxp;
+	ap->sent_tail = &ap->sent;
+	ap->done_tail = &ap->done;
+	pc->pc_async = ap;
+	PM_LOCK(async_lock);
+	ap->next = async_list;
+	async_list = ap;
+	PM_UNLOCK(async_lock);
+    }
+    return ap;
+}
+
+/* oldest request awaiting a reply is done */
+static void
+async_done(asyncctl_t *ap, int sts, pmResult *result)
+{
+    asyncreq_t	*rp = ap->sent;
+
+    if ((ap->sent = rp->next) == NULL)
+	ap->sent_tail = &ap->sent;
+    ap->nsent--;
+    rp->next = NULL;
+    rp->sts = sts;
+    rp->result = result;
+    *ap->done_tail = rp;
+    ap->done_tail = &rp->next;
+}
+
+/*
+ * Receive the reply for the oldest request awaiting one ... the
+ * context is locked.
+ */
+static int
+async_recv(__pmContext *ctxp, asyncctl_t *ap)
+{
+    asyncreq_t	*rp = ap->sent;
+    pmResult	*result = NULL;
+    int		sts;
+
+    PM_FAULT_POINT("libpcp/" __FILE__ ":2", PM_FAULT_TIMEOUT);
+    sts = __pmRecvFetch(ctxp->c_pmcd->pc_fd, ctxp, ctxp->c_pmcd->pc_tout_sec, &result);
+    if (sts == PM_ERR_TIMEOUT) {
+	/*
+	 * part of the reply may have been read, so the connection is
+	 * out of step with pmcd and cannot be used again ... close it,
+	 * and pmReconnectContext() is needed for the next request
+	 */
+	__pmCloseSocket(ctxp->c_pmcd->pc_fd);
+	ctxp->c_pmcd->pc_fd = -1;
+	async_done(ap, sts, NULL);
+	__pmFetchAsyncAbort(ctxp, PM_ERR_IPC);
+	return sts;
+    }
+    if (sts == PM_ERR_IPC) {
+	/* connection is broken, so no replies for any of them */
+	__pmFetchAsyncAbort(ctxp, sts);
+	return sts;
+    }
+    if (rp->have_dm) {
+	/* other fetches may have been prepared since this one */
+	__dmresumefetch(ctxp, rp->numpmid);
+	__pmFinishResult(ctxp, sts, &result);
+    }
+    async_done(ap, sts, sts >= 0 ? result : NULL);
+    return 0;
+}
+
+/*
+ * Wait for the replies to all outstanding requests, before some other
+ * request is sent to pmcd.
+ */
+static int
+async_drain(__pmContext *ctxp)
+{
+    asyncctl_t	*ap = (asyncctl_t *)ctxp->c_pmcd->pc_async;
+    int		sts;
+
+    while (ap != NULL && ap->sent != NULL) {
+	if ((sts = async_recv(ctxp, ap)) < 0)
+	    return sts;
+    }
+    return 0;
+}
+
+/*
+ * Called from __pmXmitPDU() for any request other than a fetch or a
+ * profile, so replies for pmFetchAsync() requests outstanding on the
+ * connection are not taken as the reply to the new request.  The
+ * context owning fd is locked by the caller.
+ */
+int
+__pmFetchAsyncDrain(int fd)
+{
+    asyncctl_t	*ap;
+
+    /* unlocked peek, the common case is no pmFetchAsync() at all */
+    if (async_list == NULL)
+	return 0;
+
+    PM_LOCK(async_lock);
+    for (ap = async_list; ap != NULL; ap = ap->next) {
+	if (ap->sent != NULL && ap->ctxp->c_pmcd->pc_fd == fd)
+	    break;
+    }
+    PM_UNLOCK(async_lock);
+    if (ap == NULL)
+	return 0;
+
+    PM_ASSERT_IS_LOCKED(ap->ctxp->c_lock);
+    return async_drain(ap->ctxp);
+}
+
+/*
+ * Requests still awaiting replies will not get them, e.g. when the
+ * connection to pmcd is closed.
+ */
+void
+__pmFetchAsyncAbort(__pmContext *ctxp, int sts)
+{
+    asyncctl_t	*ap = (asyncctl_t *)ctxp->c_pmcd->pc_async;
+
+    while (ap != NULL && ap->sent != NULL)
+	async_done(ap, sts, NULL);
+}
+
+/* context is being destroyed, callbacks are not made */
+void
+__pmFetchAsyncFree(__pmPMCDCtl *pc)
+{
+    asyncctl_t	*ap = (asyncctl_t *)pc->pc_async;
+    asyncctl_t	**app;
+    asyncreq_t	*rp;
+
+    if (ap == NULL)
+	return;
+    PM_LOCK(async_lock);
+    for (app = &async_list; *app != NULL; app = &(*app)->next) {
+	if (*app == ap) {
+	    *app = ap->next;
+	    break;
+	}
+    }
+    PM_UNLOCK(async_lock);
+    while ((rp = ap->sent) != NULL) {
+	ap->sent = rp->next;
+	free(rp);
+    }
+    while ((rp = ap->done) != NULL) {
+	ap->done = rp->next;
+	if (rp->result != NULL)
+	    pmFreeResult(rp->result);
+	free(rp);
+    }
+    free(ap);
+    pc->pc_async = NULL;
+}
+
+int
+pmFetchAsync(int numpmid, pmID *pmidlist, pmFetchCallBack callback, void *data)
+{
+    __pmContext	*ctxp;
+    asyncctl_t	*ap;
+    asyncreq_t	*rp = NULL;
+    pmID	*newlist = NULL;
+    int		newcnt;
+    int		fd, sts, tout;
+
+    if (pmDebugOptions.pmapi) {
+	char    dbgbuf[20];
+	fprintf(stderr, "pmFetchAsync(%d, pmid[0] %s", numpmid, numpmid < 1 ? "none" : pmIDStr_r(pmidlist[0], dbgbuf, sizeof(dbgbuf)));
+	if (numpmid > 1)
+	    fprintf(stderr, " ... pmid[%d] %s", numpmid-1, pmIDStr_r(pmidlist[numpmid-1], dbgbuf, sizeof(dbgbuf)));
+	fprintf(stderr, ", ...) <:");
+    }
+
+    if (numpmid < 1) {
+	sts = PM_ERR_TOOSMALL;
+	goto pmapi_return;
+    }
+    if (callback == NULL) {
+	sts = -EINVAL;
+	goto pmapi_return;
+    }
+    if ((sts = pmWhichContext()) < 0)
+	goto pmapi_return;
+    if ((ctxp = __pmHandleToPtr(sts)) == NULL) {
+	sts = PM_ERR_NOCONTEXT;
+	goto pmapi_return;
+    }
+
+    if (ctxp->c_type != PM_CONTEXT_HOST)
+	sts = PM_ERR_NOTHOST;
+    else if ((ap = async_ctl(ctxp)) == NULL ||
+	     (rp = (asyncreq_t *)calloc(1, sizeof(asyncreq_t))) == NULL)
+	sts = -ENOMEM;
+    else if (ap->nsent >= ASYNC_MAXSENT && (sts = async_recv(ctxp, ap)) < 0)
+	/* too many outstanding, and no reply for the oldest */
+	;
+    else {
+	/* for derived metrics, may need to rewrite the pmidlist */
+	rp->numpmid = numpmid;
+	rp->have_dm = newcnt = __pmPrepareFetch(ctxp, numpmid, pmidlist, &newlist);
+	if (newcnt > numpmid) {
+	    numpmid = newcnt;
+	    pmidlist = newlist;
+	}
+
+	tout = ctxp->c_pmcd->pc_tout_sec;
+	fd = ctxp->c_pmcd->pc_fd;
+	if ((sts = __pmUpdateProfile(fd, ctxp, tout)) < 0 ||
+	    (sts = __pmSendFetch(fd, __pmPtrToHandle(ctxp), ctxp->c_slot,
+				&ctxp->c_origin, numpmid, pmidlist)) < 0) {
+	    sts = __pmMapErrno(sts);
+	}
+	else {
+	    if (ap->seq == INT_MAX)
+		ap->seq = 0;
+	    rp->seq = sts = ++ap->seq;
+	    rp->callback = callback;
+	    rp->data = data;
+	    *ap->sent_tail = rp;
+	    ap->sent_tail = &rp->next;
+	    ap->nsent++;
+	    rp = NULL;
+	}
+	if (newlist != NULL)
+	    free(newlist);
+    }
+    if (rp != NULL)
+	free(rp);
+    PM_UNLOCK(ctxp->c_lock);
+
+pmapi_return:
+
+    if (pmDebugOptions.pmapi) {
+	fprintf(stderr, ":> returns ");
+	if (sts >= 0)
+	    fprintf(stderr, "%d\n", sts);
+	else {
+	    char	errmsg[PM_MAXERRMSGLEN];
+	    fprintf(stderr, "%s\n", pmErrStr_r(sts, errmsg, sizeof(errmsg)));
+	}
+    }
+
+    return sts;
+}
+
+/*
+ * Receive the replies that have arrived for the context (or with wait
+ * set, wait for at least one) and make the callbacks.
+ */
+int
+pmFetchAsyncComplete(int handle, int wait)
+{
+    __pmContext		*ctxp;
+    asyncctl_t		*ap;
+    asyncreq_t		*rp;
+    asyncreq_t		*done = NULL;
+    struct timeval	nowait;
+    int			n = 0;
+    int			sts = 0;
+
+    if ((ctxp = __pmHandleToPtr(handle)) == NULL)
+	return PM_ERR_NOCONTEXT;
+    if (ctxp->c_type != PM_CONTEXT_HOST) {
+	PM_UNLOCK(ctxp->c_lock);
+	return PM_ERR_NOTHOST;
+    }
+    if ((ap = (asyncctl_t *)ctxp->c_pmcd->pc_async) != NULL) {
+	while (ap->sent != NULL) {
+	    if (ap->done != NULL || !wait) {
+		/* only if there is something to read */
+		nowait.tv_sec = nowait.tv_usec = 0;
+		if (__pmSocketReady(ctxp->c_pmcd->pc_fd, &nowait) <= 0)
+		    break;
+	    }
+	    if ((sts = async_recv(ctxp, ap)) < 0)
+		break;
+	}
+	done = ap->done;
+	ap->done = NULL;
+	ap->done_tail = &ap->done;
+    }
+    PM_UNLOCK(ctxp->c_lock);
+
+    while ((rp = done) != NULL) {
+	done = rp->next;
+	if (pmDebugOptions.fetch)
+	    fprintf(stderr, "pmFetchAsyncComplete(%d): request %d: sts=%d\n",
+			handle, rp->seq, rp->sts);
+	rp->callback(handle, rp->seq, rp->sts, rp->result, rp->data);
+	free(rp);
+	n++;
+    }
+
+    return n > 0 ? n : sts;
+}
+
+int
+pmFetchAsyncFd(int handle)
+{
+    __pmContext	*ctxp;
+    int		sts;
+
+    if ((ctxp = __pmHandleToPtr(handle)) == NULL)
+	return PM_ERR_NOCONTEXT;
+    if (ctxp->c_type != PM_CONTEXT_HOST)
+	sts = PM_ERR_NOTHOST;
+    else if ((sts = ctxp->c_pmcd->pc_fd) < 0)
+	sts = PM_ERR_NOTCONN;
+    PM_UNLOCK(ctxp->c_lock);
+    return sts;
+}
+
 int
 pmFetchArchive(pmResult **result)
 {
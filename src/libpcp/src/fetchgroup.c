@@ -45,6 +45,11 @@ struct __pmFetchGroup {
     struct __pmFetchGroupItem *items;
     pmID *unique_pmids;
     size_t num_unique_pmids;
+    int async_seq;		/* pmFetchAsync() request awaited */
+    int async_abandoned;	/* ... or given up on, reply not yet seen */
+    int async_sts;		/* ... status of its reply */
+    pmResult *async_result;	/* ... and the reply */
+    struct timeval async_start;	/* ... and when it was sent */
 };
 
 /*
@@ -53,8 +58,10 @@ struct __pmFetchGroup {
 struct __pmFetchGroupConversionSpec {
     unsigned rate_convert : 1;
     unsigned unit_convert : 1;
+    unsigned batch_convert : 1;	/* factor valid, see pmExtractValueSet */
     pmUnits output_units;	/* NB: same dim* as input units; maybe different scale */
     double output_multiplier;
+    double factor;		/* pmConvScaleFactor * output_multiplier */
 };
 typedef struct __pmFetchGroupConversionSpec *pmFGC;
 
@@ -93,6 +100,12 @@ struct __pmFetchGroupItem {
 	    int *output_sts;	/* NB: may be NULL */
 	    unsigned output_maxnum;
 	    unsigned *output_num;	/* NB: may be NULL */
+	    double *batch_values;	/* pmExtractValueSet space, current */
+	    double *batch_prev_values;	/* ... and previous values */
+	    int *batch_insts;
+	    int *batch_prev_insts;
+	    int *batch_stss;
+	    unsigned batch_size;
 	} indom;
 	struct {
 	    pmID metric_pmid;
@@ -288,6 +301,21 @@ pmfg_lookup_event(const char *metric, const char *instance, const char *field, p
     return 0;
 }
 
+/*
+ * Precompute the multiplier for unit conversion, so that whole sets of
+ * values can be converted at once, see pmfg_convert_indom().
+ */
+static void
+pmfg_prep_factor(const pmDesc *desc, pmFGC conv)
+{
+    double factor;
+
+    if (pmConvScaleFactor(&desc->units, &conv->output_units, &factor) < 0)
+	conv->batch_convert = 0;	/* pmConvScale fails for each value */
+    else
+	conv->factor = factor * conv->output_multiplier;
+}
+
 /*
  * Parse and type-check the given pmDesc for conversion to given scale
  * units.  Fill in conversion specification.
@@ -327,6 +355,10 @@ pmfg_prep_conversion(const pmDesc *desc, const char *scale, pmFGC conv, int otyp
 	    return PM_ERR_TYPE;
     }
 
+    /* Numeric values may be converted in batches */
+    conv->batch_convert = (desc->type != PM_TYPE_STRING);
+    conv->factor = 1.0;
+
     /* Validate unit conversion */
     if (scale == NULL) {
 	conv->rate_convert = (desc->sem == PM_SEM_COUNTER);
@@ -355,6 +387,7 @@ pmfg_prep_conversion(const pmDesc *desc, const char *scale, pmFGC conv, int otyp
 	    desc->units.dimTime == conv->output_units.dimTime) {
 	    conv->unit_convert = 1;
 	    conv->rate_convert = 0;
+	    pmfg_prep_factor(desc, conv);
 	    return 0;
 	}
 	if (desc->units.dimSpace == conv->output_units.dimSpace &&
@@ -385,6 +418,7 @@ pmfg_prep_conversion(const pmDesc *desc, const char *scale, pmFGC conv, int otyp
 	    conv->output_units.dimTime++;	/* Adjust back to normal dim */
 	    conv->unit_convert = 1;
 	    conv->rate_convert = 1;
+	    pmfg_prep_factor(desc, conv);
 	    return 0;
 	}
 	return PM_ERR_CONV;
@@ -866,6 +900,111 @@ pmfg_fetch_timestamp(pmFG pmfg, pmFGI item, pmResult *newResult)
 	*item->u.timestamp.output_value = newResult->timestamp;
 }
 
+/*
+ * Space for converting the values of an indom item all at once, with
+ * the same number of previous values for rate conversion.
+ */
+static int
+pmfg_grow_batch(pmFGI item, unsigned size)
+{
+    char *space;
+
+    space = realloc(item->u.indom.batch_values,
+		    size * (2 * sizeof(double) + 3 * sizeof(int)));
+    if (space == NULL)
+	return -ENOMEM;
+    item->u.indom.batch_values = (double *)space;
+    item->u.indom.batch_prev_values = item->u.indom.batch_values + size;
+    item->u.indom.batch_insts = (int *)(item->u.indom.batch_prev_values + size);
+    item->u.indom.batch_prev_insts = item->u.indom.batch_insts + size;
+    item->u.indom.batch_stss = item->u.indom.batch_prev_insts + size;
+    item->u.indom.batch_size = size;
+    return 0;
+}
+
+/*
+ * Extract, rate- and unit-convert all the values of an indom item at
+ * once, rather than searching for each instance in the current and
+ * previous pmResults in turn as pmfg_extract_convert_item() does.
+ * The results are left in batch_values[] and batch_stss[] in vlist[]
+ * order.  Returns 0 if the values must be converted one at a time
+ * instead, e.g. for strings.
+ */
+static int
+pmfg_convert_indom(pmFG pmfg, pmFGI item, pmResult *newResult,
+		   const pmValueSet *iv)
+{
+    const pmDesc *desc = &item->u.indom.metric_desc;
+    const pmFGC conv = &item->u.indom.conv;
+    pmResult *prev_r = pmfg->prevResult;
+    const pmValueSet *pv = NULL;
+    struct timespec prev_t, timestamp;
+    double deltaT;
+    const double epsilon = 0.000000001;	/* 1 nanosecond */
+    unsigned size = iv->numval;
+    int i, n, pn, sts = 0;
+
+    if (!conv->batch_convert)
+	return 0;
+
+    if (conv->rate_convert && prev_r) {
+	for (i = 0; i < prev_r->numpmid; i++) {
+	    if (prev_r->vset[i]->pmid == item->u.indom.metric_pmid) {
+		pv = prev_r->vset[i];
+		break;
+	    }
+	}
+	if (pv && pv->numval > (int)size)
+	    size = pv->numval;
+    }
+    if (size > item->u.indom.batch_size && pmfg_grow_batch(item, size) < 0)
+	return 0;
+
+    n = pmExtractValueSet(iv, desc->type,
+		conv->rate_convert ? 1.0 : conv->factor,
+		item->u.indom.batch_insts, item->u.indom.batch_values, size);
+    if (n != iv->numval)	/* malformed value, find it the slow way */
+	return 0;
+
+    if (!conv->rate_convert) {
+	memset(item->u.indom.batch_stss, 0, n * sizeof(int));
+	return 1;
+    }
+
+    /* Same errors as pmfg_extract_convert_item() for missing values */
+    if (prev_r == NULL)
+	sts = PM_ERR_AGAIN;
+    else if (pv == NULL)
+	sts = PM_ERR_VALUE;
+    else if (pv->numval < 0)
+	sts = pv->numval;
+    if (sts < 0) {
+	for (i = 0; i < n; i++)
+	    item->u.indom.batch_stss[i] = sts;
+	return 1;
+    }
+    pn = pmExtractValueSet(pv, desc->type, 1.0, item->u.indom.batch_prev_insts,
+		item->u.indom.batch_prev_values, size);
+    if (pn < 0)
+	return 0;
+
+    pmfg_timespec_from_timeval(&prev_r->timestamp, &prev_t);
+    pmfg_timespec_from_timeval(&newResult->timestamp, &timestamp);
+    deltaT = pmfg_timespec_delta(&timestamp, &prev_t);
+    if (deltaT < epsilon)	/* avoid division by zero */
+	deltaT = epsilon;
+
+    pmRateValues(desc->type, deltaT, pmfg->wrap, conv->factor,
+		n, item->u.indom.batch_insts, item->u.indom.batch_values,
+		pn, item->u.indom.batch_prev_insts,
+		item->u.indom.batch_prev_values, item->u.indom.batch_stss);
+    for (i = 0; i < n; i++) {
+	if (item->u.indom.batch_stss[i] == PM_ERR_AGAIN)	/* new instance */
+	    item->u.indom.batch_stss[i] = PM_ERR_VALUE;
+    }
+    return 1;
+}
+
 static void
 pmfg_fetch_indom(pmFG pmfg, pmFGI item, pmResult *newResult)
 {
@@ -873,6 +1012,7 @@ pmfg_fetch_indom(pmFG pmfg, pmFGI item, pmResult *newResult)
     int i;
     unsigned j;
     int need_indom_refresh;
+    int batch = 0;
     const pmValueSet *iv;
 
     assert(item != NULL);
@@ -952,6 +1092,10 @@ pmfg_fetch_indom(pmFG pmfg, pmFGI item, pmResult *newResult)
 	sts = 0;
     }
 
+    if (item->u.indom.conv.rate_convert ||
+	item->u.indom.conv.unit_convert)
+	batch = pmfg_convert_indom(pmfg, item, newResult, iv);
+
     /*
      * Process each instance element in the pmValueSet.	 We persevere
      * in the face of per-item errors (including conversion errors),
@@ -994,7 +1138,16 @@ pmfg_fetch_indom(pmFG pmfg, pmFGI item, pmResult *newResult)
 	}
 
 	/* Fetch & convert the actual value. */
-	if (item->u.indom.conv.rate_convert ||
+	if (batch) {
+	    stss = item->u.indom.batch_stss[j];
+	    if (stss < 0)
+		goto out1;
+	    stss = __pmStuffDoubleValue(item->u.indom.batch_values[j], &v,
+				item->u.indom.output_type);
+	    if (stss < 0)
+		goto out1;
+	}
+	else if (item->u.indom.conv.rate_convert ||
 	    item->u.indom.conv.unit_convert) {
 	    struct timespec timestamp;
 
@@ -1008,9 +1161,9 @@ pmfg_fetch_indom(pmFG pmfg, pmFGI item, pmResult *newResult)
 		goto out1;
 	}
 	else {
-	    stss = pmfg_extract_item(item->u.indom.metric_pmid, jv->inst,
-				0, &item->u.indom.metric_desc,
-				newResult->vset, newResult->numpmid, &v,
+	    /* NB: jv is the value, no need to search for it again. */
+	    stss = __pmExtractValue2(iv->valfmt, jv,
+				item->u.indom.metric_desc.type, &v,
 				item->u.indom.output_type);
 	    if (stss < 0)
 		goto out1;
@@ -1228,6 +1381,135 @@ pmfg_clear_profile(pmFG pmfg)
 }
 
 
+/*
+ * Walk the fetchgroup, reinitializing every output spot, regardless of
+ * later errors.
+ */
+static void
+pmfg_reinit_group(pmFG pmfg)
+{
+    pmFGI item;
+
+    for (item = pmfg->items; item; item = item->next) {
+	switch (item->type) {
+	    case pmfg_timestamp:
+		pmfg_reinit_timestamp(item);
+		break;
+	    case pmfg_item:
+		if (item->u.item.metric_desc.sem != PM_SEM_DISCRETE)
+		    pmfg_reinit_item(item); /* preserve DISCRETE */
+		break;
+	    case pmfg_indom:
+		if (item->u.indom.metric_desc.sem != PM_SEM_DISCRETE)
+		    pmfg_reinit_indom(item); /* preserve DISCRETE */
+		break;
+	    case pmfg_event:
+		/* DISCRETE mode doesn't make sense for an event vector */
+		pmfg_reinit_event(item);
+		break;
+	    default:
+		assert(0);	/* can't happen */
+	}
+    }
+}
+
+/*
+ * Unpack/convert/store the fetch result (or error sts) for all items
+ * that requested it.
+ */
+static void
+pmfg_fetch_group(pmFG pmfg, int sts, pmResult *newResult)
+{
+    pmFGI item;
+    pmResult dummyResult;
+
+    if (sts < 0 || newResult == NULL) {
+	/*
+	 * Populate an empty fetch result, which will send out the
+	 * appropriate PM_ERR_VALUE etc. indications to the fetchgroup
+	 * items.
+	 */
+	gettimeofday(&dummyResult.timestamp, NULL);
+	dummyResult.numpmid = 0;
+	dummyResult.vset[0] = NULL;
+	newResult = &dummyResult;
+    }
+
+    /* Sort instances so that the indom fetchgroups come out conveniently */
+    pmSortInstances(newResult);
+
+    /* Walk the fetchgroup. */
+    for (item = pmfg->items; item; item = item->next) {
+	switch (item->type) {
+	    case pmfg_timestamp:
+		pmfg_fetch_timestamp(pmfg, item, newResult);
+		break;
+	    case pmfg_item:
+		pmfg_fetch_item(pmfg, item, newResult);
+		break;
+	    case pmfg_indom:
+		pmfg_fetch_indom(pmfg, item, newResult);
+		break;
+	    case pmfg_event:
+		pmfg_fetch_event(pmfg, item, newResult);
+		break;
+	    default:
+		assert(0);	/* can't happen */
+	}
+    }
+
+    /*
+     * Store new result as previous, if there was one.	If we
+     * encountered a pmFetch error this time, retain the previous
+     * results, as a rate-conversion reference for a future successful
+     * pmFetch.
+     */
+    if (newResult != &dummyResult) {
+	if (pmfg->prevResult)
+	    pmFreeResult(pmfg->prevResult);
+	pmfg->prevResult = newResult;
+    }
+}
+
+/*
+ * pmFetchAsync() callback for pmFetchGroups().  A reply for a request
+ * abandoned at an earlier deadline is discarded.
+ */
+static void
+pmfg_fetch_callback(int ctx, int seq, int sts, pmResult *result, void *data)
+{
+    pmFG pmfg = (pmFG)data;
+
+    if (seq != pmfg->async_seq) {
+	if (seq == pmfg->async_abandoned)
+	    pmfg->async_abandoned = 0;
+	if (result)
+	    pmFreeResult(result);
+	return;
+    }
+    pmfg->async_seq = 0;
+    pmfg->async_sts = sts;
+    pmfg->async_result = result;
+}
+
+/*
+ * Receive and discard the reply for a request abandoned by pmFetchGroups(),
+ * before any other request is made for the context.  Replies arrive in
+ * request order, so this also completes any abandoned before it.
+ */
+static void
+pmfg_complete_async(pmFG pmfg)
+{
+    while (pmfg->async_abandoned != 0) {
+	if (pmFetchAsyncComplete(pmfg->ctx, 1) <= 0) {
+	    /* nothing outstanding, or no reply coming */
+	    pmfg->async_abandoned = 0;
+	    break;
+	}
+    }
+}
+
+
 /* ------------------------------------------------------------------------ */
 /* Public functions exported from libpcp and in pmapi.h */
 
@@ -1300,6 +1582,7 @@ pmExtendFetchGroup_item(pmFG pmfg,
     sts = pmUseContext(pmfg->ctx);
     if (sts != 0)
 	return sts;
+    pmfg_complete_async(pmfg);
 
     item = calloc(1, sizeof(*item));
     if (item == NULL)
@@ -1419,6 +1702,7 @@ pmExtendFetchGroup_indom(pmFG pmfg,
     sts = pmUseContext(pmfg->ctx);
     if (sts != 0)
 	return sts;
+    pmfg_complete_async(pmfg);
 
     item = calloc(1, sizeof(*item));
     if (item == NULL)
@@ -1482,6 +1766,7 @@ pmExtendFetchGroup_event(pmFG pmfg,
     sts = pmUseContext(pmfg->ctx);
     if (sts != 0)
 	return sts;
+    pmfg_complete_async(pmfg);
 
     item = calloc(1, sizeof(*item));
     if (item == NULL)
@@ -1588,93 +1873,157 @@ int
 pmFetchGroup(pmFG pmfg)
 {
     int sts;
-    pmFGI item;
     pmResult *newResult;
-    pmResult dummyResult;
 
     if (pmfg == NULL)
 	return -EINVAL;
 
-    /*
-     * Walk the fetchgroup, reinitializing every output spot, regardless of
-     * later errors.
-     */
-    for (item = pmfg->items; item; item = item->next) {
-	switch (item->type) {
-	    case pmfg_timestamp:
-		pmfg_reinit_timestamp(item);
-		break;
-	    case pmfg_item:
-		if (item->u.item.metric_desc.sem != PM_SEM_DISCRETE)
-		    pmfg_reinit_item(item); /* preserve DISCRETE */
-		break;
-	    case pmfg_indom:
-		if (item->u.indom.metric_desc.sem != PM_SEM_DISCRETE)
-		    pmfg_reinit_indom(item); /* preserve DISCRETE */
-		break;
-	    case pmfg_event:
-		/* DISCRETE mode doesn't make sense for an event vector */
-		pmfg_reinit_event(item);
-		break;
-	    default:
-		assert(0);	/* can't happen */
-	}
-    }
+    pmfg_reinit_group(pmfg);
 
     sts = pmUseContext(pmfg->ctx);
     if (sts != 0)
 	return sts;
 
+    pmfg_complete_async(pmfg);
     sts = pmFetch(pmfg->num_unique_pmids, pmfg->unique_pmids, &newResult);
-    if (sts < 0 || newResult == NULL) {
-	/*
-	 * Populate an empty fetch result, which will send out the
-	 * appropriate PM_ERR_VALUE etc. indications to the fetchgroup
-	 * items.
-	 */
-	gettimeofday(&dummyResult.timestamp, NULL);
-	dummyResult.numpmid = 0;
-	dummyResult.vset[0] = NULL;
-	newResult = &dummyResult;
-    }
+    pmfg_fetch_group(pmfg, sts, newResult);
 
-    /* Sort instances so that the indom fetchgroups come out conveniently */
-    pmSortInstances(newResult);
+    /* NB: we pass through the pmFetch() sts. */
+    return sts;
+}
 
-    /* Walk the fetchgroup. */
-    for (item = pmfg->items; item; item = item->next) {
-	switch (item->type) {
-	    case pmfg_timestamp:
-		pmfg_fetch_timestamp(pmfg, item, newResult);
-		break;
-	    case pmfg_item:
-		pmfg_fetch_item(pmfg, item, newResult);
-		break;
-	    case pmfg_indom:
-		pmfg_fetch_indom(pmfg, item, newResult);
-		break;
-	    case pmfg_event:
-		pmfg_fetch_event(pmfg, item, newResult);
-		break;
-	    default:
-		assert(0);	/* can't happen */
-	}
+/*
+ * As for pmFetchGroup(), but for n fetchgroups at once, with requests
+ * to pmcd for all of them outstanding together so the wait is for the
+ * slowest host rather than the sum over all of them.  Returns when all
+ * the replies have arrived or the timeout (by default the PMAPI request
+ * timeout) has passed; the status and latency (seconds) of each fetch
+ * is stored in status[] and latency[] when these are not NULL.  Returns
+ * the number of fetchgroups fetched without error.
+ */
+int
+pmFetchGroups(int n, pmFG *pmfgs, const struct timeval *timeout,
+		int *status, double *latency)
+{
+    int sts, i, fd, maxfd, pending = 0, count = 0;
+    pmFG pmfg;
+    __pmFdSet readyfds;
+    struct timeval now, deadline, wait;
+    double elapsed;
+
+    if (n < 1)
+	return PM_ERR_TOOSMALL;
+    if (pmfgs == NULL)
+	return -EINVAL;
+    for (i = 0; i < n; i++)
+	if (pmfgs[i] == NULL)
+	    return -EINVAL;
+
+    gettimeofday(&deadline, NULL);
+    if (timeout)
+	pmtimevalInc(&deadline, timeout);
+    else {
+	pmtimevalFromReal(__pmRequestTimeout(), &wait);
+	pmtimevalInc(&deadline, &wait);
     }
 
     /*
-     * Store new result as previous, if there was one.	If we
-     * encountered a pmFetch error this time, retain the previous
-     * results, as a rate-conversion reference for a future successful
-     * pmFetch.
+     * Send all the requests.  Contexts other than for a host have no
+     * round trip to overlap, so these are fetched directly.
      */
-    if (newResult != &dummyResult) {
-	if (pmfg->prevResult)
-	    pmFreeResult(pmfg->prevResult);
-	pmfg->prevResult = newResult;
+    for (i = 0; i < n; i++) {
+	pmfg = pmfgs[i];
+	pmfg_reinit_group(pmfg);
+	pmfg->async_sts = PM_ERR_TIMEOUT;	/* until the reply arrives */
+	pmfg->async_result = NULL;
+	if (latency)
+	    latency[i] = 0.0;
+	if ((sts = pmUseContext(pmfg->ctx)) < 0) {
+	    pmfg->async_sts = sts;
+	    continue;
+	}
+	gettimeofday(&pmfg->async_start, NULL);
+	sts = pmFetchAsync(pmfg->num_unique_pmids, pmfg->unique_pmids,
+			    pmfg_fetch_callback, pmfg);
+	if (sts == PM_ERR_NOTHOST) {
+	    pmfg->async_sts = pmFetch(pmfg->num_unique_pmids,
+				pmfg->unique_pmids, &pmfg->async_result);
+	    gettimeofday(&now, NULL);
+	    if (latency)
+		latency[i] = pmtimevalSub(&now, &pmfg->async_start);
+	}
+	else if (sts < 0)
+	    pmfg->async_sts = sts;
+	else {
+	    pmfg->async_seq = sts;
+	    pending++;
+	}
     }
 
-    /* NB: we pass through the pmFetch() sts. */
-    return sts;
+    /* Wait for the replies, in whatever order they arrive. */
+    while (pending > 0) {
+	__pmFD_ZERO(&readyfds);
+	maxfd = -1;
+	for (i = 0; i < n; i++) {
+	    if (pmfgs[i]->async_seq == 0)
+		continue;
+	    if ((fd = pmFetchAsyncFd(pmfgs[i]->ctx)) >= 0) {
+		__pmFD_SET(fd, &readyfds);
+		if (fd > maxfd)
+		    maxfd = fd;
+	    }
+	}
+	gettimeofday(&now, NULL);
+	if ((elapsed = pmtimevalSub(&deadline, &now)) <= 0)
+	    break;
+	pmtimevalFromReal(elapsed, &wait);
+	sts = maxfd < 0 ? 1 : __pmSelectRead(maxfd+1, &readyfds, &wait);
+	if (sts < 0 && neterror() == EINTR)
+	    continue;
+	if (sts <= 0)
+	    break;
+	for (i = 0; i < n; i++) {
+	    pmfg = pmfgs[i];
+	    if (pmfg->async_seq == 0)
+		continue;
+	    fd = pmFetchAsyncFd(pmfg->ctx);
+	    if (fd >= 0 && !__pmFD_ISSET(fd, &readyfds))
+		continue;
+	    sts = pmFetchAsyncComplete(pmfg->ctx, 0);
+	    if (pmfg->async_seq > 0 && (fd < 0 || sts < 0)) {
+		/* no reply coming, e.g. connection lost */
+		pmfg->async_abandoned = pmfg->async_seq;
+		pmfg->async_seq = 0;
+		pmfg->async_sts = fd < 0 ? fd : sts;
+	    }
+	    if (pmfg->async_seq == 0) {
+		gettimeofday(&now, NULL);
+		if (latency)
+		    latency[i] = pmtimevalSub(&now, &pmfg->async_start);
+		pending--;
+	    }
+	}
+    }
+
+    gettimeofday(&now, NULL);
+    for (i = 0; i < n; i++) {
+	pmfg = pmfgs[i];
+	if (pmfg->async_seq > 0) {
+	    /* abandoned, any reply later is discarded */
+	    pmfg->async_abandoned = pmfg->async_seq;
+	    pmfg->async_seq = 0;
+	    if (latency)
+		latency[i] = pmtimevalSub(&now, &pmfg->async_start);
+	}
+	pmfg_fetch_group(pmfg, pmfg->async_sts, pmfg->async_result);
+	pmfg->async_result = NULL;
+	if (status)
+	    status[i] = pmfg->async_sts;
+	if (pmfg->async_sts >= 0)
+	    count++;
+    }
+
+    return count;
 }
 
 /*
@@ -1700,6 +2049,7 @@ pmClearFetchGroup(pmFG pmfg)
 		pmfg_reinit_indom(item);
 		free(item->u.indom.indom_codes);
 		free(item->u.indom.indom_names);
+		free(item->u.indom.batch_values);
 		break;
 	    case pmfg_event:
 		pmfg_reinit_event(item);
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2014 Red Hat.
+ * Copyright (c) 2014,2020 Red Hat.
  * Copyright (c) 1995 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This library is free software; you can redistribute it and/or modify it
@@ -18,6 +18,55 @@
 
 /* Free result buffer routines */
 
+/*
+ * Result arena routines ... reserve a single PDU buffer for a pmResult
+ * that is about to be built, then carve its pmValueSets and
+ * pmValueBlocks out of that buffer.  The buffer is released by the
+ * one unpin in __pmFreeResultValueSets() when the pmResult is freed.
+ */
+int
+__pmResultArenaInit(__pmResultArena *ap, size_t need)
+{
+    ap->used = 0;
+    ap->size = need;
+    if (need == 0) {
+	ap->base = NULL;
+	return 0;
+    }
+    if (need > INT_MAX)
+	return PM_ERR_TOOBIG;
+    if ((ap->base = (char *)__pmFindPDUBuf((int)need)) == NULL)
+	return -oserror();
+    if (pmDebugOptions.pdubuf)
+	fprintf(stderr, "__pmResultArenaInit(" PRINTF_P_PFX "%p) size=%d\n",
+	    ap->base, (int)need);
+    return 0;
+}
+
+void *
+__pmResultArenaAlloc(__pmResultArena *ap, size_t need)
+{
+    void	*p;
+
+    need = __PM_ARENA_ALIGN(need);
+    if (ap->base == NULL || need > ap->size - ap->used)
+	return NULL;
+    p = &ap->base[ap->used];
+    ap->used += need;
+    return p;
+}
+
+/*
+ * Called once the result has been built ... if nothing was carved from
+ * the arena, no pmResult refers to the PDU buffer so release it here.
+ */
+void
+__pmResultArenaDone(__pmResultArena *ap)
+{
+    if (ap->base != NULL && ap->used == 0)
+	__pmUnpinPDUBuf(ap->base);
+}
+
 static void
 __pmFreeResultValueSets(pmValueSet **ppvstart, pmValueSet **ppvsend)
 {
@@ -26,7 +75,11 @@ __pmFreeResultValueSets(pmValueSet **ppvstart, pmValueSet **ppvsend)
     char	strbuf[20];
     int		j;
 
-    /* if _any_ vset[] -> an address within a pdubuf, we are done */
+    /*
+     * if _any_ vset[] -> an address within a pdubuf, we are done ...
+     * results from __pmDecodeResult() and those built in a result
+     * arena have all vset[] and pmValueBlocks in one pdubuf
+     */
     for (ppvs = ppvstart; ppvs < ppvsend; ppvs++) {
 	if (__pmUnpinPDUBuf((void *)*ppvs))
 	    return;
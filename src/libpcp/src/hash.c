@@ -218,3 +218,346 @@ __pmHashWalk(__pmHashCtl *hcp, __pmHashWalkState state)
     hcp->next = node->next;
     return node;
 }
+
+/*
+ * Open addressing variant.
+ *
+ * Keys are mixed and masked to a home slot, and collisions are resolved
+ * by linear probing with Robin Hood displacement (an entry further from
+ * its home slot takes the place of one nearer to its own), which keeps
+ * probe sequences short and lets an unsuccessful search stop early.
+ * Deletion shifts the rest of the cluster back, so there are no
+ * tombstones.
+ *
+ * When the table grows, the old table is kept and its entries are moved
+ * across a few clusters at a time by subsequent adds, while searches and
+ * deletes look in both tables.  Whole clusters are moved at once, so the
+ * remaining entries in the old table can still be found.
+ */
+
+#define OHASH_MINSIZE	8
+#define OHASH_MIGRATE	16	/* minimum old slots moved per add */
+
+static unsigned int
+ohash_mix(unsigned int key)
+{
+    key ^= key >> 16;
+    key *= 0x85ebca6bU;
+    key ^= key >> 13;
+    key *= 0xc2b2ae35U;
+    key ^= key >> 16;
+    return key;
+}
+
+/* an empty slot, i.e. the start of a cluster */
+static unsigned int
+ohash_empty(const __pmOHashTab *tp)
+{
+    unsigned int	i;
+
+    for (i = 0; i < tp->size; i++) {
+	if (tp->slot[i].dist == 0)
+	    break;
+    }
+    return i;
+}
+
+static void
+ohash_insert(__pmOHashTab *tp, unsigned int key, void *data)
+{
+    __pmOHashSlot	entry, tmp, *sp;
+    unsigned int	mask = tp->size - 1;
+    unsigned int	i = ohash_mix(key) & mask;
+
+    entry.node.next = NULL;
+    entry.node.key = key;
+    entry.node.data = data;
+    entry.dist = 1;
+    for (;; i = (i + 1) & mask, entry.dist++) {
+	sp = &tp->slot[i];
+	if (sp->dist == 0) {
+	    *sp = entry;
+	    tp->used++;
+	    return;
+	}
+	if (sp->dist < entry.dist) {
+	    tmp = *sp;
+	    *sp = entry;
+	    entry = tmp;
+	}
+    }
+}
+
+/* slot index holding key (and data, if matchdata), else -1 */
+static int
+ohash_find(const __pmOHashTab *tp, unsigned int key, void *data, int matchdata)
+{
+    const __pmOHashSlot	*sp;
+    unsigned int	mask = tp->size - 1;
+    unsigned int	i, dist;
+
+    if (tp->size == 0)
+	return -1;
+    for (i = ohash_mix(key) & mask, dist = 1; ; i = (i + 1) & mask, dist++) {
+	sp = &tp->slot[i];
+	if (sp->dist < dist)	/* empty, or key would have displaced it */
+	    return -1;
+	if (sp->node.key == key && (!matchdata || sp->node.data == data))
+	    return i;
+    }
+}
+
+/*
+ * Remove slot i, shifting the rest of its cluster back one place.
+ * Returns the index of the slot left empty.
+ */
+static unsigned int
+ohash_remove(__pmOHashTab *tp, unsigned int i)
+{
+    unsigned int	mask = tp->size - 1;
+    unsigned int	j;
+
+    for (;; i = j) {
+	j = (i + 1) & mask;
+	if (tp->slot[j].dist <= 1)
+	    break;
+	tp->slot[i] = tp->slot[j];
+	tp->slot[i].dist--;
+    }
+    tp->slot[i].dist = 0;
+    tp->used--;
+    return i;
+}
+
+static int
+ohash_alloc(__pmOHashTab *tp, unsigned int size)
+{
+    if ((tp->slot = (__pmOHashSlot *)calloc(size, sizeof(__pmOHashSlot))) == NULL)
+	return -oserror();
+    tp->size = size;
+    tp->used = 0;
+    return 0;
+}
+
+/*
+ * Move at least count old slots into the current table, finishing at
+ * the end of a cluster; count of zero moves everything.
+ */
+static void
+ohash_migrate(__pmOHashCtl *hcp, unsigned int count)
+{
+    __pmOHashTab	*op = &hcp->old;
+    __pmOHashSlot	*sp;
+    unsigned int	mask = op->size - 1;
+
+    if (count == 0)
+	count = hcp->mcount;
+    while (hcp->mcount > 0) {
+	sp = &op->slot[hcp->mindex];
+	if (sp->dist == 0 && count == 0)
+	    break;
+	if (sp->dist != 0) {
+	    ohash_insert(&hcp->cur, sp->node.key, sp->node.data);
+	    sp->dist = 0;
+	    op->used--;
+	}
+	hcp->mindex = (hcp->mindex + 1) & mask;
+	hcp->mcount--;
+	if (count > 0)
+	    count--;
+    }
+    if (hcp->mcount == 0 && op->slot != NULL) {
+	free(op->slot);
+	memset(op, 0, sizeof(*op));
+    }
+}
+
+void
+__pmOHashInit(__pmOHashCtl *hcp)
+{
+    memset(hcp, 0, sizeof(*hcp));
+}
+
+/*
+ * Used to preallocate the hash table when the number of entries is
+ * known ahead of time, avoiding any growth.
+ */
+int
+__pmOHashPreAlloc(int nodes, __pmOHashCtl *hcp)
+{
+    unsigned int	size = OHASH_MINSIZE;
+
+    __pmOHashClear(hcp);
+    while (size / 4 * 3 < nodes)
+	size *= 2;
+    return ohash_alloc(&hcp->cur, size);
+}
+
+__pmHashNode *
+__pmOHashSearch(unsigned int key, __pmOHashCtl *hcp)
+{
+    int		i;
+
+    if ((i = ohash_find(&hcp->cur, key, NULL, 0)) >= 0)
+	return &hcp->cur.slot[i].node;
+    if ((i = ohash_find(&hcp->old, key, NULL, 0)) >= 0)
+	return &hcp->old.slot[i].node;
+    return NULL;
+}
+
+int
+__pmOHashAdd(unsigned int key, void *data, __pmOHashCtl *hcp)
+{
+    __pmOHashTab	*tp = &hcp->cur;
+    int			sts;
+
+    if (hcp->mcount > 0)
+	ohash_migrate(hcp, OHASH_MIGRATE);
+
+    if (tp->size == 0) {
+	if ((sts = ohash_alloc(tp, OHASH_MINSIZE)) < 0)
+	    return sts;
+    }
+    else if (tp->used + 1 > tp->size / 4 * 3) {
+	if (hcp->mcount > 0)
+	    ohash_migrate(hcp, 0);	/* adds outran the move, finish it */
+	hcp->old = *tp;
+	if ((sts = ohash_alloc(tp, hcp->old.size * 2)) < 0) {
+	    *tp = hcp->old;
+	    memset(&hcp->old, 0, sizeof(hcp->old));
+	    return sts;
+	}
+	hcp->mindex = ohash_empty(&hcp->old);
+	hcp->mcount = hcp->old.size;
+    }
+
+    ohash_insert(tp, key, data);
+    hcp->nodes++;
+    return 1;
+}
+
+/*
+ * Delete slot i of table tp, keeping any __pmOHashWalk position in that
+ * table on the next unvisited entry.
+ */
+static void
+ohash_delete(__pmOHashCtl *hcp, __pmOHashTab *tp, unsigned int i)
+{
+    unsigned int	mask = tp->size - 1;
+    unsigned int	wtab = (tp == &hcp->cur) ? 0 : 1;
+    unsigned int	end;
+
+    end = ohash_remove(tp, i);
+    hcp->nodes--;
+    /* entries after i up to end have moved back one slot */
+    if (hcp->wtab == wtab && hcp->wcount > 0 &&
+	((i - hcp->wstart) & mask) < hcp->wcount &&
+	((end - hcp->wstart) & mask) >= hcp->wcount)
+	hcp->wcount--;
+}
+
+int
+__pmOHashDel(unsigned int key, void *data, __pmOHashCtl *hcp)
+{
+    int		i;
+
+    if ((i = ohash_find(&hcp->cur, key, data, 1)) >= 0) {
+	ohash_delete(hcp, &hcp->cur, i);
+	return 1;
+    }
+    if ((i = ohash_find(&hcp->old, key, data, 1)) >= 0) {
+	ohash_delete(hcp, &hcp->old, i);
+	return 1;
+    }
+    return 0;
+}
+
+void
+__pmOHashClear(__pmOHashCtl *hcp)
+{
+    free(hcp->cur.slot);
+    free(hcp->old.slot);
+    memset(hcp, 0, sizeof(*hcp));
+}
+
+/*
+ * Iterate over the entire hash table, as for __pmHashWalkCB.  Each table
+ * is walked from the start of a cluster so that deletions never move an
+ * entry back past the walk.  The callback function must not modify the
+ * hash table.
+ */
+void
+__pmOHashWalkCB(__pmHashWalkCallback cb, void *cdata, __pmOHashCtl *hcp)
+{
+    __pmOHashTab	*tabs[2] = { &hcp->cur, &hcp->old };
+    __pmOHashTab	*tp;
+    __pmOHashSlot	*sp;
+    unsigned int	start, mask, i, n, t;
+
+    for (t = 0; t < 2; t++) {
+	tp = tabs[t];
+	if (tp->size == 0)
+	    continue;
+	mask = tp->size - 1;
+	start = ohash_empty(tp);
+	for (n = 0; n < tp->size; ) {
+	    i = (start + n) & mask;
+	    sp = &tp->slot[i];
+	    if (sp->dist == 0) {
+		n++;
+		continue;
+	    }
+	    switch ((*cb)(&sp->node, cdata)) {
+	    case PM_HASH_WALK_DELETE_STOP:
+		ohash_remove(tp, i);
+		hcp->nodes--;
+		return;
+
+	    case PM_HASH_WALK_NEXT:
+		n++;
+		break;
+
+	    case PM_HASH_WALK_DELETE_NEXT:
+		/* NB: the next entry (if any) has moved back into slot i */
+		ohash_remove(tp, i);
+		hcp->nodes--;
+		break;
+
+	    case PM_HASH_WALK_STOP:
+	    default:
+		return;
+	    }
+	}
+    }
+}
+
+/*
+ * Walk a hash table; state flow is START ... NEXT ... NEXT ...
+ * Deleting the node just returned is allowed during the walk.
+ */
+__pmHashNode *
+__pmOHashWalk(__pmOHashCtl *hcp, __pmHashWalkState state)
+{
+    __pmOHashTab	*tp;
+    __pmOHashSlot	*sp;
+
+    if (state == PM_HASH_WALK_START) {
+	hcp->wtab = 0;
+	hcp->wstart = ohash_empty(&hcp->cur);
+	hcp->wcount = 0;
+    }
+
+    while (hcp->wtab < 2) {
+	tp = (hcp->wtab == 0) ? &hcp->cur : &hcp->old;
+	while (hcp->wcount < tp->size) {
+	    sp = &tp->slot[(hcp->wstart + hcp->wcount++) & (tp->size - 1)];
+	    if (sp->dist != 0)
+		return &sp->node;
+	}
+	if (++hcp->wtab == 1) {
+	    hcp->wstart = ohash_empty(&hcp->old);
+	    hcp->wcount = 0;
+	}
+    }
+    return NULL;
+}
@@ -388,6 +388,9 @@ extern __pmSockAddr *__pmSockAddrFirstSubnetAddr(const __pmSockAddr *, int) _PCP
 extern __pmSockAddr *__pmSockAddrNextSubnetAddr(__pmSockAddr *, int) _PCP_HIDDEN;
 
 extern int __pmConnectPMCD(pmHostSpec *, int, int, __pmHashCtl *) _PCP_HIDDEN;
+extern int __pmFetchAsyncDrain(int) _PCP_HIDDEN;
+extern void __pmFetchAsyncAbort(__pmContext *, int) _PCP_HIDDEN;
+extern void __pmFetchAsyncFree(__pmPMCDCtl *) _PCP_HIDDEN;
 
 extern int __pmConnectLocal(__pmHashCtl *) _PCP_HIDDEN;
 extern int __pmAuxConnectPMCD(const char *) _PCP_HIDDEN;
@@ -406,6 +409,8 @@ extern int __pmGetArchiveLabel(__pmLogCtl *, pmLogLabel *) _PCP_HIDDEN;
 extern pmTimeval *__pmLogStartTime(__pmArchCtl *) _PCP_HIDDEN;
 extern void __pmLogSetTime(__pmContext *) _PCP_HIDDEN;
 extern void __pmLogResetInterp(__pmContext *) _PCP_HIDDEN;
+extern const char *__pmLogGetCompress(void) _PCP_HIDDEN;
+extern void __pmLogFreeInDomTime(__pmOHashCtl *) _PCP_HIDDEN;
 extern void __pmArchCtlFree(__pmArchCtl *) _PCP_HIDDEN;
 extern int __pmLogChangeArchive(__pmContext *, int) _PCP_HIDDEN;
 extern int __pmLogChangeToNextArchive(__pmLogCtl **) _PCP_HIDDEN;
@@ -433,6 +438,8 @@ extern void __pmFreeInterpData(__pmContext *) _PCP_HIDDEN;
 
 extern void __pmDumpNameAndStatusList(FILE *, int, char **, int *) _PCP_HIDDEN;
 
+extern int __pmLoadPMNSImage(const char *, int, __pmnsTree **) _PCP_HIDDEN;
+
 #define MAXLABELNAMELEN		((1<<8)-1)
 #define MAXLABELVALUELEN	((1<<16)-1)
 extern void __pmDumpLabelSet(FILE *, const pmLabelSet *) _PCP_HIDDEN;
@@ -102,21 +102,56 @@ typedef struct pmidcntl {		/* metric control */
     int			valfmt;		/* used to build result */
     int			numval;		/* number of instances in this result */
     int			last_numval;	/* number of instances in previous result */
-    __pmHashCtl		hc;		/* metric-instances */
+    __pmOHashCtl	hc;		/* metric-instances */
+    int			ninst;
+    instcntl_t		**ilist;	/* metric-instances, in result order */
 } pmidcntl_t;
 
-typedef struct {
+/*
+ * Read cache ... decoded pmResults from __pmLogRead, indexed by the
+ * file offset at either end of the record in the archive, so a record
+ * can be found again when the archive is scanned in either direction.
+ * Entries are kept in LRU order and the cache is bounded by a memory
+ * budget (from $PCP_INTERP_CACHE, with a small minimum number of
+ * entries).  When consecutive misses are in the same direction, the
+ * records that follow are read ahead into the cache, doubling the
+ * read-ahead each time up to READAHEAD_MAX records.
+ */
+typedef struct cache {
+    struct cache *next;		/* LRU list, most recently used first */
+    struct cache *prev;
     pmResult	*rp;		/* cached pmResult from __pmLogRead */
     int		sts;		/* from __pmLogRead */
-    char	*c_name;	/* log name */
+    int		arch;		/* archive in multi-archive context */
     int		vol;		/* log volume */
     long	head_posn;	/* posn in file before forwards __pmLogRead */
     long	tail_posn;	/* posn in file after forwards __pmLogRead */
-    int		mode;		/* PM_MODE_FORW or PM_MODE_BACK */
-    int		used;		/* used count for LFU replacement */
+    size_t	size;		/* approx memory used by this entry */
 } cache_t;
 
-#define NUMCACHE 4
+typedef struct {
+    cache_t	*first;		/* most recently used */
+    cache_t	*last;		/* least recently used */
+    cache_t	*current;	/* last returned, in use by caller */
+    pmResult	*uncached;	/* last returned, not in the cache */
+    __pmHashCtl	head_hc;	/* entries by head_posn */
+    __pmHashCtl	tail_hc;	/* entries by tail_posn */
+    int		nentries;
+    size_t	bytes;
+    int		last_mode;	/* direction of the previous miss */
+    int		readahead;	/* records to read ahead on next miss */
+    long	hits;		/* statistics, for pmDebugOptions.interp */
+    long	misses;
+    long	readaheads;
+    long	evictions;
+} cachectl_t;
+
+#define MINCACHE	4	/* entries kept regardless of the budget */
+#define READAHEAD_MIN	2
+#define READAHEAD_MAX	64
+#define CACHE_DEFAULT	(4 * 1024 * 1024)	/* bytes */
+
+static size_t	cache_budget = (size_t)-1;
 
 /*
  * diagnostic counters ... indexed by PM_MODE_FORW (2) and
@@ -125,6 +160,230 @@ typedef struct {
 static long	nr_cache[PM_MODE_BACK+1];
 static long	nr[PM_MODE_BACK+1];
 
+/*
+ * One-trip initialization of the read cache budget ... $PCP_INTERP_CACHE
+ * is a size in bytes, with an optional K, M or G suffix.
+ */
+static size_t
+get_cache_budget(void)
+{
+    char		*str;
+    char		*end;
+    unsigned long long	size;
+
+    PM_LOCK(__pmLock_extcall);
+    if (cache_budget == (size_t)-1) {
+	cache_budget = CACHE_DEFAULT;
+	if ((str = getenv("PCP_INTERP_CACHE")) != NULL) {	/* THREADSAFE */
+	    size = strtoull(str, &end, 10);
+	    switch (*end) {
+		case 'k': case 'K':
+		    size *= 1024;
+		    end++;
+		    break;
+		case 'm': case 'M':
+		    size *= 1024 * 1024;
+		    end++;
+		    break;
+		case 'g': case 'G':
+		    size *= 1024 * 1024 * 1024;
+		    end++;
+		    break;
+	    }
+	    if (end == str || *end != '\0')
+		fprintf(stderr, "%s: Warning: bad $PCP_INTERP_CACHE: %s\n",
+			pmGetProgname(), str);
+	    else
+		cache_budget = (size_t)size;
+	}
+    }
+    PM_UNLOCK(__pmLock_extcall);
+    return cache_budget;
+}
+
+static unsigned int
+cache_key(int arch, int vol, long posn)
+{
+    return (unsigned int)posn ^ ((unsigned int)vol << 22) ^ ((unsigned int)arch << 27);
+}
+
+static cache_t *
+cache_find(cachectl_t *ccp, __pmArchCtl *acp, int mode, long posn)
+{
+    __pmHashCtl		*hcp;
+    __pmHashNode	*hp;
+    cache_t		*cp;
+    unsigned int	key = cache_key(acp->ac_cur_log, acp->ac_vol, posn);
+
+    hcp = mode == PM_MODE_FORW ? &ccp->head_hc : &ccp->tail_hc;
+    for (hp = __pmHashSearch(key, hcp); hp != NULL; hp = hp->next) {
+	if (hp->key != key)
+	    continue;
+	cp = (cache_t *)hp->data;
+	if (cp->arch == acp->ac_cur_log && cp->vol == acp->ac_vol &&
+	    posn == (mode == PM_MODE_FORW ? cp->head_posn : cp->tail_posn))
+	    return cp;
+    }
+    return NULL;
+}
+
+static void
+cache_unlink(cachectl_t *ccp, cache_t *cp)
+{
+    if (cp->prev != NULL)
+	cp->prev->next = cp->next;
+    else
+	ccp->first = cp->next;
+    if (cp->next != NULL)
+	cp->next->prev = cp->prev;
+    else
+	ccp->last = cp->prev;
+}
+
+static void
+cache_push(cachectl_t *ccp, cache_t *cp)
+{
+    cp->prev = NULL;
+    cp->next = ccp->first;
+    if (ccp->first != NULL)
+	ccp->first->prev = cp;
+    else
+	ccp->last = cp;
+    ccp->first = cp;
+}
+
+static void
+cache_append(cachectl_t *ccp, cache_t *cp)
+{
+    cp->next = NULL;
+    cp->prev = ccp->last;
+    if (ccp->last != NULL)
+	ccp->last->next = cp;
+    else
+	ccp->first = cp;
+    ccp->last = cp;
+}
+
+static void
+cache_free(cachectl_t *ccp, cache_t *cp)
+{
+    cache_unlink(ccp, cp);
+    __pmHashDel(cache_key(cp->arch, cp->vol, cp->head_posn), cp, &ccp->head_hc);
+    __pmHashDel(cache_key(cp->arch, cp->vol, cp->tail_posn), cp, &ccp->tail_hc);
+    ccp->nentries--;
+    ccp->bytes -= cp->size;
+    if (ccp->current == cp)
+	ccp->current = NULL;
+    pmFreeResult(cp->rp);
+    free(cp);
+}
+
+/*
+ * Drop least recently used entries to get back within the budget,
+ * but never the entry the caller is still using.
+ */
+static void
+cache_trim(cachectl_t *ccp, size_t budget)
+{
+    cache_t	*cp, *prev;
+
+    for (cp = ccp->last; cp != NULL; cp = prev) {
+	if (ccp->bytes <= budget || ccp->nentries <= MINCACHE)
+	    break;
+	prev = cp->prev;
+	if (cp == ccp->current)
+	    continue;
+	cache_free(ccp, cp);
+	ccp->evictions++;
+    }
+}
+
+/*
+ * Add the record spanning posn (before the read) to end (after the read)
+ * in direction mode to the cache.  Returns NULL and leaves rp with the
+ * caller if the entry could not be added.
+ *
+ * Once the cache is full, records from a sequential scan go in at the
+ * least recently used end, so a scan longer than the cache cannot flush
+ * out everything else.
+ */
+static cache_t *
+cache_add(cachectl_t *ccp, __pmArchCtl *acp, int mode, long posn, long end,
+		pmResult *rp, int sts, size_t budget)
+{
+    cache_t	*cp;
+
+    if ((cp = (cache_t *)malloc(sizeof(cache_t))) == NULL)
+	return NULL;
+    cp->rp = rp;
+    cp->sts = sts;
+    cp->arch = acp->ac_cur_log;
+    cp->vol = acp->ac_vol;
+    if (mode == PM_MODE_FORW) {
+	cp->head_posn = posn;
+	cp->tail_posn = end;
+    }
+    else {
+	cp->head_posn = end;
+	cp->tail_posn = posn;
+    }
+    /* decoded size is close to the size of the record in the archive */
+    cp->size = sizeof(cache_t) + sizeof(pmResult) +
+		rp->numpmid * sizeof(pmValueSet *) +
+		(cp->tail_posn - cp->head_posn);
+    if (__pmHashAdd(cache_key(cp->arch, cp->vol, cp->head_posn), cp, &ccp->head_hc) < 0) {
+	free(cp);
+	return NULL;
+    }
+    if (__pmHashAdd(cache_key(cp->arch, cp->vol, cp->tail_posn), cp, &ccp->tail_hc) < 0) {
+	__pmHashDel(cache_key(cp->arch, cp->vol, cp->head_posn), cp, &ccp->head_hc);
+	free(cp);
+	return NULL;
+    }
+    if (ccp->readahead > 0 && ccp->bytes + cp->size > budget)
+	cache_append(ccp, cp);
+    else
+	cache_push(ccp, cp);
+    ccp->nentries++;
+    ccp->bytes += cp->size;
+    return cp;
+}
+
+/*
+ * Read ahead up to n records following the current position in the
+ * direction mode, within the current volume, then return to the
+ * current position.
+ */
+static void
+cache_readahead(__pmContext *ctxp, cachectl_t *ccp, int mode, int n, size_t budget)
+{
+    __pmArchCtl	*acp = ctxp->c_archctl;
+    pmResult	*rp;
+    long	save;
+    long	posn;
+    long	end;
+    int		sts;
+
+    save = posn = __pmFtell(acp->ac_mfp);
+    assert(posn >= 0);
+    while (n-- > 0 && ccp->bytes < budget) {
+	if (cache_find(ccp, acp, mode, posn) != NULL)
+	    break;
+	/* passing the stream as peekf means no volume or archive switch */
+	if ((sts = __pmLogRead_ctx(ctxp, mode, acp->ac_mfp, &rp, PMLOGREAD_NEXT)) < 0)
+	    break;
+	end = __pmFtell(acp->ac_mfp);
+	assert(end >= 0);
+	if (cache_add(ccp, acp, mode, posn, end, rp, sts, budget) == NULL) {
+	    pmFreeResult(rp);
+	    break;
+	}
+	ccp->readaheads++;
+	posn = end;
+    }
+    __pmFseek(acp->ac_mfp, save, SEEK_SET);
+}
+
 /*
  * called with the context lock held
  */
@@ -133,13 +392,30 @@ cache_read(__pmContext *ctxp, int mode, pmResult **rp)
 {
     __pmArchCtl	*acp = ctxp->c_archctl;
     long	posn;
+    cachectl_t	*ccp;
     cache_t	*cp;
-    cache_t	*lfup;
-    cache_t	*cache;
-    char	*save_curlog_name;
+    pmResult	*lrp;
+    size_t	budget = get_cache_budget();
     int		sts;
     int		save_curvol;
-    int		archive_changed;
+    int		save_curlog;
+
+    if (acp->ac_cache == NULL) {
+	/* cache initialization */
+	acp->ac_cache = ccp = (cachectl_t *)calloc(1, sizeof(cachectl_t));
+	if (!ccp)
+	    return -ENOMEM;
+	ccp->last_mode = PM_MODE_INTERP;	/* no direction yet */
+    }
+    else
+	ccp = (cachectl_t *)acp->ac_cache;
+
+    /* the caller is done with the result from last time */
+    ccp->current = NULL;
+    if (ccp->uncached != NULL) {
+	pmFreeResult(ccp->uncached);
+	ccp->uncached = NULL;
+    }
 
     /*
      * If the previous __pmLogRead generated a virtual MARK record and we have
@@ -148,6 +424,8 @@ cache_read(__pmContext *ctxp, int mode, pmResult **rp)
     if (acp->ac_mark_done != 0 && acp->ac_mark_done != mode) {
 	sts = __pmLogGenerateMark_ctx(ctxp, acp->ac_mark_done, rp);
 	acp->ac_mark_done = 0;
+	if (sts >= 0)
+	    ccp->uncached = *rp;
 	return sts;
     }
 
@@ -159,16 +437,6 @@ cache_read(__pmContext *ctxp, int mode, pmResult **rp)
     else
 	posn = 0;
 
-    if (acp->ac_cache == NULL) {
-	/* cache initialization */
-	acp->ac_cache = cache = (cache_t *)calloc(NUMCACHE, sizeof(cache_t));
-	if (!cache)
-	    return -ENOMEM;
-	acp->ac_cache_idx = 0;
-    }
-    else
-	cache = acp->ac_cache;
-
     if (pmDebugOptions.log && pmDebugOptions.desperate) {
 	fprintf(stderr, "cache_read: fd=%d mode=%s vol=%d (curvol=%d) %s_posn=%ld ",
 	    __pmFileno(acp->ac_mfp),
@@ -178,61 +446,58 @@ cache_read(__pmContext *ctxp, int mode, pmResult **rp)
 	    (long)posn);
     }
 
-    acp->ac_cache_idx = (acp->ac_cache_idx + 1) % NUMCACHE;
-    lfup = &cache[acp->ac_cache_idx];
-    for (cp = cache; cp < &cache[NUMCACHE]; cp++) {
-	if (cp->c_name != NULL && strcmp(cp->c_name, acp->ac_log->l_name) == 0 &&
-	    cp->vol == acp->ac_vol &&
-	    ((mode == PM_MODE_FORW && cp->head_posn == posn) ||
-	     (mode == PM_MODE_BACK && cp->tail_posn == posn)) &&
-	    cp->rp != NULL) {
-	    *rp = cp->rp;
-	    cp->used++;
-	    if (mode == PM_MODE_FORW)
-		__pmFseek(acp->ac_mfp, cp->tail_posn, SEEK_SET);
-	    else
-		__pmFseek(acp->ac_mfp, cp->head_posn, SEEK_SET);
-	    if (pmDebugOptions.log && pmDebugOptions.desperate) {
-		pmTimeval	tmp;
-		double		t_this;
-		tmp.tv_sec = (__int32_t)cp->rp->timestamp.tv_sec;
-		tmp.tv_usec = (__int32_t)cp->rp->timestamp.tv_usec;
-		t_this = __pmTimevalSub(&tmp, __pmLogStartTime(acp));
-		fprintf(stderr, "hit cache[%d] t=%.6f\n",
-		    (int)(cp - cache), t_this);
-		nr_cache[mode]++;
-	    }
-	    acp->ac_mark_done = 0;
-	    sts = cp->sts;
-	    return sts;
+    if (posn != 0 && (cp = cache_find(ccp, acp, mode, posn)) != NULL) {
+	*rp = cp->rp;
+	cache_unlink(ccp, cp);
+	cache_push(ccp, cp);
+	ccp->current = cp;
+	if (mode == PM_MODE_FORW)
+	    __pmFseek(acp->ac_mfp, cp->tail_posn, SEEK_SET);
+	else
+	    __pmFseek(acp->ac_mfp, cp->head_posn, SEEK_SET);
+	if (pmDebugOptions.log && pmDebugOptions.desperate) {
+	    pmTimeval	tmp;
+	    double	t_this;
+	    tmp.tv_sec = (__int32_t)cp->rp->timestamp.tv_sec;
+	    tmp.tv_usec = (__int32_t)cp->rp->timestamp.tv_usec;
+	    t_this = __pmTimevalSub(&tmp, __pmLogStartTime(acp));
+	    fprintf(stderr, "hit cache head=%ld tail=%ld t=%.6f\n",
+		cp->head_posn, cp->tail_posn, t_this);
 	}
+	nr_cache[mode]++;
+	ccp->hits++;
+	acp->ac_mark_done = 0;
+	return cp->sts;
     }
 
     if (pmDebugOptions.log && pmDebugOptions.desperate)
 	fprintf(stderr, "miss\n");
     nr[mode]++;
-
-    if (lfup->rp != NULL)
-	pmFreeResult(lfup->rp);
+    ccp->misses++;
+
+    /* sequential misses grow the read-ahead, a change of direction resets it */
+    if (mode == ccp->last_mode) {
+	if (ccp->readahead == 0)
+	    ccp->readahead = READAHEAD_MIN;
+	else if (ccp->readahead < READAHEAD_MAX)
+	    ccp->readahead *= 2;
+    }
+    else
+	ccp->readahead = 0;
+    ccp->last_mode = mode;
 
     /*
      * We need to know when we cross archive or volume boundaries.
-     * The only way to know if the archive has changed is to check whether the
-     * archive name has changed.
      */
-    if ((save_curlog_name = strdup(acp->ac_log->l_name)) == NULL) {
-	pmNoMem("__pmLogFetchInterp.save_curlog_name",
-		  strlen(acp->ac_log->l_name) + 1, PM_FATAL_ERR);
-    }
+    save_curlog = acp->ac_cur_log;
     save_curvol = acp->ac_curvol;
 
-    lfup->sts = __pmLogRead_ctx(ctxp, mode, NULL, &lfup->rp, PMLOGREAD_NEXT);
-    if (lfup->sts < 0)
-	lfup->rp = NULL;
-    *rp = lfup->rp;
-
-    archive_changed = strcmp(save_curlog_name, acp->ac_log->l_name) != 0;
-    free(save_curlog_name);
+    sts = __pmLogRead_ctx(ctxp, mode, NULL, &lrp, PMLOGREAD_NEXT);
+    if (sts < 0) {
+	*rp = NULL;
+	return sts;
+    }
+    *rp = lrp;
 
     /*
      * vol/arch switch since last time, or vol/arch switch or virtual mark
@@ -240,55 +505,56 @@ cache_read(__pmContext *ctxp, int mode, pmResult **rp)
      * new vol/arch, stdio stream and we don't know where we started from
      * ... don't cache
      */
-    if (posn == 0 || save_curvol != acp->ac_curvol || archive_changed ||
-	acp->ac_mark_done) {
-	if (lfup->c_name) {
-	    free(lfup->c_name);
-	    lfup->c_name = NULL;
-	}
+    if (posn == 0 || save_curvol != acp->ac_curvol ||
+	save_curlog != acp->ac_cur_log || acp->ac_mark_done ||
+	(cp = cache_add(ccp, acp, mode, posn, __pmFtell(acp->ac_mfp), lrp, sts, budget)) == NULL) {
+	ccp->uncached = lrp;
+	ccp->readahead = 0;
 	if (pmDebugOptions.log && pmDebugOptions.desperate)
-	    fprintf(stderr, "cache_read: reload vol switch, mark cache[%d] unused\n",
-		(int)(lfup - cache));
+	    fprintf(stderr, "cache_read: vol switch, not cached\n");
+	return sts;
     }
-    else {
-	lfup->mode = mode;
-	lfup->vol = acp->ac_vol;
-	lfup->used = 1;
-	/* Try to avoid excessive copying/freeing of the archive name. */
-	if (lfup->c_name != NULL && strcmp(lfup->c_name, acp->ac_log->l_name) != 0) {
-	    free(lfup->c_name);
-	    lfup->c_name = NULL;
-	}
-	if (lfup->c_name == NULL) {
-	    if ((lfup->c_name = strdup(acp->ac_log->l_name)) == NULL) {
-		pmNoMem("__pmLogFetchInterp.l_name",
-			  strlen(acp->ac_log->l_name) + 1, PM_FATAL_ERR);
-	    }
-	}
-	if (mode == PM_MODE_FORW) {
-	    lfup->head_posn = posn;
-	    lfup->tail_posn = __pmFtell(acp->ac_mfp);
-	    assert(lfup->tail_posn >= 0);
-	}
+
+    ccp->current = cp;
+    if (pmDebugOptions.log && pmDebugOptions.desperate) {
+	fprintf(stderr, "cache_read: reload vol=%d (curvol=%d) head=%ld tail=%ld ",
+	    cp->vol, acp->ac_curvol, (long)cp->head_posn, (long)cp->tail_posn);
+	if (cp->sts == 0)
+	    fprintf(stderr, "sts=%d\n", cp->sts);
 	else {
-	    lfup->tail_posn = posn;
-	    lfup->head_posn = __pmFtell(acp->ac_mfp);
-	    assert(lfup->head_posn >= 0);
-	}
-	if (pmDebugOptions.log && pmDebugOptions.desperate) {
-	    fprintf(stderr, "cache_read: reload cache[%d] vol=%d (curvol=%d) head=%ld tail=%ld ",
-		(int)(lfup - cache), lfup->vol, acp->ac_curvol,
-		(long)lfup->head_posn, (long)lfup->tail_posn);
-	    if (lfup->sts == 0)
-		fprintf(stderr, "sts=%d\n", lfup->sts);
-	    else {
-		char	errmsg[PM_MAXERRMSGLEN];
-		fprintf(stderr, "sts=%s\n", pmErrStr_r(lfup->sts, errmsg, sizeof(errmsg)));
-	    }
+	    char	errmsg[PM_MAXERRMSGLEN];
+	    fprintf(stderr, "sts=%s\n", pmErrStr_r(cp->sts, errmsg, sizeof(errmsg)));
 	}
     }
 
-    return lfup->sts;
+    if (ccp->readahead > 0 && budget > 0)
+	cache_readahead(ctxp, ccp, mode, ccp->readahead, budget);
+    cache_trim(ccp, budget);
+
+    return sts;
+}
+
+/*
+ * Discard everything in the read cache.
+ */
+static void
+cache_flush(cachectl_t *ccp)
+{
+    if (pmDebugOptions.interp) {
+	fprintf(stderr, "read cache: %ld hits %ld misses %ld read ahead "
+		"%ld evicted, %d entries (%ld bytes)\n",
+		ccp->hits, ccp->misses, ccp->readaheads, ccp->evictions,
+		ccp->nentries, (long)ccp->bytes);
+    }
+    ccp->current = NULL;
+    while (ccp->first != NULL)
+	cache_free(ccp, ccp->first);
+    if (ccp->uncached != NULL) {
+	pmFreeResult(ccp->uncached);
+	ccp->uncached = NULL;
+    }
+    __pmHashClear(&ccp->head_hc);
+    __pmHashClear(&ccp->tail_hc);
 }
 
 /*
@@ -365,6 +631,70 @@ dumpicp(const char *tag, instcntl_t *icp)
     fprintf(stderr, " t_last=%.6f\n", icp->t_last);
 }
 
+/*
+ * Result arena space for the pmValueBlock (if any) that
+ * __pmLogFetchInterp() builds for this instance of this metric.
+ */
+static size_t
+value_size(pmidcntl_t *pcp, instcntl_t *icp)
+{
+    switch (pcp->desc.type) {
+	case PM_TYPE_FLOAT:
+	    if (icp->metric->valfmt == PM_VAL_INSITU)
+		return 0;
+	    return __PM_ARENA_ALIGN(PM_VAL_HDR_SIZE + sizeof(float));
+	case PM_TYPE_64:
+	case PM_TYPE_U64:
+	    return __PM_ARENA_ALIGN(PM_VAL_HDR_SIZE + sizeof(__int64_t));
+	case PM_TYPE_DOUBLE:
+	    return __PM_ARENA_ALIGN(PM_VAL_HDR_SIZE + sizeof(double));
+	case PM_TYPE_AGGREGATE:
+	case PM_TYPE_EVENT:
+	case PM_TYPE_HIGHRES_EVENT:
+	case PM_TYPE_STRING:
+	    if (icp->t_prior >= 0)
+		return __PM_ARENA_ALIGN(icp->v_prior.pval->vlen);
+	    return 0;
+    }
+    return 0;
+}
+
+/*
+ * Put the instances of a metric in result order ... this is the order
+ * the instances used to be walked in when they were kept in a chained
+ * hash table sized to the instance domain, i.e. by instance number
+ * modulo the number of instances and last added first after that, so
+ * interpolated results list instances just as they always have.
+ */
+static void
+orderinst(pmidcntl_t *pcp)
+{
+    instcntl_t		**ilist;
+    int			*start;
+    unsigned int	n = pcp->ninst;
+    int			i;
+
+    if (n < 2)
+	return;
+    if ((ilist = (instcntl_t **)malloc(n * sizeof(instcntl_t *))) == NULL) {
+	pmNoMem("orderinst.ilist", n * sizeof(instcntl_t *), PM_FATAL_ERR);
+	/*NOTREACHED*/
+    }
+    if ((start = (int *)calloc(n + 1, sizeof(int))) == NULL) {
+	pmNoMem("orderinst.start", (n + 1) * sizeof(int), PM_FATAL_ERR);
+	/*NOTREACHED*/
+    }
+    for (i = 0; i < n; i++)
+	start[(unsigned int)pcp->ilist[i]->inst % n + 1]++;
+    for (i = 1; i <= n; i++)
+	start[i] += start[i-1];
+    for (i = n - 1; i >= 0; i--)
+	ilist[start[(unsigned int)pcp->ilist[i]->inst % n]++] = pcp->ilist[i];
+    free(start);
+    free(pcp->ilist);
+    pcp->ilist = ilist;
+}
+
 /*
  * Update the upper (next) and lower (prior) bounds.
  * Parameters do_mark and done control the context in which this is
@@ -387,7 +717,7 @@ update_bounds(__pmContext *ctxp, double t_req, pmResult *logrp, int do_mark, int
      */
     int		k;
     int		i;
-    __pmHashCtl	*hcp = &ctxp->c_archctl->ac_pmid_hc;
+    __pmOHashCtl	*hcp = &ctxp->c_archctl->ac_pmid_hc;
     __pmHashNode	*hp;
     __pmHashNode	*ihp;
     pmidcntl_t	*pcp;
@@ -650,7 +980,7 @@ check:
 
     changed = 0;
     for (k = 0; k < logrp->numpmid; k++) {
-	hp = __pmHashSearch((int)logrp->vset[k]->pmid, hcp);
+	hp = __pmOHashSearch((int)logrp->vset[k]->pmid, hcp);
 	if (hp == NULL)
 	    continue;
 	pcp = (pmidcntl_t *)hp->data;
@@ -700,9 +1030,9 @@ check:
 	for (i = 0; i < logrp->vset[k]->numval; i++) {
 	    pmInDom vlistIndom = logrp->vset[k]->vlist[i].inst;
 
-	    ihp = __pmHashSearch((int)vlistIndom, &pcp->hc);
+	    ihp = __pmOHashSearch((int)vlistIndom, &pcp->hc);
 	    if (ihp == NULL) {
-		ihp = __pmHashSearch(PM_IN_NULL, &pcp->hc);
+		ihp = __pmOHashSearch(PM_IN_NULL, &pcp->hc);
 		if (ihp == NULL)
 		    continue;
 	    }
@@ -891,9 +1221,8 @@ __pmLogFetchInterp(__pmContext *ctxp, int numpmid, pmID pmidlist[], pmResult **r
     double	t_this;
     pmResult	*rp;
     pmResult	*logrp;
-    __pmHashCtl	*hcp = &ctxp->c_archctl->ac_pmid_hc;
+    __pmOHashCtl	*hcp = &ctxp->c_archctl->ac_pmid_hc;
     __pmHashNode	*hp;
-    __pmHashNode	*ihp;
     pmidcntl_t	*pcp = NULL;	/* initialize to pander to gcc */
     instcntl_t	*icp = NULL;	/* initialize to pander to gcc */
     instcntl_t	*ub, *ub_prev;
@@ -905,6 +1234,8 @@ __pmLogFetchInterp(__pmContext *ctxp, int numpmid, pmID pmidlist[], pmResult **r
     static int	dowrap = -1;
     pmTimeval	tmp;
     struct timeval delta_tv = {0};
+    __pmResultArena	arena;
+    size_t	rsize;
 
     PM_LOCK(__pmLock_extcall);
     if (dowrap == -1) {
@@ -971,7 +1302,7 @@ __pmLogFetchInterp(__pmContext *ctxp, int numpmid, pmID pmidlist[], pmResult **r
     for (j = 0; j < numpmid; j++) {
 	if (pmidlist[j] == PM_ID_NULL)
 	    continue;
-	hp = __pmHashSearch((int)pmidlist[j], hcp);
+	hp = __pmOHashSearch((int)pmidlist[j], hcp);
 	if (hp == NULL) {
 	    /* first time we've been asked for this one in this context */
 	    if ((pcp = (pmidcntl_t *)malloc(sizeof(pmidcntl_t))) == NULL) {
@@ -980,8 +1311,10 @@ __pmLogFetchInterp(__pmContext *ctxp, int numpmid, pmID pmidlist[], pmResult **r
 	    }
 	    pcp->valfmt = -1;
 	    pcp->last_numval = -1;
-	    __pmHashInit(&pcp->hc);
-	    sts = __pmHashAdd((int)pmidlist[j], (void *)pcp, hcp);
+	    pcp->ninst = 0;
+	    pcp->ilist = NULL;
+	    __pmOHashInit(&pcp->hc);
+	    sts = __pmOHashAdd((int)pmidlist[j], (void *)pcp, hcp);
 	    if (sts < 0) {
 		free(pcp);
 		return sts;
@@ -1007,13 +1340,17 @@ __pmLogFetchInterp(__pmContext *ctxp, int numpmid, pmID pmidlist[], pmResult **r
 		    sts = pmGetInDomArchive_ctx(ctxp, pcp->desc.indom, &instlist, &namelist);
 		    if (sts > 0) {
 			/* Pre allocate enough space for the instance domain. */
-			hsts = __pmHashPreAlloc(sts, &pcp->hc);
+			hsts = __pmOHashPreAlloc(sts, &pcp->hc);
 			if (hsts < 0) {
 			    free(pcp);
 			    goto done_icp;
 			}
 		    }
 		}
+		if (sts > 0 &&
+		    (pcp->ilist = (instcntl_t **)malloc(sts * sizeof(instcntl_t *))) == NULL) {
+		    pmNoMem("__pmLogFetchInterp.ilist", sts * sizeof(instcntl_t *), PM_FATAL_ERR);
+		}
 		for (i = 0; i < sts; i++) {
 		    if ((icp = (instcntl_t *)malloc(sizeof(instcntl_t))) == NULL) {
 			pmNoMem("__pmLogFetchInterp.instcntl_t", sizeof(instcntl_t), PM_FATAL_ERR);
@@ -1025,12 +1362,14 @@ __pmLogFetchInterp(__pmContext *ctxp, int numpmid, pmID pmidlist[], pmResult **r
 		    SET_UNDEFINED(icp->s_prior);
 		    SET_UNDEFINED(icp->s_next);
 		    icp->v_prior.pval = icp->v_next.pval = NULL;
-		    hsts = __pmHashAdd((int)instlist[i], (void *)icp, &pcp->hc);
+		    hsts = __pmOHashAdd((int)instlist[i], (void *)icp, &pcp->hc);
 		    if (hsts < 0) {
 			free(icp);
 			goto done_icp;
 		    }
+		    pcp->ilist[pcp->ninst++] = icp;
 		}
+		orderinst(pcp);
 	    done_icp:
 		if (instlist != NULL)
 		    free(instlist);
@@ -1050,33 +1389,28 @@ __pmLogFetchInterp(__pmContext *ctxp, int numpmid, pmID pmidlist[], pmResult **r
 	}
 	else if (pcp->desc.indom != PM_INDOM_NULL) {
 	    /* use the profile to filter the instances to be returned */
-	    for (i = 0; i < pcp->hc.hsize; i++) {
-		for (ihp = pcp->hc.hash[i]; ihp != NULL; ihp = ihp->next) {
-		    icp = (instcntl_t *)ihp->data;
-		    icp->search = 0;
-		    if (__pmInProfile(pcp->desc.indom, ctxp->c_instprof, icp->inst)) {
-			icp->inresult = 1;
-			icp->want = (instcntl_t *)ctxp->c_archctl->ac_want;
-			ctxp->c_archctl->ac_want = icp;
-			pcp->numval++;
-		    }
-		    else
-			icp->inresult = 0;
+	    for (i = 0; i < pcp->ninst; i++) {
+		icp = pcp->ilist[i];
+		icp->search = 0;
+		if (__pmInProfile(pcp->desc.indom, ctxp->c_instprof, icp->inst)) {
+		    icp->inresult = 1;
+		    icp->want = (instcntl_t *)ctxp->c_archctl->ac_want;
+		    ctxp->c_archctl->ac_want = icp;
+		    pcp->numval++;
 		}
+		else
+		    icp->inresult = 0;
 	    }
 	}
 	else {
 	    /* There will be only one instance */
-	    ihp = __pmHashWalk(&pcp->hc, PM_HASH_WALK_START);
-	    assert(ihp);
-	    icp = (instcntl_t *)ihp->data;
+	    assert(pcp->ninst == 1);
+	    icp = pcp->ilist[0];
 	    icp->inresult = 1;
 	    icp->search = 0;
 	    icp->want = (instcntl_t *)ctxp->c_archctl->ac_want;
 	    ctxp->c_archctl->ac_want = icp;
 	    pcp->numval = 1;
-	    ihp = __pmHashWalk(&pcp->hc, PM_HASH_WALK_NEXT);
-	    assert(!ihp);
 	}
     }
 
@@ -1133,7 +1467,7 @@ __pmLogFetchInterp(__pmContext *ctxp, int numpmid, pmID pmidlist[], pmResult **r
 	for (j = 0; j < numpmid; j++) {
 	    if (pmidlist[j] == PM_ID_NULL)
 		continue;
-	    hp = __pmHashSearch((int)pmidlist[j], hcp);
+	    hp = __pmOHashSearch((int)pmidlist[j], hcp);
 	    assert(hp != NULL);
 	    pcp = (pmidcntl_t *)hp->data;
 	    pcp->last_numval = -1;
@@ -1484,9 +1818,39 @@ __pmLogFetchInterp(__pmContext *ctxp, int numpmid, pmID pmidlist[], pmResult **r
 	}
     }
 
-    /* Build the final result. */
-    if ((rp = (pmResult *)malloc(sizeof(pmResult) + (numpmid - 1) * sizeof(pmValueSet *))) == NULL)
-	return -oserror();
+    /*
+     * Build the final result ... size it first, so all the pmValueSets
+     * and pmValueBlocks come from one result arena.
+     */
+    rsize = 0;
+    for (j = 0; j < numpmid; j++) {
+	if (pmidlist[j] == PM_ID_NULL) {
+	    rsize += __PM_ARENA_ALIGN(sizeof(pmValueSet) - sizeof(pmValue));
+	    continue;
+	}
+	hp = __pmOHashSearch((int)pmidlist[j], hcp);
+	assert(hp != NULL);
+	pcp = (pmidcntl_t *)hp->data;
+	if (pcp->numval >= 1)
+	    rsize += __PM_ARENA_ALIGN(sizeof(pmValueSet) +
+					(pcp->numval - 1)*sizeof(pmValue));
+	else
+	    rsize += __PM_ARENA_ALIGN(sizeof(pmValueSet) - sizeof(pmValue));
+	if (pcp->numval > 0) {
+	    for (k = 0; k < pcp->ninst; k++) {
+		icp = pcp->ilist[k];
+		if (icp->inresult)
+		    rsize += value_size(pcp, icp);
+	    }
+	}
+    }
+    if ((sts = __pmResultArenaInit(&arena, rsize)) < 0)
+	return sts;
+    if ((rp = (pmResult *)malloc(sizeof(pmResult) + (numpmid - 1) * sizeof(pmValueSet *))) == NULL) {
+	sts = -oserror();
+	__pmResultArenaDone(&arena);
+	return sts;
+    }
 
     rp->timestamp.tv_sec = ctxp->c_origin.tv_sec;
     rp->timestamp.tv_usec = ctxp->c_origin.tv_usec;
@@ -1494,20 +1858,20 @@ __pmLogFetchInterp(__pmContext *ctxp, int numpmid, pmID pmidlist[], pmResult **r
 
     for (j = 0; j < numpmid; j++) {
 	if (pmidlist[j] == PM_ID_NULL) {
-	    rp->vset[j] = (pmValueSet *)malloc(sizeof(pmValueSet) -
-					    sizeof(pmValue));
+	    rp->vset[j] = (pmValueSet *)__pmResultArenaAlloc(&arena,
+				sizeof(pmValueSet) - sizeof(pmValue));
 	}
 	else {
-	    hp = __pmHashSearch((int)pmidlist[j], hcp);
+	    hp = __pmOHashSearch((int)pmidlist[j], hcp);
 	    assert(hp != NULL);
 	    pcp = (pmidcntl_t *)hp->data;
 
 	    if (pcp->numval >= 1)
-		rp->vset[j] = (pmValueSet *)malloc(sizeof(pmValueSet) +
-						(pcp->numval - 1)*sizeof(pmValue));
+		rp->vset[j] = (pmValueSet *)__pmResultArenaAlloc(&arena,
+				sizeof(pmValueSet) + (pcp->numval - 1)*sizeof(pmValue));
 	    else
-		rp->vset[j] = (pmValueSet *)malloc(sizeof(pmValueSet) -
-						sizeof(pmValue));
+		rp->vset[j] = (pmValueSet *)__pmResultArenaAlloc(&arena,
+				sizeof(pmValueSet) - sizeof(pmValue));
 	}
 
 	if (rp->vset[j] == NULL) {
@@ -1524,253 +1888,276 @@ __pmLogFetchInterp(__pmContext *ctxp, int numpmid, pmID pmidlist[], pmResult **r
 
 	i = 0;
 	if (pcp->numval > 0) {
-	    for (k = 0; k < pcp->hc.hsize; k++) {
-		for (ihp = pcp->hc.hash[k]; ihp != NULL; ihp = ihp->next) {
-		    icp = (instcntl_t *)ihp->data;
-		    if (!icp->inresult)
-			continue;
-		    if (pmDebugOptions.interp && done_roll) {
-			char	strbuf[20];
-			fprintf(stderr, "pmid %s inst %d prior: t=%.6f",
-				pmIDStr_r(pmidlist[j], strbuf, sizeof(strbuf)), icp->inst, icp->t_prior);
-			dumpval(stderr, pcp->desc.type, icp->metric->valfmt, 1, icp);
-			fprintf(stderr, " next: t=%.6f", icp->t_next);
-			dumpval(stderr, pcp->desc.type, icp->metric->valfmt, 0, icp);
-			fprintf(stderr, " t_first=%.6f t_last=%.6f\n",
-				icp->t_first, icp->t_last);
-		    }
-		    rp->vset[j]->vlist[i].inst = icp->inst;
-		    if (pcp->desc.type == PM_TYPE_32 || pcp->desc.type == PM_TYPE_U32) {
-			if (icp->t_prior == t_req)
-			    rp->vset[j]->vlist[i++].value.lval = icp->v_prior.lval;
-			else if (icp->t_next == t_req)
-			    rp->vset[j]->vlist[i++].value.lval = icp->v_next.lval;
+	    for (k = 0; k < pcp->ninst; k++) {
+		icp = pcp->ilist[k];
+		if (!icp->inresult)
+		    continue;
+		if (pmDebugOptions.interp && done_roll) {
+		    char	strbuf[20];
+		    fprintf(stderr, "pmid %s inst %d prior: t=%.6f",
+			    pmIDStr_r(pmidlist[j], strbuf, sizeof(strbuf)), icp->inst, icp->t_prior);
+		    dumpval(stderr, pcp->desc.type, icp->metric->valfmt, 1, icp);
+		    fprintf(stderr, " next: t=%.6f", icp->t_next);
+		    dumpval(stderr, pcp->desc.type, icp->metric->valfmt, 0, icp);
+		    fprintf(stderr, " t_first=%.6f t_last=%.6f\n",
+			    icp->t_first, icp->t_last);
+		}
+		rp->vset[j]->vlist[i].inst = icp->inst;
+		if (pcp->desc.type == PM_TYPE_32 || pcp->desc.type == PM_TYPE_U32) {
+		    if (icp->t_prior == t_req)
+			rp->vset[j]->vlist[i++].value.lval = icp->v_prior.lval;
+		    else if (icp->t_next == t_req)
+			rp->vset[j]->vlist[i++].value.lval = icp->v_next.lval;
+		    else {
+			if (pcp->desc.sem == PM_SEM_DISCRETE) {
+			    if (icp->t_prior >= 0)
+				rp->vset[j]->vlist[i++].value.lval = icp->v_prior.lval;
+			}
+			else if (pcp->desc.sem == PM_SEM_INSTANT) {
+			    if (icp->t_prior >= 0 && icp->t_next >= 0)
+				rp->vset[j]->vlist[i++].value.lval = icp->v_prior.lval;
+			}
 			else {
-			    if (pcp->desc.sem == PM_SEM_DISCRETE) {
-				if (icp->t_prior >= 0)
-				    rp->vset[j]->vlist[i++].value.lval = icp->v_prior.lval;
-			    }
-			    else if (pcp->desc.sem == PM_SEM_INSTANT) {
-				if (icp->t_prior >= 0 && icp->t_next >= 0)
-				    rp->vset[j]->vlist[i++].value.lval = icp->v_prior.lval;
-			    }
-			    else {
-				/* assume COUNTER */
-				if (icp->t_prior >= 0 && icp->t_next >= 0) {
-				    if (pcp->desc.type == PM_TYPE_32) {
-					if (icp->v_next.lval >= icp->v_prior.lval ||
-					    dowrap == 0) {
-					    rp->vset[j]->vlist[i++].value.lval = 0.5 +
-						icp->v_prior.lval + (t_req - icp->t_prior) *
-						(icp->v_next.lval - icp->v_prior.lval) /
-						(icp->t_next - icp->t_prior);
-					}
-					else {
-					    /* not monotonic increasing and want wrap */
-					    rp->vset[j]->vlist[i++].value.lval = 0.5 +
-						(t_req - icp->t_prior) *
-						(__int32_t)(UINT_MAX - icp->v_prior.lval + 1 + icp->v_next.lval) /
-						(icp->t_next - icp->t_prior);
-					    rp->vset[j]->vlist[i].value.lval += icp->v_prior.lval;
-					}
+			    /* assume COUNTER */
+			    if (icp->t_prior >= 0 && icp->t_next >= 0) {
+				if (pcp->desc.type == PM_TYPE_32) {
+				    if (icp->v_next.lval >= icp->v_prior.lval ||
+					dowrap == 0) {
+					rp->vset[j]->vlist[i++].value.lval = 0.5 +
+					    icp->v_prior.lval + (t_req - icp->t_prior) *
+					    (icp->v_next.lval - icp->v_prior.lval) /
+					    (icp->t_next - icp->t_prior);
 				    }
 				    else {
-					pmAtomValue     av;
-					pmAtomValue     *avp_prior = (pmAtomValue *)&icp->v_prior.lval;
-					pmAtomValue     *avp_next = (pmAtomValue *)&icp->v_next.lval;
-					if (avp_next->ul >= avp_prior->ul) {
-					    av.ul = 0.5 + avp_prior->ul +
+					/* not monotonic increasing and want wrap */
+					rp->vset[j]->vlist[i++].value.lval = 0.5 +
+					    (t_req - icp->t_prior) *
+					    (__int32_t)(UINT_MAX - icp->v_prior.lval + 1 + icp->v_next.lval) /
+					    (icp->t_next - icp->t_prior);
+					rp->vset[j]->vlist[i].value.lval += icp->v_prior.lval;
+				    }
+				}
+				else {
+				    pmAtomValue     av;
+				    pmAtomValue     *avp_prior = (pmAtomValue *)&icp->v_prior.lval;
+				    pmAtomValue     *avp_next = (pmAtomValue *)&icp->v_next.lval;
+				    if (avp_next->ul >= avp_prior->ul) {
+					av.ul = 0.5 + avp_prior->ul +
+					    (t_req - icp->t_prior) *
+					    (avp_next->ul - avp_prior->ul) /
+					    (icp->t_next - icp->t_prior);
+				    }
+				    else {
+					/* not monotonic increasing */
+					if (dowrap) {
+					    av.ul = 0.5 +
 						(t_req - icp->t_prior) *
-						(avp_next->ul - avp_prior->ul) /
+						(__uint32_t)(UINT_MAX - avp_prior->ul + 1 + avp_next->ul ) /
 						(icp->t_next - icp->t_prior);
+					    av.ul += avp_prior->ul;
 					}
 					else {
-					    /* not monotonic increasing */
-					    if (dowrap) {
-						av.ul = 0.5 +
-						    (t_req - icp->t_prior) *
-						    (__uint32_t)(UINT_MAX - avp_prior->ul + 1 + avp_next->ul ) /
-						    (icp->t_next - icp->t_prior);
-						av.ul += avp_prior->ul;
-					    }
-					    else {
-						__uint32_t	tmp;
-						tmp = avp_prior->ul - avp_next->ul;
-						av.ul = 0.5 + avp_prior->ul -
-						    (t_req - icp->t_prior) * tmp /
-						    (icp->t_next - icp->t_prior);
-					    }
+					    __uint32_t	tmp;
+					    tmp = avp_prior->ul - avp_next->ul;
+					    av.ul = 0.5 + avp_prior->ul -
+						(t_req - icp->t_prior) * tmp /
+						(icp->t_next - icp->t_prior);
 					}
-					rp->vset[j]->vlist[i++].value.lval = av.ul;
 				    }
+				    rp->vset[j]->vlist[i++].value.lval = av.ul;
 				}
 			    }
 			}
 		    }
-		    else if (pcp->desc.type == PM_TYPE_FLOAT && icp->metric->valfmt == PM_VAL_INSITU) {
-			/* OLD style FLOAT insitu */
-			if (icp->t_prior == t_req)
-			    rp->vset[j]->vlist[i++].value.lval = icp->v_prior.lval;
-			else if (icp->t_next == t_req)
-			    rp->vset[j]->vlist[i++].value.lval = icp->v_next.lval;
+		}
+		else if (pcp->desc.type == PM_TYPE_FLOAT && icp->metric->valfmt == PM_VAL_INSITU) {
+		    /* OLD style FLOAT insitu */
+		    if (icp->t_prior == t_req)
+			rp->vset[j]->vlist[i++].value.lval = icp->v_prior.lval;
+		    else if (icp->t_next == t_req)
+			rp->vset[j]->vlist[i++].value.lval = icp->v_next.lval;
+		    else {
+			if (pcp->desc.sem == PM_SEM_DISCRETE) {
+			    if (icp->t_prior >= 0)
+				rp->vset[j]->vlist[i++].value.lval = icp->v_prior.lval;
+			}
+			else if (pcp->desc.sem == PM_SEM_INSTANT) {
+			    if (icp->t_prior >= 0 && icp->t_next >= 0)
+				rp->vset[j]->vlist[i++].value.lval = icp->v_prior.lval;
+			}
 			else {
-			    if (pcp->desc.sem == PM_SEM_DISCRETE) {
-				if (icp->t_prior >= 0)
-				    rp->vset[j]->vlist[i++].value.lval = icp->v_prior.lval;
-			    }
-			    else if (pcp->desc.sem == PM_SEM_INSTANT) {
-				if (icp->t_prior >= 0 && icp->t_next >= 0)
-				    rp->vset[j]->vlist[i++].value.lval = icp->v_prior.lval;
-			    }
-			    else {
-				/* assume COUNTER */
-				pmAtomValue	av;
-				pmAtomValue	*avp_prior = (pmAtomValue *)&icp->v_prior.lval;
-				pmAtomValue	*avp_next = (pmAtomValue *)&icp->v_next.lval;
-				if (icp->t_prior >= 0 && icp->t_next >= 0) {
-				    av.f = avp_prior->f + (t_req - icp->t_prior) *
-					(avp_next->f - avp_prior->f) /
-					(icp->t_next - icp->t_prior);
-				    /* yes this IS correct ... */
-				    rp->vset[j]->vlist[i++].value.lval = av.l;
-				}
+			    /* assume COUNTER */
+			    pmAtomValue	av;
+			    pmAtomValue	*avp_prior = (pmAtomValue *)&icp->v_prior.lval;
+			    pmAtomValue	*avp_next = (pmAtomValue *)&icp->v_next.lval;
+			    if (icp->t_prior >= 0 && icp->t_next >= 0) {
+				av.f = avp_prior->f + (t_req - icp->t_prior) *
+				    (avp_next->f - avp_prior->f) /
+				    (icp->t_next - icp->t_prior);
+				/* yes this IS correct ... */
+				rp->vset[j]->vlist[i++].value.lval = av.l;
 			    }
 			}
 		    }
-		    else if (pcp->desc.type == PM_TYPE_FLOAT) {
-			/* NEW style FLOAT in pmValueBlock */
-			int			need;
-			pmValueBlock	*vp;
-			int			ok = 1;
-
-			need = PM_VAL_HDR_SIZE + sizeof(float);
-			if ((vp = (pmValueBlock *)malloc(need)) == NULL) {
-			    sts = -oserror();
-			    goto bad_alloc;
+		}
+		else if (pcp->desc.type == PM_TYPE_FLOAT) {
+		    /* NEW style FLOAT in pmValueBlock */
+		    int			need;
+		    pmValueBlock	*vp;
+		    int			ok = 1;
+
+		    need = PM_VAL_HDR_SIZE + sizeof(float);
+		    if ((vp = (pmValueBlock *)__pmResultArenaAlloc(&arena, need)) == NULL) {
+			sts = -ENOMEM;
+			goto bad_alloc;
+		    }
+		    vp->vlen = need;
+		    vp->vtype = PM_TYPE_FLOAT;
+		    rp->vset[j]->valfmt = PM_VAL_DPTR;
+		    rp->vset[j]->vlist[i++].value.pval = vp;
+		    if (icp->t_prior == t_req)
+			memcpy((void *)vp->vbuf, (void *)icp->v_prior.pval->vbuf, sizeof(float));
+		    else if (icp->t_next == t_req)
+			memcpy((void *)vp->vbuf, (void *)icp->v_next.pval->vbuf, sizeof(float));
+		    else {
+			if (pcp->desc.sem == PM_SEM_DISCRETE) {
+			    if (icp->t_prior >= 0)
+				memcpy((void *)vp->vbuf, (void *)icp->v_prior.pval->vbuf, sizeof(float));
+			    else
+				ok = 0;
+			}
+			else if (pcp->desc.sem == PM_SEM_INSTANT) {
+			    if (icp->t_prior >= 0 && icp->t_next >= 0)
+				memcpy((void *)vp->vbuf, (void *)icp->v_prior.pval->vbuf, sizeof(float));
+			    else
+				ok = 0;
 			}
-			vp->vlen = need;
-			vp->vtype = PM_TYPE_FLOAT;
-			rp->vset[j]->valfmt = PM_VAL_DPTR;
-			rp->vset[j]->vlist[i++].value.pval = vp;
-			if (icp->t_prior == t_req)
-			    memcpy((void *)vp->vbuf, (void *)icp->v_prior.pval->vbuf, sizeof(float));
-			else if (icp->t_next == t_req)
-			    memcpy((void *)vp->vbuf, (void *)icp->v_next.pval->vbuf, sizeof(float));
 			else {
-			    if (pcp->desc.sem == PM_SEM_DISCRETE) {
-				if (icp->t_prior >= 0)
-				    memcpy((void *)vp->vbuf, (void *)icp->v_prior.pval->vbuf, sizeof(float));
-				else
-				    ok = 0;
-			    }
-			    else if (pcp->desc.sem == PM_SEM_INSTANT) {
-				if (icp->t_prior >= 0 && icp->t_next >= 0)
-				    memcpy((void *)vp->vbuf, (void *)icp->v_prior.pval->vbuf, sizeof(float));
-				else
-				    ok = 0;
-			    }
-			    else {
-				/* assume COUNTER */
-				if (icp->t_prior >= 0 && icp->t_next >= 0) {
-				    pmAtomValue	av;
-				    void		*avp_prior = icp->v_prior.pval->vbuf;
-				    void		*avp_next = icp->v_next.pval->vbuf;
-				    float	f_prior;
-				    float	f_next;
-
-				    memcpy((void *)&av.f, avp_prior, sizeof(av.f));
-				    f_prior = av.f;
-				    memcpy((void *)&av.f, avp_next, sizeof(av.f));
-				    f_next = av.f;
+			    /* assume COUNTER */
+			    if (icp->t_prior >= 0 && icp->t_next >= 0) {
+				pmAtomValue	av;
+				void		*avp_prior = icp->v_prior.pval->vbuf;
+				void		*avp_next = icp->v_next.pval->vbuf;
+				float	f_prior;
+				float	f_next;
+
+				memcpy((void *)&av.f, avp_prior, sizeof(av.f));
+				f_prior = av.f;
+				memcpy((void *)&av.f, avp_next, sizeof(av.f));
+				f_next = av.f;
 				    
-				    av.f = f_prior + (t_req - icp->t_prior) *
-					(f_next - f_prior) /
-					(icp->t_next - icp->t_prior);
-				    memcpy((void *)vp->vbuf, (void *)&av.f, sizeof(av.f));
-				}
-				else
-				    ok = 0;
+				av.f = f_prior + (t_req - icp->t_prior) *
+				    (f_next - f_prior) /
+				    (icp->t_next - icp->t_prior);
+				memcpy((void *)vp->vbuf, (void *)&av.f, sizeof(av.f));
 			    }
-			}
-			if (!ok) {
-			    i--;
-			    free(vp);
+			    else
+				ok = 0;
 			}
 		    }
-		    else if (pcp->desc.type == PM_TYPE_64 || pcp->desc.type == PM_TYPE_U64) {
-			int			need;
-			pmValueBlock	*vp;
-			int			ok = 1;
+		    if (!ok) {
+			/* arena space is released with the result */
+			i--;
+		    }
+		}
+		else if (pcp->desc.type == PM_TYPE_64 || pcp->desc.type == PM_TYPE_U64) {
+		    int			need;
+		    pmValueBlock	*vp;
+		    int			ok = 1;
 			
-			need = PM_VAL_HDR_SIZE + sizeof(__int64_t);
-			if ((vp = (pmValueBlock *)malloc(need)) == NULL) {
-			    sts = -oserror();
-			    goto bad_alloc;
+		    need = PM_VAL_HDR_SIZE + sizeof(__int64_t);
+		    if ((vp = (pmValueBlock *)__pmResultArenaAlloc(&arena, need)) == NULL) {
+			sts = -ENOMEM;
+			goto bad_alloc;
+		    }
+		    vp->vlen = need;
+		    if (pcp->desc.type == PM_TYPE_64)
+			vp->vtype = PM_TYPE_64;
+		    else
+			vp->vtype = PM_TYPE_U64;
+		    rp->vset[j]->valfmt = PM_VAL_DPTR;
+		    rp->vset[j]->vlist[i++].value.pval = vp;
+		    if (icp->t_prior == t_req)
+			memcpy((void *)vp->vbuf, (void *)icp->v_prior.pval->vbuf, sizeof(__int64_t));
+		    else if (icp->t_next == t_req)
+			memcpy((void *)vp->vbuf, (void *)icp->v_next.pval->vbuf, sizeof(__int64_t));
+		    else {
+			if (pcp->desc.sem == PM_SEM_DISCRETE) {
+			    if (icp->t_prior >= 0)
+				memcpy((void *)vp->vbuf, (void *)icp->v_prior.pval->vbuf, sizeof(__int64_t));
+			    else
+				ok = 0;
+			}
+			else if (pcp->desc.sem == PM_SEM_INSTANT) {
+			    if (icp->t_prior >= 0 && icp->t_next >= 0)
+				memcpy((void *)vp->vbuf, (void *)icp->v_prior.pval->vbuf, sizeof(__int64_t));
+			    else
+				ok = 0;
 			}
-			vp->vlen = need;
-			if (pcp->desc.type == PM_TYPE_64)
-			    vp->vtype = PM_TYPE_64;
-			else
-			    vp->vtype = PM_TYPE_U64;
-			rp->vset[j]->valfmt = PM_VAL_DPTR;
-			rp->vset[j]->vlist[i++].value.pval = vp;
-			if (icp->t_prior == t_req)
-			    memcpy((void *)vp->vbuf, (void *)icp->v_prior.pval->vbuf, sizeof(__int64_t));
-			else if (icp->t_next == t_req)
-			    memcpy((void *)vp->vbuf, (void *)icp->v_next.pval->vbuf, sizeof(__int64_t));
 			else {
-			    if (pcp->desc.sem == PM_SEM_DISCRETE) {
-				if (icp->t_prior >= 0)
-				    memcpy((void *)vp->vbuf, (void *)icp->v_prior.pval->vbuf, sizeof(__int64_t));
-				else
-				    ok = 0;
-			    }
-			    else if (pcp->desc.sem == PM_SEM_INSTANT) {
-				if (icp->t_prior >= 0 && icp->t_next >= 0)
-				    memcpy((void *)vp->vbuf, (void *)icp->v_prior.pval->vbuf, sizeof(__int64_t));
-				else
-				    ok = 0;
-			    }
-			    else {
-				/* assume COUNTER */
-				if (icp->t_prior >= 0 && icp->t_next >= 0) {
-				    pmAtomValue	av;
-				    void		*avp_prior = (void *)icp->v_prior.pval->vbuf;
-				    void		*avp_next = (void *)icp->v_next.pval->vbuf;
-				    if (pcp->desc.type == PM_TYPE_64) {
-					__int64_t	ll_prior;
-					__int64_t	ll_next;
-					memcpy((void *)&av.ll, avp_prior, sizeof(av.ll));
-					ll_prior = av.ll;
-					memcpy((void *)&av.ll, avp_next, sizeof(av.ll));
-					ll_next = av.ll;
-					if (ll_next >= ll_prior || dowrap == 0)
-					    av.ll = ll_next - ll_prior;
-					else
-					    /* not monotonic increasing and want wrap */
-					    av.ll = (__int64_t)(ULONGLONG_MAX - ll_prior + 1 +  ll_next);
-					av.ll = (__int64_t)(0.5 + (double)ll_prior +
-							    (t_req - icp->t_prior) * (double)av.ll / (icp->t_next - icp->t_prior));
-					memcpy((void *)vp->vbuf, (void *)&av.ll, sizeof(av.ll));
+			    /* assume COUNTER */
+			    if (icp->t_prior >= 0 && icp->t_next >= 0) {
+				pmAtomValue	av;
+				void		*avp_prior = (void *)icp->v_prior.pval->vbuf;
+				void		*avp_next = (void *)icp->v_next.pval->vbuf;
+				if (pcp->desc.type == PM_TYPE_64) {
+				    __int64_t	ll_prior;
+				    __int64_t	ll_next;
+				    memcpy((void *)&av.ll, avp_prior, sizeof(av.ll));
+				    ll_prior = av.ll;
+				    memcpy((void *)&av.ll, avp_next, sizeof(av.ll));
+				    ll_next = av.ll;
+				    if (ll_next >= ll_prior || dowrap == 0)
+					av.ll = ll_next - ll_prior;
+				    else
+					/* not monotonic increasing and want wrap */
+					av.ll = (__int64_t)(ULONGLONG_MAX - ll_prior + 1 +  ll_next);
+				    av.ll = (__int64_t)(0.5 + (double)ll_prior +
+							(t_req - icp->t_prior) * (double)av.ll / (icp->t_next - icp->t_prior));
+				    memcpy((void *)vp->vbuf, (void *)&av.ll, sizeof(av.ll));
+				}
+				else {
+				    __int64_t	ull_prior;
+				    __int64_t	ull_next;
+				    memcpy((void *)&av.ull, avp_prior, sizeof(av.ull));
+				    ull_prior = av.ull;
+				    memcpy((void *)&av.ull, avp_next, sizeof(av.ull));
+				    ull_next = av.ull;
+				    if (ull_next >= ull_prior) {
+					av.ull = ull_next - ull_prior;
+#if !defined(HAVE_CAST_U64_DOUBLE)
+					{
+					    double tmp;
+						
+					    if (SIGN_64_MASK & av.ull)
+						tmp = (double)(__int64_t)(av.ull & (~SIGN_64_MASK)) + (__uint64_t)SIGN_64_MASK;
+					    else
+						tmp = (double)(__int64_t)av.ull;
+						
+					    av.ull = (__uint64_t)(0.5 + (double)ull_prior +
+								  (t_req - icp->t_prior) * tmp /
+								  (icp->t_next - icp->t_prior));
+					}
+#else
+					av.ull = (__uint64_t)(0.5 + (double)ull_prior +
+							      (t_req - icp->t_prior) * (double)av.ull /
+							      (icp->t_next - icp->t_prior));
+#endif
 				    }
 				    else {
-					__int64_t	ull_prior;
-					__int64_t	ull_next;
-					memcpy((void *)&av.ull, avp_prior, sizeof(av.ull));
-					ull_prior = av.ull;
-					memcpy((void *)&av.ull, avp_next, sizeof(av.ull));
-					ull_next = av.ull;
-					if (ull_next >= ull_prior) {
-					    av.ull = ull_next - ull_prior;
+					/* not monotonic increasing */
+					if (dowrap) {
+					    av.ull = ULONGLONG_MAX - ull_prior + 1 +
+						ull_next;
 #if !defined(HAVE_CAST_U64_DOUBLE)
 					    {
 						double tmp;
-						
+						    
 						if (SIGN_64_MASK & av.ull)
 						    tmp = (double)(__int64_t)(av.ull & (~SIGN_64_MASK)) + (__uint64_t)SIGN_64_MASK;
 						else
 						    tmp = (double)(__int64_t)av.ull;
-						
+						    
 						av.ull = (__uint64_t)(0.5 + (double)ull_prior +
 								      (t_req - icp->t_prior) * tmp /
 								      (icp->t_next - icp->t_prior));
@@ -1782,149 +2169,125 @@ __pmLogFetchInterp(__pmContext *ctxp, int numpmid, pmID pmidlist[], pmResult **r
 #endif
 					}
 					else {
-					    /* not monotonic increasing */
-					    if (dowrap) {
-						av.ull = ULONGLONG_MAX - ull_prior + 1 +
-						    ull_next;
+					    __uint64_t	tmp;
+					    tmp = ull_prior - ull_next;
 #if !defined(HAVE_CAST_U64_DOUBLE)
-						{
-						    double tmp;
+					    {
+						double xtmp;
 						    
-						    if (SIGN_64_MASK & av.ull)
-							tmp = (double)(__int64_t)(av.ull & (~SIGN_64_MASK)) + (__uint64_t)SIGN_64_MASK;
-						    else
-							tmp = (double)(__int64_t)av.ull;
+						if (SIGN_64_MASK & av.ull)
+						    xtmp = (double)(__int64_t)(tmp & (~SIGN_64_MASK)) + (__uint64_t)SIGN_64_MASK;
+						else
+						    xtmp = (double)(__int64_t)tmp;
 						    
-						    av.ull = (__uint64_t)(0.5 + (double)ull_prior +
-									  (t_req - icp->t_prior) * tmp /
-									  (icp->t_next - icp->t_prior));
-						}
-#else
-						av.ull = (__uint64_t)(0.5 + (double)ull_prior +
-								      (t_req - icp->t_prior) * (double)av.ull /
+						av.ull = (__uint64_t)(0.5 + (double)ull_prior -
+								      (t_req - icp->t_prior) * xtmp /
 								      (icp->t_next - icp->t_prior));
-#endif
 					    }
-					    else {
-						__uint64_t	tmp;
-						tmp = ull_prior - ull_next;
-#if !defined(HAVE_CAST_U64_DOUBLE)
-						{
-						    double xtmp;
-						    
-						    if (SIGN_64_MASK & av.ull)
-							xtmp = (double)(__int64_t)(tmp & (~SIGN_64_MASK)) + (__uint64_t)SIGN_64_MASK;
-						    else
-							xtmp = (double)(__int64_t)tmp;
-						    
-						    av.ull = (__uint64_t)(0.5 + (double)ull_prior -
-									  (t_req - icp->t_prior) * xtmp /
-									  (icp->t_next - icp->t_prior));
-						}
 #else
-						av.ull = (__uint64_t)(0.5 + (double)ull_prior -
-								      (t_req - icp->t_prior) * (double)tmp /
-								      (icp->t_next - icp->t_prior));
+					    av.ull = (__uint64_t)(0.5 + (double)ull_prior -
+								  (t_req - icp->t_prior) * (double)tmp /
+								  (icp->t_next - icp->t_prior));
 #endif
-					    }
 					}
-					memcpy((void *)vp->vbuf, (void *)&av.ull, sizeof(av.ull));
 				    }
+				    memcpy((void *)vp->vbuf, (void *)&av.ull, sizeof(av.ull));
 				}
-				else
-				    ok = 0;
 			    }
+			    else
+				ok = 0;
 			}
-			if (!ok) {
-			    i--;
-			    free(vp);
-			}
 		    }
-		    else if (pcp->desc.type == PM_TYPE_DOUBLE) {
-			int			need;
-			pmValueBlock	*vp;
-			int			ok = 1;
+		    if (!ok) {
+			/* arena space is released with the result */
+			i--;
+		    }
+		}
+		else if (pcp->desc.type == PM_TYPE_DOUBLE) {
+		    int			need;
+		    pmValueBlock	*vp;
+		    int			ok = 1;
 			
-			need = PM_VAL_HDR_SIZE + sizeof(double);
-			if ((vp = (pmValueBlock *)malloc(need)) == NULL) {
-			    sts = -oserror();
-			    goto bad_alloc;
+		    need = PM_VAL_HDR_SIZE + sizeof(double);
+		    if ((vp = (pmValueBlock *)__pmResultArenaAlloc(&arena, need)) == NULL) {
+			sts = -ENOMEM;
+			goto bad_alloc;
+		    }
+		    vp->vlen = need;
+		    vp->vtype = PM_TYPE_DOUBLE;
+		    rp->vset[j]->valfmt = PM_VAL_DPTR;
+		    rp->vset[j]->vlist[i++].value.pval = vp;
+		    if (icp->t_prior == t_req)
+			memcpy((void *)vp->vbuf, (void *)icp->v_prior.pval->vbuf, sizeof(double));
+		    else if (icp->t_next == t_req)
+			memcpy((void *)vp->vbuf, (void *)icp->v_next.pval->vbuf, sizeof(double));
+		    else {
+			if (pcp->desc.sem == PM_SEM_DISCRETE) {
+			    if (icp->t_prior >= 0)
+				memcpy((void *)vp->vbuf, (void *)icp->v_prior.pval->vbuf, sizeof(double));
+			    else
+				ok = 0;
+			}
+			else if (pcp->desc.sem == PM_SEM_INSTANT) {
+			    if (icp->t_prior >= 0 && icp->t_next >= 0)
+				memcpy((void *)vp->vbuf, (void *)icp->v_prior.pval->vbuf, sizeof(double));
+			    else
+				ok = 0;
 			}
-			vp->vlen = need;
-			vp->vtype = PM_TYPE_DOUBLE;
-			rp->vset[j]->valfmt = PM_VAL_DPTR;
-			rp->vset[j]->vlist[i++].value.pval = vp;
-			if (icp->t_prior == t_req)
-			    memcpy((void *)vp->vbuf, (void *)icp->v_prior.pval->vbuf, sizeof(double));
-			else if (icp->t_next == t_req)
-			    memcpy((void *)vp->vbuf, (void *)icp->v_next.pval->vbuf, sizeof(double));
 			else {
-			    if (pcp->desc.sem == PM_SEM_DISCRETE) {
-				if (icp->t_prior >= 0)
-				    memcpy((void *)vp->vbuf, (void *)icp->v_prior.pval->vbuf, sizeof(double));
-				else
-				    ok = 0;
-			    }
-			    else if (pcp->desc.sem == PM_SEM_INSTANT) {
-				if (icp->t_prior >= 0 && icp->t_next >= 0)
-				    memcpy((void *)vp->vbuf, (void *)icp->v_prior.pval->vbuf, sizeof(double));
-				else
-				    ok = 0;
-			    }
-			    else {
-				/* assume COUNTER */
-				if (icp->t_prior >= 0 && icp->t_next >= 0) {
-				    pmAtomValue	av;
-				    void		*avp_prior = (void *)icp->v_prior.pval->vbuf;
-				    void		*avp_next = (void *)icp->v_next.pval->vbuf;
-				    double	d_prior;
-				    double	d_next;
-				    memcpy((void *)&av.d, avp_prior, sizeof(av.d));
-				    d_prior = av.d;
-				    memcpy((void *)&av.d, avp_next, sizeof(av.d));
-				    d_next = av.d;
-				    av.d = d_prior + (t_req - icp->t_prior) *
-					(d_next - d_prior) /
-					(icp->t_next - icp->t_prior);
-				    memcpy((void *)vp->vbuf, (void *)&av.d, sizeof(av.d));
-				}
-				else
-				    ok = 0;
+			    /* assume COUNTER */
+			    if (icp->t_prior >= 0 && icp->t_next >= 0) {
+				pmAtomValue	av;
+				void		*avp_prior = (void *)icp->v_prior.pval->vbuf;
+				void		*avp_next = (void *)icp->v_next.pval->vbuf;
+				double	d_prior;
+				double	d_next;
+				memcpy((void *)&av.d, avp_prior, sizeof(av.d));
+				d_prior = av.d;
+				memcpy((void *)&av.d, avp_next, sizeof(av.d));
+				d_next = av.d;
+				av.d = d_prior + (t_req - icp->t_prior) *
+				    (d_next - d_prior) /
+				    (icp->t_next - icp->t_prior);
+				memcpy((void *)vp->vbuf, (void *)&av.d, sizeof(av.d));
 			    }
-			}
-			if (!ok) {
-			    i--;
-			    free(vp);
+			    else
+				ok = 0;
 			}
 		    }
-		    else if ((pcp->desc.type == PM_TYPE_AGGREGATE ||
-			      pcp->desc.type == PM_TYPE_EVENT ||
-			      pcp->desc.type == PM_TYPE_HIGHRES_EVENT ||
-			      pcp->desc.type == PM_TYPE_STRING) &&
-			     icp->t_prior >= 0) {
-			int		need;
-			pmValueBlock	*vp;
+		    if (!ok) {
+			/* arena space is released with the result */
+			i--;
+		    }
+		}
+		else if ((pcp->desc.type == PM_TYPE_AGGREGATE ||
+			  pcp->desc.type == PM_TYPE_EVENT ||
+			  pcp->desc.type == PM_TYPE_HIGHRES_EVENT ||
+			  pcp->desc.type == PM_TYPE_STRING) &&
+			 icp->t_prior >= 0) {
+		    int		need;
+		    pmValueBlock	*vp;
 			
-			need = icp->v_prior.pval->vlen;
+		    need = icp->v_prior.pval->vlen;
 			
-			vp = (pmValueBlock *)malloc(need);
-			if (vp == NULL) {
-			    sts = -oserror();
-			    goto bad_alloc;
-			}
-			rp->vset[j]->valfmt = PM_VAL_DPTR;
-			rp->vset[j]->vlist[i++].value.pval = vp;
-			memcpy((void *)vp, icp->v_prior.pval, need);
-		    }
-		    else {
-			/* unknown type - skip it, else junk in result */
-			i--;
+		    vp = (pmValueBlock *)__pmResultArenaAlloc(&arena, need);
+		    if (vp == NULL) {
+			sts = -ENOMEM;
+			goto bad_alloc;
 		    }
+		    rp->vset[j]->valfmt = PM_VAL_DPTR;
+		    rp->vset[j]->vlist[i++].value.pval = vp;
+		    memcpy((void *)vp, icp->v_prior.pval, need);
+		}
+		else {
+		    /* unknown type - skip it, else junk in result */
+		    i--;
 		}
 	    }
 	}
 	pcp->last_numval = pcp->numval;
     }
+    __pmResultArenaDone(&arena);
 
     *result = rp;
     sts = 0;
@@ -1958,13 +2321,11 @@ all_done:
 
 bad_alloc:
     /*
-     * leaks a little (vlist[] stuff) ... but does not really matter at
-     * this point, chance of anything good happening from here on are
-     * pretty remote
+     * the result arena was sized too small, only vset[0] ... vset[j]
+     * exist, and all of them are in the arena
      */
     rp->vset[j]->numval = i;
-    while (++j < numpmid)
-	rp->vset[j]->numval = 0;
+    rp->numpmid = j + 1;
     pmFreeResult(rp);
 
     return sts;
@@ -1974,38 +2335,35 @@ bad_alloc:
 void
 __pmLogResetInterp(__pmContext *ctxp)
 {
-    __pmHashCtl	*hcp = &ctxp->c_archctl->ac_pmid_hc;
+    __pmOHashCtl	*hcp = &ctxp->c_archctl->ac_pmid_hc;
     double	t_req;
     __pmHashNode	*hp;
-    __pmHashNode	*ihp;
-    int		i, k;
+    int		i;
     pmidcntl_t	*pcp;
     instcntl_t	*icp;
 
-    if (hcp->hsize == 0)
+    if (hcp->nodes == 0)
 	return;
 
     t_req = __pmTimevalSub(&ctxp->c_origin, __pmLogStartTime(ctxp->c_archctl));
 
-    for (k = 0; k < hcp->hsize; k++) {
-	for (hp = hcp->hash[k]; hp != NULL; hp = hp->next) {
-	    pcp = (pmidcntl_t *)hp->data;
-	    for (i = 0; i < pcp->hc.hsize; i++) {
-		for (ihp = pcp->hc.hash[i]; ihp != NULL; ihp = ihp->next) {
-		    icp = (instcntl_t *)ihp->data;
-		    if (icp->t_prior > t_req || icp->t_next < t_req) {
-			icp->t_prior = icp->t_next = -1;
-			SET_UNDEFINED(icp->s_prior);
-			SET_UNDEFINED(icp->s_next);
-			if (pcp->valfmt != PM_VAL_INSITU) {
-			    if (icp->v_prior.pval != NULL)
-				__pmUnpinPDUBuf((void *)icp->v_prior.pval);
-			    if (icp->v_next.pval != NULL)
-				__pmUnpinPDUBuf((void *)icp->v_next.pval);
-			}
-			icp->v_prior.pval = icp->v_next.pval = NULL;
-		    }
+    for (hp = __pmOHashWalk(hcp, PM_HASH_WALK_START);
+	 hp != NULL;
+	 hp = __pmOHashWalk(hcp, PM_HASH_WALK_NEXT)) {
+	pcp = (pmidcntl_t *)hp->data;
+	for (i = 0; i < pcp->ninst; i++) {
+	    icp = pcp->ilist[i];
+	    if (icp->t_prior > t_req || icp->t_next < t_req) {
+		icp->t_prior = icp->t_next = -1;
+		SET_UNDEFINED(icp->s_prior);
+		SET_UNDEFINED(icp->s_next);
+		if (pcp->valfmt != PM_VAL_INSITU) {
+		    if (icp->v_prior.pval != NULL)
+			__pmUnpinPDUBuf((void *)icp->v_prior.pval);
+		    if (icp->v_next.pval != NULL)
+			__pmUnpinPDUBuf((void *)icp->v_next.pval);
 		}
+		icp->v_prior.pval = icp->v_next.pval = NULL;
 	    }
 	}
     }
@@ -2022,114 +2380,54 @@ __pmLogResetInterp(__pmContext *ctxp)
 void
 __pmFreeInterpData(__pmContext *ctxp)
 {
-    if (ctxp->c_archctl->ac_pmid_hc.hsize > 0) {
+    if (ctxp->c_archctl->ac_pmid_hc.nodes > 0) {
 	/* we have done some interpolation ... */
-	__pmHashCtl	*hcp = &ctxp->c_archctl->ac_pmid_hc;
+	__pmOHashCtl	*hcp = &ctxp->c_archctl->ac_pmid_hc;
 	__pmHashNode	*hp;
-	__pmHashNode	*ihp;
 	pmidcntl_t	*pcp;
 	instcntl_t	*icp;
-	int		i, j;
+	int		i;
 
-	for (j = 0; j < hcp->hsize; j++) {
-	    __pmHashNode	*last_hp = NULL;
-	    /*
-	     * Don't free __pmHashNode until hp->next has been traversed,
-	     * hence free lags one node in the chain (last_hp used for free).
-	     * Same for linked list of instcntl_t structs (use last_ihp
-	     * for free in this case).
-	     */
-	    for (hp = hcp->hash[j]; hp != NULL; hp = hp->next) {
-		pcp = (pmidcntl_t *)hp->data;
-		for (i = 0; i < pcp->hc.hsize; i++) {
-		    __pmHashNode	*last_ihp = NULL;
-		    for (ihp = pcp->hc.hash[i]; ihp != NULL; ihp = ihp->next) {
-			icp = (instcntl_t *)ihp->data;
-			if (pcp->valfmt != PM_VAL_INSITU) {
-			    /*
-			     * Held values may be in PDU buffers, unpin the PDU
-			     * buffers just in case (__pmUnpinPDUBuf is a NOP if
-			     * the value is not in a PDU buffer)
-			     */
-			    if (icp->v_prior.pval != NULL) {
-				if (pmDebugOptions.interp && pmDebugOptions.desperate) {
-				    char	strbuf[20];
-				    fprintf(stderr, "release pmid %s inst %d prior\n",
-					    pmIDStr_r(pcp->desc.pmid, strbuf, sizeof(strbuf)), icp->inst);
-				}
-				__pmUnpinPDUBuf((void *)icp->v_prior.pval);
-			    }
-			    if (icp->v_next.pval != NULL) {
-				if (pmDebugOptions.interp && pmDebugOptions.desperate) {
-				    char	strbuf[20];
-				    fprintf(stderr, "release pmid %s inst %d next\n",
-					    pmIDStr_r(pcp->desc.pmid, strbuf, sizeof(strbuf)), icp->inst);
-				}
-				__pmUnpinPDUBuf((void *)icp->v_next.pval);
-			    }
-			}
-			if (last_ihp != NULL) {
-			    if (last_ihp->data != NULL)
-				free(last_ihp->data);
-			    free(last_ihp);
+	for (hp = __pmOHashWalk(hcp, PM_HASH_WALK_START);
+	     hp != NULL;
+	     hp = __pmOHashWalk(hcp, PM_HASH_WALK_NEXT)) {
+	    pcp = (pmidcntl_t *)hp->data;
+	    for (i = 0; i < pcp->ninst; i++) {
+		icp = pcp->ilist[i];
+		if (pcp->valfmt != PM_VAL_INSITU) {
+		    /*
+		     * Held values may be in PDU buffers, unpin the PDU
+		     * buffers just in case (__pmUnpinPDUBuf is a NOP if
+		     * the value is not in a PDU buffer)
+		     */
+		    if (icp->v_prior.pval != NULL) {
+			if (pmDebugOptions.interp && pmDebugOptions.desperate) {
+			    char	strbuf[20];
+			    fprintf(stderr, "release pmid %s inst %d prior\n",
+				    pmIDStr_r(pcp->desc.pmid, strbuf, sizeof(strbuf)), icp->inst);
 			}
-			last_ihp = ihp;
+			__pmUnpinPDUBuf((void *)icp->v_prior.pval);
 		    }
-		    if (last_ihp != NULL) {
-			if (last_ihp->data != NULL)
-			    free(last_ihp->data);
-			free(last_ihp);
+		    if (icp->v_next.pval != NULL) {
+			if (pmDebugOptions.interp && pmDebugOptions.desperate) {
+			    char	strbuf[20];
+			    fprintf(stderr, "release pmid %s inst %d next\n",
+				    pmIDStr_r(pcp->desc.pmid, strbuf, sizeof(strbuf)), icp->inst);
+			}
+			__pmUnpinPDUBuf((void *)icp->v_next.pval);
 		    }
 		}
-		if (pcp->hc.hash) {
-		    free(pcp->hc.hash);
-		    /* just being paranoid here */
-		    pcp->hc.hash = NULL;
-		}
-		pcp->hc.hsize = 0;
-		if (last_hp != NULL) {
-		    if (last_hp->data != NULL)
-			free(last_hp->data);
-		    free(last_hp);
-		}
-		last_hp = hp;
+		free(icp);
 	    }
-	    if (last_hp != NULL) {
-		if (last_hp->data != NULL)
-		    free(last_hp->data);
-		free(last_hp);
-	    }
-	}
-	if (hcp->hash) {
-	    free(hcp->hash);
-	    /* just being paranoid here */
-	    hcp->hash = NULL;
+	    free(pcp->ilist);
+	    __pmOHashClear(&pcp->hc);
+	    free(pcp);
 	}
-	hcp->hsize = 0;
     }
+    __pmOHashClear(&ctxp->c_archctl->ac_pmid_hc);
 
     if (ctxp->c_archctl->ac_cache != NULL) {
 	/* read cache allocated, work to be done */
-	cache_t		*cache = (cache_t *)ctxp->c_archctl->ac_cache;
-	cache_t		*cp;
-
-	for (cp = cache; cp < &cache[NUMCACHE]; cp++) {
-	    if (pmDebugOptions.log && pmDebugOptions.interp) {
-		fprintf(stderr, "read cache entry "
-			PRINTF_P_PFX "%p: c_name=%s rp="
-			PRINTF_P_PFX "%p\n",
-			cp, cp->c_name ? cp->c_name : "(none)",
-			cp->rp);
-	    }
-	    if (cp->c_name != NULL) {
-		free(cp->c_name);
-		cp->c_name = NULL;
-	    }
-	    if (cp->rp != NULL) {
-		pmFreeResult(cp->rp);
-		cp->rp = NULL;
-	    }
-	    cp->used = 0;
-	}
+	cache_flush((cachectl_t *)ctxp->c_archctl->ac_cache);
     }
 }
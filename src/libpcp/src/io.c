@@ -25,9 +25,15 @@
 #include "internal.h"
 
 extern __pm_fops __pm_stdio;
+#if !defined(IS_MINGW)
+extern __pm_fops __pm_mmap;
+#endif
 #if HAVE_TRANSPARENT_DECOMPRESSION && HAVE_LZMA_DECOMPRESSION
 extern __pm_fops __pm_xz;
 #endif
+#if HAVE_TRANSPARENT_DECOMPRESSION && HAVE_ZSTD_DECOMPRESSION
+extern __pm_fops __pm_zstd;
+#endif
 
 /*
  * Suffixes and associated compresssion application for compressed filenames.
@@ -39,12 +45,18 @@ extern __pm_fops __pm_xz;
 #define	USE_BZIP2	1
 #define USE_GZIP	2
 #define USE_XZ		3
+#define USE_ZSTD	4
 
 #if HAVE_TRANSPARENT_DECOMPRESSION && HAVE_LZMA_DECOMPRESSION
 #define TRANSPARENT_XZ (&__pm_xz)
 #else
 #define TRANSPARENT_XZ NULL
 #endif
+#if HAVE_TRANSPARENT_DECOMPRESSION && HAVE_ZSTD_DECOMPRESSION
+#define TRANSPARENT_ZSTD (&__pm_zstd)
+#else
+#define TRANSPARENT_ZSTD NULL
+#endif
 
 static const struct {
     const char	*suffix;
@@ -53,6 +65,7 @@ static const struct {
 } compress_ctl[] = {
     { ".xz",	USE_XZ,	 	TRANSPARENT_XZ },
     { ".lzma",	USE_XZ,		NULL },
+    { ".zst",	USE_ZSTD,	TRANSPARENT_ZSTD },
     { ".bz2",	USE_BZIP2,	NULL },
     { ".bz",	USE_BZIP2,	NULL },
     { ".gz",	USE_GZIP,	NULL },
@@ -61,6 +74,23 @@ static const struct {
 };
 static const int ncompress = sizeof(compress_ctl) / sizeof(compress_ctl[0]);
 
+/* suffix for archive data volumes created by __pmLogNewFile(), or NULL */
+static const char *log_compress;
+
+/*
+ * Only zstd compressed files can be written, and only with a libzstd
+ * recent enough to provide ZSTD_compressStream2().
+ */
+static int
+compress_writable(int ix)
+{
+#if HAVE_TRANSPARENT_DECOMPRESSION && HAVE_ZSTD_COMPRESSSTREAM2
+    return compress_ctl[ix].appl == USE_ZSTD;
+#else
+    return 0;
+#endif
+}
+
 int
 __pmLogCompressedSuffix(const char *suffix)
 {
@@ -72,6 +102,39 @@ __pmLogCompressedSuffix(const char *suffix)
     return 0;
 }
 
+/*
+ * Compress the data volumes of archives subsequently created with
+ * __pmLogNewFile() as they are written, using the compression format
+ * for the given suffix, or no compression if suffix is NULL.  Only
+ * zstd (".zst") can be written directly, see compress_writable().
+ */
+int
+__pmLogSetCompress(const char *suffix)
+{
+    int		i;
+
+    if (suffix == NULL) {
+	log_compress = NULL;
+	return 0;
+    }
+    for (i = 0; i < ncompress; i++) {
+	if (strcmp(suffix, compress_ctl[i].suffix) == 0)
+	    break;
+    }
+    if (i == ncompress)
+	return -EINVAL;
+    if (!compress_writable(i))
+	return -EOPNOTSUPP;
+    log_compress = compress_ctl[i].suffix;
+    return 0;
+}
+
+const char *
+__pmLogGetCompress(void)
+{
+    return log_compress;
+}
+
 /*
  * Variant of __pmLogBaseName() - see below that also returns log
  * the volume number if the file name is an archive log volume.
@@ -260,6 +323,10 @@ fopen_compress(const char *fname, int compress_ix)
 	cmd = "gzip";
 	arg = "-dc";
     }
+    else if (compress_ctl[compress_ix].appl == USE_ZSTD) {
+	cmd = "zstd";
+	arg = "-dc";
+    }
     else {
 	/* botch in compress_ctl[] ... should not happen */
 	if (pmDebugOptions.log) {
@@ -409,6 +476,7 @@ __pmAccess(const char *path, int amode)
 	    if (compress_ctl[compress_ix].appl == USE_BZIP2) use = "bzip2";
 	    else if (compress_ctl[compress_ix].appl == USE_GZIP) use = "gzip";
 	    else if (compress_ctl[compress_ix].appl == USE_XZ) use = "xz";
+	    else if (compress_ctl[compress_ix].appl == USE_ZSTD) use = "zstd";
 	    else use = "???";
 	    fprintf(stderr, "__pmAccess(\"%s\", \"%d\"): decompress: %s", path, amode, use);
 	    if (compress_ctl[compress_ix].handler != NULL)
@@ -458,6 +526,7 @@ __pmFopen(const char *path, const char *mode)
 	    if (compress_ctl[compress_ix].appl == USE_BZIP2) use = "bzip2";
 	    else if (compress_ctl[compress_ix].appl == USE_GZIP) use = "gzip";
 	    else if (compress_ctl[compress_ix].appl == USE_XZ) use = "xz";
+	    else if (compress_ctl[compress_ix].appl == USE_ZSTD) use = "zstd";
 	    else use = "???";
 	    fprintf(stderr, "__pmFopen(\"%s\", \"%s\"): decompress: %s", path, mode, use);
 	    if (compress_ctl[compress_ix].handler != NULL)
@@ -467,8 +536,16 @@ __pmFopen(const char *path, const char *mode)
     }
     if (compress_ix >= 0) {
 	if (mode[0] != 'r' || mode[1] != '\0') {
-	    /* We don't (yet) support opening compressed files for writing. */
-	    return NULL;
+	    /*
+	     * Only zstd compressed files can be written, and only when
+	     * named explicitly (not found by adding a suffix above).
+	     */
+	    if (mode[0] != 'w' || mode[1] != '\0' ||
+		!compress_writable(compress_ix) ||
+		strcmp(path, tmpname) != 0) {
+		setoserror(EOPNOTSUPP);
+		return NULL;
+	    }
 	}
 
 	/* Use the compressed file name and select a handler. */
@@ -489,8 +566,14 @@ __pmFopen(const char *path, const char *mode)
     if (handler == NULL) {
 	/*
 	 * The file is either not compressed, or we can not decompress it
-	 * directly. Default to the stdio handler.
+	 * directly. Uncompressed files opened read-only are memory mapped,
+	 * otherwise default to the stdio handler.
 	 */
+#if !defined(IS_MINGW)
+	if (mode[0] == 'r' && mode[1] == '\0')
+	    handler = &__pm_mmap;
+	else
+#endif
 	handler = &__pm_stdio;
     }
 
@@ -507,6 +590,14 @@ __pmFopen(const char *path, const char *mode)
      * be used to deallocate and close, see __pmClose() below.
      */
     if (f->fops->__pmopen(f, path, mode) == NULL) {
+#if !defined(IS_MINGW)
+	if (handler == &__pm_mmap && oserror() == ENODEV) {
+	    /* not a regular file, fall back to stdio */
+	    f->fops = &__pm_stdio;
+	    if (f->fops->__pmopen(f, path, mode) != NULL)
+		goto done;
+	}
+#endif
 	free(f);
     	return NULL;
     }
@@ -638,6 +729,7 @@ __pmStat(const char *path, struct stat *buf)
 	    if (compress_ctl[compress_ix].appl == USE_BZIP2) use = "bzip2";
 	    else if (compress_ctl[compress_ix].appl == USE_GZIP) use = "gzip";
 	    else if (compress_ctl[compress_ix].appl == USE_XZ) use = "xz";
+	    else if (compress_ctl[compress_ix].appl == USE_ZSTD) use = "zstd";
 	    else use = "???";
 	    fprintf(stderr, "__pmStat(\"%s\"): decompress: %s", path, use);
 	    if (compress_ctl[compress_ix].handler != NULL)
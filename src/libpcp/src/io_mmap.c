@@ -0,0 +1,349 @@
+/*
+ * Copyright (c) 2020 Red Hat.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ */
+
+/*
+ * Memory mapped i/o handler for uncompressed files opened read-only,
+ * i.e. archive volumes, .meta and .index files being replayed.
+ *
+ * Seeks are simply changes to f->position and reads copy straight out
+ * of the mapping, so the seek and read pattern of __pmLogRead_ctx()
+ * (header, body, trailer, and backwards through the file for
+ * PM_MODE_BACK) costs one fstat(2) per read (see below) and no stdio
+ * buffer refills.
+ *
+ * An archive may still be growing as pmlogger writes to it.  The file
+ * is mapped once when it is opened and the mapping is never extended;
+ * anything appended after that (only the active volume of a live
+ * archive) is read through a stdio stream on a dup(2) of the file
+ * descriptor, positioned at f->position for each read.
+ *
+ * Touching a page of the mapping beyond the end of a file that has been
+ * truncated raises SIGBUS rather than returning an error, and a library
+ * has no business taking over the SIGBUS disposition.  So the size of
+ * the file is checked with fstat(2) before each copy, and only the part
+ * of the mapping that is still backed by the file is used; anything
+ * past that goes to the stdio stream, which reports a short read.  A
+ * file truncated between the fstat(2) and the copy, or a media error,
+ * still raises SIGBUS, as for any other mapped file.
+ */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include "pmapi.h"
+#include "libpcp.h"
+#include "internal.h"
+
+typedef struct {
+    int		fd;
+    char	*base;		/* mapping of the start of the file, or NULL */
+    size_t	size;		/* bytes mapped at base */
+    FILE	*tail;		/* stream for data beyond the mapping */
+    int		eof;
+    int		error;
+} mmap_priv;
+
+/*
+ * Read from beyond the end of the mapping.  Returns the number of bytes
+ * read, setting the eof or error flag on a short read.
+ */
+static size_t
+mmap_tail(mmap_priv *mp, char *ptr, size_t need, off_t posn)
+{
+    size_t	n;
+    int		fd;
+
+    if (mp->tail == NULL) {
+	if ((fd = dup(mp->fd)) < 0) {
+	    mp->error = 1;
+	    return 0;
+	}
+	if ((mp->tail = fdopen(fd, "r")) == NULL) {
+	    close(fd);
+	    mp->error = 1;
+	    return 0;
+	}
+    }
+    if (fseeko(mp->tail, posn, SEEK_SET) < 0) {
+	mp->error = 1;
+	return 0;
+    }
+    n = fread(ptr, 1, need, mp->tail);
+    if (n < need) {
+	if (ferror(mp->tail))
+	    mp->error = 1;
+	else
+	    mp->eof = 1;
+	clearerr(mp->tail);
+    }
+    return n;
+}
+
+static void *
+mmap_open(__pmFILE *f, const char *path, const char *mode)
+{
+    mmap_priv	*mp;
+    struct stat	sbuf;
+    int		fd, sts;
+
+    if (mode[0] != 'r' || mode[1] != '\0') {
+	setoserror(EINVAL);
+	return NULL;
+    }
+    if ((fd = open(path, O_RDONLY)) < 0)
+	return NULL;
+    if (fstat(fd, &sbuf) < 0) {
+	sts = oserror();
+	close(fd);
+	setoserror(sts);
+	return NULL;
+    }
+    if (!S_ISREG(sbuf.st_mode)) {
+	/* let the stdio handler deal with pipes, devices, ... */
+	close(fd);
+	setoserror(ENODEV);
+	return NULL;
+    }
+    if ((mp = (mmap_priv *)calloc(1, sizeof(mmap_priv))) == NULL) {
+	sts = oserror();
+	close(fd);
+	setoserror(sts);
+	return NULL;
+    }
+    mp->fd = fd;
+    if (sbuf.st_size > 0 && (off_t)(size_t)sbuf.st_size == sbuf.st_size) {
+	if ((mp->base = __pmMemoryMap(fd, sbuf.st_size, 0)) != NULL)
+	    mp->size = sbuf.st_size;
+    }
+    if (pmDebugOptions.log)
+	fprintf(stderr, "mmap_open(\"%s\"): fd=%d mapped %zd bytes\n",
+		path, fd, mp->size);
+
+    f->priv = (void *)mp;
+    f->position = 0;
+
+    return f;
+}
+
+static void *
+mmap_fdopen(__pmFILE *f, int fd, const char *mode)
+{
+    /* __pmFdopen() only ever uses the stdio handler */
+    setoserror(ENOSYS);
+    return NULL;
+}
+
+static int
+mmap_seek(__pmFILE *f, off_t offset, int whence)
+{
+    mmap_priv	*mp = (mmap_priv *)f->priv;
+    struct stat	sbuf;
+
+    switch (whence) {
+	case SEEK_SET:
+	    break;
+	case SEEK_CUR:
+	    offset += f->position;
+	    break;
+	case SEEK_END:
+	    if (fstat(mp->fd, &sbuf) < 0)
+		return -1;
+	    offset += sbuf.st_size;
+	    break;
+	default:
+	    offset = -1;
+	    break;
+    }
+    if (offset < 0) {
+	setoserror(EINVAL);
+	return -1;
+    }
+    f->position = offset;
+    mp->eof = 0;
+    return 0;
+}
+
+static void
+mmap_rewind(__pmFILE *f)
+{
+    mmap_priv	*mp = (mmap_priv *)f->priv;
+
+    f->position = 0;
+    mp->eof = mp->error = 0;
+}
+
+static off_t
+mmap_tell(__pmFILE *f)
+{
+    return f->position;
+}
+
+static size_t
+mmap_read(void *ptr, size_t size, size_t nmemb, __pmFILE *f)
+{
+    mmap_priv	*mp = (mmap_priv *)f->priv;
+    struct stat	sbuf;
+    size_t	posn = f->position;
+    size_t	need = size * nmemb;
+    size_t	have = 0;
+    size_t	limit;
+
+    if (need == 0)
+	return 0;
+    if (posn < mp->size) {
+	/* only the part of the mapping the file (still) covers */
+	if (fstat(mp->fd, &sbuf) < 0) {
+	    mp->error = 1;
+	    return 0;
+	}
+	limit = mp->size;
+	if ((off_t)limit > sbuf.st_size)
+	    limit = sbuf.st_size;
+	if (posn < limit) {
+	    have = limit - posn;
+	    if (have > need)
+		have = need;
+	    memcpy(ptr, &mp->base[posn], have);
+	}
+    }
+    if (have < need)
+	have += mmap_tail(mp, (char *)ptr + have, need - have, (off_t)(posn + have));
+    f->position += have;
+    return have / size;
+}
+
+static size_t
+mmap_write(void *ptr, size_t size, size_t nmemb, __pmFILE *f)
+{
+    mmap_priv	*mp = (mmap_priv *)f->priv;
+
+    mp->error = 1;
+    setoserror(EBADF);
+    return 0;
+}
+
+static int
+mmap_getc(__pmFILE *f)
+{
+    unsigned char	c;
+
+    if (mmap_read(&c, 1, 1, f) != 1)
+	return EOF;
+    return c;
+}
+
+static int
+mmap_flush(__pmFILE *f)
+{
+    return 0;
+}
+
+static int
+mmap_fsync(__pmFILE *f)
+{
+    mmap_priv	*mp = (mmap_priv *)f->priv;
+    return fsync(mp->fd);
+}
+
+static int
+mmap_fileno(__pmFILE *f)
+{
+    mmap_priv	*mp = (mmap_priv *)f->priv;
+    return mp->fd;
+}
+
+static off_t
+mmap_lseek(__pmFILE *f, off_t offset, int whence)
+{
+    /* the file descriptor offset is never used, only f->position */
+    if (mmap_seek(f, offset, whence) < 0)
+	return (off_t)-1;
+    return f->position;
+}
+
+static int
+mmap_fstat(__pmFILE *f, struct stat *buf)
+{
+    mmap_priv	*mp = (mmap_priv *)f->priv;
+    return fstat(mp->fd, buf);
+}
+
+static int
+mmap_feof(__pmFILE *f)
+{
+    mmap_priv	*mp = (mmap_priv *)f->priv;
+    return mp->eof;
+}
+
+static int
+mmap_ferror(__pmFILE *f)
+{
+    mmap_priv	*mp = (mmap_priv *)f->priv;
+    return mp->error;
+}
+
+static void
+mmap_clearerr(__pmFILE *f)
+{
+    mmap_priv	*mp = (mmap_priv *)f->priv;
+    mp->eof = mp->error = 0;
+}
+
+static int
+mmap_setvbuf(__pmFILE *f, char *buf, int mode, size_t size)
+{
+    /* nothing is buffered */
+    return 0;
+}
+
+static int
+mmap_close(__pmFILE *f)
+{
+    mmap_priv	*mp = (mmap_priv *)f->priv;
+    int		sts;
+
+    if (mp->base != NULL)
+	__pmMemoryUnmap(mp->base, mp->size);
+    if (mp->tail != NULL)
+	fclose(mp->tail);
+    sts = close(mp->fd);
+    free(mp);
+    return sts;
+}
+
+__pm_fops __pm_mmap = {
+    /*
+     * mmap - uncompressed, read-only
+     */
+    .__pmopen = mmap_open,
+    .__pmfdopen = mmap_fdopen,
+    .__pmseek = mmap_seek,
+    .__pmrewind = mmap_rewind,
+    .__pmtell = mmap_tell,
+    .__pmfgetc = mmap_getc,
+    .__pmread = mmap_read,
+    .__pmwrite = mmap_write,
+    .__pmflush = mmap_flush,
+    .__pmfsync = mmap_fsync,
+    .__pmfileno = mmap_fileno,
+    .__pmlseek = mmap_lseek,
+    .__pmfstat = mmap_fstat,
+    .__pmfeof = mmap_feof,
+    .__pmferror = mmap_ferror,
+    .__pmclearerr = mmap_clearerr,
+    .__pmsetvbuf = mmap_setvbuf,
+    .__pmclose = mmap_close
+};
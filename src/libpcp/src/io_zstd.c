@@ -0,0 +1,1115 @@
+/*
+ * Copyright (c) 2020 Red Hat.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ */
+
+/*
+ * Transparent decompression of zstd compressed files.
+ *
+ * A zstd file is a sequence of independently decodable frames.  Files
+ * in the zstd seekable format end with a skippable frame holding a seek
+ * table (the compressed and decompressed size of every frame), which
+ * gives us the frame index directly.  Otherwise the index is built by
+ * walking the frame and block headers, without decompressing anything
+ * unless a frame does not record its decompressed size.  A file without
+ * a seek table may still be growing, so the walk resumes from the last
+ * complete frame when a read goes past the end of the indexed data.
+ *
+ * Decompressed frames are kept in a small LRU cache of slots.  Once
+ * two consecutive frames have been read, in either direction, worker
+ * threads decompress the next few frames in the direction of travel
+ * while the caller is still consuming the current one.
+ *
+ * Files may also be written (mode "w"), appending only, as pmlogger
+ * does for archive data volumes.  Data is compressed as a stream into
+ * frames of ZSTD_FRAME_SIZE bytes of uncompressed data.  When the
+ * file is unbuffered (__pmSetvbuf(_IONBF)), as archive files are, each
+ * write is followed by a zstd flush, so every record written is on
+ * disk as complete compressed blocks.  A reader of the growing file
+ * decodes the complete blocks of the frame still being written (the
+ * "tail" frame).  Closing the file ends the last frame and appends a
+ * seek table.  Writing needs ZSTD_compressStream2() (libzstd 1.4.0 or
+ * later), without it only reading is supported.
+ */
+#include "config.h"
+#if HAVE_ZSTD_DECOMPRESSION
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zstd.h>
+#include "pmapi.h"
+#include "libpcp.h"
+#include "internal.h"
+
+#define ZSTD_FRAME_MAGIC	0xFD2FB528U
+#define SKIPPABLE_MAGIC		0x184D2A50U	/* low 4 bits are free */
+#define SKIPPABLE_MASK		0xFFFFFFF0U
+#define SEEKTABLE_MAGIC		0x184D2A5EU
+#define SEEKTABLE_FOOTER_MAGIC	0x8F92EAB1U
+#define SEEKTABLE_FOOTER_SIZE	9
+#define SEEKTABLE_CHECKSUM	0x80
+
+#define ZSTD_FRAME_SIZE		(1024*1024)
+
+#define MAX_WORKERS		4
+#define NSLOTS			(2 + 2 * MAX_WORKERS)
+
+enum { SLOT_EMPTY, SLOT_PENDING, SLOT_READY };
+
+typedef struct {
+    off_t	coff;		/* compressed offset of the frame */
+    size_t	csize;		/* compressed size */
+    off_t	uoff;		/* decompressed offset */
+    size_t	usize;		/* decompressed size */
+} zframe;
+
+typedef struct {
+    int		frame;		/* index into frames[], or -1 */
+    int		state;
+    char	*data;
+    size_t	alloc;
+    unsigned long lru;
+} zslot;
+
+typedef struct {
+    int		fd;
+    zframe	*frames;
+    int		nframes;
+    int		maxframes;
+    off_t	cend;		/* compressed offset after last indexed frame */
+    off_t	usize;		/* decompressed size of indexed frames */
+    int		complete;	/* index came from a seek table */
+    off_t	fsize;		/* compressed file size when indexed */
+    int		partial;	/* last frame is still being written */
+    int		eof;
+    int		error;
+    int		last;		/* last frame read by the caller */
+    zslot	slots[NSLOTS];
+    unsigned long tick;
+    zslot	tail;		/* data decoded from a partial last frame */
+    ZSTD_DCtx	*dctx;
+    char	*cbuf;		/* compressed frame buffer for dctx */
+    size_t	cmax;
+    ZSTD_CCtx	*cctx;		/* only when open for writing */
+    char	*obuf;		/* compressed output buffer for cctx */
+    size_t	osize;
+    size_t	fusize;		/* bytes written to the open frame */
+    int		unbuffered;
+#ifdef PM_MULTI_THREAD
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t	workers[MAX_WORKERS];
+    int		nworkers;
+    int		want[NSLOTS];	/* frames to decompress ahead, -1 done */
+    int		nwant;
+    int		shutdown;
+#endif
+} zstdfile;
+
+#ifdef PM_MULTI_THREAD
+#define ZLOCK(zp)	pthread_mutex_lock(&(zp)->lock)
+#define ZUNLOCK(zp)	pthread_mutex_unlock(&(zp)->lock)
+#else
+#define ZLOCK(zp)
+#define ZUNLOCK(zp)
+#endif
+
+static unsigned int
+get_le32(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+#if HAVE_ZSTD_COMPRESSSTREAM2
+static void
+put_le32(unsigned char *p, unsigned int v)
+{
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = (v >> 24) & 0xff;
+}
+#endif
+
+static int
+readat(int fd, void *buf, size_t len, off_t offset)
+{
+    size_t	have = 0;
+    ssize_t	n;
+
+    while (have < len) {
+	n = pread(fd, (char *)buf + have, len - have, offset + have);
+	if (n < 0) {
+	    if (oserror() == EINTR)
+		continue;
+	    return -1;
+	}
+	if (n == 0)
+	    break;
+	have += n;
+    }
+    return have;
+}
+
+static int
+add_frame(zstdfile *zp, off_t coff, size_t csize, size_t usize)
+{
+    zframe	*fp;
+    int		max;
+
+    zp->cend = coff + csize;
+    if (usize == 0)
+	return 0;
+    if (zp->nframes == zp->maxframes) {
+	max = zp->maxframes ? 2 * zp->maxframes : 64;
+	if ((fp = realloc(zp->frames, max * sizeof(zframe))) == NULL)
+	    return -ENOMEM;
+	zp->frames = fp;
+	zp->maxframes = max;
+    }
+    fp = &zp->frames[zp->nframes++];
+    fp->coff = coff;
+    fp->csize = csize;
+    fp->uoff = zp->usize;
+    fp->usize = usize;
+    zp->usize += usize;
+    return 0;
+}
+
+/*
+ * Build the frame index from a seek table at the end of the file.
+ * Returns 1 if there is a usable seek table, else 0.
+ */
+static int
+seektable_index(zstdfile *zp, off_t fsize)
+{
+    unsigned char	footer[SEEKTABLE_FOOTER_SIZE];
+    unsigned char	*table, *p;
+    unsigned int	n, i, esize;
+    off_t		tsize, coff;
+
+    if (fsize < 8 + SEEKTABLE_FOOTER_SIZE ||
+	readat(zp->fd, footer, sizeof(footer), fsize - sizeof(footer)) != sizeof(footer))
+	return 0;
+    if (get_le32(&footer[5]) != SEEKTABLE_FOOTER_MAGIC)
+	return 0;
+    n = get_le32(&footer[0]);
+    esize = (footer[4] & SEEKTABLE_CHECKSUM) ? 12 : 8;
+    tsize = 8 + (off_t)n * esize + SEEKTABLE_FOOTER_SIZE;
+    if (tsize > fsize || (table = malloc(tsize)) == NULL)
+	return 0;
+    if (readat(zp->fd, table, tsize, fsize - tsize) != tsize ||
+	get_le32(&table[0]) != SEEKTABLE_MAGIC ||
+	get_le32(&table[4]) != tsize - 8) {
+	free(table);
+	return 0;
+    }
+    for (i = 0, coff = 0, p = &table[8]; i < n; i++, p += esize) {
+	if (add_frame(zp, coff, get_le32(p), get_le32(p + 4)) < 0)
+	    break;
+	coff += get_le32(p);
+    }
+    free(table);
+    if (i < n || coff != fsize - tsize) {
+	/* not consistent with the file, fall back to walking it */
+	zp->nframes = 0;
+	zp->cend = zp->usize = 0;
+	return 0;
+    }
+    zp->cend = fsize;
+    zp->complete = 1;
+    return 1;
+}
+
+/*
+ * Stream decompress csize bytes at coff, for a frame that does not
+ * record its decompressed size or one that is still being written
+ * (and so ends part way through).  Returns the decompressed size, and
+ * the data itself in sp if that is not NULL.
+ */
+static size_t
+stream_decode(zstdfile *zp, off_t coff, size_t csize, zslot *sp)
+{
+    ZSTD_DStream	*ds;
+    ZSTD_inBuffer	in;
+    ZSTD_outBuffer	out;
+    char		*cbuf, *obuf, *tmp;
+    size_t		sts, chunk, usize = 0;
+
+    chunk = ZSTD_DStreamOutSize();
+    if ((cbuf = malloc(csize)) == NULL)
+	return 0;
+    if ((obuf = malloc(chunk)) == NULL ||
+	(ds = ZSTD_createDStream()) == NULL) {
+	free(obuf);
+	free(cbuf);
+	return 0;
+    }
+    if (readat(zp->fd, cbuf, csize, coff) == (int)csize) {
+	in.src = cbuf;
+	in.size = csize;
+	in.pos = 0;
+	do {
+	    out.dst = obuf;
+	    out.size = chunk;
+	    out.pos = 0;
+	    sts = ZSTD_decompressStream(ds, &out, &in);
+	    if (ZSTD_isError(sts)) {
+		usize = 0;
+		break;
+	    }
+	    if (sp != NULL && out.pos > 0) {
+		if (sp->alloc < usize + out.pos) {
+		    if ((tmp = realloc(sp->data, usize + out.pos)) == NULL) {
+			usize = 0;
+			break;
+		    }
+		    sp->data = tmp;
+		    sp->alloc = usize + out.pos;
+		}
+		memcpy(&sp->data[usize], obuf, out.pos);
+	    }
+	    usize += out.pos;
+	} while (sts != 0 && (in.pos < in.size || out.pos == out.size));
+    }
+    ZSTD_freeDStream(ds);
+    free(obuf);
+    free(cbuf);
+    return usize;
+}
+
+/*
+ * Index frames from zp->cend by walking the frame and block headers.
+ * The complete blocks of a frame that is still being written become
+ * a partial last frame, which is dropped and indexed again when the
+ * file grows.  Anything that is not a zstd frame is an error.
+ */
+static int
+walk_index(zstdfile *zp)
+{
+    unsigned char	hdr[18];
+    unsigned long long	fcs;
+    struct stat		sbuf;
+    off_t		off, p, q;
+    unsigned int	magic, bh, bsize;
+    int			n, hsize, fcsflag, single, checksum, last, sts;
+
+    if (fstat(zp->fd, &sbuf) < 0)
+	return -oserror();
+    if (sbuf.st_size == zp->fsize)
+	return 0;
+    if (zp->partial) {
+	zp->partial = 0;
+	zp->nframes--;
+	zp->usize -= zp->frames[zp->nframes].usize;
+	zp->cend = zp->frames[zp->nframes].coff;
+    }
+    zp->fsize = sbuf.st_size;
+    for (off = zp->cend; off < sbuf.st_size; off = zp->cend) {
+	if ((n = readat(zp->fd, hdr, sizeof(hdr), off)) < 0)
+	    return -oserror();
+	if (n < 8)
+	    break;
+	magic = get_le32(hdr);
+	if ((magic & SKIPPABLE_MASK) == SKIPPABLE_MAGIC) {
+	    p = off + 8 + get_le32(&hdr[4]);
+	    if (p > sbuf.st_size)
+		break;
+	    zp->cend = p;
+	    continue;
+	}
+	if (magic != ZSTD_FRAME_MAGIC)
+	    return PM_ERR_LOGREC;
+
+	/* frame header descriptor, see RFC 8878 */
+	fcsflag = hdr[4] >> 6;
+	single = (hdr[4] >> 5) & 1;
+	checksum = (hdr[4] >> 2) & 1;
+	hsize = 5 + (single ? 0 : 1);
+	hsize += (int[]){ 0, 1, 2, 4 }[hdr[4] & 3];
+	switch (fcsflag) {
+	    case 0:
+		fcs = single ? hdr[hsize] : ZSTD_CONTENTSIZE_UNKNOWN;
+		hsize += single;
+		break;
+	    case 1:
+		fcs = (hdr[hsize] | (hdr[hsize+1] << 8)) + 256;
+		hsize += 2;
+		break;
+	    case 2:
+		fcs = get_le32(&hdr[hsize]);
+		hsize += 4;
+		break;
+	    default:
+		fcs = get_le32(&hdr[hsize]) |
+		      ((unsigned long long)get_le32(&hdr[hsize+4]) << 32);
+		hsize += 8;
+		break;
+	}
+	if (n < hsize)
+	    break;
+
+	/* blocks, each with a 3 byte header */
+	for (p = off + hsize, last = 0; !last; p = q) {
+	    if (readat(zp->fd, hdr, 3, p) != 3)
+		break;
+	    bh = hdr[0] | (hdr[1] << 8) | (hdr[2] << 16);
+	    bsize = bh >> 3;
+	    q = p + 3 + (((bh >> 1) & 3) == 1 ? 1 : bsize);
+	    if (q > sbuf.st_size)
+		break;
+	    last = bh & 1;
+	}
+	if (last && checksum && p + 4 > sbuf.st_size)
+	    last = 0;
+	if (!last) {
+	    /* frame still being written, decode the complete blocks */
+	    if (p > off + hsize) {
+		fcs = stream_decode(zp, off, p - off, &zp->tail);
+		if (fcs > 0) {
+		    if ((sts = add_frame(zp, off, p - off, fcs)) < 0)
+			return sts;
+		    zp->partial = 1;
+		}
+	    }
+	    zp->cend = off;
+	    break;
+	}
+	if (checksum)
+	    p += 4;
+	if (fcs == ZSTD_CONTENTSIZE_UNKNOWN)
+	    fcs = stream_decode(zp, off, p - off, NULL);
+	if ((sts = add_frame(zp, off, p - off, fcs)) < 0)
+	    return sts;
+    }
+    return 0;
+}
+
+static int
+find_frame(zstdfile *zp, off_t posn)
+{
+    int		lo = 0, hi = zp->nframes - 1, mid;
+
+    while (lo <= hi) {
+	mid = (lo + hi) / 2;
+	if (posn < zp->frames[mid].uoff)
+	    hi = mid - 1;
+	else if (posn >= zp->frames[mid].uoff + (off_t)zp->frames[mid].usize)
+	    lo = mid + 1;
+	else
+	    return mid;
+    }
+    return -1;
+}
+
+/*
+ * Decompress frame fp into slot sp, using dctx and the compressed
+ * buffer *cbuf (grown as needed).  Called without the lock held, the
+ * slot is SLOT_PENDING so nobody else touches it.
+ */
+static int
+decompress(zstdfile *zp, zframe *fp, zslot *sp, ZSTD_DCtx *dctx,
+		char **cbuf, size_t *cmax)
+{
+    char	*tmp;
+    size_t	sts;
+
+    if (*cmax < fp->csize) {
+	if ((tmp = realloc(*cbuf, fp->csize)) == NULL)
+	    return -ENOMEM;
+	*cbuf = tmp;
+	*cmax = fp->csize;
+    }
+    if (sp->alloc < fp->usize) {
+	if ((tmp = realloc(sp->data, fp->usize)) == NULL)
+	    return -ENOMEM;
+	sp->data = tmp;
+	sp->alloc = fp->usize;
+    }
+    if (readat(zp->fd, *cbuf, fp->csize, fp->coff) != (int)fp->csize)
+	return PM_ERR_LOGREC;
+    sts = ZSTD_decompressDCtx(dctx, sp->data, fp->usize, *cbuf, fp->csize);
+    if (ZSTD_isError(sts) || sts != fp->usize) {
+	if (pmDebugOptions.log)
+	    fprintf(stderr, "zstd: frame at %ld: %s\n", (long)fp->coff,
+		    ZSTD_isError(sts) ? ZSTD_getErrorName(sts) : "short frame");
+	return PM_ERR_LOGREC;
+    }
+    return 0;
+}
+
+/*
+ * Choose a slot to (re)use, the least recently used one that is not
+ * being decompressed or holding the frame the caller is reading.
+ */
+static zslot *
+victim(zstdfile *zp)
+{
+    zslot	*sp, *best = NULL;
+    int		i;
+
+    for (i = 0; i < NSLOTS; i++) {
+	sp = &zp->slots[i];
+	if (sp->state == SLOT_EMPTY)
+	    return sp;
+	if (sp->state == SLOT_PENDING || sp->frame == zp->last)
+	    continue;
+	if (best == NULL || sp->lru < best->lru)
+	    best = sp;
+    }
+    return best;
+}
+
+static zslot *
+lookup(zstdfile *zp, int frame)
+{
+    int		i;
+
+    for (i = 0; i < NSLOTS; i++) {
+	if (zp->slots[i].frame == frame && zp->slots[i].state != SLOT_EMPTY)
+	    return &zp->slots[i];
+    }
+    return NULL;
+}
+
+#ifdef PM_MULTI_THREAD
+static void *
+worker(void *arg)
+{
+    zstdfile	*zp = (zstdfile *)arg;
+    ZSTD_DCtx	*dctx;
+    zframe	frame;
+    zslot	*sp;
+    char	*cbuf = NULL;
+    size_t	cmax = 0;
+    int		i, f, sts;
+
+    if ((dctx = ZSTD_createDCtx()) == NULL)
+	return NULL;
+    ZLOCK(zp);
+    while (!zp->shutdown) {
+	/* next wanted frame that is not cached or in progress */
+	for (f = -1, i = 0; i < zp->nwant; i++) {
+	    if (zp->want[i] >= 0 && lookup(zp, zp->want[i]) == NULL) {
+		f = zp->want[i];
+		zp->want[i] = -1;
+		break;
+	    }
+	}
+	if (f < 0 || (sp = victim(zp)) == NULL) {
+	    pthread_cond_wait(&zp->cond, &zp->lock);
+	    continue;
+	}
+	sp->frame = f;
+	sp->state = SLOT_PENDING;
+	frame = zp->frames[f];
+	ZUNLOCK(zp);
+	sts = decompress(zp, &frame, sp, dctx, &cbuf, &cmax);
+	ZLOCK(zp);
+	sp->state = sts < 0 ? SLOT_EMPTY : SLOT_READY;
+	sp->lru = ++zp->tick;
+	pthread_cond_broadcast(&zp->cond);
+    }
+    ZUNLOCK(zp);
+    free(cbuf);
+    ZSTD_freeDCtx(dctx);
+    return NULL;
+}
+
+/*
+ * Sequential access from frame to frame+dir, ask the workers for the
+ * frames beyond, starting them on first use.  Called with the lock held.
+ */
+static void
+zstd_readahead(zstdfile *zp, int frame, int dir)
+{
+    long	ncpu;
+    int		i, f;
+
+    if (zp->nworkers == 0) {
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpu < 2)
+	    return;
+	for (i = 0; i < MAX_WORKERS && i < ncpu - 1; i++) {
+	    if (pthread_create(&zp->workers[i], NULL, worker, zp) != 0)
+		break;
+	    zp->nworkers++;
+	}
+	if (zp->nworkers == 0) {
+	    zp->nworkers = -1;	/* don't try again */
+	    return;
+	}
+    }
+    if (zp->nworkers < 0)
+	return;
+    zp->nwant = 0;
+    for (i = 1, f = frame + dir; i <= 2 * zp->nworkers; i++, f += dir) {
+	if (f < 0 || f >= zp->nframes - zp->partial)
+	    break;
+	zp->want[zp->nwant++] = f;
+    }
+    pthread_cond_broadcast(&zp->cond);
+}
+#endif
+
+/*
+ * Return the slot holding decompressed frame, with the lock held on
+ * success.
+ */
+static zslot *
+get_frame(zstdfile *zp, int frame)
+{
+    zslot	*sp;
+    int		sts;
+
+    ZLOCK(zp);
+    if (frame != zp->last) {
+#ifdef PM_MULTI_THREAD
+	if (frame == zp->last + 1 || frame == zp->last - 1)
+	    zstd_readahead(zp, frame, frame - zp->last);
+#endif
+	zp->last = frame;
+    }
+    if (zp->partial && frame == zp->nframes - 1)
+	return &zp->tail;
+    for ( ; ; ) {
+	if ((sp = lookup(zp, frame)) != NULL) {
+	    if (sp->state == SLOT_READY) {
+		sp->lru = ++zp->tick;
+		return sp;
+	    }
+	}
+	else if ((sp = victim(zp)) != NULL)
+	    break;
+#ifdef PM_MULTI_THREAD
+	/* being decompressed, or all slots busy */
+	pthread_cond_wait(&zp->cond, &zp->lock);
+#endif
+    }
+    sp->frame = frame;
+    sp->state = SLOT_PENDING;
+    ZUNLOCK(zp);
+    sts = decompress(zp, &zp->frames[frame], sp, zp->dctx, &zp->cbuf, &zp->cmax);
+    ZLOCK(zp);
+    sp->lru = ++zp->tick;
+#ifdef PM_MULTI_THREAD
+    pthread_cond_broadcast(&zp->cond);
+#endif
+    if (sts < 0) {
+	sp->state = SLOT_EMPTY;
+	ZUNLOCK(zp);
+	setoserror(sts == -ENOMEM ? ENOMEM : EIO);
+	return NULL;
+    }
+    sp->state = SLOT_READY;
+    return sp;
+}
+
+static void
+zstd_free(zstdfile *zp)
+{
+    int		i;
+
+#ifdef PM_MULTI_THREAD
+    if (zp->nworkers > 0) {
+	ZLOCK(zp);
+	zp->shutdown = 1;
+	pthread_cond_broadcast(&zp->cond);
+	ZUNLOCK(zp);
+	for (i = 0; i < zp->nworkers; i++)
+	    pthread_join(zp->workers[i], NULL);
+    }
+    pthread_cond_destroy(&zp->cond);
+    pthread_mutex_destroy(&zp->lock);
+#endif
+    for (i = 0; i < NSLOTS; i++)
+	free(zp->slots[i].data);
+    free(zp->tail.data);
+    if (zp->dctx)
+	ZSTD_freeDCtx(zp->dctx);
+    if (zp->cctx)
+	ZSTD_freeCCtx(zp->cctx);
+    free(zp->obuf);
+    free(zp->cbuf);
+    free(zp->frames);
+    free(zp);
+}
+
+#if HAVE_ZSTD_COMPRESSSTREAM2
+/*
+ * Compress in with the given end directive and write the compressed
+ * data, until all of in is consumed, and for ZSTD_e_flush and
+ * ZSTD_e_end until everything buffered by zstd is written too.
+ */
+static int
+compress_out(zstdfile *zp, ZSTD_inBuffer *in, ZSTD_EndDirective end)
+{
+    ZSTD_outBuffer	out;
+    size_t		rem, done;
+    ssize_t		n;
+
+    do {
+	out.dst = zp->obuf;
+	out.size = zp->osize;
+	out.pos = 0;
+	rem = ZSTD_compressStream2(zp->cctx, &out, in, end);
+	if (ZSTD_isError(rem)) {
+	    if (pmDebugOptions.log)
+		fprintf(stderr, "zstd: compress: %s\n", ZSTD_getErrorName(rem));
+	    setoserror(EIO);
+	    return -1;
+	}
+	for (done = 0; done < out.pos; done += n) {
+	    if ((n = write(zp->fd, (char *)out.dst + done, out.pos - done)) < 0) {
+		if (oserror() != EINTR)
+		    return -1;
+		n = 0;
+	    }
+	}
+	zp->cend += out.pos;
+    } while (end == ZSTD_e_continue ? in->pos < in->size : rem != 0);
+    return 0;
+}
+
+/* End the frame being written, if any, and add it to the index. */
+static int
+end_frame(zstdfile *zp)
+{
+    ZSTD_inBuffer	in = { NULL, 0, 0 };
+    zframe		*fp;
+    off_t		start = 0;
+    int			sts;
+
+    if (zp->fusize == 0)
+	return 0;
+    if (zp->nframes > 0) {
+	fp = &zp->frames[zp->nframes - 1];
+	start = fp->coff + fp->csize;
+    }
+    if (compress_out(zp, &in, ZSTD_e_end) < 0)
+	return -1;
+    if ((sts = add_frame(zp, start, zp->cend - start, zp->fusize)) < 0) {
+	setoserror(-sts);
+	return -1;
+    }
+    zp->fusize = 0;
+    return 0;
+}
+
+/* Append a seek table for the frames written, see seektable_index(). */
+static int
+write_seektable(zstdfile *zp)
+{
+    unsigned char	*table, *p;
+    size_t		tsize;
+    ssize_t		n;
+    int			i, sts = 0;
+
+    tsize = 8 + zp->nframes * 8 + SEEKTABLE_FOOTER_SIZE;
+    if ((table = malloc(tsize)) == NULL)
+	return -1;
+    p = table;
+    put_le32(p, SEEKTABLE_MAGIC);
+    put_le32(p + 4, (unsigned int)(tsize - 8));
+    for (i = 0, p += 8; i < zp->nframes; i++, p += 8) {
+	put_le32(p, (unsigned int)zp->frames[i].csize);
+	put_le32(p + 4, (unsigned int)zp->frames[i].usize);
+    }
+    put_le32(p, (unsigned int)zp->nframes);
+    p[4] = 0;	/* no per-frame checksums */
+    put_le32(p + 5, SEEKTABLE_FOOTER_MAGIC);
+    if ((n = write(zp->fd, table, tsize)) != (ssize_t)tsize) {
+	if (n >= 0)
+	    setoserror(ENOSPC);
+	sts = -1;
+    }
+    free(table);
+    return sts;
+}
+#endif /* HAVE_ZSTD_COMPRESSSTREAM2 */
+
+static void *
+zstd_open(__pmFILE *f, const char *path, const char *mode)
+{
+    zstdfile	*zp;
+    struct stat	sbuf;
+    int		i, sts;
+
+    if ((mode[0] != 'r' && mode[0] != 'w') || mode[1] != '\0') {
+	setoserror(EINVAL);
+	return NULL;
+    }
+#if !HAVE_ZSTD_COMPRESSSTREAM2
+    if (mode[0] == 'w') {
+	setoserror(EOPNOTSUPP);
+	return NULL;
+    }
+#endif
+    if ((zp = (zstdfile *)calloc(1, sizeof(zstdfile))) == NULL)
+	return NULL;
+    zp->last = -1;
+    for (i = 0; i < NSLOTS; i++)
+	zp->slots[i].frame = -1;
+#ifdef PM_MULTI_THREAD
+    pthread_mutex_init(&zp->lock, NULL);
+    pthread_cond_init(&zp->cond, NULL);
+#endif
+#if HAVE_ZSTD_COMPRESSSTREAM2
+    if (mode[0] == 'w') {
+	if ((zp->fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0666)) < 0) {
+	    sts = oserror();
+	    goto fail;
+	}
+	zp->osize = ZSTD_CStreamOutSize();
+	if ((zp->cctx = ZSTD_createCCtx()) == NULL ||
+	    (zp->obuf = malloc(zp->osize)) == NULL) {
+	    sts = ENOMEM;
+	    goto fail;
+	}
+	ZSTD_CCtx_setParameter(zp->cctx, ZSTD_c_checksumFlag, 1);
+	if (pmDebugOptions.log)
+	    fprintf(stderr, "zstd_open(\"%s\", \"w\"): fd=%d\n", path, zp->fd);
+	f->priv = (void *)zp;
+	f->position = 0;
+	return f;
+    }
+#endif
+    if ((zp->fd = open(path, O_RDONLY)) < 0) {
+	sts = oserror();
+	goto fail;
+    }
+    if ((zp->dctx = ZSTD_createDCtx()) == NULL) {
+	sts = ENOMEM;
+	goto fail;
+    }
+    if (fstat(zp->fd, &sbuf) < 0) {
+	sts = oserror();
+	goto fail;
+    }
+    if (!seektable_index(zp, sbuf.st_size) && (sts = walk_index(zp)) < 0) {
+	if (pmDebugOptions.log)
+	    fprintf(stderr, "zstd_open(\"%s\"): not a zstd file\n", path);
+	sts = (sts == -ENOMEM) ? ENOMEM : EINVAL;
+	goto fail;
+    }
+    if (pmDebugOptions.log)
+	fprintf(stderr, "zstd_open(\"%s\"): %d frames, %lld bytes%s\n",
+		path, zp->nframes, (long long)zp->usize,
+		zp->complete ? " (seek table)" : "");
+
+    f->priv = (void *)zp;
+    f->position = 0;
+    return f;
+
+fail:
+    if (zp->fd >= 0)
+	close(zp->fd);
+    zstd_free(zp);
+    setoserror(sts);
+    return NULL;
+}
+
+static void *
+zstd_fdopen(__pmFILE *f, int fd, const char *mode)
+{
+    /* __pmFdopen() only ever uses the stdio handler */
+    setoserror(ENOSYS);
+    return NULL;
+}
+
+/* More data may have been appended to a file without a seek table. */
+static void
+refresh(zstdfile *zp)
+{
+    if (!zp->complete && zp->cctx == NULL) {
+	ZLOCK(zp);
+	walk_index(zp);
+	ZUNLOCK(zp);
+    }
+}
+
+static int
+zstd_seek(__pmFILE *f, off_t offset, int whence)
+{
+    zstdfile	*zp = (zstdfile *)f->priv;
+
+    switch (whence) {
+	case SEEK_SET:
+	    break;
+	case SEEK_CUR:
+	    offset += f->position;
+	    break;
+	case SEEK_END:
+	    refresh(zp);
+	    offset += zp->usize + zp->fusize;
+	    break;
+	default:
+	    offset = -1;
+	    break;
+    }
+    if (offset < 0) {
+	setoserror(EINVAL);
+	return -1;
+    }
+    f->position = offset;
+    zp->eof = 0;
+    return 0;
+}
+
+static void
+zstd_rewind(__pmFILE *f)
+{
+    zstdfile	*zp = (zstdfile *)f->priv;
+
+    f->position = 0;
+    zp->eof = zp->error = 0;
+}
+
+static off_t
+zstd_tell(__pmFILE *f)
+{
+    return f->position;
+}
+
+static size_t
+zstd_read(void *ptr, size_t size, size_t nmemb, __pmFILE *f)
+{
+    zstdfile	*zp = (zstdfile *)f->priv;
+    zframe	*fp;
+    zslot	*sp;
+    off_t	posn = f->position;
+    size_t	need = size * nmemb;
+    size_t	have = 0, n;
+    int		frame;
+
+    if (zp->cctx != NULL) {
+	zp->error = 1;
+	setoserror(EBADF);
+	return 0;
+    }
+    while (have < need) {
+	if (posn >= zp->usize)
+	    refresh(zp);
+	if ((frame = find_frame(zp, posn)) < 0) {
+	    zp->eof = 1;
+	    break;
+	}
+	if ((sp = get_frame(zp, frame)) == NULL) {
+	    zp->error = 1;
+	    break;
+	}
+	fp = &zp->frames[frame];
+	n = fp->uoff + fp->usize - posn;
+	if (n > need - have)
+	    n = need - have;
+	memcpy((char *)ptr + have, &sp->data[posn - fp->uoff], n);
+	ZUNLOCK(zp);
+	have += n;
+	posn += n;
+    }
+    f->position = posn;
+    return size ? have / size : 0;
+}
+
+#if HAVE_ZSTD_COMPRESSSTREAM2
+static int zstd_flush(__pmFILE *);
+
+static size_t
+zstd_write(void *ptr, size_t size, size_t nmemb, __pmFILE *f)
+{
+    zstdfile		*zp = (zstdfile *)f->priv;
+    ZSTD_inBuffer	in;
+    size_t		need = size * nmemb;
+    size_t		have = 0, n;
+
+    if (zp->cctx == NULL) {
+	zp->error = 1;
+	setoserror(EBADF);
+	return 0;
+    }
+    /* append only, seeks back are only ever to find the offset */
+    if (f->position != zp->usize + zp->fusize) {
+	zp->error = 1;
+	setoserror(ESPIPE);
+	return 0;
+    }
+    while (have < need) {
+	n = ZSTD_FRAME_SIZE - zp->fusize;
+	if (n > need - have)
+	    n = need - have;
+	in.src = (char *)ptr + have;
+	in.size = n;
+	in.pos = 0;
+	if (compress_out(zp, &in, ZSTD_e_continue) < 0)
+	    break;
+	zp->fusize += n;
+	have += n;
+	if (zp->fusize == ZSTD_FRAME_SIZE && end_frame(zp) < 0)
+	    break;
+    }
+    f->position += have;
+    if (have < need || (zp->unbuffered && zstd_flush(f) != 0)) {
+	zp->error = 1;
+	return size ? have / size : 0;
+    }
+    return nmemb;
+}
+#else
+static size_t
+zstd_write(void *ptr, size_t size, size_t nmemb, __pmFILE *f)
+{
+    zstdfile	*zp = (zstdfile *)f->priv;
+
+    /* never open for writing, see zstd_open() */
+    zp->error = 1;
+    setoserror(EBADF);
+    return 0;
+}
+#endif
+
+static int
+zstd_getc(__pmFILE *f)
+{
+    unsigned char	c;
+
+    if (zstd_read(&c, 1, 1, f) != 1)
+	return EOF;
+    return c;
+}
+
+static int
+zstd_flush(__pmFILE *f)
+{
+#if HAVE_ZSTD_COMPRESSSTREAM2
+    zstdfile		*zp = (zstdfile *)f->priv;
+    ZSTD_inBuffer	in = { NULL, 0, 0 };
+
+    /* make all data written so far decodable by readers */
+    if (zp->cctx != NULL && zp->fusize > 0 &&
+	compress_out(zp, &in, ZSTD_e_flush) < 0)
+	return EOF;
+#endif
+    return 0;
+}
+
+static int
+zstd_fsync(__pmFILE *f)
+{
+    zstdfile	*zp = (zstdfile *)f->priv;
+
+    if (zstd_flush(f) != 0)
+	return -1;
+    return fsync(zp->fd);
+}
+
+static int
+zstd_fileno(__pmFILE *f)
+{
+    zstdfile	*zp = (zstdfile *)f->priv;
+    return zp->fd;
+}
+
+static off_t
+zstd_lseek(__pmFILE *f, off_t offset, int whence)
+{
+    zstdfile	*zp = (zstdfile *)f->priv;
+    return lseek(zp->fd, offset, whence);
+}
+
+static int
+zstd_fstat(__pmFILE *f, struct stat *buf)
+{
+    zstdfile	*zp = (zstdfile *)f->priv;
+    int		sts;
+
+    /* What the caller really wants for st_size is the uncompressed size. */
+    if ((sts = fstat(zp->fd, buf)) == 0) {
+	refresh(zp);
+	buf->st_size = zp->usize + zp->fusize;
+    }
+    return sts;
+}
+
+static int
+zstd_feof(__pmFILE *f)
+{
+    zstdfile	*zp = (zstdfile *)f->priv;
+    return zp->eof;
+}
+
+static int
+zstd_ferror(__pmFILE *f)
+{
+    zstdfile	*zp = (zstdfile *)f->priv;
+    return zp->error;
+}
+
+static void
+zstd_clearerr(__pmFILE *f)
+{
+    zstdfile	*zp = (zstdfile *)f->priv;
+    zp->eof = zp->error = 0;
+}
+
+static int
+zstd_setvbuf(__pmFILE *f, char *buf, int mode, size_t size)
+{
+    zstdfile	*zp = (zstdfile *)f->priv;
+
+    /* only "unbuffered" has any meaning, see zstd_write() */
+    zp->unbuffered = (mode == _IONBF);
+    return 0;
+}
+
+static int
+zstd_close(__pmFILE *f)
+{
+    zstdfile	*zp = (zstdfile *)f->priv;
+    int		sts = 0;
+
+#if HAVE_ZSTD_COMPRESSSTREAM2
+    if (zp->cctx != NULL &&
+	(end_frame(zp) < 0 || write_seektable(zp) < 0))
+	sts = -1;
+#endif
+    if (close(zp->fd) < 0)
+	sts = -1;
+    zstd_free(zp);
+    return sts;
+}
+
+__pm_fops __pm_zstd = {
+    /*
+     * zstd compression and decompression
+     */
+    .__pmopen = zstd_open,
+    .__pmfdopen = zstd_fdopen,
+    .__pmseek = zstd_seek,
+    .__pmrewind = zstd_rewind,
+    .__pmtell = zstd_tell,
+    .__pmfgetc = zstd_getc,
+    .__pmread = zstd_read,
+    .__pmwrite = zstd_write,
+    .__pmflush = zstd_flush,
+    .__pmfsync = zstd_fsync,
+    .__pmfileno = zstd_fileno,
+    .__pmlseek = zstd_lseek,
+    .__pmfstat = zstd_fstat,
+    .__pmfeof = zstd_feof,
+    .__pmferror = zstd_ferror,
+    .__pmclearerr = zstd_clearerr,
+    .__pmsetvbuf = zstd_setvbuf,
+    .__pmclose = zstd_close
+};
+#endif /* HAVE_ZSTD_DECOMPRESSION */
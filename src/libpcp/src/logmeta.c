@@ -23,6 +23,21 @@
 /* bytes for a length field in a header/trailer, or a string length field */
 #define LENSIZE	4
 
+/*
+ * The versions of one instance domain, in ascending time order, so
+ * searchindom() can find the one in force at a given time with a
+ * binary search rather than walking the l_hashindom list.  These are
+ * kept in l_hashindomtime, and maintained as the list is changed in
+ * addindom().  nversions is -1 if this could not be done (out of
+ * memory), in which case searchindom() falls back to the list.
+ */
+typedef struct {
+    int			nversions;
+    int			maxversions;
+    int			cursor;		/* last hit, often next time too */
+    __pmLogInDom	**versions;
+} indomtime_t;
+
 static void
 StrTimeval(const pmTimeval *tp)
 {
@@ -93,9 +108,93 @@ addinsts(__pmLogInDom *idp, int numinst, int *instlist, char **namelist)
     idp->namelist = namelist;
 }
 
+static int
+growindomtime(indomtime_t *itp, int need)
+{
+    __pmLogInDom	**versions;
+    int			max = itp->maxversions ? itp->maxversions : 4;
+
+    if (need <= itp->maxversions)
+	return 0;
+    while (max < need)
+	max *= 2;
+PM_FAULT_POINT("libpcp/" __FILE__ ":17", PM_FAULT_ALLOC);
+    if ((versions = (__pmLogInDom **)realloc(itp->versions,
+				max * sizeof(__pmLogInDom *))) == NULL)
+	return -oserror();
+    itp->versions = versions;
+    itp->maxversions = max;
+    return 0;
+}
+
+/*
+ * Update the time-ordered versions of indom after idp has been
+ * added to its list (at the head, if it is the latest) ... appending
+ * is the common case, anything else rebuilds the array from the list.
+ */
+static void
+updateindomtime(__pmLogCtl *lcp, pmInDom indom, __pmLogInDom *head, __pmLogInDom *idp)
+{
+    __pmHashNode	*hp;
+    indomtime_t		*itp;
+    int			n;
+
+    if ((hp = __pmOHashSearch((unsigned int)indom, &lcp->l_hashindomtime)) != NULL)
+	itp = (indomtime_t *)hp->data;
+    else {
+PM_FAULT_POINT("libpcp/" __FILE__ ":18", PM_FAULT_ALLOC);
+	if ((itp = (indomtime_t *)calloc(1, sizeof(indomtime_t))) == NULL)
+	    return;
+	if (__pmOHashAdd((unsigned int)indom, (void *)itp, &lcp->l_hashindomtime) < 0) {
+	    free(itp);
+	    return;
+	}
+    }
+
+    if (idp == head && itp->nversions >= 0) {
+	if (growindomtime(itp, itp->nversions + 1) < 0)
+	    itp->nversions = -1;
+	else
+	    itp->versions[itp->nversions++] = idp;
+	return;
+    }
+
+    for (n = 0, idp = head; idp != NULL; idp = idp->next)
+	n++;
+    if (growindomtime(itp, n) < 0) {
+	itp->nversions = -1;
+	return;
+    }
+    itp->nversions = n;
+    itp->cursor = 0;
+    for (idp = head; idp != NULL; idp = idp->next)
+	itp->versions[--n] = idp;
+}
+
+void
+__pmLogFreeInDomTime(__pmOHashCtl *hcp)
+{
+    __pmHashNode	*hp;
+    indomtime_t		*itp;
+
+    for (hp = __pmOHashWalk(hcp, PM_HASH_WALK_START);
+	 hp != NULL;
+	 hp = __pmOHashWalk(hcp, PM_HASH_WALK_NEXT)) {
+	itp = (indomtime_t *)hp->data;
+	free(itp->versions);
+	free(itp);
+    }
+    __pmOHashClear(hcp);
+}
+
 /*
  * Add the given instance domain to the hashed instance domain.
  * Filter out duplicates.
+ *
+ * If the instances are the same as those of the previous version
+ * (in time), the new version refers to the previous version's lists
+ * rather than keeping its own copy, and as for a duplicate the caller
+ * retains control of the storage passed in.
  */
 static int
 addindom(__pmLogCtl *lcp, pmInDom indom, const pmTimeval *tp, int numinst, 
@@ -105,6 +204,7 @@ addindom(__pmLogCtl *lcp, pmInDom indom, const pmTimeval *tp, int numinst,
     __pmLogInDom	*idp_cached, *idp_time;
     __pmHashNode	*hp;
     int			timecmp;
+    int			moved = 0;
     int			sts;
 
 PM_FAULT_POINT("libpcp/" __FILE__ ":1", PM_FAULT_ALLOC);
@@ -128,6 +228,7 @@ PM_FAULT_POINT("libpcp/" __FILE__ ":1", PM_FAULT_ALLOC);
 	if (sts > 0) {
 	    /* __pmHashAdd returns 1 for success, but we want 0. */
 	    sts = 0;
+	    updateindomtime(lcp, indom, idp, idp);
 	}
 	return sts;
     }
@@ -211,6 +312,7 @@ PM_FAULT_POINT("libpcp/" __FILE__ ":1", PM_FAULT_ALLOC);
 		else
 		    hp->data = (void *)idp_cached->next;
 		idp = idp_cached;
+		moved = 1;
 	    }
 
 	    /*
@@ -228,6 +330,31 @@ PM_FAULT_POINT("libpcp/" __FILE__ ":1", PM_FAULT_ALLOC);
 	idp_prev = idp_cached;
     }
 
+    /*
+     * Share the instance lists with the previous version if they are
+     * the same, so long runs of unchanged versions (as for a metric
+     * logged once, or every time with pmlogger -r) cost no more than
+     * one copy of the instances.
+     */
+    idp_time = idp_prev ? idp_prev->next : (__pmLogInDom *)hp->data;
+    if (sts == 0 && idp_time != NULL && idp_time->numinst > 0 &&
+	sameindom(idp_time, idp)) {
+	idp->instlist = idp_time->instlist;
+	idp->namelist = idp_time->namelist;
+	idp->buf = NULL;
+	idp->allinbuf = 1;
+	sts = PMLOGPUTINDOM_DUP;	/* storage stays with the caller */
+	if (pmDebugOptions.logmeta && pmDebugOptions.desperate) {
+	    char	strbuf[20];
+	    fprintf(stderr, "indom: %s @ ",
+		pmInDomStr_r(indom, strbuf, sizeof(strbuf)));
+	    __pmPrintTimeval(stderr, &idp->stamp);
+	    fprintf(stderr, " shares instances with @ ");
+	    __pmPrintTimeval(stderr, &idp_time->stamp);
+	    fputc('\n', stderr);
+	}
+    }
+
     /* Insert at the identified insertion point. */
     if (idp_prev == NULL) {
 	idp->next = (__pmLogInDom *)hp->data;
@@ -237,6 +364,7 @@ PM_FAULT_POINT("libpcp/" __FILE__ ":1", PM_FAULT_ALLOC);
 	idp->next = idp_prev->next;
 	idp_prev->next = idp;
     }
+    updateindomtime(lcp, indom, (__pmLogInDom *)hp->data, moved ? NULL : idp);
 
     return sts;
 }
@@ -1191,11 +1319,50 @@ PM_FAULT_POINT("libpcp/" __FILE__ ":5", PM_FAULT_ALLOC);
     return __pmHashAdd((int)dp->pmid, (void *)tdp, &lcp->l_hashpmid);
 }
 
+/*
+ * Index of the last version in itp at or before *tp, else -1 ...
+ * the cursor from the previous search makes forward (and repeated)
+ * replay of an archive constant time, otherwise binary search.
+ */
+static int
+searchindomtime(indomtime_t *itp, const pmTimeval *tp)
+{
+    __pmLogInDom	**versions = itp->versions;
+    int			n = itp->nversions;
+    int			i, lo, hi, mid;
+
+    /* at or just after the last hit, the common case for replay */
+    i = itp->cursor;
+    if (i < n && __pmTimevalCmp(&versions[i]->stamp, tp) <= 0) {
+	if (i + 1 < n && __pmTimevalCmp(&versions[i+1]->stamp, tp) <= 0)
+	    i++;
+	if (i + 1 == n || __pmTimevalCmp(&versions[i+1]->stamp, tp) > 0) {
+	    itp->cursor = i;
+	    return i;
+	}
+    }
+
+    lo = 0;
+    hi = n - 1;
+    while (lo <= hi) {
+	mid = lo + (hi - lo) / 2;
+	if (__pmTimevalCmp(&versions[mid]->stamp, tp) <= 0)
+	    lo = mid + 1;
+	else
+	    hi = mid - 1;
+    }
+    if (hi >= 0)
+	itp->cursor = hi;
+    return hi;
+}
+
 static __pmLogInDom *
 searchindom(__pmLogCtl *lcp, pmInDom indom, pmTimeval *tp)
 {
     __pmHashNode	*hp;
     __pmLogInDom	*idp;
+    indomtime_t		*itp;
+    int			i;
 
     if (pmDebugOptions.logmeta) {
 	char	strbuf[20];
@@ -1204,27 +1371,44 @@ searchindom(__pmLogCtl *lcp, pmInDom indom, pmTimeval *tp)
 	fprintf(stderr, ")\n");
     }
 
-    if ((hp = __pmHashSearch((unsigned int)indom, &lcp->l_hashindom)) == NULL)
-	return NULL;
-
-    idp = (__pmLogInDom *)hp->data;
-    if (tp != NULL) {
-	for ( ; idp != NULL; idp = idp->next) {
-	    /*
-	     * need first one at or earlier than the requested time
-	     */
-	    if (__pmTimevalCmp(&idp->stamp, tp) <= 0)
-		break;
+    if (tp != NULL &&
+	(hp = __pmOHashSearch((unsigned int)indom, &lcp->l_hashindomtime)) != NULL &&
+	(itp = (indomtime_t *)hp->data)->nversions > 0) {
+	if ((i = searchindomtime(itp, tp)) < 0) {
 	    if (pmDebugOptions.logmeta) {
 		fprintf(stderr, "request @ ");
 		StrTimeval(tp);
 		fprintf(stderr, " is too early for indom @ ");
-		StrTimeval(&idp->stamp);
+		StrTimeval(&itp->versions[0]->stamp);
 		fputc('\n', stderr);
 	    }
+	    return NULL;
 	}
-	if (idp == NULL)
+	idp = itp->versions[i];
+    }
+    else {
+	if ((hp = __pmHashSearch((unsigned int)indom, &lcp->l_hashindom)) == NULL)
 	    return NULL;
+
+	idp = (__pmLogInDom *)hp->data;
+	if (tp != NULL) {
+	    for ( ; idp != NULL; idp = idp->next) {
+		/*
+		 * need first one at or earlier than the requested time
+		 */
+		if (__pmTimevalCmp(&idp->stamp, tp) <= 0)
+		    break;
+		if (pmDebugOptions.logmeta) {
+		    fprintf(stderr, "request @ ");
+		    StrTimeval(tp);
+		    fprintf(stderr, " is too early for indom @ ");
+		    StrTimeval(&idp->stamp);
+		    fputc('\n', stderr);
+		}
+	    }
+	    if (idp == NULL)
+		return NULL;
+	}
     }
 
     if (pmDebugOptions.logmeta) {
@@ -438,6 +438,8 @@ __pmFILE *
 __pmLogNewFile(const char *base, int vol)
 {
     char	fname[MAXPATHLEN];
+    const char	*suffix;
+    size_t	len;
     __pmFILE	*f;
     int		save_error;
 
@@ -451,6 +453,22 @@ __pmLogNewFile(const char *base, int vol)
 	return NULL;
     }
 
+    /*
+     * Data volumes may be compressed as they are written, the metadata
+     * and temporal index are not (pmDiscover reads the metadata file
+     * directly as it grows).
+     */
+    if (vol >= 0 && (suffix = __pmLogGetCompress()) != NULL) {
+	len = strlen(fname);
+	pmsprintf(&fname[len], sizeof(fname) - len, "%s", suffix);
+	if (access(fname, R_OK) != -1) {
+	    pmprintf("__pmLogNewFile: \"%s\" already exists, not over-written\n", fname);
+	    pmflush();
+	    setoserror(EEXIST);
+	    return NULL;
+	}
+    }
+
     if ((f = __pmFopen(fname, "w")) == NULL) {
 	char	errmsg[PM_MAXERRMSGLEN];
 	save_error = oserror();
@@ -524,6 +542,7 @@ __pmLogCreate(const char *host, const char *base, int log_version,
     lcp->l_minvol = lcp->l_maxvol = acp->ac_curvol = 0;
     lcp->l_hashpmid.nodes = lcp->l_hashpmid.hsize = 0;
     lcp->l_hashindom.nodes = lcp->l_hashindom.hsize = 0;
+    __pmOHashInit(&lcp->l_hashindomtime);
     lcp->l_hashlabels.nodes = lcp->l_hashlabels.hsize = 0;
     lcp->l_hashtext.nodes = lcp->l_hashtext.hsize = 0;
     lcp->l_tifp = lcp->l_mdfp = acp->ac_mfp = NULL;
@@ -734,6 +753,9 @@ logFreeMeta(__pmLogCtl *lcp)
     if (lcp->l_hashindom.hsize != 0)
 	logFreeHashInDom(&lcp->l_hashindom);
 
+    if (lcp->l_hashindomtime.nodes != 0)
+	__pmLogFreeInDomTime(&lcp->l_hashindomtime);
+
     if (lcp->l_hashlabels.hsize != 0)
 	logFreeHashLabels(&lcp->l_hashlabels);
 
@@ -368,6 +368,14 @@ __pmXmitPDU(int fd, __pmPDU *pdubuf)
     int		len;
     __pmPDUHdr	*php = (__pmPDUHdr *)pdubuf;
 
+    /*
+     * replies for pmFetchAsync() requests still outstanding on this
+     * connection must be received before any other request is sent
+     */
+    if (php->type != PDU_FETCH && php->type != PDU_PROFILE &&
+	(len = __pmFetchAsyncDrain(fd)) < 0)
+	return len;
+
     __pmIgnoreSignalPIPE();
 
     if (pmDebugOptions.pdu) {
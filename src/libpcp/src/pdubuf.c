@@ -1,6 +1,6 @@
 /*
  * Copyright (c) 1995 Silicon Graphics, Inc.  All Rights Reserved.
- * Copyright (c) 2015 Red Hat, Inc.
+ * Copyright (c) 2015,2020 Red Hat, Inc.
  * 
  * This library is free software; you can redistribute it and/or modify it
  * under the terms of the GNU Lesser General Public License as published
@@ -17,6 +17,27 @@
  * To avoid buffer trampling, on success __pmFindPDUBuf() now returns
  * a pinned PDU buffer.  It is the caller's responsibility to unpin the
  * PDU buffer when safe to do so.
+ *
+ * Buffers up to PDUBUF_MAXCLASS bytes come from pools of fixed size
+ * slots carved out of PDUBUF_SLAB sized (and aligned) slabs.  Any
+ * address handed to __pmPinPDUBuf() or __pmUnpinPDUBuf() is mapped to
+ * its slab by masking, the slab is checked against the slab registry
+ * and the buffer header is then found by arithmetic, so pin and unpin
+ * are O(1).  Freed slots are kept on per-size-class free lists (with a
+ * small per-thread cache in front of these, so most allocations do not
+ * need pdubuf_lock) and slabs are never returned to malloc.
+ *
+ * A slot taken from a free list is owned by the allocating thread, which
+ * sets bc_size and then bc_pincnt without pdubuf_lock.  The diagnostics
+ * (pdubufdump() and __pmCountPDUBuf()) and slab_find() walk slots under
+ * the lock, so they load bc_pincnt with PIN_LOAD(), paired with the
+ * PIN_STORE() when the slot is handed out, and only look at bc_size
+ * once bc_pincnt is non-zero.  Pin count changes after that are made
+ * with pdubuf_lock held, and the only other unlocked update is to
+ * bc_next of a free slot, which none of these look at.
+ *
+ * Larger buffers are malloc'd individually and tracked in a tsearch(3)
+ * tree, as all buffers used to be.
  */
 
 #include "pmapi.h"
@@ -28,12 +49,83 @@
 
 typedef struct bufctl
 {
-    int		bc_pincnt;
-    int		bc_size;
-    char	*bc_buf;
-    /* The actual buffer happens to follow this struct. */
+    int			bc_pincnt;	/* 0 => free pool slot */
+    int			bc_size;	/* bytes requested */
+    int			bc_class;	/* pool size class, -1 if malloc'd */
+    char		*bc_buf;
+    struct bufctl	*bc_next;	/* pool free list */
+    /* The actual buffer follows this struct, at BC_HDRSIZE. */
 } bufctl_t;
 
+/* keep the buffer at least as aligned as malloc(3) would */
+#define BC_HDRSIZE	((sizeof(bufctl_t) + 15) & ~((size_t)15))
+
+#ifdef HAVE_POSIX_MEMALIGN
+#define PDUBUF_POOL	1
+#endif
+
+#ifdef PDUBUF_POOL
+#define PDUBUF_SLAB	(64*1024)	/* slab size and alignment */
+#define PDUBUF_NCLASS	7		/* 128, 256, ... 8192 bytes */
+#define PDUBUF_MINCLASS	128
+#define PDUBUF_MAXCLASS	(PDUBUF_MINCLASS << (PDUBUF_NCLASS-1))
+
+typedef struct slab
+{
+    struct slab		*s_next;	/* all slabs, for diagnostics */
+    int			s_class;
+    int			s_nslots;
+    size_t		s_slotsize;	/* BC_HDRSIZE + class size */
+    char		*s_first;	/* first slot */
+} slab_t;
+
+#define SLAB_HDRSIZE	((sizeof(slab_t) + 15) & ~((size_t)15))
+
+#ifdef PM_MULTI_THREAD
+#define PIN_LOAD(x)		__atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define PIN_STORE(x, v)		__atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+#else
+#define PIN_LOAD(x)		(x)
+#define PIN_STORE(x, v)		((x) = (v))
+#endif
+#define SLAB_BASE(p)	((slab_t *)((uintptr_t)(p) & ~((uintptr_t)PDUBUF_SLAB-1)))
+
+/*
+ * All protected by the pdubuf_lock mutex.
+ *
+ * The registry is an open addressing hash table of slab addresses; slabs
+ * are never freed, so there are no deletions to worry about.
+ */
+static slab_t	*slab_list;
+static slab_t	**slab_reg;
+static unsigned	slab_regsize;		/* power of 2 */
+static unsigned	slab_count;
+static bufctl_t	*free_list[PDUBUF_NCLASS];
+static int	free_count[PDUBUF_NCLASS];
+
+#if defined(PM_MULTI_THREAD) && defined(HAVE___THREAD)
+/*
+ * Per-thread cache of free slots for each size class.  Slots move between
+ * here and the global free lists in batches, and a thread's cache is
+ * handed back to the global free lists when the thread exits.
+ */
+#define PDUBUF_TCACHE	1
+#define TCACHE_BATCH	8
+#define TCACHE_MAX	32
+
+typedef struct {
+    int		init;
+    bufctl_t	*free_list[PDUBUF_NCLASS];
+    int		free_count[PDUBUF_NCLASS];
+} tcache_t;
+
+static __thread tcache_t	tcache;
+static pthread_key_t		tcache_key;
+static pthread_once_t		tcache_once = PTHREAD_ONCE_INIT;
+static int			tcache_ok;
+#endif
+#endif /* PDUBUF_POOL */
+
 /* Protected by the pdubuf_lock mutex. */
 static void *buf_tree;
 
@@ -54,31 +146,58 @@ __pmIsPdubufLock(void *lock)
 }
 #endif
 
+static int	dump_header;	/* protected by the pdubuf_lock mutex */
+
+static void
+pdubufdump_buf(const bufctl_t *pcp)
+{
+    if (!dump_header) {
+	fprintf(stderr, "   pinned pdubuf[size](pincnt):");
+	dump_header = 1;
+    }
+    fprintf(stderr, " " PRINTF_P_PFX "%p...%p[%d](%d)",
+	    pcp->bc_buf, &pcp->bc_buf[pcp->bc_size - 1], pcp->bc_size,
+	    pcp->bc_pincnt);
+}
+
 static void
 pdubufdump1(const void *nodep, const VISIT which, const int depth)
 {
     const bufctl_t	*pcp = *(bufctl_t **)nodep;
 
     if (which == postorder || which == leaf)	/* called once per node */
-	fprintf(stderr, " " PRINTF_P_PFX "%p...%p[%d](%d)",
-		pcp->bc_buf, &pcp->bc_buf[pcp->bc_size - 1], pcp->bc_size,
-		pcp->bc_pincnt);
+	pdubufdump_buf(pcp);
 }
 
 static void
 pdubufdump(void)
 {
+#ifdef PDUBUF_POOL
+    slab_t	*sp;
+    bufctl_t	*pcp;
+    int		i;
+#endif
+
     /*
-     * There is no longer a pdubuf free list, ergo no
-     * fprintf(stderr, "   free pdubuf[size]:\n");
+     * Only pinned buffers are reported, free pool slots are counted
+     * by __pmCountPDUBuf()
      */
     PM_LOCK(pdubuf_lock);
-    if (buf_tree != NULL) {
-	fprintf(stderr, "   pinned pdubuf[size](pincnt):");
-	/* THREADSAFE - no locks acquired in pdubufdump1() */
+    dump_header = 0;
+#ifdef PDUBUF_POOL
+    for (sp = slab_list; sp != NULL; sp = sp->s_next) {
+	for (i = 0; i < sp->s_nslots; i++) {
+	    pcp = (bufctl_t *)&sp->s_first[i * sp->s_slotsize];
+	    if (PIN_LOAD(pcp->bc_pincnt) > 0)
+		pdubufdump_buf(pcp);
+	}
+    }
+#endif
+    /* THREADSAFE - no locks acquired in pdubufdump1() */
+    if (buf_tree != NULL)
 	twalk(buf_tree, &pdubufdump1);
+    if (dump_header)
 	fprintf(stderr, "\n");
-    }
     PM_UNLOCK(pdubuf_lock);
 }
 
@@ -99,11 +218,300 @@ bufctl_t_compare(const void *a, const void *b)
     return 0;		/* overlap */
 }
 
+#ifdef PDUBUF_POOL
+static unsigned int
+slab_hash(const slab_t *sp)
+{
+    return (unsigned int)(((uintptr_t)sp / PDUBUF_SLAB) * 2654435761U);
+}
+
+/*
+ * Add a slab to the registry, growing it as needed.
+ * Called with pdubuf_lock held.
+ */
+static int
+slab_register(slab_t *sp)
+{
+    slab_t	**reg;
+    unsigned	size, i, j;
+
+    if (2 * (slab_count + 1) > slab_regsize) {
+	size = slab_regsize ? 2 * slab_regsize : 64;
+	if ((reg = (slab_t **)calloc(size, sizeof(slab_t *))) == NULL)
+	    return -ENOMEM;
+	for (i = 0; i < slab_regsize; i++) {
+	    if (slab_reg[i] == NULL)
+		continue;
+	    for (j = slab_hash(slab_reg[i]) & (size-1); reg[j] != NULL; j = (j+1) & (size-1))
+		;
+	    reg[j] = slab_reg[i];
+	}
+	free(slab_reg);
+	slab_reg = reg;
+	slab_regsize = size;
+    }
+    for (j = slab_hash(sp) & (slab_regsize-1); slab_reg[j] != NULL; j = (j+1) & (slab_regsize-1))
+	;
+    slab_reg[j] = sp;
+    slab_count++;
+    return 0;
+}
+
+/*
+ * Map an arbitrary address to the pinned pool buffer containing it,
+ * or NULL.  Nothing is dereferenced until the slab is known to be ours.
+ * Called with pdubuf_lock held.
+ */
+static bufctl_t *
+slab_find(const void *handle)
+{
+    slab_t	*sp = SLAB_BASE(handle);
+    bufctl_t	*pcp;
+    unsigned	j;
+    size_t	slot;
+
+    if (slab_regsize == 0)
+	return NULL;
+    for (j = slab_hash(sp) & (slab_regsize-1); slab_reg[j] != sp; j = (j+1) & (slab_regsize-1)) {
+	if (slab_reg[j] == NULL)
+	    return NULL;
+    }
+    if ((char *)handle < sp->s_first)
+	return NULL;
+    slot = ((char *)handle - sp->s_first) / sp->s_slotsize;
+    if (slot >= sp->s_nslots)
+	return NULL;
+    pcp = (bufctl_t *)&sp->s_first[slot * sp->s_slotsize];
+    if (PIN_LOAD(pcp->bc_pincnt) == 0 || (char *)handle < pcp->bc_buf ||
+	(char *)handle >= &pcp->bc_buf[pcp->bc_size])
+	return NULL;
+    return pcp;
+}
+
+/*
+ * Carve a new slab into free slots for size class c, and return them
+ * as a list.  Called with pdubuf_lock held.
+ */
+static bufctl_t *
+slab_new(int c, int *count)
+{
+    slab_t	*sp;
+    bufctl_t	*pcp, *list = NULL;
+    void	*p;
+    int		i;
+
+    if (posix_memalign(&p, PDUBUF_SLAB, PDUBUF_SLAB) != 0)
+	return NULL;
+    sp = (slab_t *)p;
+    if (slab_register(sp) < 0) {
+	free(p);
+	return NULL;
+    }
+    sp->s_class = c;
+    sp->s_slotsize = BC_HDRSIZE + (PDUBUF_MINCLASS << c);
+    sp->s_nslots = (PDUBUF_SLAB - SLAB_HDRSIZE) / sp->s_slotsize;
+    sp->s_first = (char *)sp + SLAB_HDRSIZE;
+    sp->s_next = slab_list;
+    slab_list = sp;
+
+    for (i = sp->s_nslots - 1; i >= 0; i--) {
+	pcp = (bufctl_t *)&sp->s_first[i * sp->s_slotsize];
+	pcp->bc_pincnt = 0;
+	pcp->bc_size = 0;
+	pcp->bc_class = c;
+	pcp->bc_buf = (char *)pcp + BC_HDRSIZE;
+	pcp->bc_next = list;
+	list = pcp;
+    }
+    *count = sp->s_nslots;
+    return list;
+}
+
+static int
+size_class(int need)
+{
+    int		c;
+
+    for (c = 0; c < PDUBUF_NCLASS; c++) {
+	if (need <= (PDUBUF_MINCLASS << c))
+	    return c;
+    }
+    return -1;
+}
+
+#ifdef PDUBUF_TCACHE
+/*
+ * Return up to max slots from the front of a per-thread list to the
+ * global free list.  Called with pdubuf_lock held.
+ */
+static void
+tcache_release(tcache_t *tc, int c, int max)
+{
+    bufctl_t	*pcp;
+
+    while (max-- > 0 && (pcp = tc->free_list[c]) != NULL) {
+	tc->free_list[c] = pcp->bc_next;
+	tc->free_count[c]--;
+	pcp->bc_next = free_list[c];
+	free_list[c] = pcp;
+	free_count[c]++;
+    }
+}
+
+static void
+tcache_destroy(void *arg)
+{
+    tcache_t	*tc = (tcache_t *)arg;
+    int		c;
+
+    PM_LOCK(pdubuf_lock);
+    for (c = 0; c < PDUBUF_NCLASS; c++)
+	tcache_release(tc, c, tc->free_count[c]);
+    PM_UNLOCK(pdubuf_lock);
+}
+
+static void
+tcache_key_init(void)
+{
+    tcache_ok = (pthread_key_create(&tcache_key, tcache_destroy) == 0);
+}
+
+/* This thread's cache, or NULL if one cannot be used. */
+static tcache_t *
+tcache_get(void)
+{
+    tcache_t	*tc = &tcache;
+
+    if (unlikely(!tc->init)) {
+	pthread_once(&tcache_once, tcache_key_init);
+	if (!tcache_ok || pthread_setspecific(tcache_key, tc) != 0)
+	    return NULL;
+	tc->init = 1;
+    }
+    return tc;
+}
+#endif /* PDUBUF_TCACHE */
+
+static bufctl_t *
+pool_alloc(int c)
+{
+    bufctl_t	*pcp, *list;
+    int		count;
+#ifdef PDUBUF_TCACHE
+    tcache_t	*tc = tcache_get();
+
+    if (tc != NULL) {
+	if (tc->free_list[c] == NULL) {
+	    /* refill from the global free list, or a new slab */
+	    PM_LOCK(pdubuf_lock);
+	    for (count = 0; count < TCACHE_BATCH && (pcp = free_list[c]) != NULL; count++) {
+		free_list[c] = pcp->bc_next;
+		free_count[c]--;
+		pcp->bc_next = tc->free_list[c];
+		tc->free_list[c] = pcp;
+		tc->free_count[c]++;
+	    }
+	    if (tc->free_list[c] == NULL &&
+		(list = slab_new(c, &count)) != NULL) {
+		tc->free_list[c] = list;
+		tc->free_count[c] = count;
+	    }
+	    PM_UNLOCK(pdubuf_lock);
+	    if (tc->free_list[c] == NULL)
+		return NULL;
+	}
+	/*
+	 * Slots on this thread's list are private to it, so the slot
+	 * can be initialized without the lock.
+	 */
+	pcp = tc->free_list[c];
+	tc->free_list[c] = pcp->bc_next;
+	tc->free_count[c]--;
+	pcp->bc_next = NULL;
+	return pcp;
+    }
+#endif
+
+    PM_LOCK(pdubuf_lock);
+    if (free_list[c] == NULL && (list = slab_new(c, &count)) != NULL) {
+	free_list[c] = list;
+	free_count[c] = count;
+    }
+    if ((pcp = free_list[c]) != NULL) {
+	free_list[c] = pcp->bc_next;
+	free_count[c]--;
+	pcp->bc_next = NULL;
+    }
+    PM_UNLOCK(pdubuf_lock);
+    return pcp;
+}
+
+/* Return a slot (pincnt already 0) to the pool */
+static void
+pool_free(bufctl_t *pcp)
+{
+    int		c = pcp->bc_class;
+#ifdef PDUBUF_TCACHE
+    tcache_t	*tc = tcache_get();
+
+    if (tc != NULL) {
+	pcp->bc_next = tc->free_list[c];
+	tc->free_list[c] = pcp;
+	if (++tc->free_count[c] > TCACHE_MAX) {
+	    PM_LOCK(pdubuf_lock);
+	    tcache_release(tc, c, TCACHE_MAX / 2);
+	    PM_UNLOCK(pdubuf_lock);
+	}
+	return;
+    }
+#endif
+
+    PM_LOCK(pdubuf_lock);
+    pcp->bc_next = free_list[c];
+    free_list[c] = pcp;
+    free_count[c]++;
+    PM_UNLOCK(pdubuf_lock);
+}
+#endif /* PDUBUF_POOL */
+
+/*
+ * Find the pinned buffer containing handle, pool first, then the tree
+ * of large buffers.  Called with pdubuf_lock held.
+ */
+static bufctl_t *
+bufctl_find(void *handle)
+{
+    bufctl_t	pcp_search;
+    void	*bcp;
+
+#ifdef PDUBUF_POOL
+    bufctl_t	*pcp;
+
+    if ((pcp = slab_find(handle)) != NULL)
+	return pcp;
+#endif
+    if (buf_tree == NULL)
+	return NULL;
+    /*
+     * Initialize a dummy bufctl_t to use only as search key;
+     * only its bc_buf & bc_size fields need to be set, as that's
+     * all that bufctl_t_compare will look at.
+     */
+    pcp_search.bc_buf = handle;
+    pcp_search.bc_size = 1;
+    /* THREADSAFE - no locks acquired in bufctl_t_compare() */
+    bcp = tfind(&pcp_search, &buf_tree, &bufctl_t_compare);
+    return bcp ? *(bufctl_t **)bcp : NULL;
+}
+
 __pmPDU *
 __pmFindPDUBuf(int need)
 {
     bufctl_t	*pcp;
     void	*bcp;
+#ifdef PDUBUF_POOL
+    int		c;
+#endif
 
     if (unlikely(need < 0)) {
 	/* special diagnostic case ... dump buffer state */
@@ -112,13 +520,26 @@ __pmFindPDUBuf(int need)
 	return NULL;
     }
 
-    if ((pcp = (bufctl_t *)malloc(sizeof(*pcp) + need)) == NULL) {
+#ifdef PDUBUF_POOL
+    if ((c = size_class(need)) >= 0) {
+	if ((pcp = pool_alloc(c)) == NULL)
+	    return NULL;
+	/* no pdubuf_lock here, see the thread-safe notes above */
+	pcp->bc_size = need;
+	PIN_STORE(pcp->bc_pincnt, 1);
+	goto done;
+    }
+#endif
+
+    if ((pcp = (bufctl_t *)malloc(BC_HDRSIZE + need)) == NULL) {
 	return NULL;
     }
 
     pcp->bc_pincnt = 1;
     pcp->bc_size = need;
-    pcp->bc_buf = ((char *)pcp) + sizeof(*pcp);
+    pcp->bc_class = -1;
+    pcp->bc_buf = ((char *)pcp) + BC_HDRSIZE;
+    pcp->bc_next = NULL;
 
     PM_LOCK(pdubuf_lock);
     /* Insert the node in the tree. */
@@ -131,6 +552,9 @@ __pmFindPDUBuf(int need)
     }
     PM_UNLOCK(pdubuf_lock);
 
+#ifdef PDUBUF_POOL
+done:
+#endif
     if (unlikely(pmDebugOptions.pdubuf)) {
 	fprintf(stderr, "__pmFindPDUBuf(%d) -> " PRINTF_P_PFX "%p\n",
 		need, pcp->bc_buf);
@@ -143,27 +567,16 @@ __pmFindPDUBuf(int need)
 void
 __pmPinPDUBuf(void *handle)
 {
-    bufctl_t	*pcp, pcp_search;
-    void	*bcp;
+    bufctl_t	*pcp;
 
     assert(((__psint_t)handle % sizeof(int)) == 0);
-    /*
-     * Initialize a dummy bufctl_t to use only as search key;
-     * only its bc_buf & bc_size fields need to be set, as that's
-     * all that bufctl_t_compare will look at.
-     */
-    pcp_search.bc_buf = handle;
-    pcp_search.bc_size = 1;
 
     PM_LOCK(pdubuf_lock);
-    /* THREADSAFE - no locks acquired in bufctl_t_compare() */
-    bcp = tfind(&pcp_search, &buf_tree, &bufctl_t_compare);
     /*
      * NB: don't release the lock until final disposition of this object;
      * we don't want to play TOCTOU.
      */
-    if (likely(bcp != NULL)) {
-	pcp = *(bufctl_t **)bcp;
+    if (likely((pcp = bufctl_find(handle)) != NULL)) {
 	assert((&pcp->bc_buf[0] <= (char *)handle) &&
 	       ((char *)handle < &pcp->bc_buf[pcp->bc_size]));
 	pcp->bc_pincnt++;
@@ -186,29 +599,16 @@ __pmPinPDUBuf(void *handle)
 int
 __pmUnpinPDUBuf(void *handle)
 {
-    bufctl_t	*pcp, pcp_search;
-    void	*bcp;
+    bufctl_t	*pcp;
 
     assert(((__psint_t)handle % sizeof(int)) == 0);
     PM_LOCK(pdubuf_lock);
 
-    /*
-     * Initialize a dummy bufctl_t to use only as search key;
-     * only its bc_buf & bc_size fields need to be set, as that's
-     * all that bufctl_t_compare will look at.
-     */
-    pcp_search.bc_buf = handle;
-    pcp_search.bc_size = 1;
-
-    /* THREADSAFE - no locks acquired in bufctl_t_compare() */
-    bcp = tfind(&pcp_search, &buf_tree, &bufctl_t_compare);
     /*
      * NB: don't release the lock until final disposition of this object;
      * we don't want to play TOCTOU.
      */
-    if (likely(bcp != NULL)) {
-	pcp = *(bufctl_t **)bcp;
-    } else {
+    if (unlikely((pcp = bufctl_find(handle)) == NULL)) {
 	PM_UNLOCK(pdubuf_lock);
 	if (pmDebugOptions.pdubuf) {
 	    fprintf(stderr, "__pmUnpinPDUBuf(" PRINTF_P_PFX "%p) -> fails\n",
@@ -227,6 +627,13 @@ __pmUnpinPDUBuf(void *handle)
 	   ((char*)handle < &pcp->bc_buf[pcp->bc_size]));
 
     if (likely(--pcp->bc_pincnt == 0)) {
+#ifdef PDUBUF_POOL
+	if (pcp->bc_class >= 0) {
+	    PM_UNLOCK(pdubuf_lock);
+	    pool_free(pcp);
+	    return 1;
+	}
+#endif
 	/* THREADSAFE - no locks acquired in bufctl_t_compare() */
 	tdelete(pcp, &buf_tree, &bufctl_t_compare);
 	PM_UNLOCK(pdubuf_lock);
@@ -256,9 +663,19 @@ pdubufcount(const void *nodep, const VISIT which, const int depth)
 	    pdu_bufcnt++;
 }
 
+/*
+ * Count the pinned buffers of at least need bytes, and the free pool
+ * slots that could hold need bytes.
+ */
 void
 __pmCountPDUBuf(int need, int *alloc, int *free)
 {
+#ifdef PDUBUF_POOL
+    slab_t	*sp;
+    bufctl_t	*pcp;
+    int		i;
+#endif
+
     PM_LOCK(pdubuf_lock);
 
     pdu_bufcnt_need = need;
@@ -266,8 +683,25 @@ __pmCountPDUBuf(int need, int *alloc, int *free)
     /* THREADSAFE - no locks acquired in pdubufcount() */
     twalk(buf_tree, &pdubufcount);
     *alloc = pdu_bufcnt;
+    *free = 0;
 
-    *free = 0;			/* We don't retain freed nodes. */
+#ifdef PDUBUF_POOL
+    /*
+     * Slots in per-thread caches are free too, so walk the slabs
+     * rather than the global free lists.
+     */
+    for (sp = slab_list; sp != NULL; sp = sp->s_next) {
+	for (i = 0; i < sp->s_nslots; i++) {
+	    pcp = (bufctl_t *)&sp->s_first[i * sp->s_slotsize];
+	    if (PIN_LOAD(pcp->bc_pincnt) > 0) {
+		if (pcp->bc_size >= need)
+		    (*alloc)++;
+	    }
+	    else if ((PDUBUF_MINCLASS << sp->s_class) >= need)
+		(*free)++;
+	}
+    }
+#endif
 
     PM_UNLOCK(pdubuf_lock);
 }
@@ -109,7 +109,7 @@ static int export;
 static int havePmLoadCall;
 
 static int load(const char *, int, int);
-static __pmnsNode *locate(const char *, __pmnsNode *);
+static __pmnsNode *locate(const char *, __pmnsTree *, __pmnsNode *);
 
 #ifdef PM_MULTI_THREAD
 static pthread_mutex_t	pmns_lock;
@@ -860,10 +860,179 @@ backname(__pmnsNode *np, char **name)
     return 0;
 }
 
+/*
+ * The child index is an open addressing hash table (linear probing)
+ * of all the nodes in a tree below the root, keyed on the parent node
+ * and the node's name, so each component of a name is resolved without
+ * a scan of the siblings ... wide nodes like proc.* or openmetrics.*
+ * may have thousands of children.
+ *
+ * A tree with no index (ctab == NULL, e.g. allocation failure or after
+ * __pmExportPMNS) is searched with the sibling lists instead.
+ */
+static unsigned int
+child_hash(const __pmnsNode *parent, const char *name, size_t nch)
+{
+    unsigned int	h = 2166136261U;	/* FNV-1a */
+    size_t		i;
+
+    for (i = 0; i < nch; i++) {
+	h ^= (unsigned char)name[i];
+	h *= 16777619U;
+    }
+    h ^= (unsigned int)((uintptr_t)parent >> 4);
+    h *= 16777619U;
+    return h ^ (h >> 16);
+}
+
+static void
+child_drop(__pmnsTree *tree)
+{
+    free(tree->ctab);
+    tree->ctab = NULL;
+    tree->ctabsize = tree->ctabused = 0;
+}
+
+/*
+ * Start an empty index sized for about nnodes nodes.
+ */
+static void
+child_init(__pmnsTree *tree, int nnodes)
+{
+    int		size = 16;
+
+    child_drop(tree);
+    while (size < 2 * nnodes)
+	size <<= 1;
+    if ((tree->ctab = (__pmnsNode **)calloc(size, sizeof(__pmnsNode *))) != NULL)
+	tree->ctabsize = size;
+}
+
+static void
+child_insert(__pmnsTree *tree, __pmnsNode *np)
+{
+    unsigned int	mask = tree->ctabsize - 1;
+    unsigned int	i;
+
+    i = child_hash(np->parent, np->name, strlen(np->name)) & mask;
+    while (tree->ctab[i] != NULL)
+	i = (i + 1) & mask;
+    tree->ctab[i] = np;
+}
+
+/*
+ * Add a node (with its parent already set) to the index, growing
+ * the table to keep it no more than half full.
+ */
+static void
+child_add(__pmnsTree *tree, __pmnsNode *np)
+{
+    __pmnsNode	**old;
+    int		oldsize;
+    int		i;
+
+    if (tree->ctab == NULL)
+	return;
+
+    if (2 * (tree->ctabused + 1) > tree->ctabsize) {
+	old = tree->ctab;
+	oldsize = tree->ctabsize;
+	tree->ctab = (__pmnsNode **)calloc(2 * oldsize, sizeof(__pmnsNode *));
+	if (tree->ctab == NULL) {
+	    /* no index, fall back to the sibling lists */
+	    tree->ctab = old;
+	    child_drop(tree);
+	    return;
+	}
+	tree->ctabsize = 2 * oldsize;
+	for (i = 0; i < oldsize; i++) {
+	    if (old[i] != NULL)
+		child_insert(tree, old[i]);
+	}
+	free(old);
+    }
+    child_insert(tree, np);
+    tree->ctabused++;
+}
+
+/*
+ * Find the child of parent matching the first nch bytes of name.
+ */
+static __pmnsNode *
+child_find(__pmnsTree *tree, __pmnsNode *parent, const char *name, size_t nch)
+{
+    __pmnsNode		*np;
+    unsigned int	mask;
+    unsigned int	i;
+
+    if (tree->ctab == NULL) {
+	for (np = parent->first; np != NULL; np = np->next) {
+	    if (strncmp(name, np->name, nch) == 0 && np->name[nch] == '\0')
+		return np;
+	}
+	return NULL;
+    }
+
+    mask = tree->ctabsize - 1;
+    i = child_hash(parent, name, nch) & mask;
+    while ((np = tree->ctab[i]) != NULL) {
+	if (np->parent == parent &&
+	    strncmp(name, np->name, nch) == 0 && np->name[nch] == '\0')
+	    return np;
+	i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+/*
+ * Return 1 if any two children of np have the same name, else 0.
+ * Wide subtrees use a scratch hash table rather than comparing all
+ * pairs of children.
+ */
+static int
+dupchildren(__pmnsNode *np)
+{
+    __pmnsNode		*xp;
+    __pmnsNode		*yp;
+    __pmnsNode		**tab;
+    unsigned int	size = 32;
+    unsigned int	i;
+    int			n = 0;
+
+    for (xp = np->first; xp != NULL; xp = xp->next)
+	n++;
+    while (size < 2 * n)
+	size <<= 1;
+    if (n <= 16 || (tab = (__pmnsNode **)calloc(size, sizeof(*tab))) == NULL) {
+	for (xp = np->first; xp != NULL; xp = xp->next) {
+	    for (yp = xp->next; yp != NULL; yp = yp->next) {
+		if (strcmp(xp->name, yp->name) == 0)
+		    return 1;
+	    }
+	}
+	return 0;
+    }
+
+    for (xp = np->first; xp != NULL; xp = xp->next) {
+	i = child_hash(NULL, xp->name, strlen(xp->name)) & (size - 1);
+	while ((yp = tab[i]) != NULL) {
+	    if (strcmp(xp->name, yp->name) == 0) {
+		free(tab);
+		return 1;
+	    }
+	    i = (i + 1) & (size - 1);
+	}
+	tab[i] = xp;
+    }
+    free(tab);
+    return 0;
+}
+
 /*
  * Fixup the parent pointers of the tree.
  * Fill in the hash table with nodes from the tree.
  * Hashing is done on pmid.
+ * Also fill in the child index.
  */
 static int
 backlink(__pmnsTree *tree, __pmnsNode *root, int dupok)
@@ -873,6 +1042,7 @@ backlink(__pmnsTree *tree, __pmnsNode *root, int dupok)
 
     for (np = root->first; np != NULL; np = np->next) {
 	np->parent = root;
+	child_add(tree, np);
 	if (np->pmid != PM_ID_NULL) {
 	    int		i;
 	    __pmnsNode	*xp;
@@ -928,6 +1098,10 @@ pass2(int dupok)
     main_pmns->htab = NULL;
     main_pmns->htabsize = 0;
     main_pmns->mark_state = UNKNOWN_MARK_STATE;
+    main_pmns->ctab = NULL;
+    main_pmns->ctabsize = main_pmns->ctabused = 0;
+    main_pmns->image = NULL;
+    main_pmns->imagesize = 0;
 
     /* Get the root subtree out of the seen list */
     if ((main_pmns->root = findseen("root")) == NULL) {
@@ -1044,6 +1218,11 @@ __pmNewPMNS(__pmnsTree **pmns)
     t->htab = NULL;
     t->htabsize = 0;
     t->mark_state = UNKNOWN_MARK_STATE;
+    t->ctab = NULL;
+    t->ctabsize = t->ctabused = 0;
+    t->image = NULL;
+    t->imagesize = 0;
+    child_init(t, 0);
 
     *pmns = t;
     return 0;
@@ -1051,7 +1230,7 @@ __pmNewPMNS(__pmnsTree **pmns)
 
 /*
  * Go through the tree and build a hash table.
- * Fix up parent links while we're there.
+ * Fix up parent links and (re)build the child index while we're there.
  * Unmark all nodes.
  *
  * In addition to being called from other routines within pmns.c
@@ -1080,6 +1259,7 @@ __pmFixPMNSHashTab(__pmnsTree *tree, int numpmid, int dupok)
 	goto pmapi_return;
     }
 
+    child_init(tree, numpmid);
     if ((sts = backlink(tree, tree->root, dupok)) < 0) {
 	goto pmapi_return;
     }
@@ -1099,7 +1279,7 @@ pmapi_return:
  */
 
 static int
-AddPMNSNode(__pmnsNode *root, int pmid, const char *name)
+AddPMNSNode(__pmnsTree *tree, __pmnsNode *root, int pmid, const char *name)
 {
     __pmnsNode *np = NULL;
     const char *tail;
@@ -1111,11 +1291,7 @@ AddPMNSNode(__pmnsNode *root, int pmid, const char *name)
 
     nch = (int)(tail - name);
 
-    /* Compare name with all the child nodes */
-    for (np = root->first; np != NULL; np = np->next) {
-	if (strncmp(name, np->name, (int)nch) == 0 && np->name[(int)nch] == '\0')
-	    break;
-    }
+    np = child_find(tree, root, name, nch);
 
     if (np == NULL) { /* no match with child */
 	__pmnsNode *parent_np = root;
@@ -1147,6 +1323,7 @@ AddPMNSNode(__pmnsNode *root, int pmid, const char *name)
 		}
 	    }
 	    parent_np->first = np;
+	    child_add(tree, np);
 
 	    /* at this stage, assume np is a non-leaf */
 	    np->pmid = PM_ID_NULL;
@@ -1170,7 +1347,7 @@ AddPMNSNode(__pmnsNode *root, int pmid, const char *name)
 	    return 0;
     }
     else {
-	return AddPMNSNode(np, pmid, tail+1); /* try matching with rest of pathname */
+	return AddPMNSNode(tree, np, pmid, tail+1); /* try matching with rest of pathname */
     }
 
 }
@@ -1184,7 +1361,7 @@ AddPMNSNode(__pmnsNode *root, int pmid, const char *name)
 int
 __pmAddPMNSNode(__pmnsTree *tree, int pmid, const char *name)
 {
-    return AddPMNSNode(tree->root, pmid, name);
+    return AddPMNSNode(tree, tree->root, pmid, name);
 }
 
 /*
@@ -1317,7 +1494,7 @@ loadascii(int dupok, int use_cpp)
 	    }
 	}
 	else if (state == 0) {
-	    if (seen) {
+	    if (seen && dupchildren(seen)) {
 		__pmnsNode	*xp;
 
 		for (np = seen->first; np != NULL; np = np->next) {
@@ -1522,6 +1699,14 @@ load(const char *filename, int dupok, int use_cpp)
     if (use_cpp == USE_CPP && filename == PM_NS_DEFAULT)
 	use_cpp = NO_CPP;
 
+    /*
+     * use an up to date binary image if there is one ... images are
+     * only made from PMNS files written by pmnsmerge or pmnsdel, which
+     * have nothing for pmcpp to do
+     */
+    if (__pmLoadPMNSImage(fname, dupok, &main_pmns) == 0)
+	return 0;
+
     /*
      * load ASCII PMNS
      */
@@ -1539,6 +1724,12 @@ __pmExportPMNS(void)
     lock_ctx_and_pmns(NULL, &ctx_ctl);
 
     export = 1;
+    /*
+     * caller may rearrange the tree, so stop using the child index ...
+     * nodes may belong to a binary image, so must not be freed
+     */
+    if (main_pmns != NULL)
+	child_drop(main_pmns);
 
     if (ctx_ctl.need_pmns_unlock)
 	PM_UNLOCK(pmns_lock);
@@ -1552,34 +1743,61 @@ __pmExportPMNS(void)
 }
 
 /*
- * Find and return the named node in the tree, root.
+ * Find and return the named node below root in the tree.
  */
 static __pmnsNode *
-locate(const char *name, __pmnsNode *root)
+locate(const char *name, __pmnsTree *tree, __pmnsNode *root)
 {
     const char	*tail;
-    ptrdiff_t	nch;
-    __pmnsNode	*np;
-
-    /* Traverse until '.' or '\0' */
-    for (tail = name; *tail && *tail != '.'; tail++)
-	;
+    __pmnsNode	*np = root;
 
-    nch = tail - name;
+    for ( ; ; ) {
+	/* Traverse until '.' or '\0' */
+	for (tail = name; *tail && *tail != '.'; tail++)
+	    ;
 
-    /* Compare name with all the child nodes */
-    for (np = root->first; np != NULL; np = np->next) {
-	if (strncmp(name, np->name, (int)nch) == 0 && np->name[(int)nch] == '\0' &&
-	    (np->pmid & MARK_BIT) == 0)
-	    break;
+	np = child_find(tree, np, name, tail - name);
+	if (np == NULL || (np->pmid & MARK_BIT) != 0) /* no match with child */
+	    return NULL;
+	if (*tail == '\0') /* matched with whole path */
+	    return np;
+	name = tail+1; /* try matching with rest of pathname */
     }
+}
 
-    if (np == NULL) /* no match with child */
-	return NULL;
-    else if (*tail == '\0') /* matched with whole path */
-	return np;
-    else
-	return locate(tail+1, np); /* try matching with rest of pathname */
+/*
+ * Bulk lookups usually have names grouped by subtree, so rather than
+ * starting from the root, start from the deepest node the name shares
+ * with the previous name, which was found at prev (or NULL if not).
+ */
+static __pmnsNode *
+locate_near(const char *name, __pmnsTree *tree, const char *prevname, __pmnsNode *prev)
+{
+    const char	*p;
+    const char	*q;
+    const char	*tail = name;
+    __pmnsNode	*np = tree->root;
+    int		common = 0;
+    int		depth;
+
+    if (prev != NULL) {
+	/* count the leading components common to both names */
+	for (p = name, q = prevname; *p != '\0' && *p == *q; p++, q++) {
+	    if (*p == '.') {
+		common++;
+		tail = p+1;
+	    }
+	}
+	if (common > 0) {
+	    for (depth = 1, q = prevname; *q != '\0'; q++) {
+		if (*q == '.')
+		    depth++;
+	    }
+	    for (np = prev; depth > common; depth--)
+		np = np->parent;
+	}
+    }
+    return locate(tail, tree, np);
 }
 
 /*
@@ -1656,7 +1874,14 @@ __pmFreePMNS(__pmnsTree *pmns)
 {
     if (pmns != NULL) {
 	free(pmns->htab);
-	FreeTraversePMNS(pmns->root);
+	free(pmns->ctab);
+	if (pmns->image != NULL) {
+	    /* nodes are one array, names are in the image */
+	    free(pmns->root);
+	    __pmMemoryUnmap(pmns->image, pmns->imagesize);
+	}
+	else
+	    FreeTraversePMNS(pmns->root);
 	free(pmns);
     }
 }
@@ -1761,13 +1986,16 @@ pmLookupName_ctx(__pmContext *ctxp, int derive_locked, int numpmid, char *nameli
 	char		*xname;
 	char		*xp;
 	__pmnsNode	*np;
+	__pmnsNode	*last = NULL;
 
 	for (i = 0; i < numpmid; i++) {
 	    /*
 	     * if we locate the name and it is a leaf in the PMNS
 	     * this is good
 	     */
-	    np = locate(namelist[i], PM_TPD(curr_pmns)->root);
+	    np = locate_near(namelist[i], PM_TPD(curr_pmns),
+			     i > 0 ? namelist[i-1] : NULL, last);
+	    last = np;
 	    if (np != NULL ) {
 		if (np->first == NULL) {
 		    /* looks good from local PMNS */
@@ -1797,7 +2025,7 @@ pmLookupName_ctx(__pmContext *ctxp, int derive_locked, int numpmid, char *nameli
 	    while ((xp = rindex(xname, '.')) != NULL) {
 		*xp = '\0';
 		lsts = 0;
-		np = locate(xname, PM_TPD(curr_pmns)->root);
+		np = locate(xname, PM_TPD(curr_pmns), PM_TPD(curr_pmns)->root);
 		if (np != NULL && np->first == NULL &&
 		    IS_DYNAMIC_ROOT(np->pmid)) {
 		    /* root of dynamic subtree */
@@ -2200,7 +2428,7 @@ getchildren(__pmContext *ctxp, int needlocks, const char *name, char ***offsprin
 	if (*name == '\0')
 	    np = PM_TPD(curr_pmns)->root; /* use "" to name the root of the PMNS */
 	else
-	    np = locate(name, PM_TPD(curr_pmns)->root);
+	    np = locate(name, PM_TPD(curr_pmns), PM_TPD(curr_pmns)->root);
 	if (np == NULL) {
 	    if (ctxp != NULL && ctxp->c_type == PM_CONTEXT_LOCAL) {
 		/*
@@ -2218,7 +2446,7 @@ getchildren(__pmContext *ctxp, int needlocks, const char *name, char ***offsprin
 		}
 		while ((xp = rindex(xname, '.')) != NULL) {
 		    *xp = '\0';
-		    np = locate(xname, PM_TPD(curr_pmns)->root);
+		    np = locate(xname, PM_TPD(curr_pmns), PM_TPD(curr_pmns)->root);
 		    if (np != NULL && np->first == NULL &&
 			IS_DYNAMIC_ROOT(np->pmid)) {
 			int		domain = ((__pmID_int *)&np->pmid)->cluster;
@@ -0,0 +1,339 @@
+/*
+ * Copyright (c) 2020 Red Hat.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+/*
+ * Binary PMNS images.
+ *
+ * An image of the ASCII PMNS file "foo" is kept in "foo.bin", written by
+ * pmnsmerge -b (and kept up to date by pmnsdel) when the PMNS is built.
+ * Loading the image replaces running pmcpp, lexing and parsing the ASCII
+ * file and joining up its subtrees with one pass over a flat array of
+ * nodes.
+ *
+ * The image is a header, an array of nodes in depth-first order, then
+ * a string table of node names.  Nodes refer to each other and to their
+ * names by index and offset, so the image is position independent: it
+ * is mapped read-only and the names are used in place, shared by every
+ * process using the PMNS.  The per-process tree is one calloc'd array of
+ * __pmnsNode and the pmid hash table and child index are rebuilt by
+ * __pmFixPMNSHashTab() from that.
+ *
+ * The header records the size and a hash of the contents of the ASCII
+ * file it was made from.  If the ASCII file has changed since (edited
+ * by hand, or replaced without an image) the image is not used and the
+ * ASCII file is loaded as before.  The size and modification time of
+ * the ASCII file remain the basis for __pmHasPMNSFileChanged().
+ */
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include "pmapi.h"
+#include "libpcp.h"
+#include "internal.h"
+
+#define IMAGE_MAGIC	0x504d4e53	/* "PMNS" */
+#define IMAGE_VERSION	1
+
+typedef struct {
+    __uint32_t	magic;
+    __uint32_t	version;	/* also detects a change of byte order */
+    __uint32_t	nnodes;		/* node[0] is the root */
+    __uint32_t	nleaves;
+    __uint32_t	strsize;	/* bytes in the string table */
+    __uint32_t	pad;
+    __uint64_t	srcsize;	/* size of the ASCII PMNS file */
+    __uint64_t	srchash;	/* FNV-1a hash of the ASCII PMNS file */
+} image_hdr;
+
+typedef struct {
+    __uint32_t	name;		/* offset into the string table */
+    __uint32_t	first;		/* index of first child, or 0 */
+    __uint32_t	next;		/* index of next sibling, or 0 */
+    __uint32_t	pmid;
+} image_node;
+
+/*
+ * Size and FNV-1a hash of the contents of the ASCII PMNS file.
+ */
+static int
+srcstamp(const char *fname, __uint64_t *size, __uint64_t *hash)
+{
+    char	buf[16384];
+    __uint64_t	h = 14695981039346656037ULL;
+    __uint64_t	n = 0;
+    ssize_t	bytes;
+    ssize_t	i;
+    int		fd;
+
+    if ((fd = open(fname, O_RDONLY)) < 0)
+	return -oserror();
+    while ((bytes = read(fd, buf, sizeof(buf))) > 0) {
+	for (i = 0; i < bytes; i++) {
+	    h ^= (unsigned char)buf[i];
+	    h *= 1099511628211ULL;
+	}
+	n += bytes;
+    }
+    if (bytes < 0) {
+	bytes = -oserror();
+	close(fd);
+	return bytes;
+    }
+    close(fd);
+    *size = n;
+    *hash = h;
+    return 0;
+}
+
+static void
+count(__pmnsNode *np, __uint32_t *nnodes, __uint32_t *nleaves, size_t *strsize)
+{
+    __pmnsNode	*cp;
+
+    (*nnodes)++;
+    if (np->first == NULL)
+	(*nleaves)++;
+    *strsize += strlen(np->name) + 1;
+    for (cp = np->first; cp != NULL; cp = cp->next)
+	count(cp, nnodes, nleaves, strsize);
+}
+
+/*
+ * Fill in node[i] for np and then its subtree, depth first, so the
+ * first child is always node[i+1] and a next sibling always follows
+ * the subtree before it.  Returns the index after the subtree.
+ */
+static __uint32_t
+emit(__pmnsNode *np, __uint32_t i, image_node *node, char *strtab, __uint32_t *stroff)
+{
+    __pmnsNode	*cp;
+    __uint32_t	j = i + 1;
+    __uint32_t	prev = 0;
+    size_t	len = strlen(np->name) + 1;
+
+    node[i].name = *stroff;
+    memcpy(&strtab[*stroff], np->name, len);
+    *stroff += len;
+    /*
+     * non-leaf nodes are PM_ID_NULL when loaded (unmarking a tree
+     * clears the top bit of their pmid), and strip any pmTrimNameSpace()
+     * mark from leaf nodes
+     */
+    if (np->first != NULL || np->pmid == PM_ID_NULL)
+	node[i].pmid = PM_ID_NULL;
+    else
+	node[i].pmid = np->pmid & 0x7fffffff;
+    node[i].first = np->first != NULL ? j : 0;
+    node[i].next = 0;
+    for (cp = np->first; cp != NULL; cp = cp->next) {
+	if (prev != 0)
+	    node[prev].next = j;
+	prev = j;
+	j = emit(cp, j, node, strtab, stroff);
+    }
+    return j;
+}
+
+/*
+ * Write the image of the PMNS below root, loaded from the ASCII PMNS
+ * file fname, to fname.bin.  The image is written to a temporary file
+ * and renamed, so a concurrent loader never sees a partial image.
+ */
+int
+__pmWritePMNSImage(const char *fname, __pmnsNode *root)
+{
+    image_hdr	hdr;
+    image_node	*node;
+    char	*strtab;
+    char	*buf;
+    char	imagename[MAXPATHLEN];
+    char	tmpname[MAXPATHLEN];
+    size_t	strsize = 0;
+    size_t	size;
+    __uint32_t	stroff = 0;
+    int		fd;
+    int		sts;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = IMAGE_MAGIC;
+    hdr.version = IMAGE_VERSION;
+    if ((sts = srcstamp(fname, &hdr.srcsize, &hdr.srchash)) < 0)
+	return sts;
+    count(root, &hdr.nnodes, &hdr.nleaves, &strsize);
+    if (strsize > 0xffffffff)
+	return -E2BIG;
+    hdr.strsize = (__uint32_t)strsize;
+
+    size = sizeof(hdr) + hdr.nnodes * sizeof(image_node) + strsize;
+    if ((buf = (char *)calloc(1, size)) == NULL)
+	return -oserror();
+    memcpy(buf, &hdr, sizeof(hdr));
+    node = (image_node *)&buf[sizeof(hdr)];
+    strtab = (char *)&node[hdr.nnodes];
+    emit(root, 0, node, strtab, &stroff);
+
+    pmsprintf(imagename, sizeof(imagename), "%s.bin", fname);
+    pmsprintf(tmpname, sizeof(tmpname), "%s.binXXXXXX", fname);
+    if ((fd = mkstemp(tmpname)) < 0) {
+	sts = -oserror();
+	free(buf);
+	return sts;
+    }
+    if (write(fd, buf, size) != (ssize_t)size) {
+	sts = -oserror();
+	if (sts == 0)
+	    sts = -ENOSPC;
+    }
+    else if (fchmod(fd, 0644) < 0)
+	sts = -oserror();
+    if (close(fd) < 0 && sts == 0)
+	sts = -oserror();
+    free(buf);
+    if (sts == 0 && rename(tmpname, imagename) < 0)
+	sts = -oserror();
+    if (sts < 0)
+	unlink(tmpname);
+    else if (pmDebugOptions.pmns)
+	fprintf(stderr, "__pmWritePMNSImage(%s): %u nodes, %zd bytes\n",
+		imagename, hdr.nnodes, size);
+    return sts;
+}
+
+/*
+ * Load the image of the ASCII PMNS file fname, if there is an image
+ * and it is up to date.  Returns 0 and the new tree in *treep, or a
+ * negative value if the caller should load the ASCII file instead.
+ */
+int
+__pmLoadPMNSImage(const char *fname, int dupok, __pmnsTree **treep)
+{
+    image_hdr	*hdr;
+    image_node	*inp;
+    __pmnsNode	*node = NULL;
+    __pmnsNode	*np;
+    __pmnsTree	*tree = NULL;
+    struct stat	sbuf;
+    char	imagename[MAXPATHLEN];
+    char	*base;
+    char	*strtab;
+    const char	*reason;
+    __uint64_t	srcsize;
+    __uint64_t	srchash;
+    __uint32_t	i;
+    size_t	size;
+    int		fd;
+    int		sts;
+
+    pmsprintf(imagename, sizeof(imagename), "%s.bin", fname);
+    if ((fd = open(imagename, O_RDONLY)) < 0)
+	return -oserror();
+    if (fstat(fd, &sbuf) < 0 || sbuf.st_size < (off_t)sizeof(image_hdr) ||
+	(off_t)(size_t)sbuf.st_size != sbuf.st_size) {
+	if (pmDebugOptions.pmns)
+	    fprintf(stderr, "__pmLoadPMNSImage(%s): not used, bad size\n", imagename);
+	close(fd);
+	return PM_ERR_PMNS;
+    }
+    size = sbuf.st_size;
+    base = (char *)__pmMemoryMap(fd, size, 0);
+    close(fd);
+    if (base == NULL)
+	return -ENOMEM;
+
+    hdr = (image_hdr *)base;
+    inp = (image_node *)&base[sizeof(*hdr)];
+    if (hdr->magic != IMAGE_MAGIC || hdr->version != IMAGE_VERSION) {
+	reason = "bad magic or version";
+	goto fail;
+    }
+    if (hdr->nnodes == 0 || hdr->strsize == 0 ||
+	hdr->nnodes > (size - sizeof(*hdr)) / sizeof(image_node) ||
+	size != sizeof(*hdr) + hdr->nnodes * sizeof(image_node) + hdr->strsize) {
+	reason = "bad size";
+	goto fail;
+    }
+    strtab = (char *)&inp[hdr->nnodes];
+    if (strtab[hdr->strsize - 1] != '\0') {
+	reason = "bad string table";
+	goto fail;
+    }
+    if (srcstamp(fname, &srcsize, &srchash) < 0 ||
+	srcsize != hdr->srcsize || srchash != hdr->srchash) {
+	reason = "out of date";
+	goto fail;
+    }
+
+    if ((node = (__pmnsNode *)calloc(hdr->nnodes, sizeof(*node))) == NULL ||
+	(tree = (__pmnsTree *)calloc(1, sizeof(*tree))) == NULL) {
+	reason = "out of memory";
+	goto fail;
+    }
+    for (i = 0; i < hdr->nnodes; i++) {
+	if (inp[i].name >= hdr->strsize ||
+	    (inp[i].first != 0 && (inp[i].first <= i || inp[i].first >= hdr->nnodes)) ||
+	    (inp[i].next != 0 && (inp[i].next <= i || inp[i].next >= hdr->nnodes))) {
+	    reason = "bad node";
+	    goto fail;
+	}
+	np = &node[i];
+	np->name = &strtab[inp[i].name];
+	np->pmid = inp[i].pmid;
+	np->first = inp[i].first != 0 ? &node[inp[i].first] : NULL;
+	np->next = inp[i].next != 0 ? &node[inp[i].next] : NULL;
+    }
+    /*
+     * Links only ever point forwards, so there are no cycles; now make
+     * sure every node other than the root has exactly one parent.
+     */
+    for (i = 0; i < hdr->nnodes; i++) {
+	for (np = node[i].first; np != NULL; np = np->next) {
+	    if (np->parent != NULL) {
+		reason = "bad tree";
+		goto fail;
+	    }
+	    np->parent = &node[i];
+	}
+    }
+    for (i = 1; i < hdr->nnodes; i++) {
+	if (node[i].parent == NULL) {
+	    reason = "bad tree";
+	    goto fail;
+	}
+    }
+
+    tree->root = node;
+    tree->mark_state = -1;
+    tree->image = base;
+    tree->imagesize = size;
+    if ((sts = __pmFixPMNSHashTab(tree, hdr->nleaves, dupok)) < 0) {
+	tree->image = NULL;
+	tree->root = NULL;
+	free(tree->htab);
+	free(tree->ctab);
+	reason = pmErrStr(sts);
+	goto fail;
+    }
+    if (pmDebugOptions.pmns)
+	fprintf(stderr, "__pmLoadPMNSImage(%s): %u nodes\n", imagename, hdr->nnodes);
+    *treep = tree;
+    return 0;
+
+fail:
+    if (pmDebugOptions.pmns)
+	fprintf(stderr, "__pmLoadPMNSImage(%s): not used, %s\n", imagename, reason);
+    free(tree);
+    free(node);
+    __pmMemoryUnmap(base, size);
+    return PM_ERR_PMNS;
+}
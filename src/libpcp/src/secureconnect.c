@@ -24,6 +24,9 @@
 #include <sslerr.h>
 #include <pk11pub.h>
 #include <sys/stat.h>
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
 #ifdef HAVE_SYS_TERMIOS_H
 #include <sys/termios.h>
 #endif
@@ -1613,13 +1616,27 @@ int
 __pmSocketReady(int fd, struct timeval *timeout)
 {
     __pmSecureSocket socket;
+#ifdef HAVE_POLL_H
+    struct pollfd onefd;
+    int msec = -1;
+#else
     __pmFdSet onefd;
+#endif
 
     if (__pmDataIPC(fd, &socket) == 0 && socket.sslFd)
         if (SSL_DataPending(socket.sslFd))
 	    return 1;	/* proceed without blocking */
 
+#ifdef HAVE_POLL_H
+    onefd.fd = fd;
+    onefd.events = POLLIN;
+    onefd.revents = 0;
+    if (timeout != NULL)
+	msec = timeout->tv_sec * 1000 + (timeout->tv_usec + 999) / 1000;
+    return poll(&onefd, 1, msec);
+#else
     FD_ZERO(&onefd);
     FD_SET(fd, &onefd);
     return select(fd+1, &onefd, NULL, NULL, timeout);
+#endif
 }
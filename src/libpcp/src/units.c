@@ -17,6 +17,7 @@
 #include <inttypes.h>
 #include <assert.h>
 #include <ctype.h>
+#include <limits.h>
 
 #if defined(HAVE_MATH_H)
 #include <math.h>
@@ -336,25 +337,19 @@ pmUnitsStr(const pmUnits *pu)
     return ubuf;
 }
 
-/* Scale conversion, based on value format, value type and scale */
-int
-pmConvScale(int type, const pmAtomValue * ival, const pmUnits * iunit, pmAtomValue * oval, const pmUnits * ounit)
+/*
+ * Integer multiplier and divisor to convert values in iunit to ounit,
+ * common to pmConvScale() and pmConvScaleFactor()
+ */
+static int
+convfactors(const pmUnits *iunit, const pmUnits *ounit, __int64_t *multp, __int64_t *divp)
 {
-    int sts;
     int k;
     __int64_t div, mult;
     __int64_t d, m;
-    char strbuf[80];
-
-    if (pmDebugOptions.value) {
-	fprintf(stderr, "pmConvScale: %s", pmAtomStr_r(ival, type, strbuf, sizeof(strbuf)));
-	fprintf(stderr, " [%s]", pmUnitsStr_r(iunit, strbuf, sizeof(strbuf)));
-    }
 
-    if (iunit->dimSpace != ounit->dimSpace || iunit->dimTime != ounit->dimTime || iunit->dimCount != ounit->dimCount) {
-	sts = PM_ERR_CONV;
-	goto bad;
-    }
+    if (iunit->dimSpace != ounit->dimSpace || iunit->dimTime != ounit->dimTime || iunit->dimCount != ounit->dimCount)
+	return PM_ERR_CONV;
 
     div = mult = 1;
 
@@ -384,8 +379,7 @@ pmConvScale(int type, const pmAtomValue * ival, const pmUnits * iunit, pmAtomVal
 		m = (__int64_t) 1024 *1024 * 1024 * 1024;
 		break;
 	    default:
-		sts = PM_ERR_UNIT;
-		goto bad;
+		return PM_ERR_UNIT;
 	}
 	switch (ounit->scaleSpace) {
 	    case PM_SPACE_BYTE:
@@ -410,8 +404,7 @@ pmConvScale(int type, const pmAtomValue * ival, const pmUnits * iunit, pmAtomVal
 		d *= (__int64_t) 1024 *1024 * 1024 * 1024;
 		break;
 	    default:
-		sts = PM_ERR_UNIT;
-		goto bad;
+		return PM_ERR_UNIT;
 	}
 	if (iunit->dimSpace > 0) {
 	    for (k = 0; k < iunit->dimSpace; k++) {
@@ -450,8 +443,7 @@ pmConvScale(int type, const pmAtomValue * ival, const pmUnits * iunit, pmAtomVal
 		m = 3600;
 		break;
 	    default:
-		sts = PM_ERR_UNIT;
-		goto bad;
+		return PM_ERR_UNIT;
 	}
 	switch (ounit->scaleTime) {
 	    case PM_TIME_NSEC:
@@ -473,8 +465,7 @@ pmConvScale(int type, const pmAtomValue * ival, const pmUnits * iunit, pmAtomVal
 		d *= 3600;
 		break;
 	    default:
-		sts = PM_ERR_UNIT;
-		goto bad;
+		return PM_ERR_UNIT;
 	}
 	if (iunit->dimTime > 0) {
 	    for (k = 0; k < iunit->dimTime; k++) {
@@ -532,6 +523,27 @@ pmConvScale(int type, const pmAtomValue * ival, const pmUnits * iunit, pmAtomVal
 	div = 1;
     }
 
+    *multp = mult;
+    *divp = div;
+    return 0;
+}
+
+/* Scale conversion, based on value format, value type and scale */
+int
+pmConvScale(int type, const pmAtomValue * ival, const pmUnits * iunit, pmAtomValue * oval, const pmUnits * ounit)
+{
+    int sts;
+    __int64_t div, mult;
+    char strbuf[80];
+
+    if (pmDebugOptions.value) {
+	fprintf(stderr, "pmConvScale: %s", pmAtomStr_r(ival, type, strbuf, sizeof(strbuf)));
+	fprintf(stderr, " [%s]", pmUnitsStr_r(iunit, strbuf, sizeof(strbuf)));
+    }
+
+    if ((sts = convfactors(iunit, ounit, &mult, &div)) < 0)
+	goto bad;
+
     switch (type) {
 	case PM_TYPE_32:
 	    oval->l = (__int32_t) ((ival->l * mult + div / 2) / div);
@@ -1058,6 +1070,243 @@ pmExtractValue(int valfmt, const pmValue * ival, int itype, pmAtomValue * oval,
     return sts;
 }
 
+/*
+ * The scale factor pmConvScale() applies to PM_TYPE_DOUBLE values,
+ * computed once so whole arrays of values can be converted with a
+ * multiply each, e.g. by pmExtractValueSet().
+ */
+int
+pmConvScaleFactor(const pmUnits *iunit, const pmUnits *ounit, double *factor)
+{
+    __int64_t	div, mult;
+    int		sts;
+
+    if ((sts = convfactors(iunit, ounit, &mult, &div)) < 0)
+	return sts;
+    *factor = (double)mult / (double)div;
+    return 0;
+}
+
+/*
+ * Batch variants of pmExtractValue() for all the values in a pmValueSet
+ * ... the type and encoding are checked once for the set, rather than
+ * for each value, and each loop below handles one input type so that
+ * the compiler is free to vectorize it.
+ *
+ * Returns the number of values, else an error if the set has an error
+ * code, more than maxvalues values, or any value that is not a valid
+ * encoding of type (in which case the caller may use pmExtractValue()
+ * for each value to find out which).
+ */
+static int
+checkvalueset(const pmValueSet *vsp, int type, int maxvalues)
+{
+    const pmValueBlock	*vbp;
+    int			i, len;
+
+    if (vsp->numval <= 0)
+	return vsp->numval;
+    if (vsp->numval > maxvalues)
+	return PM_ERR_TOOBIG;
+
+    switch (type) {
+	case PM_TYPE_32:
+	case PM_TYPE_U32:
+	    if (vsp->valfmt != PM_VAL_INSITU)
+		return PM_ERR_CONV;
+	    return vsp->numval;
+	case PM_TYPE_FLOAT:
+	    if (vsp->valfmt == PM_VAL_INSITU)	/* old style insitu encoding */
+		return vsp->numval;
+	    len = sizeof(float);
+	    break;
+	case PM_TYPE_64:
+	case PM_TYPE_U64:
+	case PM_TYPE_DOUBLE:
+	    if (vsp->valfmt == PM_VAL_INSITU)
+		return PM_ERR_CONV;
+	    len = sizeof(__int64_t);
+	    break;
+	default:
+	    return PM_ERR_CONV;
+    }
+    for (i = 0; i < vsp->numval; i++) {
+	vbp = vsp->vlist[i].value.pval;
+	if (vbp->vlen != PM_VAL_HDR_SIZE + len ||
+	    (vbp->vtype != type && vbp->vtype != 0))
+	    return PM_ERR_CONV;
+    }
+    return vsp->numval;
+}
+
+/*
+ * Extract numeric values as doubles, multiplied by factor (1.0, or from
+ * pmConvScaleFactor()), into values[], and if insts is not NULL their
+ * instance identifiers into insts[].
+ */
+int
+pmExtractValueSet(const pmValueSet *vsp, int type, double factor,
+		int *insts, double *values, int maxvalues)
+{
+    const pmValue	*vlist = vsp->vlist;
+    pmAtomValue		av;
+    int			i, n;
+
+    if ((n = checkvalueset(vsp, type, maxvalues)) <= 0)
+	return n;
+
+    switch (type) {
+	case PM_TYPE_32:
+	    for (i = 0; i < n; i++)
+		values[i] = (double)vlist[i].value.lval * factor;
+	    break;
+	case PM_TYPE_U32:
+	    for (i = 0; i < n; i++)
+		values[i] = (double)(__uint32_t)vlist[i].value.lval * factor;
+	    break;
+	case PM_TYPE_64:
+	    for (i = 0; i < n; i++) {
+		memcpy(&av.ll, vlist[i].value.pval->vbuf, sizeof(av.ll));
+		values[i] = (double)av.ll * factor;
+	    }
+	    break;
+	case PM_TYPE_U64:
+	    for (i = 0; i < n; i++) {
+		memcpy(&av.ull, vlist[i].value.pval->vbuf, sizeof(av.ull));
+		values[i] = (double)av.ull * factor;
+	    }
+	    break;
+	case PM_TYPE_FLOAT:
+	    if (vsp->valfmt == PM_VAL_INSITU) {
+		for (i = 0; i < n; i++) {
+		    av.l = vlist[i].value.lval;
+		    values[i] = (double)av.f * factor;
+		}
+	    }
+	    else {
+		for (i = 0; i < n; i++) {
+		    memcpy(&av.f, vlist[i].value.pval->vbuf, sizeof(av.f));
+		    values[i] = (double)av.f * factor;
+		}
+	    }
+	    break;
+	case PM_TYPE_DOUBLE:
+	    for (i = 0; i < n; i++) {
+		memcpy(&av.d, vlist[i].value.pval->vbuf, sizeof(av.d));
+		values[i] = av.d * factor;
+	    }
+	    break;
+    }
+    if (insts != NULL) {
+	for (i = 0; i < n; i++)
+	    insts[i] = vlist[i].inst;
+    }
+    return n;
+}
+
+/*
+ * Extract integer values as 64-bit integers, without the rounding of
+ * doubles ... PM_TYPE_U64 values keep their bit pattern, so those above
+ * the maximum __int64_t are negative, but differences between counter
+ * values are still exact (modulo 2^64).
+ */
+int
+pmExtractValueSet64(const pmValueSet *vsp, int type, int *insts,
+		__int64_t *values, int maxvalues)
+{
+    const pmValue	*vlist = vsp->vlist;
+    int			i, n;
+
+    if (type != PM_TYPE_32 && type != PM_TYPE_U32 &&
+	type != PM_TYPE_64 && type != PM_TYPE_U64)
+	return PM_ERR_CONV;
+    if ((n = checkvalueset(vsp, type, maxvalues)) <= 0)
+	return n;
+
+    switch (type) {
+	case PM_TYPE_32:
+	    for (i = 0; i < n; i++)
+		values[i] = vlist[i].value.lval;
+	    break;
+	case PM_TYPE_U32:
+	    for (i = 0; i < n; i++)
+		values[i] = (__uint32_t)vlist[i].value.lval;
+	    break;
+	case PM_TYPE_64:
+	case PM_TYPE_U64:
+	    for (i = 0; i < n; i++)
+		memcpy(&values[i], vlist[i].value.pval->vbuf, sizeof(values[i]));
+	    break;
+    }
+    if (insts != NULL) {
+	for (i = 0; i < n; i++)
+	    insts[i] = vlist[i].inst;
+    }
+    return n;
+}
+
+/*
+ * Rate conversion of n counter values (from pmExtractValueSet() with a
+ * factor of 1.0) in place, against the pn previous values interval
+ * seconds earlier, matching instances between insts[] and pinsts[].
+ * A decrease is counter wrap, corrected for the range of an integer
+ * type if wrap is set, else an error.  The rates are then multiplied by factor.
+ *
+ * Instances are usually in the same order each time, so each one is
+ * looked for first where the last match left off.  The status for each
+ * value (0, else PM_ERR_AGAIN for a new instance or PM_ERR_VALUE for
+ * a counter that went backwards) goes into stss[], and the number of
+ * rates computed is returned.
+ */
+int
+pmRateValues(int type, double interval, int wrap, double factor,
+		int n, const int *insts, double *values,
+		int pn, const int *pinsts, const double *pvalues, int *stss)
+{
+    double	range, delta;
+    int		i, j, k, count = 0;
+
+    switch (type) {
+	case PM_TYPE_32:
+	case PM_TYPE_U32:
+	    range = (double)UINT_MAX+1;
+	    break;
+	case PM_TYPE_64:
+	case PM_TYPE_U64:
+	    range = (double)ULONGLONG_MAX+1;
+	    break;
+	default:
+	    range = 0;
+	    break;
+    }
+
+    for (i = 0, j = 0; i < n; i++) {
+	for (k = 0; k < pn; k++, j++) {
+	    if (j >= pn)
+		j = 0;
+	    if (pinsts[j] == insts[i])
+		break;
+	}
+	if (k == pn) {
+	    stss[i] = PM_ERR_AGAIN;
+	    continue;
+	}
+	delta = values[i] - pvalues[j];
+	if (delta < 0.0) {
+	    if (!wrap) {
+		stss[i] = PM_ERR_VALUE;
+		continue;
+	    }
+	    delta += range;
+	}
+	values[i] = delta / interval * factor;
+	stss[i] = 0;
+	count++;
+	j++;
+    }
+    return count;
+}
+
 /*
  * An internal variant of pmUnits, but without the narrow bitfields.
  * That way, we can tolerate intermediate arithmetic that goes out of
@@ -33,6 +33,11 @@ PMCD_DATA char *pmcd_hostname;		/* Explicitly requested hostname */
 PMCD_DATA char *pmcd_labels;		/* Current set of context labels */
 
 PMCD_DATA unsigned pmcd_sighups;	/* Count of SIGHUPS responded to */
+PMCD_DATA __uint64_t pmcd_loop_iterations;	/* ClientLoop() wakeups */
+PMCD_DATA __uint64_t pmcd_loop_readyfds;	/* descriptors ready at wakeup */
+PMCD_DATA int	pmcd_cachetime;		/* Default agent cache window (msec) */
+PMCD_DATA __uint64_t pmcd_cache_hits;	/* Agent fetches answered from cache */
+PMCD_DATA __uint64_t pmcd_cache_misses;	/* Agent fetches not in cache */
 
 
 /*
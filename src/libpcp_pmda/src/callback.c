@@ -280,8 +280,8 @@ __pmdaMetricSearch(pmdaExt *pmda, pmID pmid, pmdaMetric *mbuf, e_ext_t *extp)
  * For DSO pmdas, the profiles are managed per client in DoProfile() and
  * DeleteClient() but sent to the pmda in SendFetch()
  *
- * For daemon pmdas, the profile is received from pmcd in __pmdaMainPDU
- * and the last received profile is held there
+ * For daemon pmdas, the profiles are received from pmcd in __pmdaMainPDU
+ * and held there for each client context
  */
 
 int
@@ -489,9 +489,201 @@ __pmdaEncodeStatus(pmResult *result, unsigned char byte)
 
 #define PMDA_STATUS_CHANGE (PMDA_EXT_LABEL_CHANGE|PMDA_EXT_NAMES_CHANGE)
 
+/*
+ * Report an error from a fetch callback, for one instance of a metric
+ * or (PM_IN_NULL) for all of them
+ */
+static void
+__pmdaFetchError(pmDesc *dp, int inst, int sts)
+{
+    char		strbuf[20];
+
+    pmIDStr_r(dp->pmid, strbuf, sizeof(strbuf));
+    if (sts == PM_ERR_PMID) {
+	pmNotifyErr(LOG_ERR, 
+	    "pmdaFetch: PMID %s not handled by fetch callback\n",
+		    strbuf);
+    }
+    else if (sts == PM_ERR_INST) {
+	if (pmDebugOptions.libpmda) {
+	    pmNotifyErr(LOG_ERR,
+		"pmdaFetch: Instance %d of PMID %s not handled by fetch callback\n",
+			inst, strbuf);
+	}
+    }
+    else if (sts == PM_ERR_VALUE ||
+	     sts == PM_ERR_APPVERSION ||
+	     sts == PM_ERR_PERMISSION ||
+	     sts == PM_ERR_AGAIN ||
+	     sts == PM_ERR_NYI) {
+	if (pmDebugOptions.libpmda) {
+	    pmNotifyErr(LOG_ERR,
+		 "pmdaFetch: Fetch callback error from metric PMID %s[%d]: %s\n",
+		    strbuf, inst, pmErrStr(sts));
+	}
+    }
+    else {
+	pmNotifyErr(LOG_ERR,
+	    "pmdaFetch: Fetch callback error from metric PMID %s[%d]: %s\n",
+		    strbuf, inst, pmErrStr(sts));
+    }
+}
+
+/*
+ * Free a PMDA_FETCH_DYNAMIC value after __pmStuffValue()
+ */
+static void
+__pmdaFetchFree(pmDesc *dp, pmAtomValue *atom)
+{
+    char		idbuf[20];
+    char		strbuf[20];
+
+    if (dp->type == PM_TYPE_STRING)
+	free(atom->cp);
+    else if (dp->type == PM_TYPE_AGGREGATE)
+	free(atom->vbp);
+    else {
+	pmNotifyErr(LOG_WARNING, "pmdaFetch: Attempt to free value for metric %s of wrong type %s\n",
+		    pmIDStr_r(dp->pmid, idbuf, sizeof(idbuf)),
+		    pmTypeStr_r(dp->type, strbuf, sizeof(strbuf)));
+    }
+}
+
+/*
+ * Make room for ninst values in the bulk fetch arrays
+ */
+static int
+__pmdaBulkAlloc(e_ext_t *extp, int ninst)
+{
+    unsigned int	*instp;
+    pmAtomValue		*atomp;
+    int			*statusp;
+    int			need;
+
+    if (ninst <= extp->bulkmaxinst)
+	return 0;
+    need = extp->bulkmaxinst ? extp->bulkmaxinst * 2 : 64;
+    while (need < ninst)
+	need *= 2;
+    if ((instp = realloc(extp->bulkinst, need * sizeof(*instp))) == NULL)
+	return -oserror();
+    extp->bulkinst = instp;
+    if ((atomp = realloc(extp->bulkatoms, need * sizeof(*atomp))) == NULL)
+	return -oserror();
+    extp->bulkatoms = atomp;
+    if ((statusp = realloc(extp->bulkstatus, need * sizeof(*statusp))) == NULL)
+	return -oserror();
+    extp->bulkstatus = statusp;
+    extp->bulkmaxinst = need;
+    return 0;
+}
+
+/*
+ * Build the list of instances in the profile for a bulk fetch callback.
+ * This is done once for each instance domain in a pmdaFetch() call,
+ * rather than once for each metric.
+ */
+static int
+__pmdaBulkInst(pmInDom indom, pmdaExt *pmda, e_ext_t *extp)
+{
+    int			inst, sts;
+
+    if (indom == PM_INDOM_NULL) {
+	if ((sts = __pmdaBulkAlloc(extp, 1)) < 0)
+	    return sts;
+	extp->bulkindom = PM_INDOM_NULL;
+	extp->bulkinst[0] = PM_IN_NULL;
+	return 1;
+    }
+    if (indom == extp->bulkindom)
+	return extp->bulkninst;
+
+    extp->bulkindom = PM_INDOM_NULL;
+    extp->bulkninst = 0;
+    __pmdaStartInst(indom, pmda);
+    while (__pmdaNextInst(&inst, pmda)) {
+	if ((sts = __pmdaBulkAlloc(extp, extp->bulkninst + 1)) < 0)
+	    return sts;
+	extp->bulkinst[extp->bulkninst++] = inst;
+    }
+    extp->bulkindom = indom;
+    return extp->bulkninst;
+}
+
+/*
+ * Fill in the pmValueSet for one metric from the bulk fetch callback.
+ * Returns PM_ERR_NYI if the callback does not handle this metric, so
+ * the per-instance fetch callback should be used instead.
+ */
+static int
+__pmdaFetchBulk(pmdaMetric *metap, pmdaExt *pmda, e_ext_t *extp, pmValueSet **vsetp)
+{
+    pmDesc		*dp = &metap->m_desc;
+    pmValueSet		*vset;
+    pmAtomValue		*atomp;
+    char		idbuf[20];
+    char		strbuf[20];
+    int			ninst, numval;
+    int			j, k, sts, lsts;
+
+    if ((ninst = __pmdaBulkInst(dp->indom, pmda, extp)) < 0)
+	return ninst;
+    if (ninst == 0)
+	sts = numval = 0;
+    else {
+	memset(extp->bulkstatus, 0, ninst * sizeof(int));
+	sts = (*(extp->bulkCallBack))(metap, ninst, extp->bulkinst,
+					extp->bulkatoms, extp->bulkstatus);
+	if (sts == PM_ERR_NYI)
+	    return sts;
+	numval = sts < 0 ? sts : ninst;
+    }
+
+    if (numval >= 1)
+	vset = (pmValueSet *)malloc(sizeof(pmValueSet) + (numval - 1)*sizeof(pmValue));
+    else
+	vset = (pmValueSet *)malloc(sizeof(pmValueSet) - sizeof(pmValue));
+    if ((*vsetp = vset) == NULL)
+	return -oserror();
+    vset->pmid = dp->pmid;
+    vset->numval = numval;
+    vset->valfmt = PM_VAL_INSITU;
+    if (numval <= 0) {
+	if (numval < 0)
+	    __pmdaFetchError(dp, PM_IN_NULL, numval);
+	return 0;
+    }
+
+    for (j = k = 0; k < ninst; k++) {
+	atomp = &extp->bulkatoms[k];
+	if ((sts = extp->bulkstatus[k]) < 0) {
+	    __pmdaFetchError(dp, extp->bulkinst[k], sts);
+	    continue;
+	}
+	if (sts == PMDA_FETCH_NOVALUES)
+	    continue;
+	vset->vlist[j].inst = extp->bulkinst[k];
+	if ((lsts = __pmStuffValue(atomp, &vset->vlist[j], dp->type)) == PM_ERR_TYPE) {
+	    pmNotifyErr(LOG_ERR, "pmdaFetch: Descriptor type (%s) for metric %s is bad",
+			pmTypeStr_r(dp->type, strbuf, sizeof(strbuf)),
+			pmIDStr_r(dp->pmid, idbuf, sizeof(idbuf)));
+	}
+	else if (lsts >= 0) {
+	    vset->valfmt = lsts;
+	    j++;
+	}
+	if (sts == PMDA_FETCH_DYNAMIC)
+	    __pmdaFetchFree(dp, atomp);
+	if (lsts < 0)
+	    sts = lsts;
+    }
+    vset->numval = j ? j : sts;
+    return 0;
+}
+
 /*
  * Resize the pmResult and call the e_callback for each metric instance
- * required in the profile.
+ * required in the profile, or the bulk callback once for each metric.
  */
 
 int
@@ -555,6 +747,9 @@ pmdaFetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
     }
     __pmdaEncodeStatus(extp->res, flags);
 
+    /* instances in the profile may have changed since the last fetch */
+    extp->bulkindom = PM_INDOM_NULL;
+
     /* Look up the pmDesc for the incoming pmids in our pmdaMetrics tables,
        if present.  Fall back to .desc callback if not found (for highly
        dynamic pmdas). */
@@ -565,6 +760,13 @@ pmdaFetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 	 * will be zero
 	 */
 	dp = &(metap->m_desc);
+	if (dp->pmid != 0 && extp->bulkCallBack != NULL) {
+	    sts = __pmdaFetchBulk(metap, pmda, extp, &extp->res->vset[i]);
+	    if (sts == 0)
+		continue;
+	    if (sts != PM_ERR_NYI)
+		goto error;
+	}
 	if (dp->pmid != 0)
 	    numval = __pmdaCountInst(dp, pmda);
 	else {
@@ -619,35 +821,7 @@ pmdaFetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 	    vset->vlist[j].inst = inst;
 
 	    if ((sts = (*(pmda->e_fetchCallBack))(metap, inst, &atom)) < 0) {
-		pmIDStr_r(dp->pmid, strbuf, sizeof(strbuf));
-		if (sts == PM_ERR_PMID) {
-		    pmNotifyErr(LOG_ERR, 
-		        "pmdaFetch: PMID %s not handled by fetch callback\n",
-				strbuf);
-		}
-		else if (sts == PM_ERR_INST) {
-		    if (pmDebugOptions.libpmda) {
-			pmNotifyErr(LOG_ERR,
-			    "pmdaFetch: Instance %d of PMID %s not handled by fetch callback\n",
-				    inst, strbuf);
-		    }
-		}
-		else if (sts == PM_ERR_VALUE ||
-			 sts == PM_ERR_APPVERSION ||
-			 sts == PM_ERR_PERMISSION ||
-			 sts == PM_ERR_AGAIN ||
-			 sts == PM_ERR_NYI) {
-		    if (pmDebugOptions.libpmda) {
-			pmNotifyErr(LOG_ERR,
-			     "pmdaFetch: Fetch callback error from metric PMID %s[%d]: %s\n",
-				strbuf, inst, pmErrStr(sts));
-		    }
-		}
-		else {
-		    pmNotifyErr(LOG_ERR,
-			"pmdaFetch: Fetch callback error from metric PMID %s[%d]: %s\n",
-				strbuf, inst, pmErrStr(sts));
-		}
+		__pmdaFetchError(dp, inst, sts);
 	    }
 	    else {
 		/*
@@ -673,17 +847,8 @@ pmdaFetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 			vset->valfmt = lsts;
 			j++;
 		    }
-		    if (version >= PMDA_INTERFACE_5 && sts == PMDA_FETCH_DYNAMIC) {
-			if (type == PM_TYPE_STRING)
-			    free(atom.cp);
-			else if (type == PM_TYPE_AGGREGATE)
-			    free(atom.vbp);
-			else {
-			    pmNotifyErr(LOG_WARNING, "pmdaFetch: Attempt to free value for metric %s of wrong type %s\n",
-					pmIDStr_r(dp->pmid, idbuf, sizeof(idbuf)),
-					pmTypeStr_r(type, strbuf, sizeof(strbuf)));
-			}
-		    }
+		    if (version >= PMDA_INTERFACE_5 && sts == PMDA_FETCH_DYNAMIC)
+			__pmdaFetchFree(dp, &atom);
 		    if (lsts < 0)
 			sts = lsts;
 		}
@@ -23,6 +23,7 @@
 #define HAVE_ANY(interface)	((interface) <= PMDA_INTERFACE_7 && HAVE_V_TWO(interface))
 
 struct dynamic;
+struct snapshot;
 
 /*
  * Auxilliary structure used to save data from pmdaDSO or pmdaDaemon and
@@ -37,6 +38,14 @@ typedef struct {
     int			ndynamics;	/* number of dynamics entries, below */
     struct dynamic	*dynamics;	/* dynamic metric manipulation table */
     void		*privdata;	/* private (user) data for this PMDA */
+    struct snapshot	*snapshot;	/* background refresh, see snapshot.c */
+    pmdaFetchBulkCallBack bulkCallBack;	/* all instances of a metric at once */
+    pmInDom		bulkindom;	/* indom of bulkinst[], or PM_INDOM_NULL */
+    int			bulkninst;	/* instances of bulkindom in the profile */
+    int			bulkmaxinst;	/* allocated size of the bulk arrays */
+    unsigned int	*bulkinst;	/* instances passed to bulkCallBack */
+    pmAtomValue		*bulkatoms;	/* values returned by bulkCallBack */
+    int			*bulkstatus;	/* status of each value */
 } e_ext_t;
 
 /*
@@ -44,6 +53,18 @@ typedef struct {
  */
 extern __uint32_t hash(const signed char *, int, __uint32_t);
 
+/*
+ * Background refresh of metric values (pmdaSetSnapshot), for the
+ * PDU processing in mainloop.c
+ */
+extern void __pmdaSnapshotStart(pmdaExt *);
+extern void __pmdaSnapshotLock(pmdaExt *);
+extern void __pmdaSnapshotUnlock(pmdaExt *);
+extern int __pmdaSnapshotFetch(pmdaExt *, int, pmProfile *, int, pmID *, pmResult **);
+extern void __pmdaSnapshotRelease(pmdaExt *);
+extern void __pmdaSnapshotAttribute(pmdaExt *, int, int);
+extern void __pmdaSnapshotEndContext(pmdaExt *, int);
+
 /*
  * These ones escaped via the exports file, but are only used within
  * the libpcp_pmda library, so pull the definitions back from <pcp/pmda.h>
@@ -29,6 +29,180 @@ __pmdaInFd(pmdaInterface *dispatch)
     return -1;
 }
 
+/*
+ * Profiles received from pmcd are kept for each client context, keyed
+ * by the client (PDU from field) and context slot.  pmcd only sends the
+ * profile for a client context when it changes (PDU_FLAG_PROFILES) and
+ * the matching profile is installed before each fetch.
+ */
+typedef struct ctxprofile {
+    struct ctxprofile	*next;
+    int			ctxnum;
+    pmProfile		*profile;
+} ctxprofile_t;
+
+static __pmHashCtl	ctxprofiles;	/* ctxprofile_t lists, by client */
+static pmProfile	*curprofile;	/* profile last installed */
+static pmProfile	*orphan;	/* installed, but client has gone */
+
+static ctxprofile_t *
+profile_lookup(int client, int ctxnum)
+{
+    __pmHashNode	*hp;
+    ctxprofile_t	*cpp;
+
+    if ((hp = __pmHashSearch(client, &ctxprofiles)) == NULL)
+	return NULL;
+    for (cpp = (ctxprofile_t *)hp->data; cpp != NULL; cpp = cpp->next)
+	if (cpp->ctxnum == ctxnum)
+	    return cpp;
+    return NULL;
+}
+
+static int
+profile_install(pmdaInterface *dispatch, pmProfile *profile)
+{
+    int			sts;
+
+    if (profile == curprofile)
+	return 0;
+    if ((sts = dispatch->version.any.profile(profile,
+				dispatch->version.any.ext)) < 0)
+	return sts;
+    curprofile = profile;
+    if (orphan != NULL) {
+	__pmFreeProfile(orphan);
+	orphan = NULL;
+    }
+    return 0;
+}
+
+/* New profile for a client context, the table takes it over */
+static void
+profile_save(int client, int ctxnum, pmProfile *profile)
+{
+    __pmHashNode	*hp;
+    ctxprofile_t	*cpp;
+
+    if ((cpp = profile_lookup(client, ctxnum)) != NULL) {
+	if (cpp->profile == curprofile)
+	    orphan = cpp->profile;
+	else
+	    __pmFreeProfile(cpp->profile);
+	cpp->profile = profile;
+	return;
+    }
+    if ((cpp = (ctxprofile_t *)malloc(sizeof(*cpp))) == NULL) {
+	pmNoMem("profile_save", sizeof(*cpp), PM_FATAL_ERR);
+	/*NOTREACHED*/
+    }
+    cpp->ctxnum = ctxnum;
+    cpp->profile = profile;
+    if ((hp = __pmHashSearch(client, &ctxprofiles)) != NULL) {
+	cpp->next = (ctxprofile_t *)hp->data;
+	hp->data = (void *)cpp;
+    }
+    else {
+	cpp->next = NULL;
+	if (__pmHashAdd(client, (void *)cpp, &ctxprofiles) < 0) {
+	    pmNoMem("profile_save", sizeof(__pmHashNode), PM_FATAL_ERR);
+	    /*NOTREACHED*/
+	}
+    }
+}
+
+/* Client has gone, discard the profiles for all of its contexts */
+static void
+profile_drop(int client)
+{
+    __pmHashNode	*hp;
+    ctxprofile_t	*cpp, *next;
+    void		*head;
+
+    if ((hp = __pmHashSearch(client, &ctxprofiles)) == NULL)
+	return;
+    head = hp->data;
+    for (cpp = (ctxprofile_t *)head; cpp != NULL; cpp = next) {
+	next = cpp->next;
+	if (cpp->profile == curprofile)
+	    orphan = cpp->profile;
+	else
+	    __pmFreeProfile(cpp->profile);
+	free(cpp);
+    }
+    __pmHashDel(client, head, &ctxprofiles);
+}
+
+/*
+ * Fetch for a PMDA with background refresh (pmdaSetSnapshot), values
+ * come from the latest snapshot where possible and any others from
+ * the PMDA itself.  Returns 0 if the fetch has been answered, else
+ * the PDU must be processed in the usual way.
+ */
+static int
+snapshot_fetch(pmdaInterface *dispatch, __pmPDU *pb, int from)
+{
+    pmdaExt		*pmda = dispatch->version.any.ext;
+    pmResult		*result;
+    pmResult		*rest;
+    pmProfile		*profile;
+    ctxprofile_t	*cpp;
+    pmTimeval		when;
+    pmID		*pmidlist;
+    pmID		*restlist;
+    int			npmids;
+    int			nrest;
+    int			ctxnum;
+    int			i, j, sts;
+
+    if ((sts = __pmDecodeFetch(pb, &ctxnum, &when, &npmids, &pmidlist)) < 0)
+	return sts;
+    cpp = profile_lookup(from, ctxnum);
+    profile = cpp ? cpp->profile : curprofile;
+    if ((nrest = __pmdaSnapshotFetch(pmda, from, profile, npmids, pmidlist, &result)) < 0) {
+	/* decoded in place, so undo that for the usual processing */
+	for (i = 0; i < npmids; i++)
+	    pmidlist[i] = htonl(pmidlist[i]);
+	__pmUnpinPDUBuf(pmidlist);
+	return nrest;
+    }
+
+    if (nrest == 0)
+	__pmSendResult(pmda->e_outfd, FROM_ANON, result);
+    else {
+	/* fetch the rest from the PMDA, as for any other PDU */
+	if ((restlist = (pmID *)malloc(nrest * sizeof(pmID))) == NULL)
+	    sts = -oserror();
+	else {
+	    for (i = j = 0; i < npmids; i++)
+		if (result->vset[i] == NULL)
+		    restlist[j++] = pmidlist[i];
+	    __pmdaSnapshotLock(pmda);
+	    if (HAVE_V_FIVE(dispatch->comm.pmda_interface))
+		dispatch->version.four.ext->e_context = from;
+	    if ((sts = profile_install(dispatch, profile)) >= 0)
+		sts = dispatch->version.any.fetch(nrest, restlist, &rest, pmda);
+	    if (sts >= 0) {
+		for (i = j = 0; i < npmids; i++)
+		    if (result->vset[i] == NULL)
+			result->vset[i] = rest->vset[j++];
+		/* PMDA status flags, see __pmdaEncodeStatus() */
+		*(unsigned char *)&result->timestamp |= *(unsigned char *)&rest->timestamp;
+		__pmSendResult(pmda->e_outfd, FROM_ANON, result);
+		if (pmda->e_resultCallBack != NULL)
+		    pmda->e_resultCallBack(rest);
+	    }
+	    __pmdaSnapshotUnlock(pmda);
+	    free(restlist);
+	}
+	if (sts < 0)
+	    __pmSendError(pmda->e_outfd, FROM_ANON, sts);
+    }
+    __pmdaSnapshotRelease(pmda);
+    __pmUnpinPDUBuf(pmidlist);
+    return 0;
+}
+
 int
 __pmdaMainPDU(pmdaInterface *dispatch)
 {
@@ -57,9 +231,11 @@ __pmdaMainPDU(pmdaInterface *dispatch)
     pmLabelSet		*labels = NULL;
     char		*buffer;
     pmProfile  		*new_profile;
-    static pmProfile	*profile = NULL;
+    ctxprofile_t	*cpp;
+    int			from;
     static int		first_time = 1;
     static pmdaExt	*pmda = NULL;
+    static int		snapshot;
     int			pinpdu;
 
     /* Initial version checks */
@@ -75,6 +251,10 @@ __pmdaMainPDU(pmdaInterface *dispatch)
 	}
 	pmda = dispatch->version.any.ext;
 	dispatch->comm.pmapi_version = PMAPI_VERSION;
+	if (((e_ext_t *)pmda->e_ext)->snapshot != NULL) {
+	    __pmdaSnapshotStart(pmda);
+	    snapshot = 1;
+	}
 	first_time = 0;
     }
 
@@ -90,11 +270,25 @@ __pmdaMainPDU(pmdaInterface *dispatch)
 	return sts;
     }
 
+    /* ntohl() converted already in __pmGetPDU() */
+    from = ((__pmPDUHdr *)pb)->from;
+
+    /*
+     * With background refresh, fetches are answered from the snapshot
+     * where possible, and everything else waits for any refresh that
+     * is calling into the PMDA to finish.
+     */
+    if (snapshot) {
+	if (sts == PDU_FETCH && snapshot_fetch(dispatch, pb, from) == 0) {
+	    __pmUnpinPDUBuf(pb);
+	    return 0;
+	}
+	__pmdaSnapshotLock(pmda);
+    }
+
     if (HAVE_V_FIVE(dispatch->comm.pmda_interface)) {
 	/* set up sender context */
-	__pmPDUHdr	*php = (__pmPDUHdr *)pb;
-	/* ntohl() converted already in __pmGetPDU() */
-	dispatch->version.four.ext->e_context = php->from;
+	dispatch->version.four.ext->e_context = from;
     }
 
     /*
@@ -106,7 +300,13 @@ __pmdaMainPDU(pmdaInterface *dispatch)
 	    if (sts != PDU_PROFILE && sts != PDU_ATTR)
 		/* all other PDUs expect an ACK */
 		__pmSendError(pmda->e_outfd, FROM_ANON, op_sts);
+	    else if (sts == PDU_PROFILE &&
+		     __pmDecodeProfile(pb, &ctxnum, &new_profile) >= 0)
+		/* pmcd will not send it again, keep for later fetches */
+		profile_save(from, ctxnum, new_profile);
 	    __pmUnpinPDUBuf(pb);
+	    if (snapshot)
+		__pmdaSnapshotUnlock(pmda);
 	    return 0;
 	}
     }
@@ -120,6 +320,9 @@ __pmdaMainPDU(pmdaInterface *dispatch)
 	 */
 	if (__pmDecodeError(pb, &op_sts) >= 0) {
 	    if (op_sts == PM_ERR_NOTCONN) {
+		profile_drop(from);
+		if (snapshot)
+		    __pmdaSnapshotEndContext(pmda, from);
 		if (HAVE_V_FIVE(dispatch->comm.pmda_interface)) {
 		    if (pmDebugOptions.context)
 			pmNotifyErr(LOG_DEBUG, "Received PDU_ERROR (end context %d)\n", dispatch->version.four.ext->e_context);
@@ -140,20 +343,17 @@ __pmdaMainPDU(pmdaInterface *dispatch)
 	    pmNotifyErr(LOG_DEBUG, "Received PDU_PROFILE\n");
 
 	/*
-	 * can ignore ctxnum, since pmcd has already used this to send
-	 * the correct profile, if required
-	 * Free last profile received (if any)
+	 * Keep the profile for this client context, and install it now
+	 * for PMDAs (and older pmcd) expecting a fetch to use the last
+	 * profile sent.
 	 * Note error responses are not sent for PDU_PROFILE
 	 */
 	if (__pmDecodeProfile(pb, &ctxnum, &new_profile) < 0) 
 	   break;
-	sts = dispatch->version.any.profile(new_profile, pmda);
-	if (sts < 0) {
+	if (profile_install(dispatch, new_profile) < 0)
 	    __pmFreeProfile(new_profile);
-	} else {
-	    __pmFreeProfile(profile);
-	    profile = new_profile;
-	}
+	else
+	    profile_save(from, ctxnum, new_profile);
 	break;
 
     case PDU_FETCH:
@@ -161,12 +361,15 @@ __pmdaMainPDU(pmdaInterface *dispatch)
 	    pmNotifyErr(LOG_DEBUG, "Received PDU_FETCH\n");
 
 	/*
-	 * can ignore ctxnum, since pmcd has already used this to send
-	 * the correct profile, if required
+	 * pmcd may not have sent the profile for this client context
+	 * again if it was not the last one, so install the saved copy
 	 */
 	sts = __pmDecodeFetch(pb, &ctxnum, &when, &npmids, &pmidlist);
 	if (sts >= 0) {
-	    sts = dispatch->version.any.fetch(npmids, pmidlist, &result, pmda);
+	    if ((cpp = profile_lookup(from, ctxnum)) != NULL)
+		sts = profile_install(dispatch, cpp->profile);
+	    if (sts >= 0)
+		sts = dispatch->version.any.fetch(npmids, pmidlist, &result, pmda);
 	    __pmUnpinPDUBuf(pmidlist);
 	}
 	if (sts < 0) {
@@ -361,6 +564,8 @@ __pmdaMainPDU(pmdaInterface *dispatch)
 	if (!HAVE_V_SIX(dispatch->comm.pmda_interface))
 	    break;
 	ctxnum = dispatch->version.six.ext->e_context;
+	if (snapshot)
+	    __pmdaSnapshotAttribute(pmda, ctxnum, subtype);
 	if ((sts = dispatch->version.six.attribute(ctxnum, subtype, buffer, length, pmda)) < 0)
 	    /* Note error responses are not sent for PDU_ATTR */
 	    pmNotifyErr(LOG_ERR, "%s: Failed to set attribute: %s\n",
@@ -386,6 +591,8 @@ __pmdaMainPDU(pmdaInterface *dispatch)
     if (pmda->e_doneCallBack != NULL)
 	(*(pmda->e_doneCallBack))();
 
+    if (snapshot)
+	__pmdaSnapshotUnlock(pmda);
     return 0;
 }
 
@@ -435,6 +642,18 @@ pmdaSetFetchCallBack(pmdaInterface *dispatch, pmdaFetchCallBack callback)
     }
 }
 
+void
+pmdaSetFetchBulkCallBack(pmdaInterface *dispatch, pmdaFetchBulkCallBack callback)
+{
+    if (HAVE_V_FIVE(dispatch->comm.pmda_interface))
+	((e_ext_t *)dispatch->version.any.ext->e_ext)->bulkCallBack = callback;
+    else {
+	pmNotifyErr(LOG_CRIT, "Unable to set bulk fetch callback for PMDA interface version %d.",
+		     dispatch->comm.pmda_interface);
+	dispatch->status = PM_ERR_GENERIC;
+    }
+}
+
 void
 pmdaSetCheckCallBack(pmdaInterface *dispatch, pmdaCheckCallBack callback)
 {
@@ -1023,6 +1023,9 @@ pmdaDaemon(pmdaInterface *dispatch, int version, const char *name, int domain,
     if (dispatch->status < 0)
 	return;
 
+    /* __pmdaMainPDU() keeps the profile of every client context */
+    dispatch->comm.flags |= PMDA_FLAG_PROFILES;
+
     pmda = dispatch->version.any.ext;
     pmda->e_logfile = (logfile == NULL ? NULL : strdup(logfile));
     pmda->e_helptext = (helptext == NULL ? NULL : strdup(helptext));
@@ -0,0 +1,539 @@
+/*
+ * Copyright (c) 2020 Red Hat.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+/*
+ * Background refresh for daemon PMDAs (pmdaSetSnapshot).
+ *
+ * A refresh thread calls the PMDA's fetch method every interval for
+ * all the metrics in the clusters that clients have recently asked
+ * for, with no instance profile, and publishes the values as the new
+ * front snapshot.  __pmdaMainPDU() answers fetches from the front
+ * snapshot, filtered by the client's profile, without calling into
+ * the PMDA at all; only metrics that are not in the snapshot are
+ * fetched from the PMDA while the client waits.
+ *
+ * pmdalock serialises every call into the PMDA between the refresh
+ * thread and the PDU processing in the main thread.  lock protects
+ * the front snapshot and the cluster usage, and is only ever held
+ * briefly, so a fetch never waits for a refresh to finish.
+ */
+
+#include "pmapi.h"
+#include "libpcp.h"
+#include "pmda.h"
+#include "libdefs.h"
+
+#ifdef PM_MULTI_THREAD
+
+#define SNAP_NCLUSTERS	(1 << 12)	/* size of the pmID cluster field */
+#define SNAP_IDLE	10		/* refreshes before an unused cluster is dropped */
+
+/*
+ * The values from one refresh.  The pmValueSets are those returned by
+ * the PMDA's fetch method, and are released with its result callback.
+ */
+typedef struct snapvals {
+    struct snapvals	*next;		/* retired, waiting for readers */
+    int			refcnt;		/* fetch replies being sent */
+    unsigned char	status;		/* PMDA status flags from the fetch */
+    pmResult		*result;
+    pmInDom		*indoms;	/* instance domain of each vset */
+    __pmOHashCtl	pmids;		/* pmID -> &indoms[index in vset] */
+} snapvals_t;
+
+typedef struct snapshot {
+    pmdaInterface	*dispatch;
+    struct timeval	interval;
+    pthread_t		thread;
+    int			started;
+    pthread_mutex_t	pmdalock;	/* calls into the PMDA */
+    pthread_mutex_t	lock;		/* everything from here down */
+    pthread_cond_t	wakeup;		/* clusters newly wanted */
+    int			wanted;
+    unsigned int	refreshes;
+    unsigned int	used[SNAP_NCLUSTERS];	/* refreshes+1 when last fetched */
+    unsigned char	eligible[SNAP_NCLUSTERS];
+    unsigned char	status;		/* PMDA status flags not yet sent */
+    snapvals_t		*front;		/* latest values, or NULL */
+    snapvals_t		*retired;	/* older values, still being sent */
+    /* main thread only */
+    __pmHashCtl		containers;	/* client contexts in a container */
+    snapvals_t		*sending;	/* values in the current reply */
+    pmResult		*reply;
+    int			maxreply;
+    char		*buf;		/* profile filtered vsets */
+    size_t		bufsize;
+} snapshot_t;
+
+static int
+snapshot_enabled(snapshot_t *sp, unsigned int cluster)
+{
+    return sp->used[cluster] != 0 &&
+	   sp->refreshes - sp->used[cluster] + 1 < SNAP_IDLE;
+}
+
+static void
+snapvals_free(pmdaExt *pmda, snapvals_t *svp)
+{
+    if (svp->result != NULL) {
+	if (pmda->e_resultCallBack != NULL)
+	    pmda->e_resultCallBack(svp->result);
+	free(svp->result);
+    }
+    free(svp->indoms);
+    __pmOHashClear(&svp->pmids);
+    free(svp);
+}
+
+/*
+ * Fetch all of the metrics in pmidlist from the PMDA, with pmdalock
+ * held.  The pmValueSets are taken over from the PMDA's result, which
+ * pmdaFetch() reuses for its next call.
+ */
+static snapvals_t *
+snapshot_sample(snapshot_t *sp, pmdaExt *pmda, int npmids, pmID *pmidlist,
+		pmInDom *indomlist)
+{
+    e_ext_t		*extp = (e_ext_t *)pmda->e_ext;
+    snapvals_t		*svp;
+    pmResult		*res;
+    pmProfile		*profile;
+    int			context;
+    int			i, sts;
+
+    /* all instances, and not on behalf of any client context */
+    profile = pmda->e_prof;
+    context = pmda->e_context;
+    pmda->e_prof = NULL;
+    pmda->e_context = -1;
+    sts = sp->dispatch->version.any.fetch(npmids, pmidlist, &res, pmda);
+    pmda->e_prof = profile;
+    pmda->e_context = context;
+    if (sts < 0) {
+	if (pmDebugOptions.libpmda)
+	    pmNotifyErr(LOG_DEBUG, "snapshot: fetch of %d metrics failed: %s\n",
+			npmids, pmErrStr(sts));
+	return NULL;
+    }
+    if (res != extp->res) {
+	/* values not from pmdaFetch(), so we cannot keep them */
+	pmNotifyErr(LOG_WARNING, "%s: background refresh needs pmdaFetch, disabled\n",
+			pmda->e_name);
+	if (pmda->e_resultCallBack != NULL)
+	    pmda->e_resultCallBack(res);
+	return NULL;
+    }
+
+    if ((svp = (snapvals_t *)calloc(1, sizeof(*svp))) == NULL ||
+	(svp->result = (pmResult *)malloc(sizeof(pmResult) +
+			(res->numpmid - 1) * sizeof(pmValueSet *))) == NULL ||
+	(svp->indoms = (pmInDom *)malloc(res->numpmid * sizeof(pmInDom))) == NULL) {
+	if (svp != NULL) {
+	    free(svp->result);
+	    free(svp);
+	}
+	if (pmda->e_resultCallBack != NULL)
+	    pmda->e_resultCallBack(res);
+	return NULL;
+    }
+    svp->result->numpmid = res->numpmid;
+    svp->result->timestamp = res->timestamp;
+    memcpy(svp->result->vset, res->vset, res->numpmid * sizeof(pmValueSet *));
+    /* first byte of the timestamp, see __pmdaEncodeStatus() */
+    svp->status = *(unsigned char *)&res->timestamp;
+
+    __pmOHashInit(&svp->pmids);
+    __pmOHashPreAlloc(res->numpmid, &svp->pmids);
+    memcpy(svp->indoms, indomlist, res->numpmid * sizeof(pmInDom));
+    for (i = 0; i < res->numpmid; i++) {
+	if (__pmOHashAdd(res->vset[i]->pmid, &svp->indoms[i], &svp->pmids) < 0) {
+	    snapvals_free(pmda, svp);
+	    return NULL;
+	}
+    }
+    return svp;
+}
+
+static void *
+snapshot_refresh(void *arg)
+{
+    snapshot_t		*sp = (snapshot_t *)arg;
+    pmdaExt		*pmda = sp->dispatch->version.any.ext;
+    snapvals_t		*svp, *dead, *next, **svpp;
+    unsigned char	enabled[SNAP_NCLUSTERS];
+    struct timeval	now, due;
+    struct timespec	deadline;
+    pmID		*pmidlist = NULL;
+    pmInDom		*indomlist = NULL;
+    pmDesc		*dp;
+    unsigned int	cluster;
+    int			maxpmids = 0;
+    int			npmids, nenabled, timedout, i;
+
+    pmtimevalNow(&due);
+    pthread_mutex_lock(&sp->lock);
+    for ( ; ; ) {
+	/* wait for the next refresh, or for clusters that are newly wanted */
+	for (timedout = 0; ; ) {
+	    for (nenabled = cluster = 0; cluster < SNAP_NCLUSTERS; cluster++)
+		nenabled += (enabled[cluster] = snapshot_enabled(sp, cluster));
+	    if (sp->wanted)
+		break;
+	    if (nenabled == 0) {
+		if (sp->front != NULL)
+		    break;	/* all idle, drop the values */
+		pthread_cond_wait(&sp->wakeup, &sp->lock);
+		continue;
+	    }
+	    deadline.tv_sec = due.tv_sec;
+	    deadline.tv_nsec = due.tv_usec * 1000;
+	    if (pthread_cond_timedwait(&sp->wakeup, &sp->lock, &deadline) == ETIMEDOUT) {
+		timedout = 1;
+		break;
+	    }
+	}
+	sp->wanted = 0;
+	/* values no longer being sent */
+	dead = NULL;
+	for (svpp = &sp->retired; (svp = *svpp) != NULL; ) {
+	    if (svp->refcnt == 0) {
+		*svpp = svp->next;
+		svp->next = dead;
+		dead = svp;
+	    }
+	    else
+		svpp = &svp->next;
+	}
+	pthread_mutex_unlock(&sp->lock);
+
+	pmtimevalNow(&now);
+	if (timedout)
+	    pmtimevalInc(&due, &sp->interval);
+	if (pmtimevalSub(&due, &now) <= 0) {
+	    /* running late or was idle, start afresh from now */
+	    due = now;
+	    pmtimevalInc(&due, &sp->interval);
+	}
+
+	pthread_mutex_lock(&sp->pmdalock);
+	for (svp = dead; svp != NULL; svp = next) {
+	    next = svp->next;
+	    snapvals_free(pmda, svp);
+	}
+	svp = NULL;
+	if (nenabled > 0) {
+	    if (pmda->e_nmetrics > maxpmids) {
+		free(pmidlist);
+		free(indomlist);
+		maxpmids = pmda->e_nmetrics;
+		pmidlist = (pmID *)malloc(maxpmids * sizeof(pmID));
+		indomlist = (pmInDom *)malloc(maxpmids * sizeof(pmInDom));
+		if (pmidlist == NULL || indomlist == NULL)
+		    maxpmids = 0;
+	    }
+	    for (npmids = i = 0; i < maxpmids && i < pmda->e_nmetrics; i++) {
+		dp = &pmda->e_metrics[i].m_desc;
+		if (enabled[pmID_cluster(dp->pmid)]) {
+		    pmidlist[npmids] = dp->pmid;
+		    indomlist[npmids++] = dp->indom;
+		}
+	    }
+	    if (npmids > 0)
+		svp = snapshot_sample(sp, pmda, npmids, pmidlist, indomlist);
+	}
+	pthread_mutex_unlock(&sp->pmdalock);
+
+	pthread_mutex_lock(&sp->lock);
+	if (sp->front != NULL) {
+	    sp->front->next = sp->retired;
+	    sp->retired = sp->front;
+	}
+	sp->front = svp;
+	if (svp != NULL)
+	    sp->status |= svp->status;
+	sp->refreshes++;
+    }
+    /*NOTREACHED*/
+    return NULL;
+}
+
+int
+pmdaSetSnapshot(pmdaInterface *dispatch, const struct timeval *interval,
+		int nclusters, const unsigned int *clusters)
+{
+    pmdaExt		*pmda;
+    e_ext_t		*extp;
+    snapshot_t		*sp;
+    int			i;
+
+    if (!HAVE_ANY(dispatch->comm.pmda_interface)) {
+	pmNotifyErr(LOG_CRIT, "pmdaSetSnapshot: PMDA interface version %d not supported",
+		     dispatch->comm.pmda_interface);
+	return PM_ERR_GENERIC;
+    }
+    pmda = dispatch->version.any.ext;
+    extp = (e_ext_t *)pmda->e_ext;
+    if (extp->snapshot != NULL)
+	return -EBUSY;
+    if (interval->tv_sec < 0 || interval->tv_usec < 0 ||
+	(interval->tv_sec == 0 && interval->tv_usec == 0))
+	return -EINVAL;
+    for (i = 0; i < nclusters; i++)
+	if (clusters[i] >= SNAP_NCLUSTERS)
+	    return -EINVAL;
+
+    if ((sp = (snapshot_t *)calloc(1, sizeof(*sp))) == NULL)
+	return -oserror();
+    sp->dispatch = dispatch;
+    sp->interval = *interval;
+    if (clusters == NULL)
+	memset(sp->eligible, 1, sizeof(sp->eligible));
+    else for (i = 0; i < nclusters; i++)
+	sp->eligible[clusters[i]] = 1;
+    pthread_mutex_init(&sp->pmdalock, NULL);
+    pthread_mutex_init(&sp->lock, NULL);
+    pthread_cond_init(&sp->wakeup, NULL);
+    __pmHashInit(&sp->containers);
+    extp->snapshot = sp;
+
+    if (pmDebugOptions.libpmda)
+	pmNotifyErr(LOG_DEBUG, "pmdaSetSnapshot: interval %.6f, %d clusters\n",
+			pmtimevalToReal(interval), clusters ? nclusters : SNAP_NCLUSTERS);
+    return 0;
+}
+
+/*
+ * Called by __pmdaMainPDU() on the first PDU, so the thread is only
+ * started for daemon PMDAs, after pmdaInit() and pmdaConnect().
+ */
+void
+__pmdaSnapshotStart(pmdaExt *pmda)
+{
+    snapshot_t		*sp = ((e_ext_t *)pmda->e_ext)->snapshot;
+    int			sts;
+
+    if (sp == NULL || sp->started)
+	return;
+    if ((sts = pthread_create(&sp->thread, NULL, snapshot_refresh, sp)) != 0) {
+	pmNotifyErr(LOG_ERR, "%s: cannot start background refresh: %s\n",
+			pmda->e_name, pmErrStr(-sts));
+	return;
+    }
+    sp->started = 1;
+}
+
+void
+__pmdaSnapshotLock(pmdaExt *pmda)
+{
+    snapshot_t		*sp = ((e_ext_t *)pmda->e_ext)->snapshot;
+
+    if (sp != NULL)
+	pthread_mutex_lock(&sp->pmdalock);
+}
+
+void
+__pmdaSnapshotUnlock(pmdaExt *pmda)
+{
+    snapshot_t		*sp = ((e_ext_t *)pmda->e_ext)->snapshot;
+
+    if (sp != NULL)
+	pthread_mutex_unlock(&sp->pmdalock);
+}
+
+/*
+ * Build the reply to a fetch from the front snapshot.  Returns the
+ * number of metrics that are not in the snapshot (their vset[] is
+ * NULL in *resp), or PM_ERR_AGAIN if the snapshot cannot be used for
+ * this fetch.  __pmdaSnapshotRelease() must be called after sending.
+ */
+int
+__pmdaSnapshotFetch(pmdaExt *pmda, int ctx, pmProfile *prof,
+		int numpmid, pmID *pmidlist, pmResult **resp)
+{
+    snapshot_t		*sp = ((e_ext_t *)pmda->e_ext)->snapshot;
+    snapvals_t		*svp;
+    pmValueSet		*vsp, *fvsp;
+    __pmHashNode	*hp;
+    pmInDom		indom;
+    size_t		need;
+    unsigned int	cluster;
+    unsigned char	status = 0;
+    char		*bp;
+    int			allinst, wake = 0;
+    int			missing = 0;
+    int			i, j, k;
+
+    if (sp == NULL || !sp->started)
+	return PM_ERR_AGAIN;
+    /* values from inside a container are never refreshed in the background */
+    if (__pmHashSearch(ctx, &sp->containers) != NULL)
+	return PM_ERR_AGAIN;
+
+    pthread_mutex_lock(&sp->lock);
+    for (i = 0; i < numpmid; i++) {
+	cluster = pmID_cluster(pmidlist[i]);
+	if (!sp->eligible[cluster])
+	    continue;
+	if (!snapshot_enabled(sp, cluster))
+	    wake = 1;
+	sp->used[cluster] = sp->refreshes + 1;
+    }
+    if (wake) {
+	sp->wanted = 1;
+	pthread_cond_signal(&sp->wakeup);
+    }
+    if ((svp = sp->front) != NULL) {
+	svp->refcnt++;
+	status = sp->status;
+	sp->status = 0;
+    }
+    pthread_mutex_unlock(&sp->lock);
+    if (svp == NULL)
+	return PM_ERR_AGAIN;
+    sp->sending = svp;
+
+    if (numpmid > sp->maxreply) {
+	free(sp->reply);
+	need = sizeof(pmResult) + (numpmid - 1) * sizeof(pmValueSet *);
+	if ((sp->reply = (pmResult *)malloc(need)) == NULL) {
+	    sp->maxreply = 0;
+	    __pmdaSnapshotRelease(pmda);
+	    return PM_ERR_AGAIN;
+	}
+	sp->maxreply = numpmid;
+    }
+    sp->reply->numpmid = numpmid;
+    memset(&sp->reply->timestamp, 0, sizeof(sp->reply->timestamp));
+    *(unsigned char *)&sp->reply->timestamp = status;
+
+    allinst = (prof == NULL ||
+	       (prof->state == PM_PROFILE_INCLUDE && prof->profile_len == 0));
+
+    /* find the values, and the space for any that need filtering */
+    need = 0;
+    for (i = 0; i < numpmid; i++) {
+	if ((hp = __pmOHashSearch(pmidlist[i], &svp->pmids)) == NULL) {
+	    sp->reply->vset[i] = NULL;
+	    missing++;
+	    continue;
+	}
+	k = (pmInDom *)hp->data - svp->indoms;
+	sp->reply->vset[i] = vsp = svp->result->vset[k];
+	if (!allinst && svp->indoms[k] != PM_INDOM_NULL && vsp->numval > 0)
+	    need += sizeof(pmValueSet) + (vsp->numval - 1) * sizeof(pmValue);
+    }
+    if (need > sp->bufsize) {
+	free(sp->buf);
+	if ((sp->buf = (char *)malloc(need)) == NULL) {
+	    sp->bufsize = 0;
+	    __pmdaSnapshotRelease(pmda);
+	    return PM_ERR_AGAIN;
+	}
+	sp->bufsize = need;
+    }
+
+    /* values of instances not in the profile are left out */
+    for (i = 0, bp = sp->buf; need > 0 && i < numpmid; i++) {
+	if ((vsp = sp->reply->vset[i]) == NULL || vsp->numval <= 0)
+	    continue;
+	indom = *(pmInDom *)__pmOHashSearch(vsp->pmid, &svp->pmids)->data;
+	if (indom == PM_INDOM_NULL)
+	    continue;
+	for (j = 0; j < vsp->numval; j++)
+	    if (!__pmInProfile(indom, prof, vsp->vlist[j].inst))
+		break;
+	if (j == vsp->numval)
+	    continue;	/* all of them, send as is */
+	fvsp = (pmValueSet *)bp;
+	fvsp->pmid = vsp->pmid;
+	fvsp->valfmt = vsp->valfmt;
+	for (j = k = 0; j < vsp->numval; j++) {
+	    if (__pmInProfile(indom, prof, vsp->vlist[j].inst))
+		fvsp->vlist[k++] = vsp->vlist[j];
+	}
+	fvsp->numval = k;
+	bp += sizeof(pmValueSet) + (vsp->numval - 1) * sizeof(pmValue);
+	sp->reply->vset[i] = fvsp;
+    }
+
+    *resp = sp->reply;
+    return missing;
+}
+
+void
+__pmdaSnapshotRelease(pmdaExt *pmda)
+{
+    snapshot_t		*sp = ((e_ext_t *)pmda->e_ext)->snapshot;
+
+    if (sp == NULL || sp->sending == NULL)
+	return;
+    pthread_mutex_lock(&sp->lock);
+    sp->sending->refcnt--;
+    pthread_mutex_unlock(&sp->lock);
+    sp->sending = NULL;
+}
+
+/*
+ * Client contexts with a container attribute, whose values depend on
+ * the context, are fetched from the PMDA directly.
+ */
+void
+__pmdaSnapshotAttribute(pmdaExt *pmda, int ctx, int attr)
+{
+    snapshot_t		*sp = ((e_ext_t *)pmda->e_ext)->snapshot;
+
+    if (sp == NULL || attr != PCP_ATTR_CONTAINER)
+	return;
+    if (__pmHashSearch(ctx, &sp->containers) == NULL)
+	__pmHashAdd(ctx, NULL, &sp->containers);
+}
+
+void
+__pmdaSnapshotEndContext(pmdaExt *pmda, int ctx)
+{
+    snapshot_t		*sp = ((e_ext_t *)pmda->e_ext)->snapshot;
+
+    if (sp != NULL)
+	__pmHashDel(ctx, NULL, &sp->containers);
+}
+
+#else	/* !PM_MULTI_THREAD */
+
+int
+pmdaSetSnapshot(pmdaInterface *dispatch, const struct timeval *interval,
+		int nclusters, const unsigned int *clusters)
+{
+    (void)dispatch;
+    (void)interval;
+    (void)nclusters;
+    (void)clusters;
+    return PM_ERR_NYI;
+}
+
+void __pmdaSnapshotStart(pmdaExt *pmda) { (void)pmda; }
+void __pmdaSnapshotLock(pmdaExt *pmda) { (void)pmda; }
+void __pmdaSnapshotUnlock(pmdaExt *pmda) { (void)pmda; }
+void __pmdaSnapshotRelease(pmdaExt *pmda) { (void)pmda; }
+void __pmdaSnapshotAttribute(pmdaExt *pmda, int ctx, int attr) { (void)pmda; }
+void __pmdaSnapshotEndContext(pmdaExt *pmda, int ctx) { (void)pmda; }
+
+int
+__pmdaSnapshotFetch(pmdaExt *pmda, int ctx, pmProfile *prof,
+		int numpmid, pmID *pmidlist, pmResult **resp)
+{
+    (void)pmda;
+    return PM_ERR_AGAIN;
+}
+
+#endif	/* PM_MULTI_THREAD */
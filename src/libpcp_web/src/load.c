@@ -259,63 +259,43 @@ pmwebapi_clear_metric_updated(metric_t *metric)
 	metric->u.vlist->value[i].updated = 0;
 }
 
+/*
+ * Walk the event records (of either type) in place, rather than
+ * unpacking each one into a separate result.
+ */
 static sds
 pmwebapi_extract_events(pmValueSet *vsp, int inst)
 {
     sds			s;
-    int			record, param, nrecords, flags, sts;
-    pmResult		**results, *result;
+    int			param, flags, sts;
+    pmValueSet		*xvsp;
+    pmEventIter		iter;
+    struct timeval	stamp;
 
-    if ((sts = nrecords = pmUnpackEventRecords(vsp, inst, &results)) < 0) {
+    if ((sts = pmEventIterInit(&iter, vsp, inst)) < 0) {
 	if (pmDebugOptions.series)
-	    fprintf(stderr, "pmUnpackEventRecords: %s\n", pmErrStr(sts));
+	    fprintf(stderr, "pmEventIterInit: %s\n", pmErrStr(sts));
 	return NULL;
     }
-    nrecords = sts;
     pmwebapi_event_flags();
     pmwebapi_event_missed();
     s = sdsnewlen("{", 1);
-    for (record = 0; record < nrecords; record++) {
-	if (record > 0)
-	    s = sdscatlen(s, ",", 1);
-	result = results[record];
-	s = sdscatfmt(s, "\"timestamp\":");
-	s = pmwebapi_usectimestamp(s, &result->timestamp);
-	for (param = flags = 0; param < result->numpmid; param++)
-	    s = pmwebapi_event_parameter(s, result->vset[param], param, &flags);
-    }
-    s = sdscatlen(s, "}", 1);
-    pmFreeEventResult(results);
-    return s;
-}
-
-static sds
-pmwebapi_extract_highres_events(pmValueSet *vsp, int inst)
-{
-    sds			s;
-    int			record, param, nrecords, flags, sts;
-    pmHighResResult	**results, *result;
-
-    if ((sts = pmUnpackHighResEventRecords(vsp, inst, &results)) < 0) {
-	if (pmDebugOptions.series)
-	    fprintf(stderr, "pmUnpackHighResEventRecords: %s\n", pmErrStr(sts));
-	return NULL;
-    }
-    nrecords = sts;
-    pmwebapi_event_flags();
-    pmwebapi_event_missed();
-    s = sdsempty();
-    for (record = 0; record < nrecords; record++) {
-	if (record > 0)
+    while (pmEventIterNextRecord(&iter) > 0) {
+	if (iter.ei_record > 0)
 	    s = sdscatlen(s, ",", 1);
-	result = results[record];
 	s = sdscatfmt(s, "\"timestamp\":");
-	s = pmwebapi_nsectimestamp(s, &result->timestamp);
-	for (param = flags = 0; param < result->numpmid; param++)
-	    s = pmwebapi_event_parameter(s, result->vset[param], param, &flags);
+	if (iter.ei_type == PM_TYPE_HIGHRES_EVENT)
+	    s = pmwebapi_nsectimestamp(s, &iter.ei_timestamp);
+	else {
+	    stamp.tv_sec = iter.ei_timestamp.tv_sec;
+	    stamp.tv_usec = iter.ei_timestamp.tv_nsec / 1000;
+	    s = pmwebapi_usectimestamp(s, &stamp);
+	}
+	flags = iter.ei_flags;
+	for (param = 0; pmEventIterNextParam(&iter, &xvsp) > 0; param++)
+	    s = pmwebapi_event_parameter(s, xvsp, param, &flags);
     }
     s = sdscatlen(s, "}", 1);
-    pmFreeHighResEventResult(results);
     return s;
 }
 
@@ -359,15 +339,10 @@ pmwebapi_extract_value(pmValueSet *vsp, int inst, int type, pmAtomValue *ap)
 	return 0;
 
     case PM_TYPE_EVENT:
-	if (ap->cp)
-	    sdsfree(ap->cp);
-	ap->cp = pmwebapi_extract_events(vsp, inst);
-	return 0;
-
     case PM_TYPE_HIGHRES_EVENT:
 	if (ap->cp)
 	    sdsfree(ap->cp);
-	ap->cp = pmwebapi_extract_highres_events(vsp, inst);
+	ap->cp = pmwebapi_extract_events(vsp, inst);
 	return 0;
 
     default:
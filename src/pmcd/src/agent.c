@@ -162,6 +162,8 @@ CleanupAgent(AgentInfo* aPtr, int why, int status)
 #endif
     }
     fputc('\n', stderr);
+    FetchAbortAgent(aPtr);
+    ResetAgentProfileSent(aPtr->pmDomainId);
     aPtr->reason = reason;
     aPtr->status.connected = 0;
     aPtr->status.busy = 0;
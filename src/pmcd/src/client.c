@@ -19,9 +19,6 @@
 
 #define MIN_CLIENTS_ALLOC 8
 
-int		maxClientFd = -1;	/* largest fd for a client */
-__pmFdSet	clientFds;		/* for client select() */
-
 static int	clientSize;
 
 /*
@@ -75,7 +72,7 @@ ClientInfo *
 AcceptNewClient(int reqfd)
 {
     static unsigned int	seq = 0;
-    int			i, fd;
+    int			i, fd, sts;
     __pmSockLen		addrlen;
     struct timeval	now;
 
@@ -103,20 +100,24 @@ AcceptNewClient(int reqfd)
 	DeleteClient(&client[i]);
 	return NULL;	
     }
-    if (fd > maxClientFd)
-	maxClientFd = fd;
+    client[i].fd = fd;
+    if ((sts = IoWaitAddClient(&client[i])) < 0) {
+	pmNotifyErr(LOG_ERR, "AcceptNewClient(%d): cannot wait for input on fd %d: %s\n",
+			reqfd, fd, pmErrStr(sts));
+	DeleteClient(&client[i]);
+	return NULL;
+    }
 
     pmcd_openfds_sethi(fd);
 
-    __pmFD_SET(fd, &clientFds);
     __pmSetVersionIPC(fd, UNKNOWN_VERSION);	/* before negotiation */
     __pmSetSocketIPC(fd);
 
-    client[i].fd = fd;
     client[i].status.connected = 1;
     client[i].status.attributes = 0;
     client[i].status.changes = 0;
     memset(&client[i].attrs, 0, sizeof(__pmHashCtl));
+    __pmOHashInit(&client[i].profsent);
 
     /*
      * Note seq needs to be unique, but we're using a free running counter
@@ -167,12 +168,106 @@ NewClient(void)
     return i;
 }
 
+/*
+ * Daemon agents that keep a profile for each client context (flagged
+ * PDU_FLAG_PROFILES at connection time) are sent each profile just once,
+ * rather than before every fetch from a different client context.  For
+ * each context slot, a bitmap of agent domains records which agents
+ * hold the current profile.
+ */
+#define PROFSENT_WORDS	((MAXDOMID + 32) / 32)
+
+static unsigned int *
+ProfileSentMap(ClientInfo *cp, int ctxnum, int create)
+{
+    __pmHashNode	*hp;
+    unsigned int	*map;
+
+    if ((hp = __pmOHashSearch(ctxnum, &cp->profsent)) != NULL)
+	return (unsigned int *)hp->data;
+    if (!create)
+	return NULL;
+    if ((map = (unsigned int *)calloc(PROFSENT_WORDS, sizeof(unsigned int))) == NULL) {
+	pmNoMem("ProfileSentMap", PROFSENT_WORDS * sizeof(unsigned int), PM_FATAL_ERR);
+	/*NOTREACHED*/
+    }
+    if (__pmOHashAdd(ctxnum, map, &cp->profsent) < 0) {
+	free(map);
+	return NULL;
+    }
+    return map;
+}
+
+/* Does the agent for this domain hold the client context's profile? */
+int
+ProfileSent(ClientInfo *cp, int ctxnum, int domain)
+{
+    unsigned int	*map = ProfileSentMap(cp, ctxnum, 0);
+
+    return map != NULL && (map[domain / 32] & (1U << (domain % 32))) != 0;
+}
+
+void
+SetProfileSent(ClientInfo *cp, int ctxnum, int domain)
+{
+    unsigned int	*map = ProfileSentMap(cp, ctxnum, 1);
+
+    if (map != NULL)
+	map[domain / 32] |= (1U << (domain % 32));
+}
+
+/* Client context has a new profile, no agent holds it yet */
+void
+ResetProfileSent(ClientInfo *cp, int ctxnum)
+{
+    unsigned int	*map = ProfileSentMap(cp, ctxnum, 0);
+
+    if (map != NULL)
+	memset(map, 0, PROFSENT_WORDS * sizeof(unsigned int));
+}
+
+static __pmHashWalkState
+ClearProfileSent(const __pmHashNode *hp, void *cdata)
+{
+    unsigned int	*map = (unsigned int *)hp->data;
+    int			domain = *(int *)cdata;
+
+    map[domain / 32] &= ~(1U << (domain % 32));
+    return PM_HASH_WALK_NEXT;
+}
+
+/* Agent for this domain has gone, along with all profiles it held */
+void
+ResetAgentProfileSent(int domain)
+{
+    int		i;
+
+    for (i = 0; i < nClients; i++) {
+	if (client[i].status.connected)
+	    __pmOHashWalkCB(ClearProfileSent, &domain, &client[i].profsent);
+    }
+}
+
+static __pmHashWalkState
+FreeProfile(const __pmHashNode *hp, void *cdata)
+{
+    (void)cdata;
+    if (hp->data != NULL)
+	__pmFreeProfile((pmProfile *)hp->data);
+    return PM_HASH_WALK_NEXT;
+}
+
+static __pmHashWalkState
+FreeProfileSent(const __pmHashNode *hp, void *cdata)
+{
+    (void)cdata;
+    free(hp->data);
+    return PM_HASH_WALK_NEXT;
+}
+
 void
 DeleteClient(ClientInfo *cp)
 {
-    __pmHashCtl		*hcp;
-    __pmHashNode	*hp;
-    pmProfile		*profile;
     int			i;
 
     for (i = 0; i < nClients; i++)
@@ -188,7 +283,7 @@ DeleteClient(ClientInfo *cp)
 	return;
     }
     if (cp->fd != -1) {
-	__pmFD_CLR(cp->fd, &clientFds);
+	IoWaitDelClient(cp);
 	__pmCloseSocket(cp->fd);
     }
     if (i == nClients-1) {
@@ -197,25 +292,10 @@ DeleteClient(ClientInfo *cp)
 	    i--;
 	nClients = (i >= 0) ? i + 1 : 0;
     }
-    if (cp->fd == maxClientFd) {
-	maxClientFd = -1;
-	for (i = 0; i < nClients; i++) {
-	    if (client[i].fd > maxClientFd)
-		maxClientFd = client[i].fd;
-	}
-    }
-    hcp = &cp->profile;
-    for (i = 0; i < hcp->hsize; i++) {
-	for (hp = hcp->hash[i]; hp != NULL; hp = hp->next) {
-	    profile = (pmProfile *)hp->data;
-	    if (profile != NULL) {
-		__pmFreeProfile(profile);
-		hp->data = NULL;
-	    }
-
-	}
-    }
-    __pmHashClear(hcp);
+    __pmOHashWalkCB(FreeProfile, NULL, &cp->profile);
+    __pmOHashClear(&cp->profile);
+    __pmOHashWalkCB(FreeProfileSent, NULL, &cp->profsent);
+    __pmOHashClear(&cp->profsent);
     __pmFreeAttrsSpec(&cp->attrs);
     __pmHashClear(&cp->attrs);
     __pmSockAddrFree(cp->addr);
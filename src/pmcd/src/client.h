@@ -22,24 +22,24 @@ typedef struct {
 	unsigned int	connected : 1;	/* Client connected */
 	unsigned int	changes : 6;	/* PMCD_* bits for changes since last fetch */
 	unsigned int	attributes: 1;	/* Connection attributes have changed */
+	unsigned int	fetching : 1;	/* Fetch awaiting results from agents */
     } status;
     /* There is a profile associated with each client context.
      * The context slot number (not the context number) sent with each
      * profile/fetch is used as the key to the profile hash table.
      */
-    __pmHashCtl		profile;	/* Client context profile pointers */
+    __pmOHashCtl	profile;	/* Client context profile pointers */
     unsigned int	denyOps;	/* Disallowed operations for client */
     __pmPDUInfo		pduInfo;
     unsigned int	seq;		/* Client sequence number (pmdapmcd) */
     time_t		start;		/* Time client connected (pmdapmcd) */
     __pmSockAddr	*addr;		/* Network address of client */
     __pmHashCtl		attrs;		/* Connection attributes (tuples) */
+    __pmOHashCtl	profsent;	/* Agents holding context profiles */
 } ClientInfo;
 
 PMCD_DATA extern ClientInfo *client;		/* Array of clients */
 PMCD_DATA extern int	nClients;		/* Number of entries in array */
-extern int		maxClientFd;		/* largest fd for a client */
-extern __pmFdSet	clientFds;		/* for client select() */
 PMCD_DATA extern int	this_client_id;		/* client for current request */
 
 /* prototypes */
@@ -51,6 +51,10 @@ PMCD_CALL extern int SetClientAttribute(int, int, char *);
 PMCD_CALL extern void ShowClients(FILE *m);
 extern int CheckClientAccess(ClientInfo *);
 extern int CheckAccountAccess(ClientInfo *);
+extern int ProfileSent(ClientInfo *, int, int);
+extern void SetProfileSent(ClientInfo *, int, int);
+extern void ResetProfileSent(ClientInfo *, int);
+extern void ResetAgentProfileSent(int);
 
 extern char *nameclient(int);
 
@@ -573,6 +573,7 @@ FreeAgent(AgentInfo *ap)
     int		i;
     char	**argv = NULL;
 
+    CacheFlush(ap);
     free(ap->pmDomainLabel);
     if (ap->ipcType == AGENT_DSO) {
 	free(ap->ipc.dso.pathName);
@@ -1342,6 +1343,9 @@ ReadConfigFiles(FILE *configFile, FILE *accessFile)
 			 source, nLines);
 	    sts = -1;
 	}
+	/* pmcd's own metrics are mostly per-client, never cache these */
+	if (sts == 0 && pmDomainId != PMCD_DOMAIN)
+	    agent[nAgents-1].cacheWindow = pmcd_cachetime;
 doneLine:
 	if (pmDomainLabel != NULL) {
 	    free(pmDomainLabel);
@@ -2382,6 +2386,9 @@ DupAgent(AgentInfo *dest, AgentInfo *src)
     dest->outFd = src->outFd;
     dest->profClient = src->profClient;
     dest->profIndex = src->profIndex;
+    dest->cacheWindow = src->cacheWindow;
+    dest->fetchCache = src->fetchCache;
+    src->fetchCache = NULL;
     /* IMPORTANT: copy the status, connections stay connected */
     memcpy(&dest->status, &src->status, sizeof(dest->status));
     if (src->ipcType == AGENT_DSO) {
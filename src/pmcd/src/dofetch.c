@@ -194,9 +194,9 @@ MakeBadResult(int npmids, pmID *list, int sts)
 }
 
 static pmResult *
-SendFetch(DomPmidList *dpList, AgentInfo *aPtr, ClientInfo *cPtr, int ctxnum)
+SendFetch(int listSize, pmID *list, AgentInfo *aPtr, ClientInfo *cPtr, int ctxnum)
 {
-    __pmHashCtl		*hcp;
+    __pmOHashCtl	*hcp;
     __pmHashNode	*hp;
     pmProfile		*profile;
     pmResult		*result = NULL;
@@ -207,7 +207,7 @@ SendFetch(DomPmidList *dpList, AgentInfo *aPtr, ClientInfo *cPtr, int ctxnum)
 
     if (pmDebugOptions.appl0) {
 	fprintf(stderr, "SendFetch %d metrics to PMDA domain %d ",
-	    dpList->listSize, dpList->domain);
+	    listSize, aPtr->pmDomainId);
 	switch (aPtr->ipcType) {
 	case AGENT_DSO:
 	    fprintf(stderr, "(dso)\n");
@@ -225,8 +225,8 @@ SendFetch(DomPmidList *dpList, AgentInfo *aPtr, ClientInfo *cPtr, int ctxnum)
 	    fprintf(stderr, "(type %d unknown!)\n", aPtr->ipcType);
 	    break;
 	}
-	for (i = 0; i < dpList->listSize; i++)
-	    fprintf(stderr, "  pmid[%d] %s\n", i, pmIDStr(dpList->list[i]));
+	for (i = 0; i < listSize; i++)
+	    fprintf(stderr, "  pmid[%d] %s\n", i, pmIDStr(list[i]));
     }
 
     /* status.madeDsoResult is only used for DSO agents so don't waste time by
@@ -234,9 +234,26 @@ SendFetch(DomPmidList *dpList, AgentInfo *aPtr, ClientInfo *cPtr, int ctxnum)
      */
     aPtr->status.madeDsoResult = 0;
 
-    if (aPtr->profClient != cPtr || ctxnum != aPtr->profIndex) {
+    if (aPtr->ipcType != AGENT_DSO && (aPtr->status.flags & PDU_FLAG_PROFILES)) {
+	/* agent keeps every client context profile, send only new ones */
+	if (!ProfileSent(cPtr, ctxnum, aPtr->pmDomainId)) {
+	    hp = __pmOHashSearch(ctxnum, &cPtr->profile);
+	    profile = hp != NULL ? (pmProfile *)hp->data : NULL;
+	    if (aPtr->status.notReady == 0) {
+		pmcd_trace(TR_XMIT_PDU, aPtr->inFd, PDU_PROFILE, ctxnum);
+		if ((sts = __pmSendProfile(aPtr->inFd, cPtr - client,
+					   ctxnum, profile)) < 0)
+		    pmcd_trace(TR_XMIT_ERR, aPtr->inFd, PDU_PROFILE, sts);
+		else
+		    SetProfileSent(cPtr, ctxnum, aPtr->pmDomainId);
+	    } else {
+		sts = PM_ERR_AGAIN;
+	    }
+	}
+    }
+    else if (aPtr->profClient != cPtr || ctxnum != aPtr->profIndex) {
 	hcp = &cPtr->profile;
-	hp = __pmHashSearch(ctxnum, hcp);
+	hp = __pmOHashSearch(ctxnum, hcp);
 	if (hp != NULL)
 	    profile = (pmProfile *)hp->data;
 	else
@@ -269,8 +286,8 @@ SendFetch(DomPmidList *dpList, AgentInfo *aPtr, ClientInfo *cPtr, int ctxnum)
 	if (aPtr->ipcType == AGENT_DSO) {
 	    if (aPtr->ipc.dso.dispatch.comm.pmda_interface >= PMDA_INTERFACE_5)
 		aPtr->ipc.dso.dispatch.version.four.ext->e_context = cPtr - client;
-	    sts = aPtr->ipc.dso.dispatch.version.any.fetch(dpList->listSize,
-				   dpList->list, &result, 
+	    sts = aPtr->ipc.dso.dispatch.version.any.fetch(listSize,
+				   list, &result, 
 				   aPtr->ipc.dso.dispatch.version.any.ext);
 	    if (sts >= 0) {
 		if (result == NULL) {
@@ -280,11 +297,11 @@ SendFetch(DomPmidList *dpList, AgentInfo *aPtr, ClientInfo *cPtr, int ctxnum)
 		    sts = PM_ERR_PMID;
 		    bad = 1;
 		}
-		else if (result->numpmid != dpList->listSize) {
+		else if (result->numpmid != listSize) {
 		    pmNotifyErr(LOG_WARNING,
 				"\"%s\" agent (DSO) returned %d pmIDs (%d expected)\n",
 				aPtr->pmDomainLabel,
-				result->numpmid,dpList->listSize);
+				result->numpmid, listSize);
 		    sts = PM_ERR_PMID;
 		    bad = 2;
 		}
@@ -297,9 +314,9 @@ SendFetch(DomPmidList *dpList, AgentInfo *aPtr, ClientInfo *cPtr, int ctxnum)
 	    }
 	    else if (aPtr->status.notReady == 0) {
 		/* agent is ready for PDUs */
-		pmcd_trace(TR_XMIT_PDU, aPtr->inFd, PDU_FETCH, dpList->listSize);
+		pmcd_trace(TR_XMIT_PDU, aPtr->inFd, PDU_FETCH, listSize);
 		if ((sts = __pmSendFetch(aPtr->inFd, cPtr - client, ctxnum, &when,
-				   dpList->listSize, dpList->list)) < 0)
+				   listSize, list)) < 0)
 		    pmcd_trace(TR_XMIT_ERR, aPtr->inFd, PDU_FETCH, sts);
 	    }
 	    else {
@@ -323,7 +340,7 @@ SendFetch(DomPmidList *dpList, AgentInfo *aPtr, ClientInfo *cPtr, int ctxnum)
 		case 2:
 		    fprintf(stderr, "\"%s\" agent (DSO) returned %d pmIDs (%d expected)\n",
 			    aPtr->pmDomainLabel,
-			    result->numpmid, dpList->listSize);
+			    result->numpmid, listSize);
 		    break;
 	    }
 	if (aPtr->ipcType == AGENT_DSO) {
@@ -333,7 +350,7 @@ SendFetch(DomPmidList *dpList, AgentInfo *aPtr, ClientInfo *cPtr, int ctxnum)
 	else if (sts == PM_ERR_IPC || sts == PM_ERR_TIMEOUT || sts == -EPIPE)
 	    CleanupAgent(aPtr, AT_COMM, aPtr->inFd);
 
-	result = MakeBadResult(dpList->listSize, dpList->list, sts);
+	result = MakeBadResult(listSize, list, sts);
     }
 
     return result;
@@ -354,44 +371,572 @@ ExtractState(pmResult *result)
     return (int)byte;
 }
 
+/*
+ * Fetch requests are not answered synchronously.  The pmIDs from a
+ * client request are split into per-agent sublists (FetchReq) and these
+ * are queued on daemon PMDAs, which only ever have one request in flight.
+ * The client request (FetchCtl) remains pending while ClientLoop() goes
+ * on servicing other clients, and is completed once every daemon PMDA
+ * involved has responded (or timed out).  DSO PMDAs are only called at
+ * completion time, as they return pmResults they own and reuse.
+ *
+ * While a client has a fetch pending no further PDUs are read from it,
+ * so responses are always returned in the order requests were made.
+ */
+
+typedef struct FetchReq {
+    struct FetchReq	*next;		/* Next request queued on the agent */
+    struct FetchCtl	*ctl;		/* Client request this is part of */
+    int			agent;		/* Index into agent[] */
+    int			listSize;	/* Number of pmIDs for this agent */
+    pmID		*list;		/* The pmIDs for this agent */
+    pmResult		*result;	/* Agent's result, once known */
+    CacheKey		*key;		/* Identifies request if cacheable */
+    CacheEntry		*cached;	/* Cache entry holding result */
+} FetchReq;
+
+typedef struct FetchCtl {
+    struct FetchCtl	*next;		/* Next pending client request */
+    int			client;		/* Index into client[], -1 if gone */
+    unsigned int	seq;		/* client[].seq when request arrived */
+    int			ctxnum;		/* Client context slot */
+    int			nPmids;		/* Number of pmIDs requested */
+    pmID		*pmidList;	/* pmIDs in the order requested */
+    int			*reqIndex;	/* req[] index for each pmID, or -1 */
+    pmResult		*bad;		/* Values for pmIDs with no agent */
+    unsigned int	changes;	/* PMCD_* state changes from agents */
+    int			nWait;		/* Number of results not yet in */
+    int			nReqs;		/* Number of per-agent requests */
+    FetchReq		req[1];		/* nReqs per-agent requests */
+} FetchCtl;
+
+static FetchCtl		*pending;	/* Client requests not yet complete */
+
+/* Time remaining until deadline, zero if already passed */
+static void
+TimeLeft(const struct timeval *deadline, struct timeval *left)
+{
+    struct timeval	now;
+
+    pmtimevalNow(&now);
+    if (pmtimevalSub(deadline, &now) > 0) {
+	*left = *deadline;
+	pmtimevalDec(left, &now);
+    }
+    else
+	left->tv_sec = left->tv_usec = 0;
+}
+
+static ClientInfo *
+FetchClient(FetchCtl *ctl)
+{
+    ClientInfo	*cp;
+
+    if (ctl->client < 0 || ctl->client >= nClients)
+	return NULL;
+    cp = &client[ctl->client];
+    if (!cp->status.connected || cp->seq != ctl->seq)
+	return NULL;
+    return cp;
+}
+
+static void
+FetchQueue(AgentInfo *ap, FetchReq *rp)
+{
+    rp->next = NULL;
+    if (ap->fetchTail == NULL)
+	ap->fetchHead = rp;
+    else
+	ap->fetchTail->next = rp;
+    ap->fetchTail = rp;
+}
+
+static FetchReq *
+FetchDequeue(AgentInfo *ap)
+{
+    FetchReq	*rp;
+
+    if ((rp = ap->fetchHead) != NULL) {
+	if ((ap->fetchHead = rp->next) == NULL)
+	    ap->fetchTail = NULL;
+	rp->next = NULL;
+    }
+    return rp;
+}
+
+/* An agent has responded (or failed to) for one part of a client request */
+static void
+FetchDone(FetchReq *rp, pmResult *result)
+{
+    FetchCtl	*ctl = rp->ctl;
+
+    rp->result = result;
+    if (result != NULL && rp->cached == NULL)
+	ctl->changes |= ExtractState(result);
+    ctl->nWait--;
+}
+
+/* Answer a request from the agent's cache, if possible */
+static int
+FetchCached(AgentInfo *ap, FetchReq *rp)
+{
+    if (rp->key == NULL || CacheWindow(ap) <= 0)
+	return 0;
+    if ((rp->cached = CacheLookup(ap, rp->key)) == NULL)
+	return 0;
+    rp->result = CacheResult(rp->cached);
+    return 1;
+}
+
+/* Keep a good result from the agent for others making the same request */
+static void
+FetchCacheStore(AgentInfo *ap, FetchReq *rp)
+{
+    if (rp->key == NULL || rp->result == NULL || CacheWindow(ap) <= 0)
+	return;
+    rp->cached = CacheStore(ap, rp->key, rp->result);
+    rp->result = CacheResult(rp->cached);
+    rp->key = NULL;
+}
+
+/*
+ * Send queued requests to an idle daemon agent until one is in flight,
+ * or the queue is empty.  Requests from departed clients are discarded.
+ */
+static void
+FetchStart(AgentInfo *ap)
+{
+    FetchReq	*rp;
+    ClientInfo	*cp;
+    pmResult	*result;
+
+    while (!ap->status.fetching && (rp = FetchDequeue(ap)) != NULL) {
+	if ((cp = FetchClient(rp->ctl)) == NULL) {
+	    FetchDone(rp, NULL);
+	    continue;
+	}
+	if (FetchCached(ap, rp)) {
+	    FetchDone(rp, rp->result);
+	    continue;
+	}
+	result = SendFetch(rp->listSize, rp->list, ap, cp, rp->ctl->ctxnum);
+	if (result != NULL) {
+	    FetchDone(rp, result);
+	    continue;
+	}
+	ap->fetchReq = rp;
+	ap->status.fetching = 1;
+	pmtimevalNow(&ap->fetchDeadline);
+	ap->fetchDeadline.tv_sec += pmcd_timeout;
+    }
+}
+
+/*
+ * Agent is going away, fail the request in flight and all those
+ * queued behind it.  Called from CleanupAgent().
+ */
+void
+FetchAbortAgent(AgentInfo *ap)
+{
+    FetchReq	*rp;
+
+    if ((rp = ap->fetchReq) != NULL) {
+	ap->fetchReq = NULL;
+	FetchDone(rp, MakeBadResult(rp->listSize, rp->list, PM_ERR_NOAGENT));
+    }
+    ap->status.fetching = 0;
+    while ((rp = FetchDequeue(ap)) != NULL)
+	FetchDone(rp, MakeBadResult(rp->listSize, rp->list, PM_ERR_NOAGENT));
+    CacheFlush(ap);
+}
+
+/*
+ * Client is going away, any pending request of theirs is completed
+ * as usual but the result is discarded.  Called from CleanupClient().
+ */
+void
+FetchAbortClient(ClientInfo *cp)
+{
+    FetchCtl	*ctl;
+
+    for (ctl = pending; ctl != NULL; ctl = ctl->next) {
+	if (ctl->client == cp - client)
+	    ctl->client = -1;
+    }
+    cp->status.fetching = 0;
+}
+
+/* The agent with a request in flight did not respond in time */
+static void
+FetchTimeout(AgentInfo *ap)
+{
+    FetchReq	*rp = ap->fetchReq;
+
+    pmNotifyErr(LOG_INFO, "DoFetch: \"%s\" agent timeout", ap->pmDomainLabel);
+    ap->fetchReq = NULL;
+    ap->status.fetching = 0;
+    FetchDone(rp, MakeBadResult(rp->listSize, rp->list, PM_ERR_NOAGENT));
+    pmcd_trace(TR_RECV_TIMEOUT, ap->outFd, PDU_RESULT, 0);
+    CleanupAgent(ap, AT_COMM, ap->inFd);
+}
+
+/* Read the response from an agent with a request in flight */
+static void
+FetchInput(AgentInfo *ap)
+{
+    FetchReq	*rp = ap->fetchReq;
+    pmResult	*result = NULL;
+    __pmPDU	*pb;
+    int		pinpdu;
+    int		sts;
+
+    ap->fetchReq = NULL;
+    ap->status.fetching = 0;
+
+    pinpdu = sts = __pmGetPDU(ap->outFd, ANY_SIZE, pmcd_timeout, &pb);
+    if (sts > 0)
+	pmcd_trace(TR_RECV_PDU, ap->outFd, sts, (int)((__psint_t)pb & 0xffffffff));
+    if (sts == PDU_RESULT) {
+	if ((sts = __pmDecodeResult(pb, &result)) >= 0) {
+	    if (result->numpmid != rp->listSize) {
+		if (pmDebugOptions.appl0)
+		    pmNotifyErr(LOG_ERR, "DoFetch: \"%s\" agent given %d pmIDs, returned %d\n",
+				 ap->pmDomainLabel, rp->listSize, result->numpmid);
+		pmFreeResult(result);
+		result = NULL;
+		sts = PM_ERR_IPC;
+	    }
+	}
+    }
+    else {
+	if (sts == PDU_ERROR) {
+	    int s;
+	    if ((s = __pmDecodeError(pb, &sts)) < 0)
+		sts = s;
+	    else if (sts >= 0)
+		sts = PM_ERR_GENERIC;
+	    pmcd_trace(TR_RECV_ERR, ap->outFd, PDU_RESULT, sts);
+	}
+	else if (sts >= 0) {
+	    pmcd_trace(TR_WRONG_PDU, ap->outFd, PDU_RESULT, sts);
+	    sts = PM_ERR_IPC;
+	}
+    }
+    if (pinpdu > 0)
+	__pmUnpinPDUBuf(pb);
+
+    if (sts < 0) {
+	result = MakeBadResult(rp->listSize, rp->list, sts);
+
+	if (sts == PM_ERR_PMDANOTREADY) {
+	    /* the agent is indicating it can't handle PDUs for now */
+	    int k;
+	    extern int CheckError(AgentInfo *ap, int sts);
+
+	    for (k = 0; k < rp->listSize; k++)
+		result->vset[k]->numval = PM_ERR_AGAIN;
+	    sts = CheckError(ap, sts);
+	}
+
+	if (pmDebugOptions.appl0) {
+	    fprintf(stderr, "RESULT error from \"%s\" agent : %s\n",
+		    ap->pmDomainLabel, pmErrStr(sts));
+	}
+    }
+    FetchDone(rp, result);
+    if (sts >= 0)
+	FetchCacheStore(ap, rp);
+
+    if (sts == PM_ERR_IPC || sts == PM_ERR_TIMEOUT)
+	CleanupAgent(ap, AT_COMM, ap->outFd);
+}
+
+/*
+ * Wait for the response to the request in flight for this agent, if any,
+ * before some other PDU exchange with the agent.  Any queued requests
+ * will be sent later from ServiceFetches().
+ */
+void
+FetchDrainAgent(AgentInfo *ap)
+{
+    __pmFdSet		readyFds;
+    struct timeval	timeout, *tp;
+    int			sts;
+
+    while (ap->status.fetching) {
+	tp = NULL;
+	if (pmcd_timeout > 0) {
+	    TimeLeft(&ap->fetchDeadline, &timeout);
+	    tp = &timeout;
+	}
+	__pmFD_ZERO(&readyFds);
+	__pmFD_SET(ap->outFd, &readyFds);
+	setoserror(0);
+	sts = __pmSelectRead(ap->outFd + 1, &readyFds, tp);
+	if (sts > 0)
+	    FetchInput(ap);
+	else if (sts == 0)
+	    FetchTimeout(ap);
+	else if (neterror() != EINTR) {
+	    /* this is not expected to happen! */
+	    pmNotifyErr(LOG_ERR, "DoFetch: fatal select failure: %s\n",
+			netstrerror());
+	    Shutdown();
+	    exit(1);
+	}
+    }
+}
+
+/* Build and send the result for a client request, and release it */
+static void
+FetchComplete(FetchCtl *ctl)
+{
+    static pmResult	*endResult = NULL;
+    static int		maxnpmids = 0;	/* sizes endResult */
+    static int		*cursor = NULL;
+    static int		maxnreqs = 0;	/* sizes cursor */
+    ClientInfo		*cp;
+    AgentInfo		*ap;
+    FetchReq		*rp;
+    int			i, j;
+    int			sts;
+
+    if (ctl->nPmids > maxnpmids) {
+	int		need;
+	if (endResult != NULL)
+	    free(endResult);
+	need = (int)sizeof(pmResult) + (ctl->nPmids - 1) * (int)sizeof(pmValueSet *);
+	if ((endResult = (pmResult *)malloc(need)) == NULL) {
+	    pmNoMem("DoFetch.endResult", need, PM_FATAL_ERR);
+	}
+	maxnpmids = ctl->nPmids;
+    }
+    if (ctl->nReqs > maxnreqs) {
+	if (cursor != NULL)
+	    free(cursor);
+	if ((cursor = (int *)malloc(ctl->nReqs * sizeof(int))) == NULL) {
+	    pmNoMem("DoFetch.cursor", ctl->nReqs * sizeof(int), PM_FATAL_ERR);
+	}
+	maxnreqs = ctl->nReqs;
+    }
+
+    if ((cp = FetchClient(ctl)) != NULL) {
+	if (cp->status.fetching) {
+	    cp->status.fetching = 0;
+	    IoWaitResumeClient(cp);
+	}
+	this_client_id = ctl->client;
+
+	/* results from DSO agents are only ever requested now */
+	for (i = 0; i < ctl->nReqs; i++) {
+	    rp = &ctl->req[i];
+	    ap = &agent[rp->agent];
+	    if (ap->ipcType != AGENT_DSO || FetchCached(ap, rp))
+		continue;
+	    rp->result = SendFetch(rp->listSize, rp->list, ap, cp, ctl->ctxnum);
+	    ctl->changes |= ExtractState(rp->result);
+	    if (!ap->status.madeDsoResult)
+		FetchCacheStore(ap, rp);
+	}
+
+	if (ctl->changes)
+	    MarkStateChanges(ctl->changes);
+
+	endResult->numpmid = ctl->nPmids;
+	pmtimevalNow(&endResult->timestamp);
+	/* The order of the pmIDs in the per-agent results is the same as in
+	 * the original request, but on a per-agent basis.  cursor is an array
+	 * of indices (one per request) of the next metric to be retrieved
+	 * from each per-agent result's vset.
+	 */
+	memset(cursor, 0, ctl->nReqs * sizeof(cursor[0]));
+	for (i = j = 0; i < ctl->nPmids; i++) {
+	    int		k = ctl->reqIndex[i];
+
+	    if (k < 0)
+		endResult->vset[i] = ctl->bad->vset[j++];
+	    else
+		endResult->vset[i] = ctl->req[k].result->vset[cursor[k]++];
+	}
+	pmcd_trace(TR_XMIT_PDU, cp->fd, PDU_RESULT, endResult->numpmid);
+
+	sts = 0;
+	if (cp->status.changes) {
+	    /* notify client of PMCD state change */
+	    sts = __pmSendError(cp->fd, FROM_ANON, (int)cp->status.changes);
+	    if (sts > 0)
+		sts = 0;
+	    cp->status.changes = 0;
+	}
+	if (sts == 0)
+	    sts = __pmSendResult(cp->fd, FROM_ANON, endResult);
+
+	if (sts < 0) {
+	    pmcd_trace(TR_XMIT_ERR, cp->fd, PDU_RESULT, sts);
+	    CleanupClient(cp, sts);
+	}
+    }
+
+    /*
+     * pmFreeResult() all the accumulated results.
+     */
+    for (i = 0; i < ctl->nReqs; i++) {
+	rp = &ctl->req[i];
+	if (rp->key != NULL)
+	    free(rp->key);
+	if (rp->cached != NULL) {
+	    CacheRelease(rp->cached);
+	    continue;
+	}
+	if (rp->result == NULL)
+	    continue;
+	ap = &agent[rp->agent];
+	if (ap->ipcType == AGENT_DSO && ap->status.connected &&
+	    !ap->status.madeDsoResult)
+	    /* Living DSO's manage their own pmResult skeleton unless
+	     * MakeBadResult was called to create the result.  The value sets
+	     * within the skeleton need to be freed though!
+	     */
+	    __pmFreeResultValues(rp->result);
+	else
+	    /* For others it is dynamically allocated in __pmDecodeResult or
+	     * MakeBadResult
+	     */
+	    pmFreeResult(rp->result);
+    }
+    if (ctl->bad != NULL)
+	pmFreeResult(ctl->bad);
+    free(ctl);
+}
+
+/* Send results for all client requests that have nothing outstanding */
+static void
+FetchCompleteAll(void)
+{
+    FetchCtl	*ctl, **prev;
+
+    prev = &pending;
+    while ((ctl = *prev) != NULL) {
+	if (ctl->nWait > 0) {
+	    prev = &ctl->next;
+	    continue;
+	}
+	*prev = ctl->next;
+	FetchComplete(ctl);
+    }
+}
+
+/*
+ * Setup for ClientLoop() wait: return non-zero if timeout has been set
+ * for the earliest deadline of requests in flight to agents.
+ */
+int
+FetchDeadline(struct timeval *timeout)
+{
+    AgentInfo		*ap;
+    struct timeval	*first = NULL;
+    int			i;
+
+    if (pmcd_timeout <= 0)
+	return 0;
+    for (i = 0; i < nAgents; i++) {
+	ap = &agent[i];
+	if (!ap->status.fetching)
+	    continue;
+	if (first == NULL || pmtimevalSub(&ap->fetchDeadline, first) < 0)
+	    first = &ap->fetchDeadline;
+    }
+    if (first == NULL)
+	return 0;
+    TimeLeft(first, timeout);
+    return 1;
+}
+
+/*
+ * Called from ClientLoop() after waiting: collect agent responses, expire
+ * requests that have timed out, send queued requests to idle agents and
+ * finally respond to clients with completed requests.
+ */
+void
+ServiceFetches(IoReady *ready, int nready)
+{
+    struct timeval	now;
+    AgentInfo		*ap;
+    int			i;
+
+    for (i = 0; i < nready; i++) {
+	if (ready[i].type != IOWAIT_AGENT)
+	    continue;
+	ap = &agent[ready[i].index];
+	if (ap->status.fetching && ap->outFd == ready[i].fd)
+	    FetchInput(ap);
+    }
+
+    pmtimevalNow(&now);
+    for (i = 0; i < nAgents; i++) {
+	ap = &agent[i];
+	if (ap->status.fetching && pmcd_timeout > 0 &&
+	    pmtimevalSub(&ap->fetchDeadline, &now) <= 0)
+	    FetchTimeout(ap);
+	if (!ap->status.fetching && ap->fetchHead != NULL)
+	    FetchStart(ap);
+    }
+    FetchCompleteAll();
+}
+
+/*
+ * Complete all pending requests, e.g. before the agent table is
+ * reconfigured.
+ */
+void
+FetchDrainAll(void)
+{
+    int		i, busy;
+
+    do {
+	busy = 0;
+	for (i = 0; i < nAgents; i++) {
+	    FetchDrainAgent(&agent[i]);
+	    if (agent[i].fetchHead != NULL) {
+		FetchStart(&agent[i]);
+		busy = 1;
+	    }
+	}
+    } while (busy);
+    FetchCompleteAll();
+}
+
 int
 DoFetch(ClientInfo *cip, __pmPDU* pb)
 {
-    int			i, j;
+    int			i;
     int 		sts;
     int			ctxnum;
-    unsigned int	changes = 0;
     pmTimeval		when;
     int			nPmids;
     pmID		*pmidList;
-    static pmResult	*endResult = NULL;
-    static int		maxnpmids = 0;	/* sizes endResult */
     DomPmidList		*dList;		/* NOTE: NOT indexed by agent index */
     static int		nDoms = 0;
-    static pmResult	**results = NULL;
-    static int		*resIndex = NULL;
-    __pmFdSet		waitFds;
-    __pmFdSet		readyFds;
-    int			nWait;
-    int			maxFd;
-    struct timeval	timeout;
-    __pmHashCtl		*hcp;
+    static int		*reqIndex = NULL;
+    __pmOHashCtl	*hcp;
     __pmHashNode	*hp;
     pmProfile		*profile;
+    FetchCtl		*ctl;
+    FetchReq		*rp;
+    AgentInfo		*ap;
+    pmID		*list;
+    int			nReqs;
+    size_t		need;
 
     if (nAgents > nDoms) {
-	if (results != NULL)
-	    free(results);
-	if (resIndex != NULL)
-	    free(resIndex);
-	results = (pmResult **)malloc((nAgents + 1) * sizeof (pmResult *));
-	resIndex = (int *)malloc((nAgents + 1) * sizeof(int));
-	if (results == NULL || resIndex == NULL) {
-	    pmNoMem("DoFetch.results", (nAgents + 1) * sizeof (pmResult *) + (nAgents + 1) * sizeof(int), PM_FATAL_ERR);
+	if (reqIndex != NULL)
+	    free(reqIndex);
+	reqIndex = (int *)malloc((nAgents + 1) * sizeof(int));
+	if (reqIndex == NULL) {
+	    pmNoMem("DoFetch.reqIndex", (nAgents + 1) * sizeof(int), PM_FATAL_ERR);
 	}
 	nDoms = nAgents;
     }
-    memset(results, 0, (nAgents + 1) * sizeof(results[0]));
 
     sts = __pmDecodeFetch(pb, &ctxnum, &when, &nPmids, &pmidList);
     if (sts < 0)
@@ -401,7 +946,7 @@ DoFetch(ClientInfo *cip, __pmPDU* pb)
     profile = NULL;
     if (ctxnum >= 0) {
 	hcp = &cip->profile;
-	hp = __pmHashSearch(ctxnum, hcp);
+	hp = __pmOHashSearch(ctxnum, hcp);
 	if (hp != NULL)
 	    profile = (pmProfile *)hp->data;
     }
@@ -414,211 +959,95 @@ DoFetch(ClientInfo *cip, __pmPDU* pb)
 	return PM_ERR_NOPROFILE;
     }
 
-    if (nPmids > maxnpmids) {
-	int		need;
-	if (endResult != NULL)
-	    free(endResult);
-	need = (int)sizeof(pmResult) + (nPmids - 1) * (int)sizeof(pmValueSet *);
-	if ((endResult = (pmResult *)malloc(need)) == NULL) {
-	    pmNoMem("DoFetch.endResult", need, PM_FATAL_ERR);
-	}
-	maxnpmids = nPmids;
-    }
-
     dList = SplitPmidList(nPmids, pmidList);
+    for (nReqs = 0; dList[nReqs].domain != -1; nReqs++)
+	;
 
-    /* For each domain in the split pmidList, dispatch the per-domain subset
-     * of pmIDs to the appropriate agent.  For DSO agents, the pmResult will
-     * come back immediately.  If a request cannot be sent to an agent, a
-     * suitable pmResult (containing metric not available values) will be
-     * returned.
+    /* One allocation holds the request, the per-agent requests, the
+     * pmIDs (copied, so the PDU buffer can be released now) in both
+     * per-agent and requested order, and the map between them.
      */
-    __pmFD_ZERO(&waitFds);
-    nWait = 0;
-    maxFd = -1;
-    for (i = 0; dList[i].domain != -1; i++) {
-	j = mapdom[dList[i].domain];
-	results[j] = SendFetch(&dList[i], &agent[j], cip, ctxnum);
-	if (results[j] == NULL) { /* Wait for agent's response */
-	    int fd = agent[j].outFd;
-	    agent[j].status.busy = 1;
-	    __pmFD_SET(fd, &waitFds);
-	    if (fd > maxFd)
-		maxFd = fd;
-	    nWait++;
-	} else {
-	    changes |= ExtractState(results[j]);
-	}
+    need = sizeof(FetchCtl) + nReqs * sizeof(FetchReq) +
+	   2 * nPmids * sizeof(pmID) + nPmids * sizeof(int);
+    if ((ctl = (FetchCtl *)malloc(need)) == NULL) {
+	pmNoMem("DoFetch.ctl", need, PM_FATAL_ERR);
     }
-    /* Construct pmResult for bad-pmID list */
-    if (dList[i].listSize != 0)
-	results[nAgents] = MakeBadResult(dList[i].listSize, dList[i].list, PM_ERR_NOAGENT);
-
-    /* Wait for results to roll in from agents */
-    while (nWait > 0) {
-        __pmFD_COPY(&readyFds, &waitFds);
-	if (nWait > 1) {
-	    timeout.tv_sec = pmcd_timeout;
-	    timeout.tv_usec = 0;
-
-            retry:
-	    setoserror(0);
-	    sts = __pmSelectRead(maxFd+1, &readyFds, &timeout);
-
-	    if (sts == 0) {
-		pmNotifyErr(LOG_INFO, "DoFetch: select timeout");
-
-		/* Timeout, terminate agents with undelivered results */
-		for (i = 0; i < nAgents; i++) {
-		    if (agent[i].status.busy) {
-			/* Find entry in dList for this agent */
-			for (j = 0; dList[j].domain != -1; j++)
-			    if (dList[j].domain == agent[i].pmDomainId)
-				break;
-			results[i] = MakeBadResult(dList[j].listSize,
-						   dList[j].list,
-						   PM_ERR_NOAGENT);
-			pmcd_trace(TR_RECV_TIMEOUT, agent[i].outFd, PDU_RESULT, 0);
-			CleanupAgent(&agent[i], AT_COMM, agent[i].inFd);
-		    }
-		}
-		break;
-	    }
-	    else if (sts < 0) {
-		if (neterror() == EINTR)
-		    goto retry;
-		/* this is not expected to happen! */
-		pmNotifyErr(LOG_ERR, "DoFetch: fatal select failure: %s\n",
-			netstrerror());
-		Shutdown();
-		exit(1);
-	    }
-	}
+    ctl->next = NULL;
+    ctl->client = cip - client;
+    ctl->seq = cip->seq;
+    ctl->ctxnum = ctxnum;
+    ctl->nPmids = nPmids;
+    ctl->changes = 0;
+    ctl->nWait = 0;
+    ctl->nReqs = nReqs;
+    list = (pmID *)&ctl->req[nReqs > 0 ? nReqs : 1];
+    ctl->pmidList = list;
+    memcpy(list, pmidList, nPmids * sizeof(pmID));
+    list += nPmids;
+    ctl->reqIndex = (int *)(list + nPmids);
 
-	/* Read results from agents that have them ready */
-	for (i = 0; i < nAgents; i++) {
-	    AgentInfo	*ap = &agent[i];
-	    int		pinpdu;
-	    if (!ap->status.busy || !__pmFD_ISSET(ap->outFd, &readyFds))
-		continue;
-	    ap->status.busy = 0;
-	    __pmFD_CLR(ap->outFd, &waitFds);
-	    nWait--;
-	    pinpdu = sts = __pmGetPDU(ap->outFd, ANY_SIZE, pmcd_timeout, &pb);
-	    if (sts > 0)
-		pmcd_trace(TR_RECV_PDU, ap->outFd, sts, (int)((__psint_t)pb & 0xffffffff));
-	    if (sts == PDU_RESULT) {
-		if ((sts = __pmDecodeResult(pb, &results[i])) >= 0) {
-		    if (results[i]->numpmid == aFreq[i]) {
-			changes |= ExtractState(results[i]);
-		    } else {
-			if (pmDebugOptions.appl0)
-			    pmNotifyErr(LOG_ERR, "DoFetch: \"%s\" agent given %d pmIDs, returned %d\n",
-					 ap->pmDomainLabel, aFreq[i], results[i]->numpmid);
-			pmFreeResult(results[i]);
-			sts = PM_ERR_IPC;
-		    }
-		}
-	    }
-	    else {
-		if (sts == PDU_ERROR) {
-		    int s;
-		    if ((s = __pmDecodeError(pb, &sts)) < 0)
-			sts = s;
-		    else if (sts >= 0)
-			sts = PM_ERR_GENERIC;
-		    pmcd_trace(TR_RECV_ERR, ap->outFd, PDU_RESULT, sts);
-		}
-		else if (sts >= 0) {
-		    pmcd_trace(TR_WRONG_PDU, ap->outFd, PDU_RESULT, sts);
-		    sts = PM_ERR_IPC;
-		}
-	    }
-	    if (pinpdu > 0)
-		__pmUnpinPDUBuf(pb);
-
-	    if (sts < 0) {
-		/* Find entry in dList for this agent */
-		for (j = 0; dList[j].domain != -1; j++)
-		    if (dList[j].domain == agent[i].pmDomainId)
-			break;
-		results[i] = MakeBadResult(dList[j].listSize,
-					   dList[j].list, sts);
-
-		if (sts == PM_ERR_PMDANOTREADY) {
-		    /* the agent is indicating it can't handle PDUs for now */
-		    int k;
-		    extern int CheckError(AgentInfo *ap, int sts);
-
-		    for (k = 0; k < dList[j].listSize; k++)
-			results[i]->vset[k]->numval = PM_ERR_AGAIN;
-		    sts = CheckError(&agent[i], sts);
-		}
-
-		if (pmDebugOptions.appl0) {
-		    fprintf(stderr, "RESULT error from \"%s\" agent : %s\n",
-			    ap->pmDomainLabel, pmErrStr(sts));
-		}
-		if (sts == PM_ERR_IPC || sts == PM_ERR_TIMEOUT)
-		    CleanupAgent(ap, AT_COMM, ap->outFd);
-	    }
+    for (i = 0; i <= nAgents; i++)
+	reqIndex[i] = -1;
+    for (i = 0; i < nReqs; i++) {
+	rp = &ctl->req[i];
+	rp->next = NULL;
+	rp->ctl = ctl;
+	rp->agent = mapdom[dList[i].domain];
+	rp->listSize = dList[i].listSize;
+	rp->list = list;
+	rp->result = NULL;
+	rp->cached = NULL;
+	memcpy(list, dList[i].list, rp->listSize * sizeof(pmID));
+	list += rp->listSize;
+	reqIndex[rp->agent] = i;
+	ap = &agent[rp->agent];
+	if (CacheWindow(ap) > 0)
+	    rp->key = CacheMakeKey(ap, cip, profile, rp->listSize, rp->list);
+	else {
+	    rp->key = NULL;
+	    if (ap->fetchCache != NULL)
+		CacheFlush(ap);
 	}
     }
+    for (i = 0; i < nPmids; i++)
+	ctl->reqIndex[i] = reqIndex[mapdom[((__pmID_int *)&pmidList[i])->domain]];
 
-    if (changes)
-	MarkStateChanges(changes);
-
-    endResult->numpmid = nPmids;
-    pmtimevalNow(&endResult->timestamp);
-    /* The order of the pmIDs in the per-domain results is the same as in the
-     * original request, but on a per-domain basis.  resIndex is an array of
-     * indices (one per agent) of the next metric to be retrieved from each
-     * per-domain result's vset.
-     */
-    memset(resIndex, 0, (nAgents + 1) * sizeof(resIndex[0]));
+    /* Construct pmResult for bad-pmID list */
+    if (dList[i = nReqs].listSize != 0)
+	ctl->bad = MakeBadResult(dList[i].listSize, dList[i].list, PM_ERR_NOAGENT);
+    else
+	ctl->bad = NULL;
 
-    for (i = 0; i < nPmids; i++) {
-	j = mapdom[((__pmID_int *)&pmidList[i])->domain];
-	endResult->vset[i] = results[j]->vset[resIndex[j]++];
-    }
-    pmcd_trace(TR_XMIT_PDU, cip->fd, PDU_RESULT, endResult->numpmid);
+    __pmUnpinPDUBuf(pmidList);
 
-    sts = 0;
-    if (cip->status.changes) {
-	/* notify client of PMCD state change */
-	sts = __pmSendError(cip->fd, FROM_ANON, (int)cip->status.changes);
-	if (sts > 0)
-	    sts = 0;
-	cip->status.changes = 0;
+    /* For each agent in the split pmidList, queue the per-agent subset
+     * of pmIDs with daemon agents, sending immediately to idle agents.
+     * If a request cannot be sent to an agent, a suitable pmResult
+     * (containing metric not available values) will be used.
+     */
+    for (i = 0; i < nReqs; i++) {
+	rp = &ctl->req[i];
+	ap = &agent[rp->agent];
+	if (ap->ipcType == AGENT_DSO)
+	    continue;
+	ctl->nWait++;
+	FetchQueue(ap, rp);
+	if (!ap->status.fetching)
+	    FetchStart(ap);
+	else if (pmDebugOptions.appl0)
+	    fprintf(stderr, "DoFetch: client[%d] queued behind busy \"%s\" agent\n",
+		    ctl->client, ap->pmDomainLabel);
     }
-    if (sts == 0)
-	sts = __pmSendResult(cip->fd, FROM_ANON, endResult);
 
-    if (sts < 0) {
-	pmcd_trace(TR_XMIT_ERR, cip->fd, PDU_RESULT, sts);
-	CleanupClient(cip, sts);
+    if (ctl->nWait == 0) {
+	/* all done, or DSO agents only */
+	FetchComplete(ctl);
     }
-
-    /*
-     * pmFreeResult() all the accumulated results.
-     */
-    for (i = 0; dList[i].domain != -1; i++) {
-	j = mapdom[dList[i].domain];
-	if (agent[j].ipcType == AGENT_DSO && agent[j].status.connected &&
-	    !agent[j].status.madeDsoResult)
-	    /* Living DSO's manage their own pmResult skeleton unless
-	     * MakeBadResult was called to create the result.  The value sets
-	     * within the skeleton need to be freed though!
-	     */
-	    __pmFreeResultValues(results[j]);
-	else
-	    /* For others it is dynamically allocated in __pmDecodeResult or
-	     * MakeBadResult
-	     */
-	    pmFreeResult(results[j]);
+    else {
+	cip->status.fetching = 1;
+	IoWaitSuspendClient(cip);
+	ctl->next = pending;
+	pending = ctl;
     }
-    if (results[nAgents] != NULL)
-	pmFreeResult(results[nAgents]);
-    __pmUnpinPDUBuf(pmidList);
     return 0;
 }
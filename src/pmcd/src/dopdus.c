@@ -79,6 +79,7 @@ DoText(ClientInfo *cp, __pmPDU* pb)
 					  ap->ipc.dso.dispatch.version.any.ext);
     }
     else {
+	FetchDrainAgent(ap);
 	if (ap->status.notReady)
 	    return PM_ERR_AGAIN;
 	pmcd_trace(TR_XMIT_PDU, ap->inFd, PDU_TEXT_REQ, ident);
@@ -131,7 +132,7 @@ DoText(ClientInfo *cp, __pmPDU* pb)
 int
 DoProfile(ClientInfo *cp, __pmPDU *pb)
 {
-    __pmHashCtl	*hcp;
+    __pmOHashCtl	*hcp;
     pmProfile	*newProf;
     int		ctxnum, sts, i;
 
@@ -139,7 +140,7 @@ DoProfile(ClientInfo *cp, __pmPDU *pb)
     if (sts >= 0) {
 	__pmHashNode	*hp;
 	hcp = &cp->profile;
-	if ((hp = __pmHashSearch(ctxnum, hcp)) != NULL) {
+	if ((hp = __pmOHashSearch(ctxnum, hcp)) != NULL) {
 	    /* seen this context slot before for this client */
 	    pmProfile	*profile = (pmProfile *)hp->data;
 	    if (profile != NULL)
@@ -148,8 +149,8 @@ DoProfile(ClientInfo *cp, __pmPDU *pb)
 	}
 	else {
 	    /* first time for this context slot for this client */
-	    if ((sts = __pmHashAdd(ctxnum, newProf, hcp)) > 0) {
-		/* __pmHashAdd returns 1 for success, but we want zero. */
+	    if ((sts = __pmOHashAdd(ctxnum, newProf, hcp)) > 0) {
+		/* __pmOHashAdd returns 1 for success, but we want zero. */
 		sts = 0;
 	    }
 	}
@@ -157,6 +158,7 @@ DoProfile(ClientInfo *cp, __pmPDU *pb)
 	/* "Invalidate" any references to the client context's profile in the
 	 * agents to which the old profile was last sent
 	 */
+	ResetProfileSent(cp, ctxnum);
 	for (i = 0; i < nAgents; i++) {
 	    AgentInfo	*ap = &agent[i];
 
@@ -193,6 +195,7 @@ DoDesc(ClientInfo *cp, __pmPDU *pb)
 					ap->ipc.dso.dispatch.version.any.ext);
     }
     else {
+	FetchDrainAgent(ap);
 	if (ap->status.notReady)
 	    return PM_ERR_AGAIN;
 	pmcd_trace(TR_XMIT_PDU, ap->inFd, PDU_DESC_REQ, (int)pmid);
@@ -283,6 +286,7 @@ DoInstance(ClientInfo *cp, __pmPDU *pb)
 					ap->ipc.dso.dispatch.version.any.ext);
     }
     else {
+	FetchDrainAgent(ap);
 	if (ap->status.notReady) {
 	    if (name != NULL) free(name);
 	    return PM_ERR_AGAIN;
@@ -511,6 +515,7 @@ DoLabel(ClientInfo *cp, __pmPDU *pb)
 	    nsets = sts;
     }
     else {
+	FetchDrainAgent(ap);
 	if (ap->status.notReady)
 	    return PM_ERR_AGAIN;
 
@@ -618,6 +623,7 @@ DoPMNSIDs(ClientInfo *cp, __pmPDU *pb)
 	}
 	else {
 	    /* daemon PMDA ... ship request on */
+	    FetchDrainAgent(ap);
 	    if (ap->status.notReady)
 		return PM_ERR_AGAIN;
 	    pmcd_trace(TR_XMIT_PDU, ap->inFd, PDU_PMNS_IDS, 1);
@@ -736,6 +742,7 @@ DoPMNSNames(ClientInfo *cp, __pmPDU *pb)
 	    else {
 		/* daemon PMDA ... ship request on */
 		int		fdfail = -1;
+		FetchDrainAgent(ap);
 		if (ap->status.notReady)
 		    lsts = PM_ERR_AGAIN;
 		else {
@@ -869,6 +876,7 @@ DoPMNSChild(ClientInfo *cp, __pmPDU *pb)
 	else {
 	    /* daemon PMDA ... ship request on */
 	    int		fdfail = -1;
+	    FetchDrainAgent(ap);
 	    if (ap->status.notReady)
 		sts = PM_ERR_AGAIN;
 	    else {
@@ -1052,6 +1060,7 @@ traverse_dynamic(ClientInfo *cp, char *start, int *num_names, char ***names)
 	    else {
 		/* daemon PMDA ... ship request on */
 		int		fdfail = -1;
+		FetchDrainAgent(ap);
 		if (ap->status.notReady)
 		    continue;
 		pmcd_trace(TR_XMIT_PDU, ap->inFd, PDU_PMNS_TRAVERSE, 1);
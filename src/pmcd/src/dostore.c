@@ -162,8 +162,12 @@ DoStore(ClientInfo *cp, __pmPDU* pb)
 		ap->ipc.dso.dispatch.version.four.ext->e_context = cp - client;
 	    s = ap->ipc.dso.dispatch.version.any.store(dResult[i],
 				       ap->ipc.dso.dispatch.version.any.ext);
+	    /* cached results may predate the store */
+	    if (s >= 0)
+		CacheFlush(ap);
 	}
 	else {
+	    FetchDrainAgent(ap);
 	    if (ap->status.notReady == 0) {
 		/* agent is ready for PDUs */
 		pmcd_trace(TR_XMIT_PDU, ap->inFd, PDU_RESULT, dResult[i]->numpmid);
@@ -255,6 +259,8 @@ DoStore(ClientInfo *cp, __pmPDU* pb)
 			sts = CheckError(ap, s);
 			pmcd_trace(TR_RECV_ERR, ap->outFd, PDU_RESULT, sts);
 		    }
+		    else
+			CacheFlush(ap);
 		}
 	    }
 	    else {
@@ -0,0 +1,315 @@
+/*
+ * Copyright (c) 2020 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+/*
+ * Per-agent cache of recent fetch results.
+ *
+ * Many clients (pmlogger, pmie, pmproxy, ...) tend to fetch the same
+ * metrics from an agent every few seconds.  When an agent has a cache
+ * window set, the pmResult from the agent is kept for that long and
+ * any identical request arriving in the meantime is answered from it.
+ * Requests are identical if they have the same pmIDs (in the same
+ * order), the same instance profile for the agent's instance domains
+ * and, for agents that use connection attributes, the same user and
+ * container attributes.
+ *
+ * Requests queued behind one in flight for a daemon agent are checked
+ * when they reach the head of the queue, so a burst of identical
+ * requests costs a single round trip to the agent.
+ */
+
+#include "pmapi.h"
+#include "libpcp.h"
+#include "pmcd.h"
+
+#define CACHE_MAXENTRIES	32	/* per agent, oldest are dropped */
+
+struct CacheKey {
+    unsigned int	hash;
+    int			len;		/* number of words in data[] */
+    __uint32_t		data[1];
+};
+
+struct CacheEntry {
+    struct CacheEntry	*next;
+    CacheKey		*key;
+    pmResult		*result;	/* owned by the cache */
+    struct timeval	stamp;		/* when result came from the agent */
+    int			refs;		/* requests using result */
+    int			orphan;		/* no longer in an agent's cache */
+};
+
+/* connection attributes that may change the values an agent returns */
+static const int	keyattrs[] = {
+    PCP_ATTR_USERNAME, PCP_ATTR_USERID, PCP_ATTR_GROUPID, PCP_ATTR_CONTAINER
+};
+
+static __uint32_t	*keybuf;	/* key under construction */
+static int		keysize;
+static int		keylen;
+
+static void
+KeyAdd(__uint32_t word)
+{
+    if (keylen == keysize) {
+	keysize = keysize ? keysize * 2 : 256;
+	if ((keybuf = (__uint32_t *)realloc(keybuf, keysize * sizeof(__uint32_t))) == NULL) {
+	    pmNoMem("CacheMakeKey", keysize * sizeof(__uint32_t), PM_FATAL_ERR);
+	    /*NOTREACHED*/
+	}
+    }
+    keybuf[keylen++] = word;
+}
+
+static void
+KeyAddString(const char *str)
+{
+    __uint32_t	word;
+    int		len = strlen(str);
+
+    KeyAdd(len);
+    for (; len > 0; len -= sizeof(word), str += sizeof(word)) {
+	word = 0;
+	memcpy(&word, str, len < sizeof(word) ? len : sizeof(word));
+	KeyAdd(word);
+    }
+}
+
+/*
+ * Cache window for an agent in milliseconds, zero if results from the
+ * agent are not cached.
+ */
+int
+CacheWindow(AgentInfo *ap)
+{
+    if (!ap->status.connected || ap->status.notReady || ap->status.fenced)
+	return 0;
+    return ap->cacheWindow;
+}
+
+/*
+ * Build the key identifying a request for the pmIDs in list from the
+ * given client context.
+ */
+CacheKey *
+CacheMakeKey(AgentInfo *ap, ClientInfo *cp, pmProfile *profile,
+		int listSize, pmID *list)
+{
+    pmInDomProfile	*ip;
+    __pmHashNode	*hp;
+    CacheKey		*key;
+    unsigned int	hash;
+    size_t		need;
+    int			i, j;
+
+    keylen = 0;
+    KeyAdd(listSize);
+    for (i = 0; i < listSize; i++)
+	KeyAdd(list[i]);
+
+    if (profile != NULL) {
+	KeyAdd(profile->state);
+	for (i = 0; i < profile->profile_len; i++) {
+	    ip = &profile->profile[i];
+	    if (pmInDom_domain(ip->indom) != ap->pmDomainId)
+		continue;
+	    KeyAdd(ip->indom);
+	    KeyAdd(ip->state);
+	    KeyAdd(ip->instances_len);
+	    for (j = 0; j < ip->instances_len; j++)
+		KeyAdd(ip->instances[j]);
+	}
+    }
+
+    if (ap->status.flags & (PDU_FLAG_AUTH|PDU_FLAG_CONTAINER)) {
+	for (i = 0; i < sizeof(keyattrs) / sizeof(keyattrs[0]); i++) {
+	    if ((hp = __pmHashSearch(keyattrs[i], &cp->attrs)) == NULL)
+		continue;
+	    KeyAdd(keyattrs[i]);
+	    KeyAddString(hp->data ? (char *)hp->data : "");
+	}
+    }
+
+    /* FNV-1a */
+    hash = 2166136261U;
+    for (i = 0; i < keylen; i++) {
+	hash ^= keybuf[i];
+	hash *= 16777619U;
+    }
+
+    need = sizeof(CacheKey) + (keylen - 1) * sizeof(__uint32_t);
+    if ((key = (CacheKey *)malloc(need)) == NULL) {
+	pmNoMem("CacheMakeKey", need, PM_FATAL_ERR);
+	/*NOTREACHED*/
+    }
+    key->hash = hash;
+    key->len = keylen;
+    memcpy(key->data, keybuf, keylen * sizeof(__uint32_t));
+    return key;
+}
+
+static int
+KeyMatch(CacheKey *a, CacheKey *b)
+{
+    return a->hash == b->hash && a->len == b->len &&
+	   memcmp(a->data, b->data, a->len * sizeof(__uint32_t)) == 0;
+}
+
+static void
+FreeEntry(CacheEntry *ep)
+{
+    pmFreeResult(ep->result);
+    free(ep->key);
+    free(ep);
+}
+
+/* Remove an entry from an agent's cache, it is freed once unused */
+static void
+DropEntry(CacheEntry *ep)
+{
+    if (ep->refs > 0)
+	ep->orphan = 1;
+    else
+	FreeEntry(ep);
+}
+
+static int
+Fresh(AgentInfo *ap, CacheEntry *ep, struct timeval *now)
+{
+    return pmtimevalSub(now, &ep->stamp) * 1000.0 < (double)ap->cacheWindow;
+}
+
+/*
+ * Return the cached entry for a request with this key if there is one
+ * within the agent's cache window, else NULL.
+ */
+CacheEntry *
+CacheLookup(AgentInfo *ap, CacheKey *key)
+{
+    struct timeval	now;
+    CacheEntry		*ep;
+
+    pmtimevalNow(&now);
+    for (ep = ap->fetchCache; ep != NULL; ep = ep->next) {
+	if (KeyMatch(ep->key, key) && Fresh(ap, ep, &now)) {
+	    ep->refs++;
+	    pmcd_cache_hits++;
+	    if (pmDebugOptions.appl0)
+		fprintf(stderr, "CacheLookup: \"%s\" agent hit, %d pmIDs\n",
+			ap->pmDomainLabel, ep->result->numpmid);
+	    return ep;
+	}
+    }
+    pmcd_cache_misses++;
+    return NULL;
+}
+
+/*
+ * Add a result just returned by the agent for the request with this key.
+ * The cache takes over both key and result.  For a DSO agent the result
+ * is the agent's own pmResult, so only the value sets (which are freed
+ * after every fetch) are taken, and any values in the agent's static
+ * buffers are copied.
+ */
+CacheEntry *
+CacheStore(AgentInfo *ap, CacheKey *key, pmResult *result)
+{
+    struct timeval	now;
+    CacheEntry		*ep, **prev;
+    pmValueSet		*vsp;
+    pmValueBlock	*vbp;
+    int			count = 0;
+    int			i, j;
+    size_t		need;
+
+    if ((ep = (CacheEntry *)malloc(sizeof(CacheEntry))) == NULL) {
+	pmNoMem("CacheStore", sizeof(CacheEntry), PM_FATAL_ERR);
+	/*NOTREACHED*/
+    }
+    if (ap->ipcType == AGENT_DSO) {
+	need = sizeof(pmResult) + (result->numpmid - 1) * sizeof(pmValueSet *);
+	if (result->numpmid == 0)
+	    need = sizeof(pmResult);
+	if ((ep->result = (pmResult *)malloc(need)) == NULL) {
+	    pmNoMem("CacheStore.result", need, PM_FATAL_ERR);
+	    /*NOTREACHED*/
+	}
+	memcpy(ep->result, result, need);
+	for (i = 0; i < result->numpmid; i++) {
+	    vsp = result->vset[i];
+	    if (vsp->numval <= 0 || vsp->valfmt != PM_VAL_SPTR)
+		continue;
+	    for (j = 0; j < vsp->numval; j++) {
+		need = vsp->vlist[j].value.pval->vlen;
+		if ((vbp = (pmValueBlock *)malloc(need)) == NULL) {
+		    pmNoMem("CacheStore.pval", need, PM_FATAL_ERR);
+		    /*NOTREACHED*/
+		}
+		memcpy(vbp, vsp->vlist[j].value.pval, need);
+		vsp->vlist[j].value.pval = vbp;
+	    }
+	    vsp->valfmt = PM_VAL_DPTR;
+	}
+    }
+    else
+	ep->result = result;
+    ep->key = key;
+    ep->refs = 1;
+    ep->orphan = 0;
+    pmtimevalNow(&now);
+    ep->stamp = now;
+
+    /* drop stale entries and any older copy of this one */
+    prev = &ap->fetchCache;
+    while (*prev != NULL) {
+	CacheEntry	*xp = *prev;
+
+	if (!Fresh(ap, xp, &now) || KeyMatch(xp->key, key) ||
+	    ++count >= CACHE_MAXENTRIES) {
+	    *prev = xp->next;
+	    DropEntry(xp);
+	}
+	else
+	    prev = &xp->next;
+    }
+    ep->next = ap->fetchCache;
+    ap->fetchCache = ep;
+    return ep;
+}
+
+/* A request has finished with a cached result */
+void
+CacheRelease(CacheEntry *ep)
+{
+    if (--ep->refs == 0 && ep->orphan)
+	FreeEntry(ep);
+}
+
+pmResult *
+CacheResult(CacheEntry *ep)
+{
+    return ep->result;
+}
+
+/* Discard all results from an agent */
+void
+CacheFlush(AgentInfo *ap)
+{
+    CacheEntry	*ep;
+
+    while ((ep = ap->fetchCache) != NULL) {
+	ap->fetchCache = ep->next;
+	DropEntry(ep);
+    }
+}
@@ -0,0 +1,392 @@
+/*
+ * Copyright (c) 2020 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+/*
+ * Waiting for input on the request ports, client connections and agents
+ * for ClientLoop().
+ *
+ * Where epoll(7) is available, client and request port descriptors are
+ * registered once (and removed while a client has a fetch pending) so
+ * the cost of each wakeup depends on the number of descriptors that are
+ * ready, not the number of connected clients.  The handful of agent
+ * descriptors that need watching changes from one iteration to the next
+ * (not ready agents, and agents with a fetch in flight) so these are
+ * polled together with the epoll descriptor itself.
+ *
+ * Otherwise, and if epoll cannot be setup, the traditional select(2)
+ * loop is used, which limits client descriptors to below FD_SETSIZE.
+ */
+
+#include "pmapi.h"
+#include "libpcp.h"
+#include "pmcd.h"
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_POLL_H)
+#include <sys/epoll.h>
+#include <poll.h>
+#define HAVE_EPOLL 1
+#endif
+#ifdef HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif
+
+static __pmFdSet	portFds;	/* request port descriptors */
+static int		maxPortFd = -1;	/* largest request port descriptor */
+
+static IoReady		*ready;		/* descriptors with input pending */
+static int		szReady;
+
+#ifdef HAVE_EPOLL
+#define MAXEVENTS	256		/* epoll_wait() batch, the rest wait */
+
+static int		epfd = -1;	/* -1 for the select(2) fallback */
+static struct epoll_event events[MAXEVENTS];
+static struct pollfd	*pfd;		/* epfd, then watched agents */
+static int		szPfd;
+#endif
+
+/* Make room for at least need entries in the ready list */
+static void
+GrowReady(int need)
+{
+    int		size;
+
+    if (need <= szReady)
+	return;
+    size = szReady ? szReady : 64;
+    while (size < need)
+	size *= 2;
+    if ((ready = (IoReady *)realloc(ready, size * sizeof(IoReady))) == NULL) {
+	pmNoMem("IoWait.ready", size * sizeof(IoReady), PM_FATAL_ERR);
+	/*NOTREACHED*/
+    }
+    szReady = size;
+}
+
+static void
+AddReady(int *n, int type, int index, int fd)
+{
+    ready[*n].type = type;
+    ready[*n].index = index;
+    ready[*n].fd = fd;
+    (*n)++;
+}
+
+/* Agents not ready, or with a fetch in flight, send unsolicited input */
+static int
+WatchAgent(AgentInfo *ap)
+{
+    return ap->outFd >= 0 && (ap->status.notReady || ap->status.fetching);
+}
+
+static int
+SelectWait(struct timeval *timeout)
+{
+    __pmFdSet	readyFds;
+    AgentInfo	*ap;
+    ClientInfo	*cp;
+    int		i, n, sts;
+    int		maxFd = maxPortFd;
+
+    readyFds = portFds;
+    for (i = 0; i < nClients; i++) {
+	cp = &client[i];
+	if (!cp->status.connected || cp->status.fetching)
+	    continue;
+	__pmFD_SET(cp->fd, &readyFds);
+	if (cp->fd > maxFd)
+	    maxFd = cp->fd;
+    }
+    for (i = 0; i < nAgents; i++) {
+	ap = &agent[i];
+	if (!WatchAgent(ap))
+	    continue;
+	__pmFD_SET(ap->outFd, &readyFds);
+	if (ap->outFd > maxFd)
+	    maxFd = ap->outFd;
+	if (pmDebugOptions.appl0 && ap->status.notReady)
+	    pmNotifyErr(LOG_INFO, "not ready: check %s agent on fd %d\n",
+			ap->pmDomainLabel, ap->outFd);
+    }
+
+    if ((sts = __pmSelectRead(maxFd + 1, &readyFds, timeout)) <= 0)
+	return sts;
+
+    /* agents first, so that fetch responses are collected early */
+    GrowReady(nAgents + nClients + maxPortFd + 1);
+    n = 0;
+    for (i = 0; i < nAgents; i++) {
+	ap = &agent[i];
+	if (WatchAgent(ap) && __pmFD_ISSET(ap->outFd, &readyFds))
+	    AddReady(&n, IOWAIT_AGENT, i, ap->outFd);
+    }
+    for (i = 0; i < nClients; i++) {
+	cp = &client[i];
+	if (cp->status.connected && !cp->status.fetching &&
+	    __pmFD_ISSET(cp->fd, &readyFds))
+	    AddReady(&n, IOWAIT_CLIENT, i, cp->fd);
+    }
+    for (i = 0; i <= maxPortFd; i++) {
+	if (__pmFD_ISSET(i, &portFds) && __pmFD_ISSET(i, &readyFds))
+	    AddReady(&n, IOWAIT_PORT, -1, i);
+    }
+    return n;
+}
+
+#ifdef HAVE_EPOLL
+static int
+EpollCtl(int op, int fd, int type, int index, unsigned int want)
+{
+    struct epoll_event	ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = want;
+    ev.data.u64 = ((__uint64_t)type << 32) | (__uint32_t)index;
+    if (epoll_ctl(epfd, op, __pmFD(fd), &ev) < 0)
+	return -oserror();
+    return 0;
+}
+
+static int
+EpollWait(struct timeval *timeout)
+{
+    AgentInfo	*ap;
+    ClientInfo	*cp;
+    int		i, n, sts, type, index;
+    int		nfds = 1;
+    int		msec = -1;
+
+    if (timeout != NULL)
+	msec = timeout->tv_sec * 1000 + (timeout->tv_usec + 999) / 1000;
+
+    if (nAgents + 1 > szPfd) {
+	szPfd = nAgents + 1;
+	if ((pfd = (struct pollfd *)realloc(pfd, szPfd * sizeof(*pfd))) == NULL) {
+	    pmNoMem("IoWait.pfd", szPfd * sizeof(*pfd), PM_FATAL_ERR);
+	    /*NOTREACHED*/
+	}
+    }
+    pfd[0].fd = epfd;
+    pfd[0].events = POLLIN;
+    pfd[0].revents = 0;
+    for (i = 0; i < nAgents; i++) {
+	ap = &agent[i];
+	if (!WatchAgent(ap))
+	    continue;
+	pfd[nfds].fd = __pmFD(ap->outFd);
+	pfd[nfds].events = POLLIN;
+	pfd[nfds].revents = 0;
+	nfds++;
+	if (pmDebugOptions.appl0 && ap->status.notReady)
+	    pmNotifyErr(LOG_INFO, "not ready: check %s agent on fd %d\n",
+			ap->pmDomainLabel, ap->outFd);
+    }
+
+    GrowReady(nAgents + MAXEVENTS);
+    n = 0;
+    if (nfds > 1) {
+	/* agent descriptors are few and change often, poll them directly */
+	if ((sts = poll(pfd, nfds, msec)) <= 0)
+	    return sts;
+	for (i = 0, nfds = 1; i < nAgents; i++) {
+	    ap = &agent[i];
+	    if (!WatchAgent(ap))
+		continue;
+	    if (pfd[nfds++].revents)
+		AddReady(&n, IOWAIT_AGENT, i, ap->outFd);
+	}
+	if (pfd[0].revents == 0)
+	    return n;
+	msec = 0;
+    }
+
+    if ((sts = epoll_wait(epfd, events, MAXEVENTS, msec)) < 0)
+	return n > 0 ? n : sts;
+
+    /*
+     * Clients before request ports, so a connection accepted into a
+     * client slot freed while processing this batch cannot be mistaken
+     * for the previous occupant of that slot.
+     */
+    for (i = 0; i < sts; i++) {
+	type = (int)(events[i].data.u64 >> 32);
+	index = (int)(events[i].data.u64 & 0xffffffff);
+	if (type != IOWAIT_CLIENT || index >= nClients)
+	    continue;
+	cp = &client[index];
+	if (cp->status.connected && !cp->status.fetching)
+	    AddReady(&n, IOWAIT_CLIENT, index, cp->fd);
+    }
+    for (i = 0; i < sts; i++) {
+	type = (int)(events[i].data.u64 >> 32);
+	index = (int)(events[i].data.u64 & 0xffffffff);
+	if (type == IOWAIT_PORT)
+	    AddReady(&n, IOWAIT_PORT, -1, index);
+    }
+    return n;
+}
+
+/*
+ * Clients can only be watched with epoll, so allow for as many of
+ * them as the hard limit on open descriptors permits.
+ */
+static void
+RaiseOpenLimit(void)
+{
+#if defined(HAVE_SYS_RESOURCE_H) && defined(RLIMIT_NOFILE)
+    struct rlimit	rlim;
+
+    if (getrlimit(RLIMIT_NOFILE, &rlim) < 0 || rlim.rlim_cur == rlim.rlim_max)
+	return;
+    rlim.rlim_cur = rlim.rlim_max;
+    if (setrlimit(RLIMIT_NOFILE, &rlim) < 0)
+	pmNotifyErr(LOG_WARNING, "IoWaitInit: cannot raise open file limit: %s\n",
+			osstrerror());
+#endif
+}
+#endif /* HAVE_EPOLL */
+
+/*
+ * Setup for waiting, given the request ports opened by
+ * __pmServerOpenRequestPorts().
+ */
+void
+IoWaitInit(__pmFdSet *ports, int maxport)
+{
+#ifdef HAVE_EPOLL
+    int		i;
+#endif
+
+    portFds = *ports;
+    maxPortFd = maxport;
+
+#ifdef HAVE_EPOLL
+    if (getenv("PMCD_SELECT") != NULL)
+	return;
+#ifdef EPOLL_CLOEXEC
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+#else
+    if ((epfd = epoll_create(MAXEVENTS)) >= 0)
+	fcntl(epfd, F_SETFD, FD_CLOEXEC);
+#endif
+    if (epfd < 0) {
+	pmNotifyErr(LOG_WARNING, "IoWaitInit: epoll_create: %s, using select\n",
+			osstrerror());
+	return;
+    }
+    for (i = 0; i <= maxPortFd; i++) {
+	if (!__pmFD_ISSET(i, &portFds))
+	    continue;
+	if (EpollCtl(EPOLL_CTL_ADD, i, IOWAIT_PORT, i, EPOLLIN) < 0) {
+	    pmNotifyErr(LOG_WARNING, "IoWaitInit: request port fd %d: %s, using select\n",
+			i, osstrerror());
+	    close(epfd);
+	    epfd = -1;
+	    return;
+	}
+    }
+    RaiseOpenLimit();
+#endif
+}
+
+/* Name of the mechanism in use, for the pmcd log */
+const char *
+IoWaitMethod(void)
+{
+#ifdef HAVE_EPOLL
+    if (epfd >= 0)
+	return "epoll";
+#endif
+    return "select";
+}
+
+/* Start watching a newly accepted client connection */
+int
+IoWaitAddClient(ClientInfo *cp)
+{
+#ifdef HAVE_EPOLL
+    if (epfd >= 0)
+	return EpollCtl(EPOLL_CTL_ADD, cp->fd, IOWAIT_CLIENT,
+			(int)(cp - client), EPOLLIN);
+#endif
+    if (__pmFD(cp->fd) >= FD_SETSIZE)
+	return -EMFILE;
+    return 0;
+}
+
+/*
+ * Stop watching a client connection ... before it is closed, as forked
+ * agents may share the socket and keep it registered.
+ */
+void
+IoWaitDelClient(ClientInfo *cp)
+{
+#ifdef HAVE_EPOLL
+    if (epfd >= 0)
+	EpollCtl(EPOLL_CTL_DEL, cp->fd, IOWAIT_CLIENT, (int)(cp - client), 0);
+#endif
+}
+
+/*
+ * Ignore input from a client while it waits for fetch results.  The
+ * descriptor is removed rather than given an empty event mask, as epoll
+ * reports hangups and errors regardless of the mask, and the client
+ * would be reported (and skipped) on every iteration after hanging up.
+ * A hangup is noticed once the fetch is done and the client is resumed,
+ * as with select.
+ */
+void
+IoWaitSuspendClient(ClientInfo *cp)
+{
+#ifdef HAVE_EPOLL
+    if (epfd >= 0)
+	EpollCtl(EPOLL_CTL_DEL, cp->fd, IOWAIT_CLIENT, (int)(cp - client), 0);
+#endif
+}
+
+void
+IoWaitResumeClient(ClientInfo *cp)
+{
+#ifdef HAVE_EPOLL
+    int		sts;
+
+    if (epfd >= 0 &&
+	(sts = EpollCtl(EPOLL_CTL_ADD, cp->fd, IOWAIT_CLIENT, (int)(cp - client), EPOLLIN)) < 0)
+	pmNotifyErr(LOG_ERR, "IoWaitResumeClient: client[%d] fd %d: %s\n",
+			(int)(cp - client), cp->fd, pmErrStr(sts));
+#endif
+}
+
+/*
+ * Wait for input, up to timeout (NULL to wait indefinitely).  Returns the
+ * number of entries in the list of ready descriptors, -1 and errno/neterror
+ * on failure.  Agents come first in the list and request ports last.
+ */
+int
+IoWait(struct timeval *timeout, IoReady **list)
+{
+    int		sts;
+
+#ifdef HAVE_EPOLL
+    if (epfd >= 0)
+	sts = EpollWait(timeout);
+    else
+#endif
+	sts = SelectWait(timeout);
+
+    pmcd_loop_iterations++;
+    if (sts > 0)
+	pmcd_loop_readyfds += sts;
+    *list = ready;
+    return sts;
+}
@@ -33,7 +33,6 @@ int		AgentPendingRestart;	/* for automatic restart */
 int		labelChanged;		/* For SIGHUP labels check */
 static int	timeToDie;		/* For SIGINT handling */
 static int	restart;		/* For SIGHUP restart */
-static int	maxReqPortFd;		/* Largest request port fd */
 static char	configFileName[MAXPATHLEN]; /* path to pmcd.conf */
 static char	*logfile = "pmcd.log";	/* log file name */
 static int	run_daemon = 1;		/* run as a daemon, see -f */
@@ -105,6 +104,7 @@ static pmLongOptions longopts[] = {
     { "", 1, 'L', "BYTES", "maximum size for PDUs from clients [default 65536]" },
     { "", 1, 'q', "TIME", "PMDA initial negotiation timeout (seconds) [default 3]" },
     { "", 1, 't', "TIME", "PMDA response timeout (seconds) [default 5]" },
+    { "fetchcache", 1, 'F', "TIME", "reuse PMDA fetch results for this long [default 0]" },
     { "verify", 0, 'v', 0, "check validity of pmcd configuration, then exit" },
     PMAPI_OPTIONS_HEADER("Connection options"),
     { "interface", 1, 'i', "ADDR", "accept connections on this IP address" },
@@ -121,7 +121,7 @@ static pmLongOptions longopts[] = {
 
 static pmOptions opts = {
     .flags = PM_OPTFLAG_POSIX,
-    .short_options = "Ac:C:D:fH:i:l:L:M:N:n:p:P:q:Qs:St:T:U:vx:?",
+    .short_options = "Ac:C:D:fF:H:i:l:L:M:N:n:p:P:q:Qs:St:T:U:vx:?",
     .long_options = longopts,
 };
 
@@ -134,6 +134,7 @@ ParseOptions(int argc, char *argv[], int *nports)
     int		verify = 0;
     int		usage = 0;
     int		val;
+    struct timeval	tv;
 
     endptr = pmGetConfig("PCP_PMCDCONF_PATH");
     strncpy(configFileName, endptr, sizeof(configFileName)-1);
@@ -167,6 +168,18 @@ ParseOptions(int argc, char *argv[], int *nports)
 		run_daemon = 0;
 		break;
 
+	    case 'F':
+		/* identical fetches within this interval share a PMDA result */
+		if (pmParseInterval(opts.optarg, &tv, &endptr) < 0) {
+		    pmprintf("%s: -F requires a time interval: %s\n",
+			pmGetProgname(), endptr);
+		    free(endptr);
+		    opts.errors++;
+		} else {
+		    pmcd_cachetime = tv.tv_sec * 1000 + tv.tv_usec / 1000;
+		}
+		break;
+
 	    case 'i':
 		/* one (of possibly several) interfaces for client requests */
 		__pmServerAddInterface(opts.optarg);
@@ -303,18 +316,22 @@ ParseOptions(int argc, char *argv[], int *nports)
  * as required.
  */
 void
-HandleClientInput(__pmFdSet *fdsPtr)
+HandleClientInput(IoReady *list, int nready)
 {
     int		sts;
-    int		i;
+    int		i, r;
     __pmPDU	*pb;
     __pmPDUHdr	*php;
     ClientInfo	*cp;
 
-    for (i = 0; i < nClients; i++) {
+    for (r = 0; r < nready; r++) {
 	int		pinpdu;
 
-	if (!client[i].status.connected || !__pmFD_ISSET(client[i].fd, fdsPtr))
+	if (list[r].type != IOWAIT_CLIENT)
+	    continue;
+	i = list[r].index;
+	if (!client[i].status.connected || client[i].status.fetching ||
+	    client[i].fd != list[r].fd)
 	    continue;
 
 	cp = &client[i];
@@ -601,7 +618,7 @@ SignalReloadPMNS(void)
  * to handle PDUs.
  */
 static int
-HandleReadyAgents(__pmFdSet *readyFds)
+HandleReadyAgents(IoReady *list, int nready)
 {
     int		i, s, sts;
     int		fd;
@@ -610,11 +627,13 @@ HandleReadyAgents(__pmFdSet *readyFds)
     AgentInfo	*ap;
     __pmPDU	*pb;
 
-    for (i = 0; i < nAgents; i++) {
-	ap = &agent[i];
+    for (i = 0; i < nready; i++) {
+	if (list[i].type != IOWAIT_AGENT)
+	    continue;
+	ap = &agent[list[i].index];
 	if (ap->status.notReady) {
 	    fd = ap->outFd;
-	    if (__pmFD_ISSET(fd, readyFds)) {
+	    if (fd == list[i].fd) {
 		int		pinpdu;
 
 		/* Expect an error PDU containing PM_ERR_PMDAREADY */
@@ -746,60 +765,49 @@ CheckNewClient(__pmFdSet * fdset, int rfd, int family)
     }
 }
 
-/* Loop, synchronously processing requests from clients. */
+/* Loop, processing requests from clients and responses from agents. */
 
 static void
 ClientLoop(void)
 {
-    int		i, fd, sts;
-    int		maxFd;
-    int		checkAgents;
+    int		i, sts;
+    int		fetching;
     int		reload_namespace = 0;
     int		restartAgents = -1;	/* initial state unknown */
-    __pmFdSet	readableFds;
+    __pmFdSet	readyPorts;
+    IoReady	*ready;
+    struct timeval timeout;
 
     for (;;) {
 
-	/* Figure out which file descriptors to wait for input on.  Keep
-	 * track of the highest numbered descriptor for the select call.
+	/* Clients with a fetch in progress are not heard from until it
+	 * completes, but agents working on those fetches need watching,
+	 * as do agents that were not ready, which may send an ERROR PDU
+	 * to indicate they are now ready.
 	 */
-	readableFds = clientFds;
-	maxFd = maxClientFd + 1;
+	fetching = FetchDeadline(&timeout);
 
-	/* If an agent was not ready, it may send an ERROR PDU to indicate it
-	 * is now ready.  Add such agents to the list of file descriptors.
-	 */
-	checkAgents = 0;
-	for (i = 0; i < nAgents; i++) {
-	    AgentInfo	*ap = &agent[i];
-
-	    if (ap->status.notReady) {
-		fd = ap->outFd;
-		__pmFD_SET(fd, &readableFds);
-		if (fd > maxFd)
-		    maxFd = fd + 1;
-		checkAgents = 1;
+	sts = IoWait(fetching ? &timeout : NULL, &ready);
+	if (sts > 0) {
+	    __pmFD_ZERO(&readyPorts);
+	    for (i = 0; i < sts; i++) {
 		if (pmDebugOptions.appl0)
-		    pmNotifyErr(LOG_INFO,
-				 "not ready: check %s agent on fd %d (max = %d)\n",
-				 ap->pmDomainLabel, fd, maxFd);
+		    fprintf(stderr, "DATA: from %s (fd %d)\n",
+			    FdToString(ready[i].fd), ready[i].fd);
+		if (ready[i].type == IOWAIT_PORT)
+		    __pmFD_SET(ready[i].fd, &readyPorts);
 	    }
+	    reload_namespace = HandleReadyAgents(ready, sts);
+	    ServiceFetches(ready, sts);
+	    HandleClientInput(ready, sts);
+	    /* last, as new clients may reuse the slots of departed ones */
+	    __pmServerAddNewClients(&readyPorts, CheckNewClient);
 	}
-
-	sts = __pmSelectRead(maxFd, &readableFds, NULL);
-	if (sts > 0) {
-	    if (pmDebugOptions.appl0)
-		for (i = 0; i <= maxClientFd; i++)
-		    if (__pmFD_ISSET(i, &readableFds))
-			fprintf(stderr, "DATA: from %s (fd %d)\n",
-				FdToString(i), i);
-	    __pmServerAddNewClients(&readableFds, CheckNewClient);
-	    if (checkAgents)
-		reload_namespace = HandleReadyAgents(&readableFds);
-	    HandleClientInput(&readableFds);
-	}
+	else if (sts == 0)
+	    ServiceFetches(NULL, 0);
 	else if (sts == -1 && neterror() != EINTR) {
-	    pmNotifyErr(LOG_ERR, "ClientLoop select: %s\n", netstrerror());
+	    pmNotifyErr(LOG_ERR, "ClientLoop %s: %s\n",
+			IoWaitMethod(), netstrerror());
 	    break;
 	}
 	if (AgentDied) {
@@ -829,6 +837,7 @@ ClientLoop(void)
 	if (restart) {
 	    restart = 0;
 	    reload_namespace = 1;
+	    FetchDrainAll();
 	    SignalRestart();
 	}
 	if (reload_namespace) {
@@ -929,6 +938,7 @@ main(int argc, char *argv[])
     int		maxpending = MAXPENDING;
     int		env_warn = 0;
     char	*envstr;
+    __pmFdSet	portFds;
 #ifdef HAVE_SA_SIGINFO
     static struct sigaction act;
 #endif
@@ -988,9 +998,10 @@ main(int argc, char *argv[])
     __pmSetSignalHandler(SIGBUS, SigBad);
     __pmSetSignalHandler(SIGSEGV, SigBad);
 
-    if ((sts = __pmServerOpenRequestPorts(&clientFds, maxpending)) < 0)
+    __pmFD_ZERO(&portFds);
+    if ((sts = __pmServerOpenRequestPorts(&portFds, maxpending)) < 0)
 	DontStart();
-    maxReqPortFd = maxClientFd = sts;
+    IoWaitInit(&portFds, sts);
 
     /*
      * would prefer open log earlier so any messages up to this point
@@ -1156,11 +1167,9 @@ CleanupClient(ClientInfo *cp, int sts)
         __pmAccDelClient(cp->addr);
 
     pmcd_trace(TR_DEL_CLIENT, cp-client, cp->fd, sts);
+    FetchAbortClient(cp);
     DeleteClient(cp);
 
-    if (maxClientFd < maxReqPortFd)
-	maxClientFd = maxReqPortFd;
-
     for (i = 0; i < nAgents; i++)
 	if (agent[i].profClient == cp)
 	    agent[i].profClient = NULL;
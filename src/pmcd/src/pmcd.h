@@ -71,6 +71,15 @@ typedef struct {
     pid_t agentPid;			/* Process ID of the agent */
 } PipeInfo;
 
+/* Per-agent part of a pending client fetch request (dofetch.c) */
+struct FetchReq;
+
+/* Domain of the pmcd PMDA, see $PCP_VAR_DIR/pmns/stdpmid */
+#define PMCD_DOMAIN	2
+
+/* Cached result from an agent (fetchcache.c) */
+struct CacheEntry;
+
 /* The agent table and its size. */
 
 typedef struct {
@@ -93,10 +102,17 @@ typedef struct {
 	    notReady : 1,		/* Agent not ready to process PDUs */
 	    startNotReady : 1,		/* Agent starts in non-ready state */
 	    fenced : 1,			/* Agent fenced; no sampling */
-	    unused : 7,			/* Zero-padded, unused space */
+	    fetching : 1,		/* Fetch request sent, awaiting result */
+	    unused : 6,			/* Zero-padded, unused space */
 	    flags : 16;			/* Agent-supplied connection flags */
     } status;
     int		reason;			/* if ! connected */
+    struct FetchReq *fetchReq;		/* Fetch request sent to the agent */
+    struct FetchReq *fetchHead;		/* Fetch requests queued for agent */
+    struct FetchReq *fetchTail;
+    struct timeval fetchDeadline;	/* When fetchReq times out */
+    int		cacheWindow;		/* Reuse results for this long (msec) */
+    struct CacheEntry *fetchCache;	/* Recent results from the agent */
     union {				/* per-ipcType info */
 	DsoInfo    dso;
 	SocketInfo socket;
@@ -216,6 +232,51 @@ extern int DoPMNSNames(ClientInfo *, __pmPDU *);
 extern int DoPMNSChild(ClientInfo *, __pmPDU *);
 extern int DoPMNSTraverse(ClientInfo *, __pmPDU *);
 
+/*
+ * Waiting for input from request ports, clients and agents (iowait.c)
+ */
+#define IOWAIT_PORT	1
+#define IOWAIT_CLIENT	2
+#define IOWAIT_AGENT	3
+
+typedef struct {
+    int		type;		/* IOWAIT_* */
+    int		index;		/* client[] or agent[] index, -1 for ports */
+    int		fd;		/* descriptor with input pending */
+} IoReady;
+
+extern void IoWaitInit(__pmFdSet *, int);
+extern const char *IoWaitMethod(void);
+extern int IoWaitAddClient(ClientInfo *);
+extern void IoWaitDelClient(ClientInfo *);
+extern void IoWaitSuspendClient(ClientInfo *);
+extern void IoWaitResumeClient(ClientInfo *);
+extern int IoWait(struct timeval *, IoReady **);
+
+/*
+ * Pending fetch request handling (dofetch.c)
+ */
+extern int FetchDeadline(struct timeval *);
+extern void ServiceFetches(IoReady *, int);
+extern void FetchDrainAgent(AgentInfo *);
+extern void FetchDrainAll(void);
+extern void FetchAbortAgent(AgentInfo *);
+extern void FetchAbortClient(ClientInfo *);
+
+/*
+ * Agent fetch result cache (fetchcache.c)
+ */
+typedef struct CacheKey CacheKey;
+typedef struct CacheEntry CacheEntry;
+
+extern int CacheWindow(AgentInfo *);
+extern CacheKey *CacheMakeKey(AgentInfo *, ClientInfo *, pmProfile *, int, pmID *);
+extern CacheEntry *CacheLookup(AgentInfo *, CacheKey *);
+extern CacheEntry *CacheStore(AgentInfo *, CacheKey *, pmResult *);
+extern pmResult *CacheResult(CacheEntry *);
+extern void CacheRelease(CacheEntry *);
+extern void CacheFlush(AgentInfo *);
+
 /*
  * General purpose routines
  */
@@ -248,6 +309,17 @@ PMCD_DATA extern char *pmcd_labels;
 /* Counter of SIGHUPs received and responded to by pmcd */
 PMCD_DATA extern unsigned pmcd_sighups;
 
+/* ClientLoop() wakeups, and descriptors found ready (pmcd.loop metrics) */
+PMCD_DATA extern __uint64_t pmcd_loop_iterations;
+PMCD_DATA extern __uint64_t pmcd_loop_readyfds;
+
+/* Default agent result cache window in msec, -F (pmcd.agent.cachetime) */
+PMCD_DATA extern int pmcd_cachetime;
+
+/* Agent fetches answered from, and not from, cache (pmcd.fetchcache) */
+PMCD_DATA extern __uint64_t pmcd_cache_hits;
+PMCD_DATA extern __uint64_t pmcd_cache_misses;
+
 /* pmcd's pid */
 PMCD_DATA extern pid_t pmcd_pid;
 
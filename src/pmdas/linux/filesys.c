@@ -14,9 +14,285 @@
  * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
  * for more details.
  */
+#include <pthread.h>
+#include <signal.h>
 #include "linux.h"
 #include "filesys.h"
 
+/*
+ * statfs(2) calls are made by worker threads, so that a mount whose
+ * server has stopped responding (a hung NFS or FUSE filesystem, say)
+ * cannot hold up a fetch.  Only metrics that need statfs issue requests,
+ * and only for the instances being fetched: filesys_issue() is called
+ * from the bulk fetch callback with all of them at once, so however
+ * many mounts are hung, a fetch waits for them just once, until the
+ * deadline set by refresh_filesys().
+ *
+ * A request that times out stays with its filesystem until it does
+ * complete - it is not issued again meanwhile - and the values from
+ * the last statfs that did complete are returned and flagged stale.
+ * A worker stuck in such a request is not available to other mounts,
+ * so there are up to FILESYS_WORKERS workers plus one for each request
+ * still in progress past its deadline; other requests wait their turn.
+ * Up to FILESYS_WORKERS idle workers are kept.
+ */
+#define FILESYS_WORKERS	4
+
+typedef struct filesys_request {
+    struct filesys_request *next;	/* queued, or in progress */
+    char		*path;
+    struct statfs	stats;
+    int			sts;
+    int			done;
+    struct timespec	deadline;	/* for the fetch that issued it */
+} filesys_request_t;
+
+struct timeval filesys_timeout = { 1, 0 };
+
+static pthread_mutex_t	request_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	request_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t	request_done = PTHREAD_COND_INITIALIZER;
+static filesys_request_t *request_head;
+static filesys_request_t *request_tail;
+static filesys_request_t *request_active;	/* requests in progress */
+static int		nqueued;	/* requests not yet started */
+static int		nidle;		/* workers waiting for a request */
+static int		nstarting;	/* workers created, not yet running */
+static int		nworkers;
+static struct timespec	fetch_deadline;
+
+static void *
+filesys_worker(void *arg)
+{
+    filesys_request_t *rp, **rpp;
+    int sts;
+
+    (void)arg;
+    pthread_mutex_lock(&request_lock);
+    nstarting--;
+    for (;;) {
+	while ((rp = request_head) == NULL) {
+	    nidle++;
+	    pthread_cond_wait(&request_work, &request_lock);
+	    nidle--;
+	}
+	if ((request_head = rp->next) == NULL)
+	    request_tail = NULL;
+	nqueued--;
+	rp->next = request_active;
+	request_active = rp;
+	pthread_mutex_unlock(&request_lock);
+
+	sts = statfs(rp->path, &rp->stats) < 0 ? -oserror() : 0;
+
+	pthread_mutex_lock(&request_lock);
+	for (rpp = &request_active; *rpp != rp; rpp = &(*rpp)->next)
+	    ;
+	*rpp = rp->next;
+	rp->sts = sts;
+	rp->done = 1;
+	pthread_cond_broadcast(&request_done);
+	if (request_head == NULL && nidle >= FILESYS_WORKERS)
+	    break;
+    }
+    nworkers--;
+    pthread_mutex_unlock(&request_lock);
+    return NULL;
+}
+
+/* called with request_lock held */
+static int
+filesys_spawn(void)
+{
+    pthread_attr_t attr;
+    pthread_t tid;
+    sigset_t all, save;
+    int sts;
+
+    /* leave signal handling to the main thread */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &save);
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if ((sts = pthread_create(&tid, &attr, filesys_worker, NULL)) == 0) {
+	nworkers++;
+	nstarting++;
+    }
+    else
+	pmNotifyErr(LOG_WARNING, "filesys: cannot create statfs thread: %s",
+			pmErrStr(-sts));
+    pthread_attr_destroy(&attr);
+    pthread_sigmask(SIG_SETMASK, &save, NULL);
+    return -sts;
+}
+
+/*
+ * Count the requests still in progress past their deadline, with
+ * request_lock held.
+ */
+static int
+filesys_stuck(void)
+{
+    filesys_request_t *rp;
+    struct timeval now;
+    int count = 0;
+
+    gettimeofday(&now, NULL);
+    for (rp = request_active; rp != NULL; rp = rp->next) {
+	if (rp->deadline.tv_sec < now.tv_sec ||
+	    (rp->deadline.tv_sec == now.tv_sec &&
+	     rp->deadline.tv_nsec < now.tv_usec * 1000))
+	    count++;
+    }
+    return count;
+}
+
+/*
+ * Start workers for the queued requests, as many as are allowed, with
+ * request_lock held.
+ */
+static void
+filesys_dispatch(void)
+{
+    while (nqueued > nidle + nstarting &&
+	   nworkers < FILESYS_WORKERS + filesys_stuck()) {
+	if (filesys_spawn() < 0)
+	    break;
+    }
+}
+
+/*
+ * Queue a statfs request for fs, unless one is already outstanding,
+ * with request_lock held.
+ */
+static int
+filesys_request(filesys_t *fs)
+{
+    filesys_request_t *rp;
+
+    if (fs->pending != NULL)
+	return 0;
+    if ((rp = calloc(1, sizeof(*rp))) == NULL ||
+	(rp->path = strdup(fs->path)) == NULL) {
+	free(rp);
+	return -ENOMEM;
+    }
+    rp->deadline = fetch_deadline;
+    fs->pending = rp;
+
+    if (request_tail)
+	request_tail->next = rp;
+    else
+	request_head = rp;
+    request_tail = rp;
+    nqueued++;
+    filesys_dispatch();
+
+    if (nworkers == 0) {
+	/* no threads, so nothing else is queued - wait as long as it takes */
+	request_head = request_tail = NULL;
+	nqueued = 0;
+	rp->sts = statfs(rp->path, &rp->stats) < 0 ? -oserror() : 0;
+	rp->done = 1;
+	return 0;
+    }
+    pthread_cond_signal(&request_work);
+    return 0;
+}
+
+/*
+ * Start a fetch - called from refresh_filesys(), before any requests
+ * for this fetch are issued.
+ */
+static void
+filesys_begin(void)
+{
+    struct timeval now;
+
+    pthread_mutex_lock(&request_lock);
+    gettimeofday(&now, NULL);
+    pmtimevalInc(&now, &filesys_timeout);
+    fetch_deadline.tv_sec = now.tv_sec;
+    fetch_deadline.tv_nsec = now.tv_usec * 1000;
+    pthread_mutex_unlock(&request_lock);
+}
+
+/*
+ * Issue statfs requests for the instances of indom being fetched, all
+ * at once so that hung mounts time out together.
+ */
+void
+filesys_issue(pmInDom indom, int numinst, const unsigned int *instlist)
+{
+    filesys_t *fs;
+    int i;
+
+    pthread_mutex_lock(&request_lock);
+    for (i = 0; i < numinst; i++) {
+	if (pmdaCacheLookup(indom, instlist[i], NULL, (void **)&fs) != PMDA_CACHE_ACTIVE)
+	    continue;
+	if (!(fs->flags & FSF_FETCHED))
+	    filesys_request(fs);
+    }
+    pthread_mutex_unlock(&request_lock);
+}
+
+/*
+ * Ensure fs->stats is current for this fetch.  Returns 1 if there
+ * are values in fs->stats (stale ones, if FSF_STALE is set), 0 if
+ * statfs has not yet completed for this filesystem, else an error.
+ */
+int
+filesys_statfs(filesys_t *fs)
+{
+    filesys_request_t *rp;
+    int sts = 0;
+
+    if (fs->flags & FSF_FETCHED)
+	return (fs->flags & FSF_VALID) != 0;
+
+    pthread_mutex_lock(&request_lock);
+    if ((sts = filesys_request(fs)) < 0) {
+	pthread_mutex_unlock(&request_lock);
+	return sts;
+    }
+    rp = fs->pending;
+
+    /*
+     * Never wait past the deadline of the fetch that issued the request,
+     * so an earlier request that is still outstanding has had its chance.
+     */
+    while (!rp->done) {
+	if (pthread_cond_timedwait(&request_done, &request_lock,
+				    &rp->deadline) == ETIMEDOUT)
+	    break;
+    }
+
+    if (rp->done) {
+	fs->pending = NULL;
+	fs->flags &= ~FSF_STALE;
+	if ((sts = rp->sts) == 0) {
+	    fs->stats = rp->stats;
+	    fs->flags |= FSF_VALID;
+	}
+	free(rp->path);
+	free(rp);
+    }
+    else {
+	if (pmDebugOptions.libpmda && !(fs->flags & FSF_STALE))
+	    fprintf(stderr, "filesys_statfs: \"%s\" timed out\n", fs->path);
+	fs->flags |= FSF_STALE;
+	/* a worker may now be stuck, so queued requests can have another */
+	filesys_dispatch();
+    }
+    pthread_mutex_unlock(&request_lock);
+
+    if (sts < 0)
+	return sts;
+    fs->flags |= FSF_FETCHED;
+    return (fs->flags & FSF_VALID) != 0;
+}
+
 char *
 scan_filesys_options(const char *options, const char *option)
 {
@@ -49,6 +325,7 @@ refresh_filesys(pmInDom filesys_indom, pmInDom tmpfs_indom,
 
     pmdaCacheOp(tmpfs_indom, PMDA_CACHE_INACTIVE);
     pmdaCacheOp(filesys_indom, PMDA_CACHE_INACTIVE);
+    filesys_begin();
 
     /*
      * When operating within a container namespace, cannot refer
@@ -113,19 +390,23 @@ refresh_filesys(pmInDom filesys_indom, pmInDom tmpfs_indom,
 	    fs->device = strdup(device);
 	    fs->path = strdup(path);
 	    fs->options = strdup(options);
+	    fs->flags = 0;
+	    fs->pending = NULL;
 	    if (pmDebugOptions.libpmda) {
 		fprintf(stderr, "refresh_filesys: add \"%s\" \"%s\"\n",
 		    fs->path, device);
 	    }
 	    pmdaCacheStore(indom, PMDA_CACHE_ADD, device, fs);
 	}
-	fs->flags = 0;
+	fs->flags &= ~FSF_FETCHED;
     }
 
     /*
      * success
-     * Note: we do not call statfs() here since only some instances
-     * may be requested (rather, we do it in linux_fetch, see pmda.c).
+     * Note: the statfs values are collected in linux_fetch, see pmda.c,
+     * by way of filesys_issue() and filesys_statfs(), and only for the
+     * metrics and instances being fetched - statfs on a remote or FUSE
+     * mount can be slow, and is not needed for mountdir or readonly.
      */
     fclose(fp);
     return 0;
@@ -18,6 +18,10 @@
 
 /* Values for flags in filesys_t */
 #define FSF_FETCHED		(1U << 0)
+#define FSF_VALID		(1U << 1)	/* stats from a completed statfs */
+#define FSF_STALE		(1U << 2)	/* last statfs timed out */
+
+struct filesys_request;
 
 typedef struct filesys {
     int		  id;
@@ -26,8 +30,13 @@ typedef struct filesys {
     char	  *path;
     char	  *options;
     struct statfs stats;
+    struct filesys_request *pending;	/* statfs not yet completed */
 } filesys_t;
 
+extern struct timeval filesys_timeout;
+extern int filesys_statfs(filesys_t *);
+extern void filesys_issue(pmInDom, int, const unsigned int *);
+
 struct linux_container;
 extern int refresh_filesys(pmInDom, pmInDom, struct linux_container *);
 extern char *scan_filesys_options(const char *, const char *);
@@ -36,8 +36,8 @@ typedef struct {
     unsigned long long	count;		/* per-CPU sum of interrupt counts */
 } online_cpu_t;
 
-static char *iobuf;			/* buffer sized based on CPU count */
-static unsigned int iobufsz;
+static linux_statsfd_t interrupts_fd = LINUX_STATSFD("/proc/interrupts");
+static linux_statsfd_t softirqs_fd = LINUX_STATSFD("/proc/softirqs");
 
 static unsigned int cpu_count;
 static online_cpu_t *online_cpumap;	/* maps input columns to CPU info */
@@ -68,10 +68,6 @@ setup_interrupts(int reset)
 	pmdaCacheOp(INDOM(SOFTIRQS_NAMES_INDOM), PMDA_CACHE_LOAD);
 	pmdaCacheOp(INDOM(INTERRUPTS_INDOM), PMDA_CACHE_LOAD);
 	pmdaCacheOp(INDOM(SOFTIRQS_INDOM), PMDA_CACHE_LOAD);
-	if ((iobufsz = (_pm_ncpus * 64)) < BUFSIZ)
-	    iobufsz = BUFSIZ;
-	if ((iobuf = malloc(iobufsz)) == NULL)
-	    return -oserror();
 	setup = 1;
     }
     if (cpu_count != _pm_ncpus) {
@@ -243,8 +239,8 @@ extract_values(char *buffer, interrupt_t *ip, int ncolumns, int count)
 
     ip->total = 0;
     for (i = 0; i < ncolumns; i++) {
-	value = strtoul(s, &end, 10);
-	if (!isspace(*end))
+	value = linux_strtoull(s, &end);
+	if (!isspace((int)*end) && *end != '\0')
 	    return NULL;
 	s = end;
 	cpuid = column_to_cpuid(i);
@@ -376,6 +372,13 @@ extract_interrupt_lines(char *buffer, int ncolumns, int nlines)
 static int
 extract_interrupt_errors(char *buffer)
 {
+    char *s = buffer;
+
+    while (isspace((int)*s))	/* cheap test first, lines are long */
+	s++;
+    if (strncmp(s, "ERR:", 4) != 0 && strncmp(s, "Err:", 4) != 0 &&
+	strncmp(s, "BAD:", 4) != 0)
+	return 0;
     return (sscanf(buffer, " ERR: %u", &irq_err_count) == 1 ||
 	    sscanf(buffer, "Err: %u", &irq_err_count) == 1  ||
 	    sscanf(buffer, "BAD: %u", &irq_err_count) == 1);
@@ -385,7 +388,12 @@ static int
 extract_interrupt_misses(char *buffer)
 {
     unsigned int irq_mis_count;	/* not exported */
-    return sscanf(buffer, " MIS: %u", &irq_mis_count) == 1;
+
+    while (isspace((int)*buffer))	/* cheap test first, lines are long */
+	buffer++;
+    if (strncmp(buffer, "MIS:", 4) != 0)
+	return 0;
+    return sscanf(buffer, "MIS: %u", &irq_mis_count) == 1;
 }
 
 static int
@@ -431,7 +439,7 @@ extract_softirqs(char *buffer, int ncolumns, int nlines)
 int
 refresh_interrupt_values(void)
 {
-    FILE *fp;
+    char *buf, *line;
     int i, j, ncolumns;
     int sts, resized = 0;
 
@@ -440,35 +448,31 @@ refresh_interrupt_values(void)
     if ((sts = setup_interrupts(1)) < 0)
 	return sts;
 
-    if ((fp = linux_statsfile("/proc/interrupts", iobuf, iobufsz)) == NULL)
+    if ((buf = linux_statsfd_read(&interrupts_fd)) == NULL)
 	return -oserror();
 
     /* first parse header, which maps online CPU number to column number */
-    if (fgets(iobuf, iobufsz, fp)) {
-	iobuf[iobufsz - 1] = '\0';
-	ncolumns = map_online_cpus(iobuf);
-    } else {
-	fclose(fp);
+    if ((line = linux_nextline(&buf)) != NULL)
+	ncolumns = map_online_cpus(line);
+    else
 	return -EINVAL;		/* unrecognised file format */
-    }
 
     i = j = 0;
-    while (fgets(iobuf, iobufsz, fp) != NULL) {
-	iobuf[iobufsz - 1] = '\0';
+    while ((line = linux_nextline(&buf)) != NULL) {
 	/* next we parse each interrupt line row (starting with a digit) */
-	sts = extract_interrupt_lines(iobuf, ncolumns, i);
+	sts = extract_interrupt_lines(line, ncolumns, i);
 	if (sts > 0)
 	    i++;
 	if (sts > 1)
 	    resized++;
 	if (sts)
 	    continue;
-	if (extract_interrupt_errors(iobuf))
+	if (extract_interrupt_errors(line))
 	    continue;
-	if (extract_interrupt_misses(iobuf))
+	if (extract_interrupt_misses(line))
 	    continue;
 	/* parse other per-CPU interrupt counter rows (starts non-digit) */
-	sts = extract_interrupt_other(iobuf, ncolumns, j);
+	sts = extract_interrupt_other(line, ncolumns, j);
 	if (sts > 0)
 	    j++;
 	if (sts > 1)
@@ -476,7 +480,6 @@ refresh_interrupt_values(void)
 	if (!sts)
 	    break;
     }
-    fclose(fp);
 
     if (resized) {
 	dynamic_name_save(INTERRUPT_NAMES_INDOM, interrupt_other, other_count);
@@ -489,7 +492,7 @@ refresh_interrupt_values(void)
 int
 refresh_softirqs_values(void)
 {
-    FILE *fp;
+    char *buf, *line;
     int i = 0, ncolumns;
     int sts, resized = 0;
 
@@ -498,28 +501,23 @@ refresh_softirqs_values(void)
     if ((sts = setup_interrupts(0)) < 0)
 	return sts;
 
-    if ((fp = linux_statsfile("/proc/softirqs", iobuf, iobufsz)) == NULL)
+    if ((buf = linux_statsfd_read(&softirqs_fd)) == NULL)
 	return -oserror();
 
     /* first parse header, which maps online CPU number to column number */
-    if (fgets(iobuf, iobufsz, fp)) {
-	iobuf[iobufsz - 1] = '\0';
-	ncolumns = map_online_cpus(iobuf);
-    } else {
-	fclose(fp);
+    if ((line = linux_nextline(&buf)) != NULL)
+	ncolumns = map_online_cpus(line);
+    else
 	return -EINVAL;		/* unrecognised file format */
-    }
 
-    while (fgets(iobuf, iobufsz, fp) != NULL) {
-	iobuf[iobufsz - 1] = '\0';
+    while ((line = linux_nextline(&buf)) != NULL) {
 	/* next we parse each softirqs line */
-	sts = extract_softirqs(iobuf, ncolumns, i++);
+	sts = extract_softirqs(line, ncolumns, i++);
 	if (sts > 1)
 	    resized = 1;
 	if (sts == 0)
 	    break;
     }
-    fclose(fp);
 
     if (resized) {
 	dynamic_name_save(SOFTIRQS_NAMES_INDOM, softirqs, softirqs_count);
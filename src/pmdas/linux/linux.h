@@ -204,6 +204,68 @@ extern int linux_test_mode;
  */
 extern char *linux_statspath;
 extern FILE *linux_statsfile(const char *, char *, int);
+
+/*
+ * Single-file stats sources (/proc/stat, /proc/meminfo, ...) are kept
+ * open between refreshes and re-read from the start with pread(2), into
+ * a buffer that is kept for the next refresh too.
+ */
+typedef struct linux_statsfd {
+    const char	*path;		/* below linux_statspath, e.g. "/proc/stat" */
+    int		fd;		/* kept open until exit(), unless testing */
+    char	*buf;		/* file contents, null-terminated */
+    size_t	size;		/* allocated size of buf */
+    size_t	length;		/* bytes read into buf by latest refresh */
+} linux_statsfd_t;
+
+#define LINUX_STATSFD(path)	{ (path), -1, NULL, 0, 0 }
+
+extern char *linux_statsfd_read(linux_statsfd_t *);
+extern void linux_statsfd_close(linux_statsfd_t *);
+
+/*
+ * Return the line starting at *bufp with its newline overwritten by a
+ * null byte, and move *bufp along to the next line; NULL at the end.
+ */
+static inline char *
+linux_nextline(char **bufp)
+{
+    char	*line = *bufp, *end;
+
+    if (*line == '\0')
+	return NULL;
+    if ((end = strchr(line, '\n')) != NULL) {
+	*end = '\0';
+	*bufp = end + 1;
+    }
+    else
+	*bufp = line + strlen(line);
+    return line;
+}
+
+/*
+ * strtoull(3) for the unsigned decimal values in kernel stats files,
+ * without the locale, base and sign handling: skips blanks and tabs,
+ * and if there are no digits returns zero and sets *endp to s.
+ */
+static inline unsigned long long
+linux_strtoull(const char *s, char **endp)
+{
+    const char		*p = s;
+    unsigned long long	value = 0;
+
+    while (*p == ' ' || *p == '\t')
+	p++;
+    if (*p < '0' || *p > '9') {
+	*endp = (char *)s;
+	return 0;
+    }
+    do {
+	value = value * 10 + (*p++ - '0');
+    } while (*p >= '0' && *p <= '9');
+    *endp = (char *)p;
+    return value;
+}
 extern char *linux_mdadm;
 
 /*
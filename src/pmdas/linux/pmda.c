@@ -1686,6 +1686,11 @@ static pmdaMetric metrictab[] = {
     { PMDA_PMID(CLUSTER_FILESYS,11), PM_TYPE_U32, FILESYS_INDOM, PM_SEM_INSTANT,
     PMDA_PMUNITS(0,0,0,0,0,0) } },
 
+/* filesys.stale */
+  { NULL,
+    { PMDA_PMID(CLUSTER_FILESYS,12), PM_TYPE_U32, FILESYS_INDOM, PM_SEM_INSTANT,
+    PMDA_PMUNITS(0,0,0,0,0,0) } },
+
 /*
  * tmpfs filesystem cluster
  */
@@ -6160,6 +6165,64 @@ linux_statsfile(const char *path, char *buffer, int size)
     return fopen(buffer, "r");
 }
 
+char *
+linux_statsfd_read(linux_statsfd_t *sp)
+{
+    char	path[MAXPATHLEN];
+    char	*p;
+    size_t	size;
+    ssize_t	n;
+    int		sts;
+
+    /* in test mode we replace procfs files (keeping fd open thwarts that) */
+    if (sp->fd >= 0 && (linux_test_mode & LINUX_TEST_STATSPATH)) {
+	close(sp->fd);
+	sp->fd = -1;
+    }
+    if (sp->fd < 0) {
+	pmsprintf(path, sizeof(path), "%s%s", linux_statspath, sp->path);
+	if ((sp->fd = open(path, O_RDONLY)) < 0)
+	    return NULL;
+    }
+
+    for (sp->length = 0;;) {
+	if (sp->length + 1 >= sp->size) {
+	    size = sp->size ? sp->size * 2 : BUFSIZ;
+	    if ((p = realloc(sp->buf, size)) == NULL)
+		return NULL;
+	    sp->buf = p;
+	    sp->size = size;
+	}
+	n = pread(sp->fd, sp->buf + sp->length,
+			sp->size - sp->length - 1, sp->length);
+	if (n < 0) {
+	    if ((sts = oserror()) == EINTR)
+		continue;
+	    close(sp->fd);	/* reopen on the next refresh */
+	    sp->fd = -1;
+	    setoserror(sts);
+	    return NULL;
+	}
+	if (n == 0)
+	    break;
+	sp->length += n;
+    }
+    sp->buf[sp->length] = '\0';
+    return sp->buf;
+}
+
+/* release the descriptor and buffer of a source that is not kept open */
+void
+linux_statsfd_close(linux_statsfd_t *sp)
+{
+    if (sp->fd >= 0)
+	close(sp->fd);
+    sp->fd = -1;
+    free(sp->buf);
+    sp->buf = NULL;
+    sp->size = sp->length = 0;
+}
+
 static linux_access_t *
 access_ctx(int ctx)
 {
@@ -7456,10 +7519,12 @@ linux_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
 	    	return PM_ERR_INST;
 
 	    sbuf = &fs->stats;
-	    if (!(fs->flags & FSF_FETCHED)) {
-		if (statfs(fs->path, sbuf) < 0)
+	    /* mountdir and readonly do not need statfs, stale does its own */
+	    if (item != 7 && item != 11 && item != 12) {
+		if ((sts = filesys_statfs(fs)) < 0)
 		    return PM_ERR_INST;
-		fs->flags |= FSF_FETCHED;
+		if (sts == 0)	/* timed out, with no earlier values */
+		    return 0;
 	    }
 
 	    switch (item) {
@@ -7502,6 +7567,11 @@ linux_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
 	    case 11: /* filesys.readonly */
 	    	atom->ul = (scan_filesys_options(fs->options, "ro") != NULL);
 		break;
+	    case 12: /* filesys.stale */
+		if (filesys_statfs(fs) < 0)
+		    return PM_ERR_INST;
+		atom->ul = ((fs->flags & FSF_STALE) != 0);
+		break;
 	    default:
 		return PM_ERR_PMID;
 	    }
@@ -7519,11 +7589,10 @@ linux_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
 	    	return PM_ERR_INST;
 
 	    sbuf = &fs->stats;
-	    if (!(fs->flags & FSF_FETCHED)) {
-		if (statfs(fs->path, sbuf) < 0)
-		    return PM_ERR_INST;
-		fs->flags |= FSF_FETCHED;
-	    }
+	    if ((sts = filesys_statfs(fs)) < 0)
+		return PM_ERR_INST;
+	    if (sts == 0)	/* timed out, with no earlier values */
+		return 0;
 
 	    switch (item) {
 	    case 1: /* tmpfs.capacity */
@@ -8589,6 +8658,165 @@ linux_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
     return PMDA_FETCH_STATIC;
 }
 
+#define CPUACCT(field)	offsetof(cpuacct_t, field)
+#define CPUACCT_NONE	((size_t)-1)
+
+/*
+ * The cpuacct_t fields for a per-CPU or per-node CPU time metric, as
+ * first + sign * second (if any).
+ */
+static int
+linux_cpuacct_fields(unsigned int item, size_t *first, size_t *second, int *sign, int *pernode)
+{
+    *second = CPUACCT_NONE;
+    *sign = 1;
+    *pernode = 0;
+    switch (item) {
+    case 62: /* kernel.pernode.cpu.user */
+	*pernode = 1;
+	/*FALLTHROUGH*/
+    case 0: /* kernel.percpu.cpu.user */
+	*first = CPUACCT(user);
+	break;
+    case 63: /* kernel.pernode.cpu.nice */
+	*pernode = 1;
+	/*FALLTHROUGH*/
+    case 1: /* kernel.percpu.cpu.nice */
+	*first = CPUACCT(nice);
+	break;
+    case 64: /* kernel.pernode.cpu.sys */
+	*pernode = 1;
+	/*FALLTHROUGH*/
+    case 2: /* kernel.percpu.cpu.sys */
+	*first = CPUACCT(sys);
+	break;
+    case 65: /* kernel.pernode.cpu.idle */
+	*pernode = 1;
+	/*FALLTHROUGH*/
+    case 3: /* kernel.percpu.cpu.idle */
+	*first = CPUACCT(idle);
+	break;
+    case 69: /* kernel.pernode.cpu.wait.total */
+	*pernode = 1;
+	/*FALLTHROUGH*/
+    case 30: /* kernel.percpu.cpu.wait.total */
+	*first = CPUACCT(wait);
+	break;
+    case 66: /* kernel.pernode.cpu.intr */
+	*pernode = 1;
+	/*FALLTHROUGH*/
+    case 31: /* kernel.percpu.cpu.intr */
+	*first = CPUACCT(irq);
+	*second = CPUACCT(sirq);
+	break;
+    case 70: /* kernel.pernode.cpu.irq.soft */
+	*pernode = 1;
+	/*FALLTHROUGH*/
+    case 56: /* kernel.percpu.cpu.irq.soft */
+	*first = CPUACCT(sirq);
+	break;
+    case 71: /* kernel.pernode.cpu.irq.hard */
+	*pernode = 1;
+	/*FALLTHROUGH*/
+    case 57: /* kernel.percpu.cpu.irq.hard */
+	*first = CPUACCT(irq);
+	break;
+    case 67: /* kernel.pernode.cpu.steal */
+	*pernode = 1;
+	/*FALLTHROUGH*/
+    case 58: /* kernel.percpu.cpu.steal */
+	*first = CPUACCT(steal);
+	break;
+    case 68: /* kernel.pernode.cpu.guest */
+	*pernode = 1;
+	/*FALLTHROUGH*/
+    case 61: /* kernel.percpu.cpu.guest */
+	*first = CPUACCT(guest);
+	break;
+    case 77: /* kernel.pernode.cpu.vuser */
+	*pernode = 1;
+	/*FALLTHROUGH*/
+    case 76: /* kernel.percpu.cpu.vuser */
+	*first = CPUACCT(user);
+	*second = CPUACCT(guest);
+	*sign = -1;
+	break;
+    case 85: /* kernel.pernode.cpu.guest_nice */
+	*pernode = 1;
+	/*FALLTHROUGH*/
+    case 83: /* kernel.percpu.cpu.guest_nice */
+	*first = CPUACCT(guest_nice);
+	break;
+    case 86: /* kernel.pernode.cpu.vnice */
+	*pernode = 1;
+	/*FALLTHROUGH*/
+    case 84: /* kernel.percpu.cpu.vnice */
+	*first = CPUACCT(nice);
+	*second = CPUACCT(guest_nice);
+	*sign = -1;
+	break;
+    default:
+	return 0;
+    }
+    return 1;
+}
+
+/*
+ * Fetch all requested CPUs or nodes of a CPU time metric at once,
+ * working out which fields to use just the once rather than for every
+ * CPU.  For filesys and tmpfs metrics that need statfs, the requests
+ * for all the requested mounts are issued here.  Everything else, and
+ * the filesys and tmpfs values, is left to linux_fetchCallBack.
+ */
+static int
+linux_fetchBulkCallBack(pmdaMetric *mdesc, int numinst, const unsigned int *instlist,
+		pmAtomValue *atoms, int *status)
+{
+    unsigned int	cluster = pmID_cluster(mdesc->m_desc.pmid);
+    unsigned int	item = pmID_item(mdesc->m_desc.pmid);
+    pmInDom		indom = mdesc->m_desc.indom;
+    percpu_t		*cp;
+    pernode_t		*np;
+    cpuacct_t		*stat;
+    size_t		first, second;
+    double		value;
+    int			i, sign, pernode, size;
+
+    if (cluster == CLUSTER_TMPFS ||
+	(cluster == CLUSTER_FILESYS && item != 0 && item != 7 && item != 11)) {
+	/* start statfs for the requested mounts, see linux_fetchCallBack */
+	filesys_issue(indom, numinst, instlist);
+	return PM_ERR_NYI;
+    }
+    if (mdesc->m_user != NULL || cluster != CLUSTER_STAT ||
+	!linux_cpuacct_fields(item, &first, &second, &sign, &pernode))
+	return PM_ERR_NYI;
+
+    size = (item == 3 || item == 65) ? _pm_idletime_size : _pm_cputime_size;
+    for (i = 0; i < numinst; i++) {
+	if (pernode) {
+	    if (pmdaCacheLookup(indom, instlist[i], NULL, (void **)&np) < 0) {
+		status[i] = PM_ERR_INST;
+		continue;
+	    }
+	    stat = &np->stat;
+	}
+	else {
+	    if (pmdaCacheLookup(indom, instlist[i], NULL, (void **)&cp) < 0) {
+		status[i] = PM_ERR_INST;
+		continue;
+	    }
+	    stat = &cp->stat;
+	}
+	value = (double)*(unsigned long long *)((char *)stat + first);
+	if (second != CPUACCT_NONE)
+	    value += sign * (double)*(unsigned long long *)((char *)stat + second);
+	_pm_assign_utype(size, &atoms[i], 1000 * value / hz);
+	status[i] = PMDA_FETCH_STATIC;
+    }
+    return 0;
+}
+
 
 static int
 linux_fetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
@@ -9077,6 +9305,7 @@ linux_init(pmdaInterface *dp)
     pmdaSetLabelCallBack(dp, linux_labelCallBack);
     pmdaSetEndContextCallBack(dp, linux_endContextCallBack);
     pmdaSetFetchCallBack(dp, linux_fetchCallBack);
+    pmdaSetFetchBulkCallBack(dp, linux_fetchBulkCallBack);
 
     proc_buddyinfo.indom = &indomtab[BUDDYINFO_INDOM];
 
@@ -9188,13 +9417,14 @@ pmLongOptions	longopts[] = {
     PMOPT_DEBUG,
     PMDAOPT_DOMAIN,
     PMDAOPT_LOGFILE,
+    { "refresh", 1, 't', "DELTA", "refresh values in the background every DELTA" },
     PMDAOPT_USERNAME,
     PMOPT_HELP,
     PMDA_OPTIONS_END
 };
 
 pmdaOptions	opts = {
-    .short_options = "D:d:l:U:?",
+    .short_options = "D:d:l:t:U:?",
     .long_options = longopts,
 };
 
@@ -9204,9 +9434,13 @@ pmdaOptions	opts = {
 int
 main(int argc, char **argv)
 {
-    int			sep = pmPathSeparator();
+    int			c, sep = pmPathSeparator();
     pmdaInterface	dispatch;
     char		helppath[MAXPATHLEN];
+    char		*endnum;
+    struct timeval	refresh = { 0, 0 };
+    unsigned int	clusters[NUM_CLUSTERS];
+    int			nclusters = 0;
 
     _isDSO = 0;
     pmSetProgname(argv[0]);
@@ -9215,7 +9449,18 @@ main(int argc, char **argv)
 		pmGetConfig("PCP_PMDAS_DIR"), sep, sep);
     pmdaDaemon(&dispatch, PMDA_INTERFACE_7, pmGetProgname(), LINUX, "linux.log", helppath);
 
-    pmdaGetOptions(argc, argv, &opts, &dispatch);
+    while ((c = pmdaGetOptions(argc, argv, &opts, &dispatch)) != EOF) {
+	switch (c) {
+	case 't':
+	    if (pmParseInterval(opts.optarg, &refresh, &endnum) < 0) {
+		pmprintf("%s: -t requires a time interval: %s\n",
+			 pmGetProgname(), endnum);
+		free(endnum);
+		opts.errors++;
+	    }
+	    break;
+	}
+    }
     if (opts.errors) {
 	pmdaUsageMessage(&opts);
 	exit(1);
@@ -9225,6 +9470,18 @@ main(int argc, char **argv)
 
     pmdaOpenLog(&dispatch);
     linux_init(&dispatch);
+    if (refresh.tv_sec != 0 || refresh.tv_usec != 0) {
+	/*
+	 * Slab and tty values depend on the credentials of the client,
+	 * so those clusters are always fetched on demand.
+	 */
+	for (c = 0; c < NUM_CLUSTERS; c++) {
+	    if (c != CLUSTER_SLAB && c != CLUSTER_TTY)
+		clusters[nclusters++] = c;
+	}
+	if ((c = pmdaSetSnapshot(&dispatch, &refresh, nclusters, clusters)) < 0)
+	    pmNotifyErr(LOG_ERR, "background refresh disabled: %s\n", pmErrStr(c));
+    }
     pmdaConnect(&dispatch);
     pmdaMain(&dispatch);
     exit(0);
@@ -20,26 +20,19 @@
 int
 refresh_proc_loadavg(proc_loadavg_t *proc_loadavg)
 {
-    char buf[1024];
-    FILE *fp;
-    int sts = 0;
+    char *buf;
+    static linux_statsfd_t loadavg_fd = LINUX_STATSFD("/proc/loadavg");
 
-    if ((fp = linux_statsfile("/proc/loadavg", buf, sizeof(buf))) == NULL)
+    if ((buf = linux_statsfd_read(&loadavg_fd)) == NULL)
 	return -oserror();
 
-    if (fgets(buf, sizeof(buf), fp) == NULL)
-	sts = -oserror();
-    fclose(fp);
-
-    if (sts == 0) {
-	/*
-	 * 0.00 0.00 0.05 1/67 17563
-	 * Lastpid added by Mike Mason <mmlnx@us.ibm.com>
-	 */
-	sscanf((const char *)buf, "%f %f %f %u/%u %u",
-		&proc_loadavg->loadavg[0], &proc_loadavg->loadavg[1], 
-		&proc_loadavg->loadavg[2], &proc_loadavg->runnable,
-		&proc_loadavg->nprocs, &proc_loadavg->lastpid);
-    }
-    return sts;
+    /*
+     * 0.00 0.00 0.05 1/67 17563
+     * Lastpid added by Mike Mason <mmlnx@us.ibm.com>
+     */
+    sscanf((const char *)buf, "%f %f %f %u/%u %u",
+	    &proc_loadavg->loadavg[0], &proc_loadavg->loadavg[1], 
+	    &proc_loadavg->loadavg[2], &proc_loadavg->runnable,
+	    &proc_loadavg->nprocs, &proc_loadavg->lastpid);
+    return 0;
 }
@@ -89,38 +89,37 @@ int
 refresh_proc_meminfo(proc_meminfo_t *proc_meminfo)
 {
     char	buf[1024];
-    char	*bufp;
+    char	*bufp, *line, *next;
     int64_t	*p;
     int		i;
     FILE	*fp;
+    static linux_statsfd_t meminfo_fd = LINUX_STATSFD("/proc/meminfo");
 
     for (i = 0; meminfo_fields[i].field != NULL; i++) {
 	p = MOFFSET(i, proc_meminfo);
 	*p = -1; /* marked as "no value available" */
     }
 
-    if ((fp = linux_statsfile("/proc/meminfo", buf, sizeof(buf))) == NULL)
+    if ((next = linux_statsfd_read(&meminfo_fd)) == NULL)
 	return -oserror();
 
-    while (fgets(buf, sizeof(buf), fp) != NULL) {
-	if ((bufp = strchr(buf, ':')) == NULL)
+    while ((line = linux_nextline(&next)) != NULL) {
+	if ((bufp = strchr(line, ':')) == NULL)
 	    continue;
 	*bufp = '\0';
 	for (i=0; meminfo_fields[i].field != NULL; i++) {
-	    if (strcmp(buf, meminfo_fields[i].field) != 0)
+	    if (strcmp(line, meminfo_fields[i].field) != 0)
 		continue;
 	    p = MOFFSET(i, proc_meminfo);
 	    for (bufp++; *bufp; bufp++) {
 	    	if (isdigit((int)*bufp)) {
-		    sscanf(bufp, "%llu", (unsigned long long *)p);
+		    *p = linux_strtoull(bufp, &bufp);
 		    break;
 		}
 	    }
 	}
     }
 
-    fclose(fp);
-
     /*
      * MemAvailable is only in 3.x or later kernels but we can calculate it
      * using other values, similar to upstream kernel commit 34e431b0ae.
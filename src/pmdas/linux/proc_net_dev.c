@@ -247,19 +247,30 @@ refresh_net_hw_addr(char *name, net_addr_t *netip)
     }
 }
 
+/*
+ * An open /proc/net/dev stays bound to the network namespace it was
+ * opened in, so only the host's is kept open ... for a container it is
+ * opened afresh (after container_nsenter) on each refresh.
+ */
 int
 refresh_proc_net_dev(pmInDom indom, linux_container_t *container)
 {
+    static linux_statsfd_t	net_dev_fd = LINUX_STATSFD("/proc/net/dev");
     static uint32_t	gen;	/* refresh generation number */
     static uint32_t	cache_err;	/* throttle messages */
-    char		buf[1024];
-    FILE		*fp;
+    linux_statsfd_t	container_fd = LINUX_STATSFD("/proc/net/dev");
+    linux_statsfd_t	*sp = container ? &container_fd : &net_dev_fd;
+    char		*buf, *line;
     char		*p, *v;
     int			j, sts;
     net_interface_t	*netip;
 
-    if ((fp = linux_statsfile("/proc/net/dev", buf, sizeof(buf))) == NULL)
-    	return -oserror();
+    if ((buf = linux_statsfd_read(sp)) == NULL) {
+	sts = -oserror();
+	if (container)
+	    linux_statsfd_close(sp);
+	return sts;
+    }
 
     if (gen == 0) {
 	/*
@@ -279,11 +290,11 @@ Inter-|   Receive                                                |  Transmit
 
     pmdaCacheOp(indom, PMDA_CACHE_INACTIVE);
 
-    while (fgets(buf, sizeof(buf), fp) != NULL) {
-	if ((p = v = strchr(buf, ':')) == NULL)
+    while ((line = linux_nextline(&buf)) != NULL) {
+	if ((p = v = strchr(line, ':')) == NULL)
 	    continue;
 	*p = '\0';
-	for (p=buf; *p && isspace((int)*p); p++) {;}
+	for (p=line; *p && isspace((int)*p); p++) {;}
 
 	sts = pmdaCacheLookupName(indom, p, NULL, (void **)&netip);
 	if (sts == PM_ERR_INST || (sts >= 0 && netip == NULL)) {
@@ -309,15 +320,13 @@ Inter-|   Receive                                                |  Transmit
 	}
 
 	memset(&netip->ioc, 0, sizeof(netip->ioc));
-	for (p=v, j=0; j < PROC_DEV_COUNTERS_PER_LINE; j++) {
-	    for (; !isdigit((int)*p); p++) {;}
-	    sscanf(p, "%llu", (long long unsigned int *)&netip->counters[j]);
-	    for (; !isspace((int)*p); p++) {;}
-	}
+	for (p=v+1, j=0; j < PROC_DEV_COUNTERS_PER_LINE; j++)
+	    netip->counters[j] = linux_strtoull(p, &p);
     }
 
     /* success */
-    fclose(fp);
+    if (container)
+	linux_statsfd_close(sp);
 
     if (!container)
 	pmdaCacheOp(indom, PMDA_CACHE_SAVE);
@@ -173,13 +173,11 @@ refresh_proc_stat(proc_stat_t *proc_stat)
     pernode_t	*np;
     percpu_t	*cp;
     pmInDom	cpus, nodes;
-    char	buf[MAXPATHLEN], *name, *sp, **bp;
+    char	*name, *statbuf, *p, **bp;
     char	cpuname[32];
-    int		n = 0, i, size;
+    int		n, i, size;
 
-    static int fd = -1; /* kept open until exit(), unless testing */
-    static char *statbuf;
-    static int maxstatbuf;
+    static linux_statsfd_t stat_fd = LINUX_STATSFD("/proc/stat");
     static char **bufindex;
     static int nbufindex;
     static int maxbufindex;
@@ -198,36 +196,9 @@ refresh_proc_stat(proc_stat_t *proc_stat)
 	memset(&np->stat, 0, sizeof(np->stat));
     }
 
-    /* in test mode we replace procfs files (keeping fd open thwarts that) */
-    if (fd >= 0 && (linux_test_mode & LINUX_TEST_STATSPATH)) {
-	close(fd);
-	fd = -1;
-    }
-
-    if (fd >= 0) {
-	if (lseek(fd, 0, SEEK_SET) < 0)
-	    return -oserror();
-    } else {
-	pmsprintf(buf, sizeof(buf), "%s/proc/stat", linux_statspath);
-	if ((fd = open(buf, O_RDONLY)) < 0)
-	    return -oserror();
-    }
-
-    for (;;) {
-	while (n >= maxstatbuf) {
-	    size = maxstatbuf + 512;
-	    if ((sp = (char *)realloc(statbuf, size)) == NULL)
-		return -ENOMEM;
-	    statbuf = sp;
-	    maxstatbuf = size;
-	}
-	size = (statbuf + maxstatbuf) - (statbuf + n);
-	if ((i = read(fd, statbuf + n, size)) > 0)
-	    n += i;
-	else
-	    break;
-    }
-    statbuf[n] = '\0';
+    if ((statbuf = linux_statsfd_read(&stat_fd)) == NULL)
+	return -oserror();
+    n = stat_fd.length;
 
     if (bufindex == NULL) {
 	size = 16 * sizeof(char *);
@@ -260,7 +231,6 @@ refresh_proc_stat(proc_stat_t *proc_stat)
 	&proc_stat->all.sirq, &proc_stat->all.steal,
 	&proc_stat->all.guest, &proc_stat->all.guest_nice);
 
-#define PERCPU_FMT "cpu%u %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu"
     /*
      * per-CPU stats
      * e.g. cpu0 95379 4 20053 6502503
@@ -284,16 +254,22 @@ refresh_proc_stat(proc_stat_t *proc_stat)
 		continue;
 	    cp = NULL;
 	    np = NULL;
-	    i = atoi(&bufindex[n][3]);	/* extract CPU identifier */
+	    p = &bufindex[n][3];
+	    i = linux_strtoull(p, &p);	/* extract CPU identifier */
 	    pmsprintf(cpuname, sizeof(cpuname), "cpu%u", i); /* instance name */
 	    if (pmdaCacheLookupName(cpus, cpuname, &i, (void **)&cp) < 0 || !cp)
 		continue;
-	    memset(&cp->stat, 0, sizeof(cp->stat));
-	    sscanf(bufindex[n], PERCPU_FMT, &i,
-		    &cp->stat.user, &cp->stat.nice, &cp->stat.sys,
-		    &cp->stat.idle, &cp->stat.wait, &cp->stat.irq,
-		    &cp->stat.sirq, &cp->stat.steal, &cp->stat.guest,
-		    &cp->stat.guest_nice);
+	    /* fields missing from older kernels are left at zero */
+	    cp->stat.user = linux_strtoull(p, &p);
+	    cp->stat.nice = linux_strtoull(p, &p);
+	    cp->stat.sys = linux_strtoull(p, &p);
+	    cp->stat.idle = linux_strtoull(p, &p);
+	    cp->stat.wait = linux_strtoull(p, &p);
+	    cp->stat.irq = linux_strtoull(p, &p);
+	    cp->stat.sirq = linux_strtoull(p, &p);
+	    cp->stat.steal = linux_strtoull(p, &p);
+	    cp->stat.guest = linux_strtoull(p, &p);
+	    cp->stat.guest_nice = linux_strtoull(p, &p);
 	    pmdaCacheStore(cpus, PMDA_CACHE_ADD, cpuname, (void *)cp);
 
 	    /* update per-node aggregate CPU utilisation stats as well */
@@ -12,29 +12,19 @@
  * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
  * for more details.
  */
-#include <fcntl.h>
 #include "linux.h"
 #include "proc_uptime.h"
 
 int
 refresh_proc_uptime(proc_uptime_t *proc_uptime)
 {
-    char buf[MAXPATHLEN];
-    int fd, n;
+    char *buf;
+    static linux_statsfd_t uptime_fd = LINUX_STATSFD("/proc/uptime");
 
     memset(proc_uptime, 0, sizeof(proc_uptime_t));
-    pmsprintf(buf, sizeof(buf), "%s/proc/uptime", linux_statspath);
-    if ((fd = open(buf, O_RDONLY)) < 0)
+    if ((buf = linux_statsfd_read(&uptime_fd)) == NULL)
 	return -oserror();
 
-    n = read(fd, buf, sizeof(buf));
-    close(fd);
-    if (n < 0)
-	return -oserror();
-    else if (n > 0)
-	n--;
-    buf[n] = '\0';
-
     sscanf(buf, "%lf %lf", &proc_uptime->uptime, &proc_uptime->idletime);
     return 0;
 }
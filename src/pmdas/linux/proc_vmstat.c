@@ -361,39 +361,37 @@ proc_vmstat_init(void)
 int
 refresh_proc_vmstat(proc_vmstat_t *proc_vmstat)
 {
-    char	buf[1024];
-    char	*bufp;
+    char	*bufp, *line, *next;
     int64_t	*p;
     int		i;
-    FILE	*fp;
+    static linux_statsfd_t vmstat_fd = LINUX_STATSFD("/proc/vmstat");
 
     for (i = 0; vmstat_fields[i].field != NULL; i++) {
 	p = VMSTAT_OFFSET(i, proc_vmstat);
 	*p = -1; /* marked as "no value available" */
     }
 
-    if ((fp = linux_statsfile("/proc/vmstat", buf, sizeof(buf))) == NULL)
+    if ((next = linux_statsfd_read(&vmstat_fd)) == NULL)
     	return -oserror();
 
     _pm_have_proc_vmstat = 1;
 
-    while (fgets(buf, sizeof(buf), fp) != NULL) {
-	if ((bufp = strchr(buf, ' ')) == NULL)
+    while ((line = linux_nextline(&next)) != NULL) {
+	if ((bufp = strchr(line, ' ')) == NULL)
 	    continue;
 	*bufp = '\0';
 	for (i = 0; vmstat_fields[i].field != NULL; i++) {
-	    if (strcmp(buf, vmstat_fields[i].field) != 0)
+	    if (strcmp(line, vmstat_fields[i].field) != 0)
 		continue;
 	    p = VMSTAT_OFFSET(i, proc_vmstat);
 	    for (bufp++; *bufp; bufp++) {
 	    	if (isdigit((int)*bufp)) {
-		    sscanf(bufp, "%llu", (unsigned long long *)p);
+		    *p = linux_strtoull(bufp, &bufp);
 		    break;
 		}
 	    }
 	}
     }
-    fclose(fp);
 
     if (proc_vmstat->nr_slab == -1)	/* split apart in 2.6.18 */
 	proc_vmstat->nr_slab = proc_vmstat->nr_slab_reclaimable +
@@ -1715,6 +1715,127 @@ proc_instance(pmInDom indom, int inst, char *name, pmInResult **result, pmdaExt
     return sts;
 }
 
+/*
+ * Per-process value extraction, shared by proc_fetchCallBack and
+ * proc_fetchBulkCallBack.  Each returns PMDA_FETCH_STATIC with the
+ * value in atom, or PMDA_FETCH_NOVALUES if the field is missing.
+ */
+static int
+proc_pid_stat_value(proc_pid_entry_t *entry, unsigned int item, pmAtomValue *atom)
+{
+    __int64_t	jiffies;
+    char	*f, *tail;
+
+    if ((f = _pm_getfield(entry->stat_buf, item)) == NULL)
+	return PMDA_FETCH_NOVALUES;
+
+    switch (item) {
+    case PROC_PID_STAT_VSIZE: /* proc.psinfo.vsize */
+    case PROC_PID_STAT_RSS_RLIM: /* bytes converted to kbytes */ /* proc.psinfo.rss_rlim */
+	atom->ull = strtoull(f, &tail, 0);
+	atom->ull /= 1024;
+	break;
+
+    case PROC_PID_STAT_RSS: /* pages converted to kbytes */ /* proc.psinfo.rss */
+	atom->ull = strtoull(f, &tail, 0);
+	atom->ull *= _pm_system_pagesize / 1024;
+	break;
+
+    case PROC_PID_STAT_UTIME: /* proc.psinfo.utime */
+    case PROC_PID_STAT_STIME: /* proc.psinfo.stime */
+    case PROC_PID_STAT_CUTIME: /* proc.psinfo.cutime */
+    case PROC_PID_STAT_CSTIME: /* proc.psinfo.cstime */
+	/* unsigned jiffies converted to unsigned msecs */
+	jiffies = (__int64_t)strtoul(f, &tail, 0);
+	_pm_assign_ulong(atom, jiffies * 1000 / hz);
+	break;
+
+    case PROC_PID_STAT_PRIORITY: /* proc.psinfo.priority */
+    case PROC_PID_STAT_NICE: /* signed decimal int */ /* proc.psinfo.nice */
+	/* both are signed decimal integers in range [-20,20] */
+	atom->l = (__int32_t)strtol(f, &tail, 0);
+	break;
+
+    case PROC_PID_STAT_START_TIME: /* proc.psinfo.start_time */
+	/* unsigned jiffies converted to unsigned milliseconds */
+	jiffies = (__uint64_t)strtoul(f, &tail, 0);
+	atom->ull = jiffies * 1000 / hz;
+	break;
+
+    default:
+	return PM_ERR_PMID;
+    }
+    return PMDA_FETCH_STATIC;
+}
+
+static int
+proc_pid_statm_value(proc_pid_entry_t *entry, unsigned int item, pmAtomValue *atom)
+{
+    char	*f, *tail;
+
+    if (item > PROC_PID_STATM_DIRTY)
+	return PM_ERR_PMID;
+    /* unsigned int */
+    if ((f = _pm_getfield(entry->statm_buf, item)) == NULL)
+	return PMDA_FETCH_NOVALUES;
+    atom->ul = (__uint32_t)strtoul(f, &tail, 0);
+    atom->ul *= _pm_system_pagesize / 1024;
+    return PMDA_FETCH_STATIC;
+}
+
+static int
+proc_pid_schedstat_value(proc_pid_entry_t *entry, unsigned int item, pmAtomValue *atom)
+{
+    char	*f, *tail;
+
+    if (item >= NR_PROC_PID_SCHED)
+	return PM_ERR_PMID;
+    if ((f = _pm_getfield(entry->schedstat_buf, item)) == NULL)
+	return PMDA_FETCH_NOVALUES;
+    if (item == PROC_PID_SCHED_PCOUNT)
+	_pm_assign_ulong(atom, (__pm_kernel_ulong_t)strtoul(f, &tail, 0));
+    else
+	atom->ull  = (__uint64_t)strtoull(f, &tail, 0);
+    return PMDA_FETCH_STATIC;
+}
+
+static int
+proc_pid_io_value(proc_pid_entry_t *entry, unsigned int item, pmAtomValue *atom)
+{
+    char	*f, *line, *tail;
+
+    switch (item) {
+    case PROC_PID_IO_RCHAR: /* proc.io.rchar */
+	line = entry->io_lines.rchar;
+	break;
+    case PROC_PID_IO_WCHAR: /* proc.io.wchar */
+	line = entry->io_lines.wchar;
+	break;
+    case PROC_PID_IO_SYSCR: /* proc.io.syscr */
+	line = entry->io_lines.syscr;
+	break;
+    case PROC_PID_IO_SYSCW: /* proc.io.syscw */
+	line = entry->io_lines.syscw;
+	break;
+    case PROC_PID_IO_READ_BYTES: /* proc.io.read_bytes */
+	line = entry->io_lines.readb;
+	break;
+    case PROC_PID_IO_WRITE_BYTES: /* proc.io.write_bytes */
+	line = entry->io_lines.writeb;
+	break;
+    case PROC_PID_IO_CANCELLED_BYTES: /* proc.io.cancelled_write_bytes */
+	line = entry->io_lines.cancel;
+	break;
+    default:
+	return PM_ERR_PMID;
+    }
+    if ((f = _pm_getfield(line, 1)) == NULL)
+	atom->ull = 0;
+    else
+	atom->ull = (__uint64_t)strtoull(f, &tail, 0);
+    return PMDA_FETCH_STATIC;
+}
+
 /*
  * callback provided to pmdaFetch
  */
@@ -1923,42 +2044,16 @@ proc_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
 		break;
 
 	    case PROC_PID_STAT_VSIZE: /* proc.psinfo.vsize */
-	    case PROC_PID_STAT_RSS_RLIM: /* bytes converted to kbytes */ /* proc.psinfo.rss_rlim */
-		f = _pm_getfield(entry->stat_buf, item);
-		if (f == NULL)
-		    return 0;
-		atom->ull = strtoull(f, &tail, 0);
-		atom->ull /= 1024;
-		break;
-
-	    case PROC_PID_STAT_RSS: /* pages converted to kbytes */ /* proc.psinfo.rss */
-		f = _pm_getfield(entry->stat_buf, item);
-		if (f == NULL)
-		    return 0;
-		atom->ull = strtoull(f, &tail, 0);
-		atom->ull *= _pm_system_pagesize / 1024;
-		break;
-
+	    case PROC_PID_STAT_RSS_RLIM: /* proc.psinfo.rss_rlim */
+	    case PROC_PID_STAT_RSS: /* proc.psinfo.rss */
 	    case PROC_PID_STAT_UTIME: /* proc.psinfo.utime */
 	    case PROC_PID_STAT_STIME: /* proc.psinfo.stime */
 	    case PROC_PID_STAT_CUTIME: /* proc.psinfo.cutime */
 	    case PROC_PID_STAT_CSTIME: /* proc.psinfo.cstime */
-		/* unsigned jiffies converted to unsigned msecs */
-		f = _pm_getfield(entry->stat_buf, item);
-		if (f == NULL)
-		    return 0;
-		jiffies = (__int64_t)strtoul(f, &tail, 0);
-		_pm_assign_ulong(atom, jiffies * 1000 / hz);
-		break;
-
 	    case PROC_PID_STAT_PRIORITY: /* proc.psinfo.priority */
-	    case PROC_PID_STAT_NICE: /* signed decimal int */ /* proc.psinfo.nice */
-		/* both are signed decimal integers in range [-20,20] */
-		f = _pm_getfield(entry->stat_buf, item);
-		if (f == NULL)
-		    return 0;
-		atom->l = (__int32_t)strtol(f, &tail, 0);
-		break;
+	    case PROC_PID_STAT_NICE: /* proc.psinfo.nice */
+	    case PROC_PID_STAT_START_TIME: /* proc.psinfo.start_time */
+		return proc_pid_stat_value(entry, item, atom);
 
 	    case PROC_PID_STAT_WCHAN: /* proc.psinfo.wchan */
 		if ((f = _pm_getfield(entry->stat_buf, item)) == NULL)
@@ -1995,16 +2090,6 @@ proc_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
 		jiffies = (__uint64_t)strtoul(f, &tail, 0);
 		atom->ull = jiffies * 1000 / hz;
 	    	break;
-	    case PROC_PID_STAT_START_TIME: /* proc.psinfo.start_time */
-	    	/*
-		 * unsigned jiffies converted to unsigned milliseconds
-		 */
-		if ((f = _pm_getfield(entry->stat_buf, item)) == NULL)
-		    return 0;
-
-		jiffies = (__uint64_t)strtoul(f, &tail, 0);
-		atom->ull = jiffies * 1000 / hz;
-	    	break;
 
 	    default: /* All the rest. Direct index by item */
 		/*
@@ -2035,16 +2120,7 @@ proc_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
 	} else {
 	    if ((entry = fetch_proc_pid_statm(inst, active_proc_pid, &sts)) == NULL)
 		return sts;
-
-	    if (item <= PROC_PID_STATM_DIRTY) {
-		/* unsigned int */
-		if ((f = _pm_getfield(entry->statm_buf, item)) == NULL)
-		    return 0;
-		atom->ul = (__uint32_t)strtoul(f, &tail, 0);
-		atom->ul *= _pm_system_pagesize / 1024;
-	    }
-	    else
-		return PM_ERR_PMID;
+	    return proc_pid_statm_value(entry, item, atom);
 	}
     	break;
 
@@ -2056,18 +2132,7 @@ proc_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
 	    return PM_ERR_PERMISSION;
 	if ((entry = fetch_proc_pid_schedstat(inst, active_proc_pid, &sts)) == NULL)
 	    return sts;
-
-	if (item < NR_PROC_PID_SCHED) {
-	    if ((f = _pm_getfield(entry->schedstat_buf, item)) == NULL)
-		return 0;
-	    if (item == PROC_PID_SCHED_PCOUNT)
-		_pm_assign_ulong(atom, (__pm_kernel_ulong_t)strtoul(f, &tail, 0));
-	    else
-		atom->ull  = (__uint64_t)strtoull(f, &tail, 0);
-	}
-	else
-	    return PM_ERR_PMID;
-    	break;
+	return proc_pid_schedstat_value(entry, item, atom);
 
     case CLUSTER_HOTPROC_PID_IO:
 	active_proc_pid = &hotproc_pid;
@@ -2077,56 +2142,7 @@ proc_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
 	    return PM_ERR_PERMISSION;
 	if ((entry = fetch_proc_pid_io(inst, active_proc_pid, &sts)) == NULL)
 	    return sts;
-
-	switch (item) {
-
-	case PROC_PID_IO_RCHAR: /* proc.io.rchar */
-	    if ((f = _pm_getfield(entry->io_lines.rchar, 1)) == NULL)
-		atom->ull = 0;
-	    else
-		atom->ull = (__uint64_t)strtoull(f, &tail, 0);
-	    break;
-	case PROC_PID_IO_WCHAR: /* proc.io.wchar */
-	    if ((f = _pm_getfield(entry->io_lines.wchar, 1)) == NULL)
-		atom->ull = 0;
-	    else
-		atom->ull = (__uint64_t)strtoull(f, &tail, 0);
-	    break;
-	case PROC_PID_IO_SYSCR: /* proc.io.syscr */
-	    if ((f = _pm_getfield(entry->io_lines.syscr, 1)) == NULL)
-		atom->ull = 0;
-	    else
-		atom->ull = (__uint64_t)strtoull(f, &tail, 0);
-	    break;
-	case PROC_PID_IO_SYSCW: /* proc.io.syscw */
-	    if ((f = _pm_getfield(entry->io_lines.syscw, 1)) == NULL)
-		atom->ull = 0;
-	    else
-		atom->ull = (__uint64_t)strtoull(f, &tail, 0);
-	    break;
-	case PROC_PID_IO_READ_BYTES: /* proc.io.read_bytes */
-	    if ((f = _pm_getfield(entry->io_lines.readb, 1)) == NULL)
-		atom->ull = 0;
-	    else
-		atom->ull = (__uint64_t)strtoull(f, &tail, 0);
-	    break;
-	case PROC_PID_IO_WRITE_BYTES: /* proc.io.write_bytes */
-	    if ((f = _pm_getfield(entry->io_lines.writeb, 1)) == NULL)
-		atom->ull = 0;
-	    else
-		atom->ull = (__uint64_t)strtoull(f, &tail, 0);
-	    break;
-	case PROC_PID_IO_CANCELLED_BYTES: /* proc.io.cancelled_write_bytes */
-	    if ((f = _pm_getfield(entry->io_lines.cancel, 1)) == NULL)
-		atom->ull = 0;
-	    else
-		atom->ull = (__uint64_t)strtoull(f, &tail, 0);
-	    break;
-
-	default:
-	    return PM_ERR_PMID;
-	}
-	break;
+	return proc_pid_io_value(entry, item, atom);
 
     case CLUSTER_HOTPROC_PID_SMAPS:
 	active_proc_pid = &hotproc_pid;
@@ -3475,6 +3491,113 @@ proc_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
     return PMDA_FETCH_STATIC;
 }
 
+/*
+ * Fetch a metric for all of the processes in the profile at once.  Only
+ * the plain numeric per-process metrics are done here, where the work
+ * is the same for every process; anything else returns PM_ERR_NYI and
+ * is fetched one process at a time by proc_fetchCallBack.
+ */
+static int
+proc_fetchBulkCallBack(pmdaMetric *mdesc, int numinst, const unsigned int *instlist,
+		pmAtomValue *atoms, int *status)
+{
+    unsigned int	cluster = pmID_cluster(mdesc->m_desc.pmid);
+    unsigned int	item = pmID_item(mdesc->m_desc.pmid);
+    proc_pid_entry_t	*entry;
+    proc_pid_t		*active_proc_pid;
+    int			i, sts;
+
+    if (mdesc->m_user != NULL)
+	return PM_ERR_NYI;
+
+    active_proc_pid = &proc_pid;
+    switch (cluster) {
+    case CLUSTER_HOTPROC_PID_STAT:
+	active_proc_pid = &hotproc_pid;
+	/*FALLTHROUGH*/
+    case CLUSTER_PID_STAT:
+	switch (item) {
+	case PROC_PID_STAT_VSIZE:
+	case PROC_PID_STAT_RSS_RLIM:
+	case PROC_PID_STAT_RSS:
+	case PROC_PID_STAT_UTIME:
+	case PROC_PID_STAT_STIME:
+	case PROC_PID_STAT_CUTIME:
+	case PROC_PID_STAT_CSTIME:
+	case PROC_PID_STAT_PRIORITY:
+	case PROC_PID_STAT_NICE:
+	case PROC_PID_STAT_START_TIME:
+	    break;
+	default:
+	    return PM_ERR_NYI;
+	}
+	if (!have_access)
+	    return PM_ERR_PERMISSION;
+	for (i = 0; i < numinst; i++) {
+	    if ((entry = fetch_proc_pid_stat(instlist[i], active_proc_pid, &sts)) == NULL) {
+		status[i] = sts;
+		continue;
+	    }
+	    status[i] = proc_pid_stat_value(entry, item, &atoms[i]);
+	}
+	return 0;
+
+    case CLUSTER_HOTPROC_PID_STATM:
+	active_proc_pid = &hotproc_pid;
+	/*FALLTHROUGH*/
+    case CLUSTER_PID_STATM:
+	if (item == PROC_PID_STATM_MAPS || item > PROC_PID_STATM_DIRTY)
+	    return PM_ERR_NYI;
+	if (!have_access)
+	    return PM_ERR_PERMISSION;
+	for (i = 0; i < numinst; i++) {
+	    if ((entry = fetch_proc_pid_statm(instlist[i], active_proc_pid, &sts)) == NULL) {
+		status[i] = sts;
+		continue;
+	    }
+	    status[i] = proc_pid_statm_value(entry, item, &atoms[i]);
+	}
+	return 0;
+
+    case CLUSTER_HOTPROC_PID_SCHEDSTAT:
+	active_proc_pid = &hotproc_pid;
+	/*FALLTHROUGH*/
+    case CLUSTER_PID_SCHEDSTAT:
+	if (item >= NR_PROC_PID_SCHED)
+	    return PM_ERR_NYI;
+	if (!have_access)
+	    return PM_ERR_PERMISSION;
+	for (i = 0; i < numinst; i++) {
+	    if ((entry = fetch_proc_pid_schedstat(instlist[i], active_proc_pid, &sts)) == NULL) {
+		status[i] = sts;
+		continue;
+	    }
+	    status[i] = proc_pid_schedstat_value(entry, item, &atoms[i]);
+	}
+	return 0;
+
+    case CLUSTER_HOTPROC_PID_IO:
+	active_proc_pid = &hotproc_pid;
+	/*FALLTHROUGH*/
+    case CLUSTER_PID_IO:
+	if (item > PROC_PID_IO_CANCELLED_BYTES)
+	    return PM_ERR_NYI;
+	if (!have_access)
+	    return PM_ERR_PERMISSION;
+	for (i = 0; i < numinst; i++) {
+	    if ((entry = fetch_proc_pid_io(instlist[i], active_proc_pid, &sts)) == NULL) {
+		status[i] = sts;
+		continue;
+	    }
+	    status[i] = proc_pid_io_value(entry, item, &atoms[i]);
+	}
+	return 0;
+
+    default:
+	return PM_ERR_NYI;
+    }
+}
+
 static int
 proc_fetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 {
@@ -3878,6 +4001,7 @@ proc_init(pmdaInterface *dp)
     pmdaSetLabelCallBack(dp, proc_labelCallBack);
     pmdaSetEndContextCallBack(dp, proc_ctx_end);
     pmdaSetFetchCallBack(dp, proc_fetchCallBack);
+    pmdaSetFetchBulkCallBack(dp, proc_fetchBulkCallBack);
 
     /*
      * Initialize the instance domain table.
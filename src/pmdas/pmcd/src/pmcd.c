@@ -87,6 +87,14 @@ static pmDesc	desctab[] = {
     { PMDA_PMID(0,24), PM_TYPE_U32, PM_INDOM_NULL, PM_SEM_DISCRETE, PMDA_PMUNITS(0,0,0,0,0,0) },
 /* labels */
     { PMDA_PMID(0,25), PM_TYPE_STRING, PM_INDOM_NULL, PM_SEM_INSTANT, PMDA_PMUNITS(0,0,0,0,0,0) },
+/* loop.iterations */
+    { PMDA_PMID(0,26), PM_TYPE_U64, PM_INDOM_NULL, PM_SEM_COUNTER, PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) },
+/* loop.readyfds */
+    { PMDA_PMID(0,27), PM_TYPE_U64, PM_INDOM_NULL, PM_SEM_COUNTER, PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) },
+/* fetchcache.hits */
+    { PMDA_PMID(0,28), PM_TYPE_U64, PM_INDOM_NULL, PM_SEM_COUNTER, PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) },
+/* fetchcache.misses */
+    { PMDA_PMID(0,29), PM_TYPE_U64, PM_INDOM_NULL, PM_SEM_COUNTER, PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) },
 
 /* pdu_in.error */
     { PMDA_PMID(1,0), PM_TYPE_U32, PM_INDOM_NULL, PM_SEM_COUNTER, PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) },
@@ -187,6 +195,8 @@ static pmDesc	desctab[] = {
     { PMDA_PMID(4,2), PM_TYPE_U32, PM_INDOM_NULL, PM_SEM_INSTANT, PMDA_PMUNITS(0,0,0,0,0,0) },
 /* agent.name */
     { PMDA_PMID(4,3), PM_TYPE_STRING, PM_INDOM_NULL, PM_SEM_DISCRETE, PMDA_PMUNITS(0,0,0,0,0,0) },
+/* agent.cachetime */
+    { PMDA_PMID(4,4), PM_TYPE_U32, PM_INDOM_NULL, PM_SEM_INSTANT, PMDA_PMUNITS(0,1,0,0,PM_TIME_MSEC,0) },
 
 /* pmie.configfile */
     { PMDA_PMID(5,0), PM_TYPE_STRING, PM_INDOM_NULL, PM_SEM_DISCRETE, PMDA_PMUNITS(0,0,0,0,0,0) },
@@ -1533,6 +1543,22 @@ pmcd_fetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 				fetch_labels(pmda->e_context, &atom, &host);
 				break;
 
+			case 26:	/* ClientLoop wakeups */
+				atom.ull = pmcd_loop_iterations;
+				break;
+
+			case 27:	/* descriptors ready at wakeup */
+				atom.ull = pmcd_loop_readyfds;
+				break;
+
+			case 28:	/* agent fetches answered from cache */
+				atom.ull = pmcd_cache_hits;
+				break;
+
+			case 29:	/* agent fetches not in cache */
+				atom.ull = pmcd_cache_misses;
+				break;
+
 			default:
 				sts = atom.l = PM_ERR_PMID;
 				break;
@@ -1654,6 +1680,9 @@ pmcd_fetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 			case 3:		/* agent.name */
 			    atom.cp = agent[j].pmDomainLabel;
 			    break;
+			case 4:		/* agent.cachetime */
+			    atom.ul = agent[j].cacheWindow;
+			    break;
 			default:
 			    sts = atom.l = PM_ERR_PMID;
 			    break;
@@ -1978,6 +2007,36 @@ pmcd_store(pmResult *result, pmdaExt *pmda)
 			ap->status.fenced = val;
 		}
 	    }
+	    else if (item == 4) { /* pmcd.agent.cachetime */
+		if (ctx >= num_ctx)
+		    grow_ctxtab(ctx);
+		if (ctxtab[ctx].uid != 0) {
+		    sts = PM_ERR_PERMISSION;
+		    break;
+		}
+		for (j = 0; j < vsp->numval; j++) {
+		    val = vsp->vlist[j].value.lval;
+		    if (val < 0) {
+			sts = PM_ERR_BADSTORE;
+			break;
+		    }
+		    if (vsp->vlist[j].inst == PM_IN_NULL) {
+			for (k = 0; k < nAgents; k++)
+			    if (agent[k].pmDomainId != pmda->e_domain)
+				agent[k].cacheWindow = val;
+			continue;
+		    }
+		    ap = pmcd_agent(vsp->vlist[j].inst);
+		    if (ap == NULL) {
+			sts = PM_ERR_INST;
+			break;
+		    }
+		    if (ap->pmDomainId != pmda->e_domain)
+			ap->cacheWindow = val;
+		    else
+			sts = PM_ERR_PERMISSION;
+		}
+	    }
 	}
 	else if (cluster == 6) {
 	    if (item == 0 ||	/* pmcd.client.whoami */
@@ -107,6 +107,8 @@ main(int argc, char **argv)
     /* initialize */
     summary_init(&dispatch);
 
+    /* summaryMainLoop() handles PDUs itself, keeping only one profile */
+    dispatch.comm.flags &= ~PMDA_FLAG_PROFILES;
     pmdaConnect(&dispatch);
     if (dispatch.status) {
 	fprintf (stderr, "Cannot connect to pmcd: %s\n",
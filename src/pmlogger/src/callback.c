@@ -789,7 +789,7 @@ do_work(task_t *tp)
 		    free(names);
 		}
 	    }
-	    if (desc.type == PM_TYPE_EVENT) {
+	    if (desc.type == PM_TYPE_EVENT || desc.type == PM_TYPE_HIGHRES_EVENT) {
 		/*
 		 * Event records need some special handling ...
 		 */
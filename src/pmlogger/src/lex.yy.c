@@ -0,0 +1,2 @@
+char *yytext; int yyleng; int yylex(void){return 0;} int yywrap(void){return 1;}
+int main(void){return 0;}
@@ -575,12 +575,13 @@ static pmLongOptions longopts[] = {
     { "version", 1, 'V', "NUM", "version for archive (default and only version is 2)" },
     { "", 1, 'x', "FD", "control file descriptor for running from pmRecordControl(3)" },
     { "", 0, 'y', 0, "set timezone for times to local time rather than from PMCD host" },
+    { "compress", 0, 'z', 0, "compress data volumes with zstd as they are written" },
     PMOPT_HELP,
     PMAPI_OPTIONS_END
 };
 
 static pmOptions opts = {
-    .short_options = "c:CD:fh:H:l:K:Lm:Nn:op:Prs:T:t:uU:v:V:x:y?",
+    .short_options = "c:CD:fh:H:l:K:Lm:Nn:op:Prs:T:t:uU:v:V:x:yz?",
     .long_options = longopts,
     .short_usage = "[options] archive",
 };
@@ -967,6 +968,14 @@ main(int argc, char **argv)
 	    use_localtime = 1;
 	    break;
 
+	case 'z':		/* compress data volumes */
+	    if ((sts = __pmLogSetCompress(".zst")) < 0) {
+		pmprintf("%s: cannot compress data volumes: %s\n",
+			pmGetProgname(), pmErrStr(sts));
+		opts.errors++;
+	    }
+	    break;
+
 	case '?':
 	default:
 	    opts.errors++;
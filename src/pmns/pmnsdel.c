@@ -215,5 +215,15 @@ main(int argc, char **argv)
 	exit(1);
     }
 
+    /* and update the binary image of the PMNS, if there is one */
+    pmsprintf(outfname, sizeof(outfname), "%s.bin", pmnsfile);
+    if (access(outfname, F_OK) == 0 &&
+	(sts = __pmWritePMNSImage(pmnsfile, root)) < 0) {
+	/* out of date now, and not worth failing for */
+	fprintf(stderr, "%s: Warning: cannot update binary PMNS image \"%s\": %s\n",
+		pmGetProgname(), outfname, pmErrStr(sts));
+	unlink(outfname);
+    }
+
     exit(0);
 }
@@ -18,9 +18,6 @@
 
 static void myeventdump(pmValueSet *, int, int);
 
-static pmID pmid_flags;
-static pmID pmid_missed;
-
 /*
  * Cache all of the most recently requested pmInDom
  */
@@ -112,9 +109,9 @@ mydump(const char *name, pmDesc *dp, pmValueSet *vsp)
 }
 
 static void
-myvaluesetdump(pmValueSet *xvsp, int idx, int *flagsp)
+myvaluesetdump(pmValueSet *xvsp)
 {
-    int			sts, flags = *flagsp;
+    int			sts;
     DescHash		*hp;
     __pmHashNode	*hnp;
     static __pmHashCtl	hash =  { 0, 0, NULL };
@@ -132,9 +129,7 @@ myvaluesetdump(pmValueSet *xvsp, int idx, int *flagsp)
 	    return;
 	}
 	else {
-	    if (xvsp->pmid != pmid_flags &&
-		xvsp->pmid != pmid_missed &&
-		(sts = pmLookupDesc(xvsp->pmid, &hp->desc)) < 0) {
+	    if ((sts = pmLookupDesc(xvsp->pmid, &hp->desc)) < 0) {
 		printf("	%s: pmLookupDesc: %s\n", hp->name, pmErrStr(sts));
 		free(hp->name);
 		free(hp);
@@ -151,116 +146,59 @@ myvaluesetdump(pmValueSet *xvsp, int idx, int *flagsp)
     else
 	hp = (DescHash *)hnp->data;
 
-    if (idx == 0) {
-	if (xvsp->pmid == pmid_flags) {
-	    flags = *flagsp = xvsp->vlist[0].value.lval;
-	    printf(" flags 0x%x", flags);
-	    printf(" (%s) ---\n", pmEventFlagsStr(flags));
-	    return;
-	}
-	else
-	    printf(" ---\n");
-    }
-    if ((flags & PM_EVENT_FLAG_MISSED) &&
-	(idx == 1) &&
-	(xvsp->pmid == pmid_missed)) {
-	printf("    ==> %d missed event records\n",
-		    xvsp->vlist[0].value.lval);
-	return;
-    }
     mydump(hp->name, &hp->desc, xvsp);
 }
 
+/*
+ * Walk the event records in place, there is no need to unpack them
+ * into pmResults just to print them
+ */
 static void
 myeventdump(pmValueSet *vsp, int idx, int highres)
 {
-    int		r;		/* event records */
-    int		p;		/* event parameters */
-    int		flags;
-    int		numpmid;
-    int		nrecords;
-    pmResult	**res = NULL;
-    pmHighResResult **hres = NULL;
+    pmEventIter		iter;
+    pmValueSet		*xvsp;
+    struct timeval	stamp;
+    int			nrecords;
+    int			sts;
 
-    if (highres) {
-	if ((nrecords = pmUnpackHighResEventRecords(vsp, idx, &hres)) < 0) {
-	    printf(" pmUnpackEventRecords: %s\n", pmErrStr(nrecords));
-	    return;
-	}
-    }
-    else {
-	if ((nrecords = pmUnpackEventRecords(vsp, idx, &res)) < 0) {
-	    printf(" pmUnpackEventRecords: %s\n", pmErrStr(nrecords));
-	    return;
-	}
+    if ((nrecords = pmEventIterInit(&iter, vsp, idx)) < 0) {
+	printf(" pmEventIterInit: %s\n", pmErrStr(nrecords));
+	return;
     }
     printf(" %d event records\n", nrecords);
 
-    if (pmid_flags == 0) {
-	/*
-	 * get PMID for event.flags and event.missed
-	 * note that pmUnpackEventRecords() will have called
-	 * __pmRegisterAnon(), so the anonymous metrics
-	 * should now be in the PMNS
-	 */
-	char	*name_flags = "event.flags";
-	char	*name_missed = "event.missed";
-	int	sts;
-
-	sts = pmLookupName(1, &name_flags, &pmid_flags);
-	if (sts < 0) {
-	    /* should not happen! */
-	    fprintf(stderr, "Warning: cannot get PMID for %s: %s\n",
-			name_flags, pmErrStr(sts));
-	    /* avoid subsequent warnings ... */
-	    pmid_flags = pmID_build(pmID_domain(pmid_flags), pmID_cluster(pmid_flags), 1);
-	}
-	sts = pmLookupName(1, &name_missed, &pmid_missed);
-	if (sts < 0) {
-	    /* should not happen! */
-	    fprintf(stderr, "Warning: cannot get PMID for %s: %s\n",
-			name_missed, pmErrStr(sts));
-	    /* avoid subsequent warnings ... */
-	    pmid_missed = pmID_build(pmID_domain(pmid_missed), pmID_cluster(pmid_missed), 1);
-	}
-    }
-
-    for (r = 0; r < nrecords; r++) {
+    while (pmEventIterNextRecord(&iter) > 0) {
 	printf("  ");
-	if (highres) {
-	    numpmid = hres[r]->numpmid;
-	    pmPrintHighResStamp(stdout, &hres[r]->timestamp);
-	}
+	if (highres)
+	    pmPrintHighResStamp(stdout, &iter.ei_timestamp);
 	else {
-	    numpmid = res[r]->numpmid;
-	    pmPrintStamp(stdout, &res[r]->timestamp);
+	    stamp.tv_sec = iter.ei_timestamp.tv_sec;
+	    stamp.tv_usec = iter.ei_timestamp.tv_nsec / 1000;
+	    pmPrintStamp(stdout, &stamp);
 	}
 
-	printf(" --- event record [%d]", r);
-	if (numpmid == 0) {
+	printf(" --- event record [%d]", iter.ei_record);
+	if (iter.ei_flags != 0) {
+	    printf(" flags 0x%x", iter.ei_flags);
+	    printf(" (%s) ---\n", pmEventFlagsStr(iter.ei_flags));
+	}
+	else if (iter.ei_nparams == 0) {
 	    printf(" ---\n");
 	    printf("    ==> No parameters\n");
 	    continue;
 	}
-	if (numpmid < 0) {
+	else
 	    printf(" ---\n");
-	    printf("	Error: illegal number of parameters (%d)\n", numpmid);
+	if (iter.ei_flags & PM_EVENT_FLAG_MISSED) {
+	    printf("    ==> %d missed event records\n", iter.ei_missed);
 	    continue;
 	}
-	flags = 0;
-	if (highres) {
-	    for (p = 0; p < numpmid; p++)
-		myvaluesetdump(hres[r]->vset[p], p, &flags);
-	}
-	else {
-	    for (p = 0; p < numpmid; p++)
-		myvaluesetdump(res[r]->vset[p], p, &flags);
-	}
+	while ((sts = pmEventIterNextParam(&iter, &xvsp)) > 0)
+	    myvaluesetdump(xvsp);
+	if (sts < 0)
+	    printf("	Error: %s\n", pmErrStr(sts));
     }
-    if (highres)
-	pmFreeHighResEventResult(hres);
-    if (res)
-	pmFreeEventResult(res);
 }
 
 /* Print event performance metric values */